@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h> // Necesario para strcpy
+#include "latency_hist.h"
 
 #define SIP_IDENTITY "sip:caller@127.0.0.1"
 #define SIP_CONTACT_STR "sip:caller@127.0.0.1"
@@ -19,6 +20,16 @@
 
 nua_handle_t	*inv_handle = NULL; // Handle para el INVITE
 
+// Hora de envío del INVITE; es la magia del handle
+typedef struct s_call_timing
+{
+	uint64_t	invite_us;
+	int			ringing;
+}	t_call_timing;
+
+lat_hist_t	lat_pdd;	// INVITE -> primera 18x
+lat_hist_t	lat_answer;	// INVITE -> 200
+
 // Callback que maneja los eventos SIP
 static void	sip_invite_callback(nua_event_t event, int status,
 		const char *phrase, nua_t *nua, void *context, nua_handle_t *nh,
@@ -32,7 +43,16 @@ static void	sip_invite_callback(nua_event_t event, int status,
 
 	else if (event == 10) // Respuesta al INVITE
 	{
+		t_call_timing	*timing = (t_call_timing *)param;
+
         printf("Respuesta agente al INVITE: %d %s\n", status, phrase);
+		if (timing && status >= 180 && status < 190 && !timing->ringing)
+		{
+			timing->ringing = 1;
+			lat_hist_record(&lat_pdd, lat_now_us() - timing->invite_us);
+		}
+		else if (timing && status == 200)
+			lat_hist_record(&lat_answer, lat_now_us() - timing->invite_us);
 		if (status == 180)
 		{
 			printf("Ringing...\n");
@@ -71,10 +91,13 @@ static void	sip_invite_callback(nua_event_t event, int status,
 
 int	main(void)
 {
-	su_root_t	*root;
-	nua_t		*nua;
+	su_root_t		*root;
+	nua_t			*nua;
+	t_call_timing	timing = {0, 0};
 
 	printf("Iniciando el programa...\n");
+	lat_hist_init(&lat_pdd, "post-dial");
+	lat_hist_init(&lat_answer, "respuesta");
 	// Inicializa la librería
 	su_init();
 	printf("su_init() completado.\n");
@@ -99,8 +122,17 @@ int	main(void)
 	printf("nua_create() completado.\n");
 	printf("Intentando enviar el INVITE...\n");
 
-    // Llamada a INVITE
-	nua_invite((nua_handle_t *)nua,
+    // Llamada a INVITE: en un handle propio para que la respuesta traiga la hora de envío
+	inv_handle = nua_handle(nua, &timing, TAG_END());
+	if (!inv_handle)
+	{
+		fprintf(stderr, "No se pudo crear el handle del INVITE\n");
+		nua_destroy(nua);
+		su_root_destroy(root);
+		return (EXIT_FAILURE);
+	}
+	timing.invite_us = lat_now_us();
+	nua_invite(inv_handle,
 			   NUTAG_ALLOW(SIP_IDENTITY),
 			   SIPTAG_CONTACT_STR(SIP_CONTACT_STR),
 			   SIPTAG_TO_STR("sip:callee@127.0.0.1:5060"),
@@ -111,7 +143,12 @@ int	main(void)
 	su_root_run(root);
 	printf("su_root_run() completado (esto podría no alcanzarse hasta recibir una respuesta).\n");
 
+	lat_hist_print_header(stdout);
+	lat_hist_export(&lat_pdd, stdout, 0);
+	lat_hist_export(&lat_answer, stdout, 0);
+
     // Limpieza
+	nua_handle_destroy(inv_handle);
 	nua_destroy(nua);
 	su_root_destroy(root);
 	su_deinit();
@@ -121,6 +158,7 @@ int	main(void)
 
 /* PARA COMPILAR:
 gcc -o demo4 demo4.c $(pkg-config --cflags --libs sofia-sip-ua)
+(latency_hist.h está en este mismo directorio)
 ./demo4 
 */
 
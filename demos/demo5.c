@@ -11,6 +11,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h> // Necesario para strcpy
+#include <time.h>
+#include "latency_hist.h"
 
 #define SIP_IDENTITY "sip:caller@127.0.0.1"
 #define SIP_CONTACT_STR "sip:caller@127.0.0.1"
@@ -23,40 +25,598 @@
 
 // Definición para el Content-Type de los mensajes
 #define MESSAGE_CONTENT_TYPE "text/plain"
+// Bytes de la arena en pila donde se parsea el To de cada destino nuevo
+#define MESSAGE_ARENA_SIZE 1024
+// Destinos con handles propios en la caché; al llenarse se retira el menos usado
+#define DEST_CACHE_SIZE 128
+#define DEST_CACHE_BUCKETS 256 // potencia de 2
+#define DEST_URI_MAX 100
+// MESSAGE sin respuesta final durante un bench o un batch
+#define BENCH_WINDOW 32
+// Sin respuestas durante este tiempo la carga en curso se da por terminada
+#define BENCH_TIMEOUT_MS 5000
+#define BENCH_WATCHDOG_MS 1000
+#define COMMAND_MAX 256
+// Handles por destino: nua no envía un MESSAGE hasta que el anterior del
+// mismo handle tiene respuesta final, así que hacen falta tantos como la ventana
+#define DEST_HANDLES BENCH_WINDOW
+// Cada cuánto se exportan los histogramas de latencia
+#define LAT_EXPORT_MS 10000
+
+struct dest_entry;
+
+/*
+Un handle para MESSAGE con, como mucho, un mensaje en vuelo. Es la magia
+(hmagic) del handle: la respuesta final trae la hora de envío de su propio
+mensaje. Los de un solo uso no tienen destino (dest NULL) y se liberan con
+la respuesta.
+*/
+typedef struct {
+    struct dest_entry *dest;
+    nua_handle_t *nh;
+    uint64_t sent_us;             // envío del MESSAGE en vuelo
+} msg_slot_t;
+
+/*
+Tiempos de una llamada saliente. Como en demo4, es la magia (hmagic) de su
+handle: cada respuesta al INVITE o al BYE trae los de su propia llamada.
+*/
+typedef struct {
+    uint64_t invite_us;           // envío del INVITE, 0 cuando ya tiene respuesta final
+    int ringing;
+    uint64_t bye_us;              // envío del BYE, 0 cuando ya tiene respuesta final
+} call_timing_t;
+
+/*
+Destino en la caché de handles: el To se parsea una vez y cada handle del
+destino se crea con To y Contact como cabeceras por defecto, así que cada
+MESSAGE solo añade Content-Type y cuerpo. Los handles se crean según hacen
+falta, hasta DEST_HANDLES, y se reutilizan cuando su MESSAGE tiene
+respuesta: los MESSAGE a un mismo destino van en paralelo, no uno por ida y
+vuelta.
+*/
+typedef struct dest_entry {
+    char uri[DEST_URI_MAX];
+    su_home_t home[1];            // memoria del To parseado
+    sip_to_t *to;
+    msg_slot_t slots[DEST_HANDLES];
+    int nslots;                   // handles creados
+    int idle[DEST_HANDLES];       // pila de handles sin MESSAGE en vuelo
+    int nidle;
+    int inflight;                 // MESSAGE enviados sin respuesta final
+    struct dest_entry *hnext;     // cadena del cubo en la tabla hash
+    struct dest_entry *prev;      // lista LRU: lru_head es el más reciente
+    struct dest_entry *next;
+} dest_entry_t;
 
 // Definición de la estructura para el contexto de la aplicación
 typedef struct {
     su_home_t home[1];
+    nua_t *nua;
+    sip_contact_t *contact;       // Contact propio, parseado una vez
+    sip_content_type_t *content_type;
+    dest_entry_t entries[DEST_CACHE_SIZE];
+    int used;
+    dest_entry_t *spare;          // entradas sin destino (el handle no se pudo crear)
+    dest_entry_t *buckets[DEST_CACHE_BUCKETS];
+    dest_entry_t *lru_head;
+    dest_entry_t *lru_tail;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long sent;           // MESSAGE enviados
+    unsigned long completed;      // respuestas finales a MESSAGE
+    unsigned long failures;       // de ellas, las que no son 2xx
+    long inflight;                // enviados sin respuesta final
+    int quiet;                    // sin trazas por mensaje (bench o batch)
+    su_root_t *root;
+    // Entrada de comandos: stdin registrado en el su_root
+    int stdin_index;              // índice de su_root_register, 0 si no está registrado
+    char input[COMMAND_MAX];      // línea a medio leer
+    size_t input_len;
+    // Carga en curso (bench o batch), dirigida por las respuestas
+    int running;
+    const char *run_label;
+    struct timespec run_start;
+    struct timespec progress;     // última respuesta final
+    unsigned long run_sent0;
+    unsigned long run_done0;
+    unsigned long run_fail0;
+    char bench_uri[DEST_URI_MAX];
+    int bench_remaining;
+    int bench_cached;
+    FILE *batch;
+    int exit_when_idle;           // salir del bucle al acabar la carga
+    su_timer_t *watchdog;
+    // Latencia por etapa (latency_hist.h), exportada cada LAT_EXPORT_MS
+    lat_hist_t lat_pdd;           // INVITE -> primera 18x (post-dial delay)
+    lat_hist_t lat_answer;        // INVITE -> 200
+    lat_hist_t lat_bye;           // BYE -> respuesta final
+    lat_hist_t lat_message;       // MESSAGE -> respuesta final
+    unsigned long lat_exported;   // muestras en la última exportación
+    su_timer_t *lat_timer;
 } app_context_t;
 
+nua_handle_t    *inv_handle = NULL; // Handle para el INVITE
+
+static unsigned dest_hash(const char *uri) {
+    // FNV-1a sobre la URI tal cual se escribió
+    unsigned h = 2166136261u;
+    while (*uri)
+        h = (h ^ (unsigned char)*uri++) * 16777619u;
+    return h & (DEST_CACHE_BUCKETS - 1);
+}
+
+static void lru_unlink(app_context_t *app, dest_entry_t *entry) {
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        app->lru_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        app->lru_tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(app_context_t *app, dest_entry_t *entry) {
+    entry->prev = NULL;
+    entry->next = app->lru_head;
+    if (app->lru_head)
+        app->lru_head->prev = entry;
+    else
+        app->lru_tail = entry;
+    app->lru_head = entry;
+}
+
+static void dest_release(dest_entry_t *entry) {
+    // Destruye los handles del destino y su To parseado
+    for (int i = 0; i < entry->nslots; ++i)
+        nua_handle_destroy(entry->slots[i].nh);
+    entry->nslots = 0;
+    entry->nidle = 0;
+    su_home_deinit(entry->home);
+    entry->to = NULL;
+}
+
+static void dest_retire(app_context_t *app, dest_entry_t *entry) {
+    // Saca el destino de la tabla y de la LRU y destruye sus handles
+    dest_entry_t **link = &app->buckets[dest_hash(entry->uri)];
+
+    while (*link != entry)
+        link = &(*link)->hnext;
+    *link = entry->hnext;
+    lru_unlink(app, entry);
+    dest_release(entry);
+    app->evictions++;
+}
+
+static dest_entry_t *dest_slot(app_context_t *app) {
+    /*
+    Sitio para un destino nuevo:
+    - una entrada sin usar o liberada tras un error;
+    - si no, la menos usada que no tenga MESSAGE en vuelo (destruir sus
+        handles perdería esas respuestas);
+    - si todas tienen MESSAGE en vuelo, NULL: el mensaje sale por un handle
+        de un solo uso.
+    */
+    dest_entry_t *spare = app->spare;
+
+    if (spare) {
+        app->spare = spare->hnext;
+        return spare;
+    }
+    if (app->used < DEST_CACHE_SIZE)
+        return &app->entries[app->used++];
+    for (dest_entry_t *entry = app->lru_tail; entry; entry = entry->prev) {
+        if (entry->inflight == 0) {
+            dest_retire(app, entry);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static nua_handle_t *msg_handle_create(app_context_t *app, msg_slot_t *slot, sip_to_t const *sip_to) {
+    // nua_handle copia las cabeceras de sus etiquetas y las usa en todas sus peticiones
+    return nua_handle(app->nua, slot,
+                      SIPTAG_TO(sip_to),
+                      SIPTAG_CONTACT(app->contact),
+                      TAG_END());
+}
+
+static msg_slot_t *dest_slot_acquire(app_context_t *app, dest_entry_t *entry) {
+    /*
+    Handle libre del destino: uno ya creado cuya respuesta llegó o, si no
+    queda ninguno, uno nuevo con el To del destino. NULL si el destino ya
+    tiene DEST_HANDLES MESSAGE en vuelo o nua no pudo crear el handle.
+    */
+    msg_slot_t *slot;
+
+    if (entry->nidle > 0)
+        return &entry->slots[entry->idle[--entry->nidle]];
+    if (entry->nslots == DEST_HANDLES)
+        return NULL;
+    slot = &entry->slots[entry->nslots];
+    slot->dest = entry;
+    slot->nh = msg_handle_create(app, slot, entry->to);
+    if (!slot->nh)
+        return NULL;
+    entry->nslots++;
+    return slot;
+}
+
+static dest_entry_t *dest_lookup(app_context_t *app, const char *to_uri) {
+    /*
+    Devuelve el destino cacheado para to_uri (lo crea si no está) y lo pasa
+    al frente de la LRU. NULL si la URI no es válida o la caché está llena
+    de destinos con MESSAGE en vuelo.
+    */
+    unsigned bucket = dest_hash(to_uri);
+    dest_entry_t *entry;
+
+    for (entry = app->buckets[bucket]; entry; entry = entry->hnext) {
+        if (strcmp(entry->uri, to_uri) == 0) {
+            app->hits++;
+            lru_unlink(app, entry);
+            lru_push_front(app, entry);
+            return entry;
+        }
+    }
+    app->misses++;
+    if (strlen(to_uri) >= DEST_URI_MAX || !(entry = dest_slot(app)))
+        return NULL;
+    su_home_init(entry->home);
+    entry->to = sip_to_create(entry->home, URL_STRING_MAKE(to_uri));
+    if (!entry->to) {
+        printf("Error al crear la dirección SIP (To) para: %s\n", to_uri);
+        su_home_deinit(entry->home);
+        entry->hnext = app->spare;
+        app->spare = entry;
+        return NULL;
+    }
+    strcpy(entry->uri, to_uri);
+    entry->inflight = 0;
+    entry->hnext = app->buckets[bucket];
+    app->buckets[bucket] = entry;
+    lru_push_front(app, entry);
+    return entry;
+}
+
+static void dest_cache_destroy(app_context_t *app) {
+    for (dest_entry_t *entry = app->lru_head; entry; entry = entry->next)
+        dest_release(entry);
+    memset(app->buckets, 0, sizeof(app->buckets));
+    app->lru_head = app->lru_tail = app->spare = NULL;
+    app->used = 0;
+}
+
+static void send_on_slot(app_context_t *app, msg_slot_t *slot, const char *message) {
+    slot->sent_us = lat_now_us();
+    app->sent++;
+    app->inflight++;
+    nua_message(slot->nh,
+                SIPTAG_CONTENT_TYPE(app->content_type),
+                SIPTAG_PAYLOAD_STR(message),
+                TAG_END());
+}
+
+// Envía un MESSAGE por un handle de un solo uso (se destruye con la respuesta final)
+static int send_uncached_message(app_context_t *app, const char *to_uri, const char *message) {
+    /*
+    El To se parsea en una arena de la pila: es lo que costaba cada envío
+    antes de la caché, y lo que sigue costando cuando un destino no cabe.
+    */
+    su_home_t area[SU_HOME_AUTO_SIZE(MESSAGE_ARENA_SIZE)];
+    su_home_t *home = su_home_auto(area, sizeof(area));
+    msg_slot_t *slot = calloc(1, sizeof(msg_slot_t));
+    sip_to_t *sip_to = home ? sip_to_create(home, URL_STRING_MAKE(to_uri)) : NULL;
+
+    if (slot && sip_to)
+        slot->nh = msg_handle_create(app, slot, sip_to);
+    else if (home && !sip_to)
+        printf("Error al crear la dirección SIP (To) para: %s\n", to_uri);
+    if (home)
+        su_home_deinit(home);
+    if (!slot || !slot->nh) {
+        free(slot);
+        return -1;
+    }
+    send_on_slot(app, slot, message);
+    return 0;
+}
+
 // Función para enviar un mensaje SIP MESSAGE
-void send_sip_message(nua_t *nua, su_root_t *root, const char *to_uri, const char *message) {
+int send_sip_message(nua_t *nua, su_root_t *root, const char *to_uri, const char *message) {
+    /*
+    Envía por un handle libre del destino cacheado: To, Contact y
+    Content-Type ya están parseados, nua_message solo copia el cuerpo. Si el
+    destino no cabe en la caché o ya tiene DEST_HANDLES MESSAGE en vuelo,
+    sale por un handle de un solo uso. Retorna 0 si el MESSAGE salió y -1
+    si no.
+    */
     app_context_t *app_ctx = (app_context_t *)su_root_magic(root);
-    if (app_ctx) {
-        url_t *url = url_make(app_ctx->home, (const char *)to_uri);
-        if (url) {
-            printf("Enviando mensaje a: %s con contenido: %s\n", to_uri, message);
-            sip_to_t *sip_to = sip_to_create(app_ctx->home, url);
-            if (sip_to) {
-                nua_message((nua_handle_t *)nua,
-                            SIPTAG_TO(sip_to),
-                            SIPTAG_CONTENT_TYPE_STR(MESSAGE_CONTENT_TYPE),
-                            SIPTAG_PAYLOAD_STR(message),
-                            TAG_END());
-                su_free(app_ctx->home, sip_to); // Liberamos la estructura sip_to_t
-            } else {
-                printf("Error al crear la dirección SIP (To) desde la URL.\n");
-            }
-            su_free(app_ctx->home, url); // Liberamos la estructura url_t
+    dest_entry_t *entry;
+    msg_slot_t *slot;
+
+    (void)nua;
+    if (!app_ctx) {
+        printf("Error al obtener el contexto de la aplicación.\n");
+        return -1;
+    }
+    if (!app_ctx->quiet)
+        printf("Enviando mensaje a: %s con contenido: %s\n", to_uri, message);
+    entry = dest_lookup(app_ctx, to_uri);
+    slot = entry ? dest_slot_acquire(app_ctx, entry) : NULL;
+    if (!slot)
+        return send_uncached_message(app_ctx, to_uri, message);
+    entry->inflight++;
+    send_on_slot(app_ctx, slot, message);
+    return 0;
+}
+
+static void message_completed(app_context_t *app, nua_handle_t *nh, msg_slot_t *slot, int status) {
+    /*
+    Respuesta final a un MESSAGE: se mide su ida y vuelta y el handle vuelve
+    a la pila de libres de su destino; el de un solo uso ya no sirve.
+    */
+    if (slot && slot->sent_us) {
+        lat_hist_record(&app->lat_message, lat_now_us() - slot->sent_us);
+        slot->sent_us = 0;
+    }
+    if (slot && !slot->dest) {
+        nua_handle_destroy(nh);
+        free(slot);
+    } else if (slot) {
+        slot->dest->inflight--;
+        slot->dest->idle[slot->dest->nidle++] = (int)(slot - slot->dest->slots);
+    }
+    app->completed++;
+    if (status >= 300)
+        app->failures++;
+    if (app->inflight > 0) // tras cortar una carga pueden llegar respuestas tardías
+        app->inflight--;
+    clock_gettime(CLOCK_MONOTONIC, &app->progress);
+}
+
+static long elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static void print_cache_stats(app_context_t *app) {
+    int handles = 0;
+
+    for (dest_entry_t *entry = app->lru_head; entry; entry = entry->next)
+        handles += entry->nslots;
+    printf("Caché de destinos: %d handles, %lu aciertos, %lu fallos, %lu retirados\n",
+           handles, app->hits, app->misses, app->evictions);
+}
+
+static void export_latencies(app_context_t *app, int only_if_new) {
+    /*
+    Imprime p50/p99/p99.9/max de cada etapa, acumulados desde el arranque.
+    La exportación periódica se salta si no hay muestras nuevas.
+    */
+    lat_hist_t *stages[] = { &app->lat_pdd, &app->lat_answer, &app->lat_bye, &app->lat_message };
+    unsigned long samples = 0;
+
+    for (int i = 0; i < 4; ++i)
+        samples += atomic_load_explicit(&stages[i]->total, memory_order_relaxed);
+    if (samples == 0 || (only_if_new && samples == app->lat_exported))
+        return;
+    app->lat_exported = samples;
+    printf("\n--- Latencias ---\n");
+    lat_hist_print_header(stdout);
+    for (int i = 0; i < 4; ++i)
+        lat_hist_export(stages[i], stdout, 0);
+    fflush(stdout);
+}
+
+static void lat_export_tick(su_root_magic_t *magic, su_timer_t *t, su_timer_arg_t *arg) {
+    (void)magic;
+    (void)t;
+    export_latencies((app_context_t *)arg, 1);
+}
+
+static void prompt(app_context_t *app) {
+    if (app->stdin_index > 0 && !app->running) {
+        printf("> ");
+        fflush(stdout);
+    }
+}
+
+static void run_finish(app_context_t *app) {
+    long ms = elapsed_ms(&app->run_start);
+    unsigned long done = app->completed - app->run_done0;
+
+    su_timer_reset(app->watchdog);
+    app->running = 0;
+    app->quiet = 0;
+    printf("%s: %lu enviados, %lu respuestas (%lu errores) en %ld ms: %.0f mensajes/s\n",
+           app->run_label, app->sent - app->run_sent0, done, app->failures - app->run_fail0, ms,
+           ms > 0 ? done * 1000.0 / ms : 0.0);
+    print_cache_stats(app);
+    if (app->exit_when_idle)
+        su_root_break(app->root);
+    prompt(app);
+}
+
+static void run_watchdog(su_root_magic_t *magic, su_timer_t *t, su_timer_arg_t *arg) {
+    // Corta la carga si el otro extremo ha dejado de contestar
+    app_context_t *app = (app_context_t *)arg;
+
+    (void)magic;
+    (void)t;
+    if (!app->running || elapsed_ms(&app->progress) < BENCH_TIMEOUT_MS)
+        return;
+    printf("Sin respuestas en %d ms, se corta la carga.\n", BENCH_TIMEOUT_MS);
+    app->bench_remaining = 0;
+    if (app->batch) {
+        fclose(app->batch);
+        app->batch = NULL;
+    }
+    app->inflight = 0;
+    run_finish(app);
+}
+
+static void run_start(app_context_t *app, const char *label) {
+    // Una carga que empieza durante otra se suma a ella (mismo cronómetro)
+    if (app->running)
+        return;
+    app->running = 1;
+    app->quiet = 1;
+    app->run_label = label;
+    app->run_sent0 = app->sent;
+    app->run_done0 = app->completed;
+    app->run_fail0 = app->failures;
+    clock_gettime(CLOCK_MONOTONIC, &app->run_start);
+    app->progress = app->run_start;
+    su_timer_run(app->watchdog, run_watchdog, app);
+}
+
+static void bench_start(app_context_t *app, const char *to_uri, int count, int cached) {
+    /*
+    Programa 'count' MESSAGE a to_uri; los envía load_pump.
+    - cached: handles de la caché del destino (To/Contact parseados una vez).
+    - sin caché: un handle nuevo por mensaje con su To parseado, destruido
+        con la respuesta (lo que costaba cada envío antes de la caché).
+    */
+    if (app->bench_remaining > 0) {
+        printf("Ya hay un bench en curso.\n");
+        return;
+    }
+    strcpy(app->bench_uri, to_uri);
+    app->bench_remaining = count;
+    app->bench_cached = cached;
+    run_start(app, cached ? "bench con caché" : "bench sin caché");
+}
+
+static void execute_command(app_context_t *app, char *command) {
+    // Un comando de la consola o de una línea del fichero batch
+    char to_uri[DEST_URI_MAX];
+    char message[156];
+    int count;
+    int n;
+
+    if (command[0] == 0 || command[0] == '#') {
+        return;
+    }
+    else if (strcmp(command, "salir") == 0) {
+        su_root_break(app->root);
+    }
+    else if (strncmp(command, "enviar ", 7) == 0) {
+        if (sscanf(command + 7, "%99s %155[^\n]", to_uri, message) == 2) {
+            send_sip_message(app->nua, app->root, to_uri, message);
         } else {
-            printf("Error al crear la URL para: %s\n", to_uri);
+            printf("Error: Formato incorrecto. Usa 'enviar <uri> <mensaje>'.\n");
+        }
+    }
+    else if (strncmp(command, "bench ", 6) == 0) {
+        n = sscanf(command + 6, "%99s %d %155s", to_uri, &count, message);
+        if (n >= 2 && count > 0) {
+            bench_start(app, to_uri, count, !(n == 3 && strcmp(message, "sin-cache") == 0));
+        } else {
+            printf("Error: Formato incorrecto. Usa 'bench <uri> <n> [sin-cache]'.\n");
         }
-    } else {
-        printf("Error al obtener el contexto de la aplicación.\n");
+    }
+    else if (strcmp(command, "cache") == 0) {
+        print_cache_stats(app);
+    }
+    else if (strcmp(command, "latencias") == 0) {
+        export_latencies(app, 0);
+    }
+    else if (strcmp(command, "colgar") == 0) {
+        if (inv_handle) {
+            call_timing_t *timing = (call_timing_t *)nua_handle_magic(inv_handle);
+            if (timing)
+                timing->bye_us = lat_now_us();
+            nua_bye(inv_handle, TAG_END());
+        } else {
+            printf("No hay llamada que colgar.\n");
+        }
+    }
+    else {
+        printf("Comando desconocido: %s\n", command);
     }
 }
 
-nua_handle_t    *inv_handle = NULL; // Handle para el INVITE
+static void load_pump(app_context_t *app) {
+    /*
+    Mete carga mientras haya menos de BENCH_WINDOW MESSAGE sin respuesta
+    final: primero lo que queda del bench, luego la siguiente línea del
+    fichero batch. Se llama al empezar y con cada respuesta final, así que
+    envía tan rápido como el stack va contestando. Cuando no queda nada por
+    enviar ni por recibir, cierra la carga e imprime el resultado.
+    */
+    char line[COMMAND_MAX];
+
+    while (app->running && app->inflight < BENCH_WINDOW) {
+        if (app->bench_remaining > 0) {
+            app->bench_remaining--;
+            if (app->bench_cached)
+                send_sip_message(app->nua, app->root, app->bench_uri, "bench");
+            else
+                send_uncached_message(app, app->bench_uri, "bench");
+        } else if (app->batch && fgets(line, sizeof(line), app->batch)) {
+            line[strcspn(line, "\r\n")] = 0;
+            execute_command(app, line);
+        } else if (app->batch) {
+            fclose(app->batch);
+            app->batch = NULL;
+        } else {
+            break;
+        }
+    }
+    if (app->running && app->bench_remaining == 0 && !app->batch && app->inflight == 0)
+        run_finish(app);
+}
+
+static int stdin_readable(su_root_magic_t *magic, su_wait_t *w, su_wakeup_arg_t *arg) {
+    /*
+    stdin está registrado en el su_root, así que los comandos y los eventos
+    SIP se atienden en el mismo bucle sin bloquear:
+    - se lee lo que haya y se ejecuta cada línea completa; el resto espera
+        en app->input a la siguiente lectura;
+    - con EOF se deja de vigilar stdin y se sale en cuanto termine la carga
+        en curso (p. ej. con los comandos entrando por una tubería).
+    */
+    app_context_t *app = (app_context_t *)magic;
+    char *line = app->input;
+    char *end;
+    ssize_t n;
+
+    (void)w;
+    (void)arg;
+    n = read(STDIN_FILENO, app->input + app->input_len, sizeof(app->input) - 1 - app->input_len);
+    if (n <= 0) {
+        su_root_deregister(app->root, app->stdin_index);
+        app->stdin_index = 0;
+        app->exit_when_idle = 1;
+        if (!app->running)
+            su_root_break(app->root);
+        return 0;
+    }
+    app->input_len += n;
+    app->input[app->input_len] = 0;
+    while ((end = strchr(line, '\n')) != NULL) {
+        *end = 0;
+        line[strcspn(line, "\r")] = 0;
+        execute_command(app, line);
+        line = end + 1;
+    }
+    app->input_len -= line - app->input;
+    memmove(app->input, line, app->input_len);
+    if (app->input_len == sizeof(app->input) - 1) {
+        printf("Error: línea demasiado larga, se descarta.\n");
+        app->input_len = 0;
+    }
+    load_pump(app);
+    prompt(app);
+    return 0;
+}
 
 // Callback que maneja los eventos SIP
 static void sip_invite_callback(nua_event_t event, int status,
@@ -64,13 +624,25 @@ static void sip_invite_callback(nua_event_t event, int status,
        void *param, const struct sip_s *sip, tagi_t *tags)
 {
     su_root_t *root = (su_root_t *)context;
-    printf("Callback received event: %d, status: %d, phrase: %s\n", event, status, phrase);
+    app_context_t *app_ctx = (app_context_t *)su_root_magic(root);
+    if (!app_ctx->quiet)
+        printf("Callback received event: %d, status: %d, phrase: %s\n", event, status, phrase);
 
     if (event == nua_i_invite) // Evento de INVITE entrante
        printf("INVITE recibido, request-response\n");
 
     else if (event == nua_r_invite)
     {
+        // Post-dial delay con la primera 18x, tiempo de respuesta con la 200
+        call_timing_t *timing = (call_timing_t *)param;
+        if (timing && status >= 180 && status < 190 && timing->invite_us && !timing->ringing) {
+            timing->ringing = 1;
+            lat_hist_record(&app_ctx->lat_pdd, lat_now_us() - timing->invite_us);
+        } else if (timing && status >= 200 && timing->invite_us) {
+            if (status < 300)
+                lat_hist_record(&app_ctx->lat_answer, lat_now_us() - timing->invite_us);
+            timing->invite_us = 0;
+        }
         printf("Respuesta agente al INVITE: %d %s\n", status, phrase);
        if (status == 180)
        {
@@ -95,7 +667,7 @@ static void sip_invite_callback(nua_event_t event, int status,
         nua_respond(nh, SIP_200_OK, "OK", TAG_END());
         // Potentially initiate shutdown after BYE is handled
         // nua_shutdown(nua);
-        su_root_break(root); // Break the event loop after handling BYE
+        // El bucle de eventos es ahora toda la sesión: se sale con 'salir'
     }
     // Handling for MESSAGE
     else if (event == nua_i_message) {
@@ -119,30 +691,53 @@ static void sip_invite_callback(nua_event_t event, int status,
             printf("Contenido vacío.\n");
         }
         printf("--------------------------------------\n");
+    } else if (event == nua_r_bye) {
+        call_timing_t *timing = (call_timing_t *)param;
+        if (timing && status >= 200 && timing->bye_us) {
+            lat_hist_record(&app_ctx->lat_bye, lat_now_us() - timing->bye_us);
+            timing->bye_us = 0;
+        }
+        printf("Respuesta al BYE: %d %s\n", status, phrase);
     } else if (event == nua_r_message) {
-        printf("Respuesta al mensaje SIP MESSAGE: %d %s\n", status, phrase);
+        if (status >= 200) {
+            message_completed(app_ctx, nh, (msg_slot_t *)param, status);
+            load_pump(app_ctx);
+        }
+        if (!app_ctx->quiet)
+            printf("Respuesta al mensaje SIP MESSAGE: %d %s\n", status, phrase);
         // nua_shutdown(nua); // Considerar si esto es apropiado aquí
     }
     else
     {
+       // Solo traza: estados del INVITE, etc. no deben cortar la sesión
        printf("Evento SIP: %d, %s\n", event, phrase);
-       // nua_shutdown(nua); // Considerar si esto es apropiado aquí
-       sleep(1);
-       su_root_break(root);
     }
 }
 
-int main(void) {
+int main(int argc, char **argv) {
+    /*
+    Uso: demo5 [fichero]
+    - Sin argumentos: consola interactiva sobre stdin.
+    - Con fichero: modo batch, ejecuta sus comandos (una línea cada uno)
+        tan rápido como el stack contesta y sale al terminar.
+    */
     app_context_t app_ctx;
     su_root_t  *root;
     nua_t     *nua;
-    char command[256];
-    char to_uri[100];
-    char message[156];
+    su_wait_t stdin_wait[1];
+    call_timing_t call_timing = { 0, 0, 0 }; // hmagic del handle del INVITE
 
     printf("Iniciando el programa...\n");
     su_init();
+    memset(&app_ctx, 0, sizeof(app_ctx));
     su_home_init(app_ctx.home); // Inicializa la memory home
+    lat_hist_init(&app_ctx.lat_pdd, "post-dial");
+    lat_hist_init(&app_ctx.lat_answer, "respuesta");
+    lat_hist_init(&app_ctx.lat_bye, "BYE");
+    lat_hist_init(&app_ctx.lat_message, "MESSAGE");
+    // Cabeceras comunes a todos los MESSAGE, parseadas una sola vez
+    app_ctx.contact = sip_contact_make(app_ctx.home, SIP_CONTACT_STR);
+    app_ctx.content_type = sip_content_type_make(app_ctx.home, MESSAGE_CONTENT_TYPE);
     printf("su_init() completado.\n");
     root = su_root_create(&app_ctx); // Pasa la estructura de contexto a su_root_create
     if (!root) {
@@ -150,6 +745,10 @@ int main(void) {
        return (EXIT_FAILURE);
     }
     printf("su_root_create() completado.\n");
+    app_ctx.root = root;
+    app_ctx.watchdog = su_timer_create(su_root_task(root), BENCH_WATCHDOG_MS);
+    app_ctx.lat_timer = su_timer_create(su_root_task(root), LAT_EXPORT_MS);
+    su_timer_run(app_ctx.lat_timer, lat_export_tick, &app_ctx);
     nua = nua_create(root,
                    sip_invite_callback,
                    root, // El contexto del callback sigue siendo root por ahora
@@ -160,12 +759,14 @@ int main(void) {
        su_root_destroy(root);
        return (EXIT_FAILURE);
     }
+    app_ctx.nua = nua;
     printf("nua_create() completado.\n");
     printf("Intentando enviar el INVITE...\n");
 
     // Llamada a INVITE
-    nua_handle_t *invite_handle = nua_handle(nua, NULL, TAG_END()); // Obtain a handle for the INVITE
+    nua_handle_t *invite_handle = nua_handle(nua, &call_timing, TAG_END()); // Obtain a handle for the INVITE
     if (invite_handle) {
+        call_timing.invite_us = lat_now_us();
         nua_invite(invite_handle,
                  NUTAG_ALLOW(SIP_IDENTITY),
                  SIPTAG_CONTACT_STR(SIP_CONTACT_STR),
@@ -178,40 +779,60 @@ int main(void) {
     }
 
 
-    printf("\n--- Cliente SIP (con Mensajería) ---\n");
-    printf("Ingresa 'enviar <uri> <mensaje>' para enviar un mensaje.\n");
-    printf("Ingresa 'salir' para salir.\n");
-    printf("El programa también intentará enviar un INVITE.\n\n");
-
-    while (1) {
-        printf("> ");
-        if (fgets(command, sizeof(command), stdin) == NULL) {
-            break; // Error o EOF
+    if (argc > 1) {
+        app_ctx.batch = fopen(argv[1], "r");
+        if (!app_ctx.batch) {
+            perror(argv[1]);
+            nua_destroy(nua);
+            su_root_destroy(root);
+            return (EXIT_FAILURE);
         }
-        command[strcspn(command, "\n")] = 0; // Eliminar el newline
-
-        if (strcmp(command, "salir") == 0) {
-            break;
-        }
-        else if (strncmp(command, "enviar ", 7) == 0) {
-            if (sscanf(command + 7, "%99s %[^\n]", to_uri, message) == 2) {
-                send_sip_message(nua, root, to_uri, message);
-            } else {
-                printf("Error: Formato incorrecto. Usa 'enviar <uri> <mensaje>'.\n");
-            }
+        app_ctx.exit_when_idle = 1;
+        run_start(&app_ctx, "batch");
+        load_pump(&app_ctx);
+    } else {
+        printf("\n--- Cliente SIP (con Mensajería) ---\n");
+        printf("Ingresa 'enviar <uri> <mensaje>' para enviar un mensaje.\n");
+        printf("Ingresa 'bench <uri> <n> [sin-cache]' para medir mensajes/s.\n");
+        printf("Ingresa 'cache' para ver la caché de destinos.\n");
+        printf("Ingresa 'latencias' para ver los histogramas de latencia.\n");
+        printf("Ingresa 'colgar' para enviar BYE en la llamada.\n");
+        printf("Ingresa 'salir' para salir.\n");
+        printf("El programa también intentará enviar un INVITE.\n\n");
+        // stdin entra en el mismo bucle que los sockets SIP
+        if (su_wait_create(stdin_wait, STDIN_FILENO, SU_WAIT_IN) == 0)
+            app_ctx.stdin_index = su_root_register(root, stdin_wait, stdin_readable, NULL, 0);
+        if (app_ctx.stdin_index <= 0) {
+            fprintf(stderr, "No se pudo registrar stdin en el su_root\n");
+            app_ctx.stdin_index = 0;
+            nua_destroy(nua);
+            su_root_destroy(root);
+            return (EXIT_FAILURE);
         }
+        prompt(&app_ctx);
     }
 
-    // Ejecuta el loop de eventos SIP (bloqueante)
-    su_root_run(root);
+    // Comandos y eventos SIP en el mismo loop, hasta 'salir' o el fin del batch
+    // (un batch sin MESSAGE ya ha terminado aquí)
+    if (app_ctx.running || app_ctx.stdin_index > 0)
+        su_root_run(root);
     printf("su_root_run() completado.\n");
+    export_latencies(&app_ctx, 0);
 
     // Limpieza
     if (inv_handle) {
         nua_handle_destroy(inv_handle); // Destroy the INVITE handle
     }
+    if (app_ctx.stdin_index > 0)
+        su_root_deregister(root, app_ctx.stdin_index);
+    if (app_ctx.batch)
+        fclose(app_ctx.batch);
+    su_timer_destroy(app_ctx.watchdog);
+    su_timer_destroy(app_ctx.lat_timer);
+    dest_cache_destroy(&app_ctx);
     nua_destroy(nua);
     su_root_destroy(root);
+    su_home_deinit(app_ctx.home);
     su_deinit();
     printf("Limpieza completada.\n");
     return (EXIT_SUCCESS);
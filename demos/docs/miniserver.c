@@ -1,24 +1,107 @@
 #include <sofia-sip/nta.h>
 #include <sofia-sip/su.h>
 #include <sofia-sip/su_tag.h>
+#include <sofia-sip/su_wait.h>
 #include <sofia-sip/nua.h>
 #include <sofia-sip/sip.h>
+#include <sofia-sip/url.h>
 #include <sofia-sip/nua_tag.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define SERVER_URL "sip:127.0.0.1:5060"
+#define RATE_INTERVAL_MS 1000
+
+/*
+Estado del servidor (magia del su_root y del agente NTA): contadores para
+la tasa de mensajes/s y si se imprime cada MESSAGE. Imprimir el mensaje
+entero cuesta más que atenderlo, así que solo se hace con -v.
+*/
+typedef struct {
+    unsigned long messages;
+    unsigned long last_messages;
+    unsigned long requests;
+    int verbose;
+} server_stats_t;
+
+static void print_message_str(const char *from, const char *content_type, const char *payload, int payload_len)
+{
+    printf("\n--- Mensaje SIP MESSAGE Recibido ---\n");
+    printf("De: %s\n", from);
+    printf("Content-Type: %s\n", content_type);
+    if (payload) {
+        printf("Contenido:\n%.*s\n", payload_len, payload);
+    } else {
+        printf("Contenido vacío.\n");
+    }
+    printf("--------------------------------------\n");
+}
+
+static int server_nta_callback(nta_agent_magic_t *context, nta_agent_t *agent, msg_t *msg, sip_t *sip)
+{
+    /*
+    Camino rápido sin estado: NTA entrega cada petición que no pertenece a
+    ninguna transacción ya parseada en 'sip' y se responde con
+    nta_msg_treply sobre el propio mensaje, sin crear handle NUA, sin
+    transacción de servidor y sin pasar por listas de etiquetas.
+    - MESSAGE y OPTIONS: 200 OK. Una retransmisión del MESSAGE recibe otra
+        vez el 200 (la entrega es idempotente para el servidor).
+    - ACK: no lleva respuesta, solo se libera el mensaje.
+    - Resto: 501.
+    nta_msg_treply se queda con msg; en todos los casos el mensaje está
+    consumido al volver.
+    */
+    server_stats_t *stats = (server_stats_t *)context;
+
+    if (!sip || !sip->sip_request) { // respuesta suelta: no hay transacción cliente a la que darla
+        msg_destroy(msg);
+        return 0;
+    }
+    stats->requests++;
+    switch (sip->sip_request->rq_method) {
+    case sip_method_message:
+        stats->messages++;
+        if (stats->verbose) {
+            char from[128] = "";
+            if (sip->sip_from)
+                snprintf(from, sizeof(from), URL_PRINT_FORMAT, URL_PRINT_ARGS(sip->sip_from->a_url));
+            print_message_str(from,
+                              sip->sip_content_type ? sip->sip_content_type->c_type : NULL,
+                              sip->sip_payload ? sip->sip_payload->pl_data : NULL,
+                              sip->sip_payload ? (int)sip->sip_payload->pl_len : 0);
+        }
+        nta_msg_treply(agent, msg, 200, "OK", TAG_END());
+        break;
+    case sip_method_options:
+        nta_msg_treply(agent, msg, 200, "OK", TAG_END());
+        break;
+    case sip_method_ack:
+        msg_destroy(msg);
+        break;
+    default:
+        nta_msg_treply(agent, msg, 501, "Not Implemented", TAG_END());
+        break;
+    }
+    return 0;
+}
+
 static void server_message_callback(nua_event_t event, int status,
                                   const char *phrase, nua_t *nua, void *context, nua_handle_t *nh,
                                   void *param, const struct sip_s *sip, tagi_t *tags)
 {
-    printf("server_message_callback fue llamada con evento: %d\n", event);
+    // Camino con NUA (modo 'nua'): un handle por MESSAGE y extracción con tl_gets
+    server_stats_t *stats = (server_stats_t *)su_root_magic((su_root_t *)context);
     const char *from = NULL;
     const char *content_type = NULL;
     const char *payload = NULL;
     // size_t payload_length = 0;
 
+    if (stats->verbose)
+        printf("server_message_callback fue llamada con evento: %d\n", event);
     if (event == nua_i_message) {
+        stats->requests++;
+        stats->messages++;
         tl_gets(tags,
                 SIPTAG_FROM_STR_REF(from),
                 SIPTAG_CONTENT_TYPE_STR_REF(content_type),
@@ -28,53 +111,120 @@ static void server_message_callback(nua_event_t event, int status,
         // payload = (const char *)sip_get_body(sip);
         // payload_length = sip_get_body_length(sip);
 
-        printf("\n--- Mensaje SIP MESSAGE Recibido ---\n");
-        printf("De: %s\n", from);
-        printf("Content-Type: %s\n", content_type);
-        if (payload) {
-            printf("Contenido:\n%s\n", payload);
-        } else {
-            printf("Contenido vacío.\n");
-        }
-        printf("--------------------------------------\n");
+        if (stats->verbose)
+            print_message_str(from, content_type, payload, payload ? (int)strlen(payload) : 0);
         nua_respond(nh, 200, "OK", TAG_END());
-        nua_destroy(nua);
+        nua_handle_destroy(nh); // El handle del MESSAGE entrante ya no se usa
+        // Sigue escuchando: destruir el nua aquí cortaba el servidor tras el primer MESSAGE
     } else if (event == nua_r_message) {
         printf("Respuesta al mensaje SIP: %d %s\n", status, phrase);
     }
 }
 
-int main(void)
+static void report_rate(su_root_magic_t *magic, su_timer_t *t, su_timer_arg_t *arg)
 {
+    // Cada segundo: MESSAGE atendidos en el último intervalo
+    server_stats_t *stats = (server_stats_t *)arg;
+    unsigned long n = stats->messages - stats->last_messages;
+
+    (void)magic;
+    (void)t;
+    if (n > 0) {
+        printf("%lu mensajes/s (%lu peticiones en total)\n", n * 1000 / RATE_INTERVAL_MS, stats->requests);
+        fflush(stdout);
+    }
+    stats->last_messages = stats->messages;
+}
+
+int main(int argc, char **argv)
+{
+    /*
+    Uso: miniserver [nua] [-v]
+    - Por defecto: agente NTA sin estado (server_nta_callback).
+    - nua: el servidor NUA de siempre, para comparar mensajes/s.
+    - -v: imprime cada MESSAGE recibido.
+    */
+    server_stats_t stats;
     su_root_t *root;
-    nua_t *nua;
+    su_timer_t *timer;
+    nua_t *nua = NULL;
+    nta_agent_t *agent = NULL;
+    int use_nua = 0;
+
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "nua") == 0)
+            use_nua = 1;
+        else if (strcmp(argv[i], "-v") == 0)
+            stats.verbose = 1;
+    }
 
     su_init();
-    root = su_root_create(NULL);
+    root = su_root_create((su_root_magic_t *)&stats);
     if (root == NULL) {
         fprintf(stderr, "Can't create root object\n");
         return EXIT_FAILURE;
     }
 
-    nua = nua_create(root,
-                   server_message_callback,
-                   root,
-                   NUTAG_URL("sip:127.0.0.1:5060"),
-                   TAG_END());
+    if (use_nua) {
+        nua = nua_create(root,
+                       server_message_callback,
+                       root,
+                       NUTAG_URL(SERVER_URL),
+                       TAG_END());
+    } else {
+        agent = nta_agent_create(root,
+                                 URL_STRING_MAKE(SERVER_URL),
+                                 server_nta_callback,
+                                 (nta_agent_magic_t *)&stats,
+                                 TAG_END());
+    }
 
-    if (nua == NULL) {
-        fprintf(stderr, "Can't create NUA object\n");
+    if (nua == NULL && agent == NULL) {
+        fprintf(stderr, "Can't create %s object\n", use_nua ? "NUA" : "NTA");
         su_root_destroy(root);
         return EXIT_FAILURE;
     }
 
-    printf("Sofia-SIP miniserver started at sip:127.0.0.1:5060\n");
+    timer = su_timer_create(su_root_task(root), RATE_INTERVAL_MS);
+    su_timer_run(timer, report_rate, &stats);
+
+    printf("Sofia-SIP miniserver (%s) started at %s\n", use_nua ? "nua" : "nta sin estado", SERVER_URL);
 
     su_root_run(root);
 
-    nua_destroy(nua);
+    su_timer_destroy(timer);
+    if (nua)
+        nua_destroy(nua);
+    if (agent)
+        nta_agent_destroy(agent);
     su_root_destroy(root);
     su_deinit();
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+/*
+Compila: gcc -o miniserver miniserver.c $(pkg-config --cflags --libs sofia-sip-ua)
+Ejecuta: ./miniserver [nua] [-v]
+Benchmark: sipload (demos/sipload.c) en su escenario message, una vez
+contra cada modo y con la misma tasa ofrecida:
+    ./miniserver &                       ./sipload message 20000 10
+    ./miniserver nua &                   ./sipload message 20000 10
+El servidor imprime los mensajes/s atendidos cada segundo; sipload imprime
+las llamadas/s completadas y la latencia del MESSAGE. Si un modo no llega a
+la tasa ofrecida, aparecen timeouts y retransmisiones: se baja la tasa hasta
+que desaparecen y esa es su capacidad. demo5 ('bench sip:127.0.0.1:5060
+10000') sirve para probar un solo cliente NUA, no para medir el servidor.
+Explicación:
+    -Camino Rápido sin Estado (NTA):
+        Para mensajes cortos (MCData) no hace falta un handle NUA por
+        MESSAGE: el agente NTA ya entrega la petición parseada (sip_t) y
+        nta_msg_treply responde 200 directamente sobre ese mensaje. No se
+        crea transacción de servidor, ni handle, ni lista de etiquetas con
+        tl_gets, y el servidor sigue atendiendo tras cada mensaje.
+
+    -Modo NUA:
+        El servidor anterior, con un handle por MESSAGE que se destruye tras
+        responder. Sirve de referencia para el benchmark.
+*/
@@ -0,0 +1,146 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+Histogramas de latencia al estilo HDR para las etapas de una llamada
+(post-dial delay, tiempo de respuesta, BYE, MESSAGE).
+
+- Valores en microsegundos. Los 128 primeros cubos son exactos (0-127 us);
+    a partir de ahí cada potencia de 2 se parte en 64 cubos, así que el
+    error relativo es como mucho 1/64 (~1.6%) en todo el rango, hasta 2^34 us.
+- Registrar es un fetch_add relajado sobre el cubo más el contador y el
+    máximo: sin locks, se puede registrar desde cualquier hilo mientras otro
+    exporta.
+- Exportar copia los cubos y calcula los percentiles sobre la copia; con
+    reset los pone a cero con exchange, así cada exportación es la ventana
+    desde la anterior.
+*/
+
+#define LAT_HIST_EXACT 128                   // cubos de 1 us
+#define LAT_HIST_SUB 64                      // cubos por potencia de 2 por encima
+#define LAT_HIST_MAX_SHIFT 27
+#define LAT_HIST_BUCKETS (LAT_HIST_EXACT + LAT_HIST_MAX_SHIFT * LAT_HIST_SUB)
+
+typedef struct {
+    const char *name;
+    atomic_ulong counts[LAT_HIST_BUCKETS];
+    atomic_ulong total;
+    atomic_ulong max_us;
+} lat_hist_t;
+
+typedef struct {
+    unsigned long counts[LAT_HIST_BUCKETS];
+    unsigned long total;
+    unsigned long max_us;
+} lat_hist_snapshot_t;
+
+static inline uint64_t lat_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static inline void lat_hist_init(lat_hist_t *h, const char *name) {
+    h->name = name;
+    for (int i = 0; i < LAT_HIST_BUCKETS; ++i)
+        atomic_init(&h->counts[i], 0);
+    atomic_init(&h->total, 0);
+    atomic_init(&h->max_us, 0);
+}
+
+static inline int lat_hist_bucket(uint64_t us) {
+    // Los 7 bits altos del valor eligen el cubo dentro de su potencia de 2
+    int msb;
+    int shift;
+
+    if (us < LAT_HIST_EXACT)
+        return (int)us;
+    msb = 63 - __builtin_clzll(us);
+    shift = msb - 6;
+    if (shift > LAT_HIST_MAX_SHIFT)
+        return LAT_HIST_BUCKETS - 1;
+    return LAT_HIST_EXACT + (shift - 1) * LAT_HIST_SUB + (int)((us >> shift) - LAT_HIST_SUB);
+}
+
+static inline uint64_t lat_hist_bucket_high(int bucket) {
+    // Mayor valor que cae en el cubo: los percentiles se dan por arriba
+    int shift;
+
+    if (bucket < LAT_HIST_EXACT)
+        return (uint64_t)bucket;
+    shift = (bucket - LAT_HIST_EXACT) / LAT_HIST_SUB + 1;
+    return ((uint64_t)(LAT_HIST_SUB + (bucket - LAT_HIST_EXACT) % LAT_HIST_SUB) << shift) + (1ULL << shift) - 1;
+}
+
+static inline void lat_hist_record(lat_hist_t *h, uint64_t us) {
+    unsigned long max = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&h->counts[lat_hist_bucket(us)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+    while (us > max && !atomic_compare_exchange_weak_explicit(&h->max_us, &max, us, memory_order_relaxed,
+                                                              memory_order_relaxed))
+        ;
+}
+
+static inline void lat_hist_snapshot(lat_hist_t *h, lat_hist_snapshot_t *snap, int reset) {
+    /*
+    Copia el histograma. Con registros concurrentes la copia no es atómica
+    en conjunto: 'total' se recalcula a partir de los cubos copiados para
+    que los percentiles sean coherentes con ellos.
+    */
+    snap->total = 0;
+    for (int i = 0; i < LAT_HIST_BUCKETS; ++i) {
+        snap->counts[i] = reset ? atomic_exchange_explicit(&h->counts[i], 0, memory_order_relaxed)
+                                : atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        snap->total += snap->counts[i];
+    }
+    if (reset) {
+        atomic_store_explicit(&h->total, 0, memory_order_relaxed);
+        snap->max_us = atomic_exchange_explicit(&h->max_us, 0, memory_order_relaxed);
+    } else {
+        snap->max_us = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+    }
+}
+
+static inline uint64_t lat_hist_percentile(const lat_hist_snapshot_t *snap, double p) {
+    unsigned long rank;
+    unsigned long seen = 0;
+
+    if (snap->total == 0)
+        return 0;
+    rank = (unsigned long)(p / 100.0 * snap->total);
+    if (rank >= snap->total)
+        rank = snap->total - 1;
+    for (int i = 0; i < LAT_HIST_BUCKETS; ++i) {
+        seen += snap->counts[i];
+        if (seen > rank) {
+            uint64_t high = lat_hist_bucket_high(i);
+            return high < snap->max_us ? high : snap->max_us;
+        }
+    }
+    return snap->max_us;
+}
+
+static inline void lat_hist_print_header(FILE *out) {
+    fprintf(out, "%-14s %9s %10s %10s %10s %10s\n", "etapa", "n", "p50 us", "p99 us", "p99.9 us", "max us");
+}
+
+static inline void lat_hist_export(lat_hist_t *h, FILE *out, int reset) {
+    // Una línea por etapa; las etapas sin muestras no se imprimen
+    lat_hist_snapshot_t snap;
+
+    lat_hist_snapshot(h, &snap, reset);
+    if (snap.total == 0)
+        return;
+    fprintf(out, "%-14s %9lu %10llu %10llu %10llu %10lu\n", h->name, snap.total,
+            (unsigned long long)lat_hist_percentile(&snap, 50.0), (unsigned long long)lat_hist_percentile(&snap, 99.0),
+            (unsigned long long)lat_hist_percentile(&snap, 99.9), snap.max_us);
+}
+
+#endif
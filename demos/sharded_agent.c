@@ -0,0 +1,707 @@
+#define _GNU_SOURCE
+#include <sofia-sip/su.h>
+#include <sofia-sip/su_tag.h>
+#include <sofia-sip/su_wait.h>
+#include <sofia-sip/nua.h>
+#include <sofia-sip/nua_tag.h>
+#include <sofia-sip/sip.h>
+#include <sofia-sip/sip_header.h>
+#include <sofia-sip/sip_status.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "sip_steering.h"
+
+/*
+Agente SIP repartido por núcleos: N hilos, cada uno fijado a su núcleo con
+su propio su_root_t y su propio nua_t. Los shards no comparten ningún
+objeto de Sofia.
+
+- Todo escucha en una sola dirección IPv4, la pública (127.0.0.1 si no se
+    da otra): es la del Contact que ve el cliente y la que alcanza a él.
+- Cada nua escucha en un puerto propio de esa dirección (puerto base + shard).
+- El puerto público lo atiende un grupo SO_REUSEPORT con un socket por
+    shard, registrado en el su_root del shard: el front end y el nua van en
+    el mismo bucle, sin hilos de por medio.
+- Dueño de una llamada: hash(Call-ID) % N. El front end que recibe la
+    petición la reenvía al nua del dueño desde su socket de relevo, así que
+    INVITE, ACK y BYE de una llamada llegan siempre al mismo nua.
+- En la Via de arriba el front end apunta la dirección del cliente
+    (parámetro fe) y asegura rport: el nua responde al socket de relevo, y
+    el front end quita esos parámetros y devuelve la respuesta al cliente
+    desde el puerto público.
+*/
+
+#define SIP_PORT 5060
+#define NUA_BASE_PORT 5100         // el nua del shard i escucha en <ip pública>:NUA_BASE_PORT + i
+#define MAX_SHARDS 64
+#define SIP_MAX_DATAGRAM 2048
+#define RECV_BATCH 32              // datagramas por recvmmsg
+#define FE_PARAM_MAX 32            // ";fe=" + 8 + 4 + 1 hex + ";rport"
+#define SESSION_EXPIRES_S 1800     // Session-Expires por defecto (RFC 4028)
+#define TICK_MS 1000
+
+typedef struct {
+    const char *p;
+    int len;
+} sip_str_t;
+
+// Lo que el front end necesita de un datagrama: el Call-ID y dónde acaba la Via de arriba
+typedef struct {
+    int is_response;
+    sip_str_t call_id;
+    sip_str_t top_via;             // valor de la primera Via (hasta ',' o fin de línea)
+} sip_scan_t;
+
+typedef struct {
+    long received;                 // peticiones leídas del puerto público
+    long relayed;                  // de ellas, enviadas al nua de otro shard
+    long responses;                // respuestas devueltas a clientes
+    long dropped;                  // datagramas inválidos o que no caben
+    long calls;                    // INVITE entrantes en el nua del shard
+    long hangups;                  // BYE entrantes
+    long messages;                 // MESSAGE entrantes
+} shard_stats_t;
+
+typedef struct {
+    int index;
+    int cpu;
+    int public_fd;                 // puerto público, grupo SO_REUSEPORT
+    int relay_fd;                  // origen de los reenvíos y destino de las respuestas del nua
+    su_root_t *root;
+    nua_t *nua;
+    su_timer_t *tick;
+    sip_contact_t *contact;        // Contact público de los 200 al INVITE
+    int failed;                    // no se pudo crear el su_root o el nua
+    pthread_t thread;
+    // Lote de entrada
+    struct mmsghdr in_msgs[RECV_BATCH];
+    struct iovec in_iov[RECV_BATCH];
+    struct sockaddr_in in_addr[RECV_BATCH];
+    char in_buf[RECV_BATCH][SIP_MAX_DATAGRAM];
+    // Lote de salida
+    struct mmsghdr out_msgs[RECV_BATCH];
+    struct iovec out_iov[RECV_BATCH];
+    struct sockaddr_in out_addr[RECV_BATCH];
+    char out_buf[RECV_BATCH][SIP_MAX_DATAGRAM + FE_PARAM_MAX];
+    int out_count;
+    su_home_t home[1];
+    // Contadores: los escribe solo el shard, el hilo principal los lee
+    _Alignas(64) atomic_long stats[sizeof(shard_stats_t) / sizeof(long)];
+} shard_t;
+
+enum {
+    ST_RECEIVED,
+    ST_RELAYED,
+    ST_RESPONSES,
+    ST_DROPPED,
+    ST_CALLS,
+    ST_HANGUPS,
+    ST_MESSAGES
+};
+
+static shard_t *shards;
+static int num_shards;
+static int sip_port = SIP_PORT;
+static int nua_base_port = NUA_BASE_PORT;
+static struct in_addr public_ip;   // Contact y sockets; 127.0.0.1 si no se da otra
+static char public_host[INET_ADDRSTRLEN];
+static pthread_barrier_t started;
+static volatile sig_atomic_t stop_requested;
+
+static void count(shard_t *s, int stat) {
+    // Un solo escritor: carga y almacenamiento relajados, sin instrucción con lock
+    atomic_store_explicit(&s->stats[stat], atomic_load_explicit(&s->stats[stat], memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+static sip_str_t trim(const char *p, const char *end) {
+    sip_str_t s;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        end--;
+    s.p = p;
+    s.len = (int)(end - p);
+    return s;
+}
+
+static int header_is(const sip_str_t *name, const char *full, char compact) {
+    return ((int)strlen(full) == name->len && strncasecmp(name->p, full, name->len) == 0) ||
+           (name->len == 1 && (name->p[0] | 0x20) == compact);
+}
+
+static int scan_message(const char *data, int len, sip_scan_t *msg) {
+    /*
+    Recorre las cabeceras hasta la línea en blanco y guarda punteros al
+    Call-ID y a la primera Via (forma larga o compacta). No parsea nada más:
+    el mensaje entero lo parsea el nua del dueño. Retorna 0 si tiene ambos.
+    */
+    const char *end = data + len;
+    const char *line = data;
+    const char *eol = memchr(data, '\n', len);
+
+    memset(msg, 0, sizeof(*msg));
+    if (!eol)
+        return -1;
+    msg->is_response = len >= 7 && memcmp(data, "SIP/2.0", 7) == 0;
+    for (line = eol + 1; line < end; line = eol + 1) {
+        const char *colon;
+        sip_str_t name;
+
+        eol = memchr(line, '\n', end - line);
+        if (!eol)
+            eol = end;
+        if (eol - line <= 1) // línea en blanco: empieza el cuerpo
+            break;
+        colon = memchr(line, ':', eol - line);
+        if (!colon)
+            continue;
+        name = trim(line, colon);
+        if (header_is(&name, "Call-ID", 'i')) {
+            msg->call_id = trim(colon + 1, eol);
+        } else if (header_is(&name, "Via", 'v') && !msg->top_via.p) {
+            const char *comma = memchr(colon + 1, ',', eol - colon - 1);
+            msg->top_via = trim(colon + 1, comma ? comma : eol);
+        }
+    }
+    return msg->call_id.len > 0 && msg->top_via.p ? 0 : -1;
+}
+
+static const char *via_param(const sip_str_t *via, const char *name, int *value_len) {
+    // Valor de un parámetro de la Via (";name=valor"), o "" si va sin valor; NULL si no está
+    int name_len = (int)strlen(name);
+    const char *end = via->p + via->len;
+
+    for (const char *p = memchr(via->p, ';', via->len); p; p = memchr(p, ';', end - p)) {
+        p++;
+        while (p < end && *p == ' ')
+            p++;
+        if (end - p >= name_len && strncasecmp(p, name, name_len) == 0 &&
+            (p + name_len == end || p[name_len] == ';' || p[name_len] == '=' || p[name_len] == ' ')) {
+            const char *v = p + name_len;
+            const char *v_end;
+
+            if (v == end || *v != '=') {
+                *value_len = 0;
+                return "";
+            }
+            v++;
+            v_end = memchr(v, ';', end - v);
+            *value_len = (int)((v_end ? v_end : end) - v);
+            return v;
+        }
+    }
+    return NULL;
+}
+
+// Lote de salida
+static void shard_flush(shard_t *s, int fd) {
+    int sent = 0;
+
+    while (sent < s->out_count) {
+        int n = sendmmsg(fd, s->out_msgs + sent, s->out_count - sent, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                perror("sendmmsg failed");
+            break; // UDP: lo que no sale lo recupera la retransmisión
+        }
+        sent += n;
+    }
+    s->out_count = 0;
+}
+
+static void shard_queue(shard_t *s, int len, const struct sockaddr_in *to) {
+    // El datagrama ya está en out_buf[out_count]
+    int i = s->out_count++;
+
+    s->out_addr[i] = *to;
+    s->out_iov[i].iov_base = s->out_buf[i];
+    s->out_iov[i].iov_len = len;
+    s->out_msgs[i].msg_hdr.msg_name = &s->out_addr[i];
+    s->out_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    s->out_msgs[i].msg_hdr.msg_iov = &s->out_iov[i];
+    s->out_msgs[i].msg_hdr.msg_iovlen = 1;
+}
+
+static void relay_request(shard_t *s, const char *data, int len, const struct sockaddr_in *from) {
+    /*
+    Petición del puerto público hacia el nua del dueño. Al final de la
+    primera Via se añade ";fe=" con la IP y el puerto del cliente en
+    hexadecimal y un dígito que dice si el cliente pidió rport; si no lo
+    pidió se añade ";rport", para que el nua responda al socket de relevo
+    y no directamente a la dirección de la Via.
+    */
+    sip_scan_t msg;
+    struct sockaddr_in owner_addr;
+    int rport_len;
+    int client_rport;
+    int owner;
+    int head;
+    int n;
+    char *out = s->out_buf[s->out_count];
+
+    if (scan_message(data, len, &msg) != 0 || msg.is_response) {
+        count(s, ST_DROPPED);
+        return;
+    }
+    count(s, ST_RECEIVED);
+    client_rport = via_param(&msg.top_via, "rport", &rport_len) != NULL;
+    owner = (int)(sip_callid_hash(msg.call_id.p, msg.call_id.len) % (uint64_t)num_shards);
+    head = (int)(msg.top_via.p + msg.top_via.len - data);
+    memcpy(out, data, head);
+    n = head + snprintf(out + head, FE_PARAM_MAX, ";fe=%08x%04x%d%s", ntohl(from->sin_addr.s_addr),
+                        ntohs(from->sin_port), client_rport, client_rport ? "" : ";rport");
+    memcpy(out + n, data + head, len - head);
+    n += len - head;
+    memset(&owner_addr, 0, sizeof(owner_addr));
+    owner_addr.sin_family = AF_INET;
+    owner_addr.sin_addr = public_ip;
+    owner_addr.sin_port = htons(nua_base_port + owner);
+    shard_queue(s, n, &owner_addr);
+    if (owner != s->index)
+        count(s, ST_RELAYED);
+}
+
+static void return_response(shard_t *s, const char *data, int len) {
+    /*
+    Respuesta de un nua al socket de relevo. La primera Via trae el fe que
+    puso relay_request, y el rport/received que el nua añadió con la
+    dirección del relevo. Se reescriben sus parámetros: fuera fe, received
+    y rport; si el cliente pidió rport, se devuelven con su dirección, como
+    los habría puesto un servidor al que hubiera llegado directamente.
+    */
+    sip_scan_t msg;
+    struct sockaddr_in client;
+    const char *fe;
+    const char *via_end;
+    const char *p;
+    unsigned ip;
+    unsigned port;
+    int client_rport;
+    int fe_len;
+    int tail_len;
+    int n;
+    char received[INET_ADDRSTRLEN];
+    char tail[FE_PARAM_MAX + INET_ADDRSTRLEN]; // ;received=...;rport=...
+    char *out = s->out_buf[s->out_count];
+
+    if (scan_message(data, len, &msg) != 0 || !msg.is_response ||
+        !(fe = via_param(&msg.top_via, "fe", &fe_len)) || fe_len != 13 ||
+        sscanf(fe, "%8x%4x%1d", &ip, &port, &client_rport) != 3) {
+        count(s, ST_DROPPED);
+        return;
+    }
+    // sent-protocol y sent-by, hasta el primer ';'
+    p = memchr(msg.top_via.p, ';', msg.top_via.len);
+    n = (int)(p - data);
+    memcpy(out, data, n);
+    via_end = msg.top_via.p + msg.top_via.len;
+    while (p && p < via_end) {
+        const char *param = p + 1;
+        const char *next = memchr(param, ';', via_end - param);
+        const char *param_end = next ? next : via_end;
+        sip_str_t name;
+        const char *eq = memchr(param, '=', param_end - param);
+
+        name = trim(param, eq ? eq : param_end);
+        if (!(name.len == 2 && strncasecmp(name.p, "fe", 2) == 0) &&
+            !(name.len == 5 && strncasecmp(name.p, "rport", 5) == 0) &&
+            !(name.len == 8 && strncasecmp(name.p, "received", 8) == 0)) {
+            memcpy(out + n, p, param_end - p);
+            n += (int)(param_end - p);
+        }
+        p = next;
+    }
+    tail_len = 0;
+    if (client_rport) {
+        struct in_addr addr = { .s_addr = htonl(ip) };
+        inet_ntop(AF_INET, &addr, received, sizeof(received));
+        tail_len = snprintf(tail, sizeof(tail), ";received=%s;rport=%u", received, port);
+    }
+    if (n + tail_len + (len - (int)(via_end - data)) > (int)sizeof(s->out_buf[0])) {
+        count(s, ST_DROPPED);
+        return;
+    }
+    memcpy(out + n, tail, tail_len);
+    n += tail_len;
+    memcpy(out + n, via_end, len - (via_end - data));
+    n += len - (int)(via_end - data);
+    memset(&client, 0, sizeof(client));
+    client.sin_family = AF_INET;
+    client.sin_addr.s_addr = htonl(ip);
+    client.sin_port = htons(port);
+    shard_queue(s, n, &client);
+    count(s, ST_RESPONSES);
+}
+
+static int shard_receive(shard_t *s, int fd, int out_fd, void (*handle)(shard_t *, const char *, int,
+                                                                         const struct sockaddr_in *)) {
+    // Vacía el socket por lotes de recvmmsg; cada lote sale con un sendmmsg por out_fd
+    for (;;) {
+        for (int i = 0; i < RECV_BATCH; ++i) {
+            s->in_iov[i].iov_base = s->in_buf[i];
+            s->in_iov[i].iov_len = SIP_MAX_DATAGRAM;
+            s->in_msgs[i].msg_hdr.msg_name = &s->in_addr[i];
+            s->in_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            s->in_msgs[i].msg_hdr.msg_iov = &s->in_iov[i];
+            s->in_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(fd, s->in_msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+                perror("recvmmsg failed");
+            return 0;
+        }
+        for (int i = 0; i < n; ++i)
+            handle(s, s->in_buf[i], (int)s->in_msgs[i].msg_len, &s->in_addr[i]);
+        shard_flush(s, out_fd);
+        if (n < RECV_BATCH)
+            return 0;
+    }
+}
+
+static void handle_response(shard_t *s, const char *data, int len, const struct sockaddr_in *from) {
+    (void)from;
+    return_response(s, data, len);
+}
+
+static int public_readable(su_root_magic_t *magic, su_wait_t *w, su_wakeup_arg_t *arg) {
+    shard_t *s = (shard_t *)magic;
+
+    (void)w;
+    (void)arg;
+    return shard_receive(s, s->public_fd, s->relay_fd, relay_request);
+}
+
+static int relay_readable(su_root_magic_t *magic, su_wait_t *w, su_wakeup_arg_t *arg) {
+    shard_t *s = (shard_t *)magic;
+
+    (void)w;
+    (void)arg;
+    return shard_receive(s, s->relay_fd, s->public_fd, handle_response);
+}
+
+// Callback del nua de cada shard: solo ve las llamadas cuyo Call-ID es suyo
+static void shard_callback(nua_event_t event, int status, const char *phrase, nua_t *nua, void *context,
+                           nua_handle_t *nh, void *param, const struct sip_s *sip, tagi_t *tags)
+{
+    shard_t *s = (shard_t *)context;
+    int state = nua_callstate_init;
+
+    (void)phrase;
+    (void)nua;
+    (void)param;
+    if (event == nua_i_invite) {
+        count(s, ST_CALLS);
+        nua_respond(nh, SIP_180_RINGING, TAG_END());
+        // El Contact público hace que el ACK y el BYE entren por el front end
+        nua_respond(nh, SIP_200_OK, SIPTAG_CONTACT(s->contact), TAG_END());
+    } else if (event == nua_i_bye) {
+        count(s, ST_HANGUPS); // nua responde 200 al BYE por su cuenta
+    } else if (event == nua_i_message) {
+        count(s, ST_MESSAGES);
+        nua_respond(nh, SIP_200_OK, TAG_END());
+        nua_handle_destroy(nh);
+    } else if (event == nua_i_register) {
+        nua_respond(nh, SIP_200_OK, SIPTAG_CONTACT(sip ? sip->sip_contact : NULL), TAG_END());
+        nua_handle_destroy(nh);
+    } else if (event == nua_i_options) {
+        nua_handle_destroy(nh); // nua ya respondió 200
+    } else if (event == nua_i_state) {
+        // Llamada terminada (BYE, ACK que no llegó o refresco de sesión sin respuesta)
+        tl_gets(tags, NUTAG_CALLSTATE_REF(state), TAG_END());
+        if (state == nua_callstate_terminated)
+            nua_handle_destroy(nh);
+    } else if (event == nua_r_shutdown && status >= 200) {
+        su_root_break(s->root);
+    }
+}
+
+static void shard_tick(su_root_magic_t *magic, su_timer_t *t, su_timer_arg_t *arg) {
+    // su_root_break no se puede llamar desde otro hilo: cada shard mira la señal en su bucle
+    shard_t *s = (shard_t *)arg;
+
+    (void)magic;
+    (void)t;
+    if (stop_requested && s->nua) {
+        su_timer_reset(s->tick);
+        nua_shutdown(s->nua);
+    }
+}
+
+static int register_fd(shard_t *s, int fd, su_wakeup_f callback) {
+    su_wait_t wait[1];
+
+    if (su_wait_create(wait, fd, SU_WAIT_IN) != 0)
+        return -1;
+    return su_root_register(s->root, wait, callback, NULL, 0) > 0 ? 0 : -1;
+}
+
+static int shard_start(shard_t *s) {
+    /*
+    El su_root pertenece al hilo que lo crea, así que el root, el nua, el
+    timer y los registros de los sockets se crean aquí, en el hilo del shard.
+    El nua va el último: una vez creado ya nada puede fallar, y un nua solo
+    se puede destruir después de que nua_shutdown haya terminado.
+    */
+    char url[64];
+    char contact[64];
+
+    su_home_init(s->home);
+    snprintf(url, sizeof(url), "sip:%s:%d;transport=udp", public_host, nua_base_port + s->index);
+    snprintf(contact, sizeof(contact), "<sip:%s:%d>", public_host, sip_port);
+    s->contact = sip_contact_make(s->home, contact);
+    s->root = su_root_create((su_root_magic_t *)s);
+    if (!s->root || !s->contact)
+        return -1;
+    s->tick = su_timer_create(su_root_task(s->root), TICK_MS);
+    if (!s->tick || su_timer_run(s->tick, shard_tick, s) != 0)
+        return -1;
+    if (register_fd(s, s->public_fd, public_readable) != 0 || register_fd(s, s->relay_fd, relay_readable) != 0)
+        return -1;
+    s->nua = nua_create(s->root, shard_callback, s,
+                        NUTAG_URL(url),
+                        NUTAG_ALLOW("REGISTER"),
+                        NUTAG_APPL_METHOD("REGISTER"),
+                        // Sesión refrescada por este lado: si el cliente ya no contesta, nua cuelga
+                        NUTAG_SESSION_TIMER(SESSION_EXPIRES_S),
+                        NUTAG_SESSION_REFRESHER(nua_local_refresher),
+                        TAG_END());
+    return s->nua ? 0 : -1;
+}
+
+static void *shard_loop(void *arg) {
+    shard_t *s = (shard_t *)arg;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(s->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        fprintf(stderr, "shard %d: no se pudo fijar al núcleo %d\n", s->index, s->cpu);
+    s->failed = shard_start(s) != 0;
+    pthread_barrier_wait(&started);
+    if (!s->failed)
+        su_root_run(s->root);
+    if (s->tick)
+        su_timer_destroy(s->tick);
+    if (s->nua)
+        nua_destroy(s->nua);
+    if (s->root)
+        su_root_destroy(s->root);
+    su_home_deinit(s->home);
+    return NULL;
+}
+
+static int open_udp_socket(in_addr_t ip, int port, int reuseport) {
+    int one = 1;
+    int fd;
+    struct sockaddr_in address;
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ip;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void read_stats(shard_t *s, shard_stats_t *st) {
+    long *out = (long *)st;
+
+    for (int i = 0; i < (int)(sizeof(s->stats) / sizeof(s->stats[0])); ++i)
+        out[i] = atomic_load_explicit(&s->stats[i], memory_order_relaxed);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+int main(int argc, char **argv) {
+    /*
+    Uso: sharded_agent [puerto] [shards] [puerto base de los nua] [ip pública]
+    Arranca los shards y cada segundo imprime llamadas/s, MESSAGE/s y qué
+    parte de las peticiones ha ido al nua de otro shard. Con SIGINT o
+    SIGTERM cada shard cierra su nua y se imprimen los totales.
+    */
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    shard_stats_t prev = { 0 };
+    int failed = 0;
+
+    if (argc > 1)
+        sip_port = atoi(argv[1]);
+    num_shards = argc > 2 ? atoi(argv[2]) : cpus;
+    if (argc > 3)
+        nua_base_port = atoi(argv[3]);
+    public_ip.s_addr = htonl(INADDR_LOOPBACK);
+    if (argc > 4 && (inet_pton(AF_INET, argv[4], &public_ip) != 1 || public_ip.s_addr == htonl(INADDR_ANY))) {
+        fprintf(stderr, "IP pública no válida: %s (hace falta una dirección concreta para el Contact)\n", argv[4]);
+        return EXIT_FAILURE;
+    }
+    inet_ntop(AF_INET, &public_ip, public_host, sizeof(public_host));
+    if (num_shards < 1 || num_shards > MAX_SHARDS) {
+        fprintf(stderr, "Uso: %s [puerto] [shards 1-%d] [puerto base nua] [ip pública]\n", argv[0], MAX_SHARDS);
+        return EXIT_FAILURE;
+    }
+    shards = aligned_alloc(64, sizeof(shard_t) * num_shards);
+    if (!shards) {
+        perror("malloc shards failed");
+        return EXIT_FAILURE;
+    }
+    memset(shards, 0, sizeof(shard_t) * num_shards);
+    // Los sockets entran al grupo SO_REUSEPORT en orden: el socket i es el shard i
+    for (int i = 0; i < num_shards; ++i) {
+        shard_t *s = &shards[i];
+
+        s->index = i;
+        s->cpu = i % (cpus > 0 ? cpus : 1);
+        for (int j = 0; j < (int)(sizeof(s->stats) / sizeof(s->stats[0])); ++j)
+            atomic_init(&s->stats[j], 0);
+        s->public_fd = open_udp_socket(public_ip.s_addr, sip_port, 1);
+        s->relay_fd = open_udp_socket(public_ip.s_addr, 0, 0);
+        if (s->public_fd < 0 || s->relay_fd < 0) {
+            fprintf(stderr, "No se pudo crear el shard %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    sip_attach_cpu_steering(shards[0].public_fd, num_shards);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    su_init();
+    pthread_barrier_init(&started, NULL, num_shards + 1);
+    for (int i = 0; i < num_shards; ++i)
+        pthread_create(&shards[i].thread, NULL, shard_loop, &shards[i]);
+    pthread_barrier_wait(&started);
+    for (int i = 0; i < num_shards; ++i) {
+        if (shards[i].failed) {
+            fprintf(stderr, "No se pudo crear el su_root/nua del shard %d (puerto %d)\n", i, nua_base_port + i);
+            failed = 1;
+        }
+    }
+    if (failed) {
+        stop_requested = 1;
+    } else {
+        printf("Agente repartido (%d shards, %d núcleos) en %s:%d, nua en los puertos %d-%d\n", num_shards, cpus,
+               public_host, sip_port, nua_base_port, nua_base_port + num_shards - 1);
+    }
+
+    while (!stop_requested) {
+        shard_stats_t total = { 0 };
+        shard_stats_t st;
+
+        sleep(1);
+        for (int i = 0; i < num_shards; ++i) {
+            read_stats(&shards[i], &st);
+            total.received += st.received;
+            total.relayed += st.relayed;
+            total.calls += st.calls;
+            total.messages += st.messages;
+            total.dropped += st.dropped;
+        }
+        if (total.received != prev.received)
+            printf("%ld llamadas/s, %ld MESSAGE/s, %ld peticiones/s, %.1f%% a otro shard, %ld descartadas\n",
+                   total.calls - prev.calls, total.messages - prev.messages, total.received - prev.received,
+                   100.0 * (total.relayed - prev.relayed) / (total.received - prev.received),
+                   total.dropped - prev.dropped);
+        fflush(stdout);
+        prev = total;
+    }
+    for (int i = 0; i < num_shards; ++i)
+        pthread_join(shards[i].thread, NULL);
+    if (!failed) {
+        printf("\n%-6s %12s %12s %12s %10s %10s %10s %10s\n", "shard", "recibidas", "a otro", "respuestas",
+               "llamadas", "colgadas", "MESSAGE", "descartes");
+        for (int i = 0; i < num_shards; ++i) {
+            shard_stats_t st;
+            read_stats(&shards[i], &st);
+            printf("%-6d %12ld %12ld %12ld %10ld %10ld %10ld %10ld\n", i, st.received, st.relayed, st.responses,
+                   st.calls, st.hangups, st.messages, st.dropped);
+        }
+    }
+    pthread_barrier_destroy(&started);
+    su_deinit();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+Compila: gcc -O2 sharded_agent.c -o sharded_agent $(pkg-config --cflags --libs sofia-sip-ua) -lpthread
+Ejecuta: ./sharded_agent [puerto] [shards] [puerto base nua] [ip pública]
+(sip_steering.h está en este mismo directorio)
+Escalado: con la misma carga, de 1 a N shards:
+    ./sharded_agent 5060 1 &             ./sipload invite 20000 10 4
+    ./sharded_agent 5060 4 &             ./sipload invite 20000 10 4
+Explicación:
+    -Un su_root y un nua por Núcleo:
+        demo2-demo5 y miniserver ejecutan un solo su_root_t con un solo nua_t
+        en un hilo, así que la señalización no pasa de un núcleo. Aquí cada
+        shard es un hilo fijado a su núcleo que crea su propio su_root y su
+        propio nua, escuchando en un puerto propio de la IP pública. Los nua no
+        comparten transacciones, diálogos ni memoria: cada uno atiende solo
+        las llamadas cuyo Call-ID le toca.
+
+    -Front End con SO_REUSEPORT:
+        El puerto público es un grupo SO_REUSEPORT con un socket por shard,
+        registrado con su_root_register en el bucle del propio shard. El
+        kernel elige el socket (con el programa cBPF, el del núcleo que
+        recibió el paquete), y el front end reenvía la petición al nua del
+        dueño, hash(Call-ID) % N, dentro de la máquina. Así el INVITE, el ACK y el
+        BYE de una llamada llegan al mismo nua aunque entren por sockets
+        distintos. Los datagramas se leen con recvmmsg y se reenvían con un
+        sendmmsg por lote.
+
+    -Vuelta de las Respuestas:
+        nua no tiene una entrada pública para inyectarle un datagrama, y
+        responde según la Via. Por eso el front end añade a la primera Via
+        un parámetro fe con la dirección del cliente y fuerza rport: el nua
+        responde al socket de relevo del front end que reenvió, y éste quita
+        fe, rport y received (o los pone con la dirección del cliente si él
+        había pedido rport) y envía la respuesta desde el puerto público.
+        El Contact del 200 al INVITE es la IP y el puerto públicos, para que
+        las peticiones dentro del diálogo también entren por el front end.
+        Las peticiones que el propio nua origina hacia el cliente (el BYE
+        o el refresco de sesión) salen directamente por su propio puerto;
+        por eso los nua escuchan en la IP pública y no en loopback, que no
+        llegaría a un cliente de otra máquina. La IP pública se da como
+        argumento: con INADDR_ANY no habría una dirección que poner en el
+        Contact.
+
+    -Fin de las Llamadas:
+        Los handles se destruyen cuando nua da la llamada por terminada.
+        nua cuelga él mismo si el ACK no llega, y con el temporizador de
+        sesión (1800 s, refrescado por este lado) también las llamadas cuyo
+        cliente desapareció sin BYE.
+
+    -Frente a udp_shard_proto:
+        udp_shard_proto mide el reparto con un UAS mínimo sobre UDP crudo y
+        pasa los datagramas por buzones sin locks. Aquí el trabajo SIP lo
+        hace Sofia, así que el salto al dueño es un datagrama local hacia el
+        puerto de su nua.
+*/
@@ -0,0 +1,53 @@
+#ifndef SIP_STEERING_H
+#define SIP_STEERING_H
+
+#include <linux/filter.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+/*
+Reparto de llamadas SIP entre shards, común a udp_shard_proto y
+sharded_agent.
+
+- sip_callid_hash: el dueño de una llamada es sip_callid_hash(Call-ID) % N,
+    así que INVITE, ACK y BYE acaban siempre en el mismo shard.
+- sip_attach_cpu_steering: dentro del grupo SO_REUSEPORT, el socket que
+    recibe es el del núcleo que recibió el paquete, para que el primer salto
+    ya esté en ese núcleo.
+*/
+
+static inline uint64_t sip_callid_hash(const char *p, int len) {
+    // FNV-1a de 64 bits con mezcla final: el módulo elige shard y los bits bajos la ranura. Nunca 0
+    uint64_t h = 1469598103934665603ULL;
+
+    for (int i = 0; i < len; ++i) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+static inline void sip_attach_cpu_steering(int fd, int count_sockets) {
+    /*
+    Programa cBPF del grupo SO_REUSEPORT: índice de socket = núcleo que
+    recibió el paquete % número de shards. Los sockets tienen que haber
+    entrado al grupo en orden de shard. Sin él (kernel antiguo) el kernel
+    reparte por hash de la 4-tupla, y el reparto por Call-ID sigue
+    funcionando igual.
+    */
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)count_sockets },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog = { .len = sizeof(code) / sizeof(code[0]), .filter = code };
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+        perror("setsockopt SO_ATTACH_REUSEPORT_CBPF failed (reparto por 4-tupla)");
+}
+
+#endif
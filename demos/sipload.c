@@ -0,0 +1,660 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+Generador de carga SIP sobre UDP en loopback: reproduce un escenario a una
+tasa fija (bucle abierto) y mide llamadas/s, latencia de cada transacción y
+fallos. Sirve contra miniserver, udp_shard_proto o cualquier UAS local.
+
+- Escenarios:
+    register  REGISTER -> 200
+    message   MESSAGE -> 200/202
+    invite    INVITE -> (1xx) -> 200 -> ACK, BYE -> 200
+- Cada hilo tiene su socket UDP conectado al servidor y su tabla de
+    llamadas; no comparten nada hasta juntar los resultados al final.
+- La llamada se identifica por su Call-ID (sl-<hilo>-<hueco>-<generación>),
+    así que una respuesta se asocia a su hueco sin tabla hash, y las
+    respuestas tardías de una llamada ya cerrada se descartan por la
+    generación.
+- Bucle abierto: las llamadas se inician a su hora aunque el servidor se
+    retrase, para que la latencia medida incluya la cola del servidor.
+- Las peticiones se retransmiten como en el temporizador A de SIP (500 ms,
+    1 s, 2 s...) y la transacción falla por timeout a los TXN_TIMEOUT_MS.
+*/
+
+#define SIP_PORT 5060
+#define DEFAULT_RATE 1000          // llamadas por segundo
+#define DEFAULT_SECONDS 10
+#define DEFAULT_THREADS 2
+#define MAX_THREADS 64
+#define MAX_CALLS 16384            // llamadas en curso por hilo
+#define MAX_SAMPLES (1 << 18)      // muestras de latencia por hilo y tipo de transacción
+#define SIP_MAX_DATAGRAM 2048
+#define RECV_BATCH 32
+#define T1_NS 500000000ULL         // primera retransmisión
+#define T2_NS 4000000000ULL        // tope del intervalo de retransmisión
+#define TXN_TIMEOUT_MS 8000
+#define TIMER_SCAN_NS 10000000ULL  // cada cuánto se revisan retransmisiones y timeouts
+#define DRAIN_SECONDS 10           // espera máxima a las llamadas en curso al acabar
+#define TAG_MAX 64
+
+typedef enum {
+    SCENARIO_REGISTER,
+    SCENARIO_MESSAGE,
+    SCENARIO_INVITE
+} scenario_t;
+
+typedef enum {
+    CALL_IDLE,
+    CALL_REGISTER,
+    CALL_MESSAGE,
+    CALL_INVITE,
+    CALL_BYE
+} call_state_t;
+
+enum {
+    TXN_REGISTER,
+    TXN_MESSAGE,
+    TXN_PDD,                       // INVITE -> primera respuesta 18x
+    TXN_INVITE,                    // INVITE -> respuesta final
+    TXN_BYE,
+    TXN_TYPES
+};
+
+static const char *txn_names[TXN_TYPES] = { "REGISTER", "MESSAGE", "INVITE->18x", "INVITE->final", "BYE" };
+
+typedef struct {
+    uint32_t gen;
+    call_state_t state;
+    uint64_t t0;                   // primer envío de la transacción en curso
+    uint64_t next_retx;
+    uint64_t retx_interval;
+    int got_provisional;
+    char to_tag[TAG_MAX];
+} call_t;
+
+typedef struct {
+    int index;
+    int fd;
+    int port;
+    int local_port;
+    scenario_t scenario;
+    double rate;
+    double seconds;
+    call_t *calls;
+    int *free_slots;
+    int nfree;
+    uint64_t *samples[TXN_TYPES];
+    size_t nsamples[TXN_TYPES];
+    size_t dropped[TXN_TYPES];     // muestras que no cupieron en MAX_SAMPLES
+    long started;
+    long completed;
+    long failed;
+    long timeouts;
+    long rejected;                 // respuesta final >= 300
+    long no_slot;                  // llamadas que no se iniciaron: tabla llena
+    long retransmits;
+    long stray;                    // respuestas sin llamada (tardías o ajenas)
+    uint64_t start_ns;
+    uint64_t end_ns;               // última llamada terminada
+    pthread_t thread;
+} load_thread_t;
+
+typedef struct {
+    int status;
+    int cseq;
+    const char *cseq_method;
+    const char *call_id;
+    int call_id_len;
+    const char *to_tag;
+    int to_tag_len;
+} sip_response_t;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void record(load_thread_t *t, int txn, uint64_t ns) {
+    if (t->nsamples[txn] < MAX_SAMPLES)
+        t->samples[txn][t->nsamples[txn]++] = ns;
+    else
+        t->dropped[txn]++;
+}
+
+// Peticiones
+static int build_request(load_thread_t *t, int slot, const char *method, int cseq, int ack_2xx, char *buf) {
+    /*
+    Una petición del escenario para el hueco 'slot'. Branch, tag y Call-ID
+    salen de (hilo, hueco, generación), así que una retransmisión es
+    idéntica al primer envío. El ACK de un 2xx es una transacción nueva
+    (branch propio); el de una respuesta de error reutiliza el del INVITE.
+    */
+    call_t *c = &t->calls[slot];
+    const char *body = strcmp(method, "MESSAGE") == 0 ? "sipload" : "";
+    int n;
+
+    n = snprintf(buf, SIP_MAX_DATAGRAM,
+                 "%s sip:service@127.0.0.1:%d SIP/2.0\r\n"
+                 "Via: SIP/2.0/UDP 127.0.0.1:%d;branch=z9hG4bK-%d-%d-%u-%d%s;rport\r\n"
+                 "Max-Forwards: 70\r\n"
+                 "From: <sip:sipload-%d-%d@127.0.0.1>;tag=%d-%d-%u\r\n"
+                 "To: <sip:%s@127.0.0.1>%s%s\r\n"
+                 "Call-ID: sl-%d-%d-%u@127.0.0.1\r\n"
+                 "CSeq: %d %s\r\n"
+                 "Contact: <sip:sipload-%d-%d@127.0.0.1:%d>\r\n",
+                 method, t->port,
+                 t->local_port, t->index, slot, c->gen, cseq, ack_2xx ? "-ack" : "",
+                 t->index, slot, t->index, slot, c->gen,
+                 strcmp(method, "REGISTER") == 0 ? "sipload" : "service", c->to_tag[0] ? ";tag=" : "", c->to_tag,
+                 t->index, slot, c->gen,
+                 cseq, method,
+                 t->index, slot, t->local_port);
+    if (strcmp(method, "REGISTER") == 0)
+        n += snprintf(buf + n, SIP_MAX_DATAGRAM - n, "Expires: 3600\r\n");
+    if (body[0])
+        n += snprintf(buf + n, SIP_MAX_DATAGRAM - n, "Content-Type: text/plain\r\n");
+    n += snprintf(buf + n, SIP_MAX_DATAGRAM - n, "Content-Length: %d\r\n\r\n%s", (int)strlen(body), body);
+    return n;
+}
+
+static void send_request(load_thread_t *t, int slot, const char *method, int cseq, int ack_2xx) {
+    char buf[SIP_MAX_DATAGRAM];
+    int n = build_request(t, slot, method, cseq, ack_2xx, buf);
+
+    // UDP: si el envío falla, lo recupera la retransmisión
+    if (send(t->fd, buf, n, 0) < 0 && errno != EAGAIN && errno != ECONNREFUSED)
+        perror("send failed");
+}
+
+static void resend_current(load_thread_t *t, int slot) {
+    switch (t->calls[slot].state) {
+    case CALL_REGISTER:
+        send_request(t, slot, "REGISTER", 1, 0);
+        break;
+    case CALL_MESSAGE:
+        send_request(t, slot, "MESSAGE", 1, 0);
+        break;
+    case CALL_INVITE:
+        send_request(t, slot, "INVITE", 1, 0);
+        break;
+    case CALL_BYE:
+        send_request(t, slot, "BYE", 2, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+static void start_txn(load_thread_t *t, int slot, call_state_t state, uint64_t now) {
+    call_t *c = &t->calls[slot];
+
+    c->state = state;
+    c->t0 = now;
+    c->retx_interval = T1_NS;
+    c->next_retx = now + T1_NS;
+    resend_current(t, slot);
+}
+
+static void start_call(load_thread_t *t, uint64_t now) {
+    int slot;
+    call_t *c;
+
+    if (t->nfree == 0) {
+        t->no_slot++;
+        return;
+    }
+    slot = t->free_slots[--t->nfree];
+    c = &t->calls[slot];
+    c->gen++;
+    c->got_provisional = 0;
+    c->to_tag[0] = 0;
+    t->started++;
+    if (t->scenario == SCENARIO_REGISTER)
+        start_txn(t, slot, CALL_REGISTER, now);
+    else if (t->scenario == SCENARIO_MESSAGE)
+        start_txn(t, slot, CALL_MESSAGE, now);
+    else
+        start_txn(t, slot, CALL_INVITE, now);
+}
+
+static void end_call(load_thread_t *t, int slot, int ok, uint64_t now) {
+    t->calls[slot].state = CALL_IDLE;
+    t->free_slots[t->nfree++] = slot;
+    if (ok)
+        t->completed++;
+    else
+        t->failed++;
+    t->end_ns = now;
+}
+
+// Respuestas
+static int parse_response(const char *data, int len, sip_response_t *res) {
+    /*
+    Saca de una respuesta el código, Call-ID, CSeq y la etiqueta del To
+    (formas largas y compactas). Retorna 0 si tiene todo lo necesario.
+    */
+    const char *end = data + len;
+    const char *line;
+    const char *eol;
+
+    memset(res, 0, sizeof(*res));
+    if (len < 12 || memcmp(data, "SIP/2.0 ", 8) != 0)
+        return -1;
+    res->status = atoi(data + 8);
+    eol = memchr(data, '\n', len);
+    for (line = eol ? eol + 1 : end; line < end; line = eol + 1) {
+        const char *colon;
+        const char *v;
+        int name_len;
+
+        eol = memchr(line, '\n', end - line);
+        if (!eol)
+            eol = end;
+        if (eol - line <= 1)
+            break;
+        colon = memchr(line, ':', eol - line);
+        if (!colon)
+            continue;
+        name_len = (int)(colon - line);
+        while (name_len > 0 && line[name_len - 1] == ' ')
+            name_len--;
+        for (v = colon + 1; v < eol && *v == ' '; ++v)
+            ;
+        if ((name_len == 7 && strncasecmp(line, "Call-ID", 7) == 0) || (name_len == 1 && (line[0] | 0x20) == 'i')) {
+            res->call_id = v;
+            res->call_id_len = (int)(eol - v);
+            while (res->call_id_len > 0 && (v[res->call_id_len - 1] == '\r' || v[res->call_id_len - 1] == ' '))
+                res->call_id_len--;
+        } else if (name_len == 4 && strncasecmp(line, "CSeq", 4) == 0) {
+            char *m;
+            res->cseq = (int)strtol(v, &m, 10);
+            while (*m == ' ')
+                m++;
+            res->cseq_method = m;
+        } else if ((name_len == 2 && strncasecmp(line, "To", 2) == 0) || (name_len == 1 && (line[0] | 0x20) == 't')) {
+            const char *tag = memmem(v, eol - v, ";tag=", 5);
+            if (tag) {
+                tag += 5;
+                res->to_tag = tag;
+                while (tag < eol && *tag != ';' && *tag != '\r' && *tag != ' ' && *tag != '>')
+                    tag++;
+                res->to_tag_len = (int)(tag - res->to_tag);
+            }
+        }
+    }
+    return res->status > 0 && res->call_id && res->cseq_method ? 0 : -1;
+}
+
+static int cseq_is(const sip_response_t *res, const char *method) {
+    return strncmp(res->cseq_method, method, strlen(method)) == 0;
+}
+
+static void handle_response(load_thread_t *t, const char *data, int len, uint64_t now) {
+    /*
+    Avanza la llamada a la que pertenece la respuesta:
+    - REGISTER / MESSAGE: la final cierra la llamada.
+    - INVITE: la primera 18x mide el post-dial delay; la 200 se confirma con
+        ACK y se cuelga con BYE; una final de error se confirma con ACK y la
+        llamada cuenta como rechazada.
+    - Una 200 del INVITE retransmitida (el ACK se perdió) recibe otro ACK.
+    - BYE: la final cierra la llamada.
+    */
+    sip_response_t res;
+    int thread, slot;
+    unsigned gen;
+    call_t *c;
+
+    if (parse_response(data, len, &res) != 0 ||
+        sscanf(res.call_id, "sl-%d-%d-%u@", &thread, &slot, &gen) != 3 ||
+        thread != t->index || slot < 0 || slot >= MAX_CALLS || t->calls[slot].gen != gen) {
+        t->stray++;
+        return;
+    }
+    c = &t->calls[slot];
+    if (c->state == CALL_IDLE) {
+        t->stray++;
+        return;
+    }
+    if (res.status < 200) {
+        if (c->state == CALL_INVITE && cseq_is(&res, "INVITE") && res.status >= 180 && !c->got_provisional) {
+            c->got_provisional = 1;
+            record(t, TXN_PDD, now - c->t0);
+        }
+        // Con una provisional el cliente deja de retransmitir el INVITE (temporizador A)
+        if (c->state == CALL_INVITE)
+            c->next_retx = UINT64_MAX;
+        return;
+    }
+    switch (c->state) {
+    case CALL_REGISTER:
+    case CALL_MESSAGE:
+        if (!cseq_is(&res, c->state == CALL_REGISTER ? "REGISTER" : "MESSAGE"))
+            return;
+        record(t, c->state == CALL_REGISTER ? TXN_REGISTER : TXN_MESSAGE, now - c->t0);
+        if (res.status >= 300)
+            t->rejected++;
+        end_call(t, slot, res.status < 300, now);
+        break;
+    case CALL_INVITE:
+        if (!cseq_is(&res, "INVITE"))
+            return;
+        record(t, TXN_INVITE, now - c->t0);
+        if (res.to_tag && res.to_tag_len < TAG_MAX) {
+            memcpy(c->to_tag, res.to_tag, res.to_tag_len);
+            c->to_tag[res.to_tag_len] = 0;
+        }
+        if (res.status >= 300) {
+            send_request(t, slot, "ACK", 1, 0);
+            t->rejected++;
+            end_call(t, slot, 0, now);
+            return;
+        }
+        send_request(t, slot, "ACK", 1, 1);
+        start_txn(t, slot, CALL_BYE, now);
+        break;
+    case CALL_BYE:
+        if (cseq_is(&res, "INVITE")) {
+            send_request(t, slot, "ACK", 1, 1);
+            return;
+        }
+        if (!cseq_is(&res, "BYE"))
+            return;
+        record(t, TXN_BYE, now - c->t0);
+        if (res.status >= 300)
+            t->rejected++;
+        end_call(t, slot, res.status < 300, now);
+        break;
+    default:
+        break;
+    }
+}
+
+static void receive_all(load_thread_t *t) {
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iov[RECV_BATCH];
+    static __thread char bufs[RECV_BATCH][SIP_MAX_DATAGRAM];
+
+    for (int i = 0; i < RECV_BATCH; ++i) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = SIP_MAX_DATAGRAM;
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (;;) {
+        int n = recvmmsg(t->fd, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+        uint64_t now = monotonic_ns();
+        if (n <= 0)
+            return; // EAGAIN, o ECONNREFUSED si el servidor no escucha: lo cubren los timeouts
+        for (int i = 0; i < n; ++i)
+            handle_response(t, bufs[i], (int)msgs[i].msg_len, now);
+        if (n < RECV_BATCH)
+            return;
+    }
+}
+
+static void check_timers(load_thread_t *t, uint64_t now) {
+    // Retransmisiones (intervalo doble hasta T2) y transacciones caducadas
+    for (int slot = 0; slot < MAX_CALLS; ++slot) {
+        call_t *c = &t->calls[slot];
+        if (c->state == CALL_IDLE)
+            continue;
+        if (now - c->t0 >= (uint64_t)TXN_TIMEOUT_MS * 1000000ULL) {
+            t->timeouts++;
+            end_call(t, slot, 0, now);
+        } else if (now >= c->next_retx) {
+            resend_current(t, slot);
+            t->retransmits++;
+            c->retx_interval = c->retx_interval * 2 < T2_NS ? c->retx_interval * 2 : T2_NS;
+            c->next_retx = now + c->retx_interval;
+        }
+    }
+}
+
+static void *load_thread(void *arg) {
+    /*
+    Hilo del generador: inicia una llamada cada 'interval' ns durante
+    'seconds' (las que tocan se inician aunque el bucle vaya con retraso),
+    lee respuestas por lotes y revisa temporizadores cada TIMER_SCAN_NS.
+    Al acabar espera hasta DRAIN_SECONDS a las llamadas en curso.
+    */
+    load_thread_t *t = (load_thread_t *)arg;
+    uint64_t interval = (uint64_t)(1e9 / t->rate);
+    uint64_t now = monotonic_ns();
+    uint64_t next_start = now;
+    uint64_t next_scan = now + TIMER_SCAN_NS;
+    uint64_t stop = now + (uint64_t)(t->seconds * 1e9);
+    uint64_t drain_until = stop + (uint64_t)DRAIN_SECONDS * 1000000000ULL;
+    struct pollfd pfd = { .fd = t->fd, .events = POLLIN };
+
+    t->start_ns = now;
+    t->end_ns = now;
+    for (;;) {
+        uint64_t wake;
+        struct timespec ts;
+
+        now = monotonic_ns();
+        while (now < stop && next_start <= now) {
+            start_call(t, now);
+            next_start += interval;
+        }
+        if (now >= next_scan) {
+            check_timers(t, now);
+            next_scan = now + TIMER_SCAN_NS;
+        }
+        if (now >= stop && (t->nfree == MAX_CALLS || now >= drain_until))
+            break;
+        wake = next_scan;
+        if (now < stop && next_start < wake)
+            wake = next_start;
+        wake = wake > now ? wake - now : 0;
+        ts.tv_sec = wake / 1000000000ULL;
+        ts.tv_nsec = wake % 1000000000ULL;
+        if (ppoll(&pfd, 1, &ts, NULL) > 0)
+            receive_all(t);
+    }
+    return NULL;
+}
+
+static int open_socket(load_thread_t *t) {
+    // Socket conectado: send/recv sin dirección y el kernel filtra lo que no viene del servidor
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int size = 4 << 20;
+
+    t->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (t->fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    setsockopt(t->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    setsockopt(t->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(t->port);
+    if (connect(t->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(t->fd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("connect failed");
+        close(t->fd);
+        return -1;
+    }
+    t->local_port = ntohs(addr.sin_port);
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(const char *name, uint64_t *all, size_t n, size_t dropped) {
+    if (n == 0)
+        return;
+    qsort(all, n, sizeof(uint64_t), cmp_u64);
+    printf("%-14s %9zu %10.1f %10.1f %10.1f %10.1f %10.1f %10zu\n", name, n, all[n / 2] / 1e3,
+           all[n * 90 / 100] / 1e3, all[n * 99 / 100] / 1e3, all[n * 999 / 1000] / 1e3, all[n - 1] / 1e3, dropped);
+}
+
+static void print_results(load_thread_t *threads, int nthreads, scenario_t scenario, double rate) {
+    long started = 0, completed = 0, failed = 0, timeouts = 0, rejected = 0, no_slot = 0, retx = 0, stray = 0;
+    size_t total_dropped = 0;
+    uint64_t start_ns = UINT64_MAX, end_ns = 0;
+    double seconds;
+
+    for (int i = 0; i < nthreads; ++i) {
+        load_thread_t *t = &threads[i];
+        started += t->started;
+        completed += t->completed;
+        failed += t->failed;
+        timeouts += t->timeouts;
+        rejected += t->rejected;
+        no_slot += t->no_slot;
+        retx += t->retransmits;
+        stray += t->stray;
+        if (t->start_ns < start_ns)
+            start_ns = t->start_ns;
+        if (t->end_ns > end_ns)
+            end_ns = t->end_ns;
+    }
+    seconds = end_ns > start_ns ? (end_ns - start_ns) / 1e9 : 0.0;
+    printf("\nEscenario %s: tasa objetivo %.0f llamadas/s, %d hilos\n",
+           scenario == SCENARIO_REGISTER ? "register" : scenario == SCENARIO_MESSAGE ? "message" : "invite", rate,
+           nthreads);
+    printf("Llamadas: %ld iniciadas, %ld completadas (%.0f llamadas/s), %ld fallidas "
+           "(%ld timeouts, %ld rechazadas), %ld sin hueco\n",
+           started, completed, seconds > 0 ? completed / seconds : 0.0, failed, timeouts, rejected, no_slot);
+    printf("Retransmisiones: %ld, respuestas sin llamada: %ld\n\n", retx, stray);
+    printf("%-14s %9s %10s %10s %10s %10s %10s %10s\n", "transacción", "n", "p50 us", "p90 us", "p99 us",
+           "p99.9 us", "max us", "perdidas");
+    for (int txn = 0; txn < TXN_TYPES; ++txn) {
+        size_t total = 0, dropped = 0;
+        uint64_t *all;
+
+        for (int i = 0; i < nthreads; ++i) {
+            total += threads[i].nsamples[txn];
+            dropped += threads[i].dropped[txn];
+        }
+        total_dropped += dropped;
+        if (total == 0 || !(all = malloc(sizeof(uint64_t) * total)))
+            continue;
+        total = 0;
+        for (int i = 0; i < nthreads; ++i) {
+            memcpy(all + total, threads[i].samples[txn], sizeof(uint64_t) * threads[i].nsamples[txn]);
+            total += threads[i].nsamples[txn];
+        }
+        print_percentiles(txn_names[txn], all, total, dropped);
+        free(all);
+    }
+    if (total_dropped > 0)
+        printf("\nAviso: %zu muestras no cupieron (%d por hilo y transacción); los percentiles solo cubren las "
+               "primeras. Sube MAX_SAMPLES o usa más hilos\n",
+               total_dropped, MAX_SAMPLES);
+}
+
+int main(int argc, char **argv) {
+    scenario_t scenario;
+    double rate = argc > 2 ? atof(argv[2]) : DEFAULT_RATE;
+    double seconds = argc > 3 ? atof(argv[3]) : DEFAULT_SECONDS;
+    int nthreads = argc > 4 ? atoi(argv[4]) : DEFAULT_THREADS;
+    int port = argc > 5 ? atoi(argv[5]) : SIP_PORT;
+    load_thread_t *threads;
+
+    if (argc < 2 || rate <= 0 || seconds <= 0 || nthreads < 1 || nthreads > MAX_THREADS) {
+        fprintf(stderr, "Uso: %s <register|message|invite> [llamadas/s] [segundos] [hilos] [puerto]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "register") == 0) {
+        scenario = SCENARIO_REGISTER;
+    } else if (strcmp(argv[1], "message") == 0) {
+        scenario = SCENARIO_MESSAGE;
+    } else if (strcmp(argv[1], "invite") == 0) {
+        scenario = SCENARIO_INVITE;
+    } else {
+        fprintf(stderr, "Escenario desconocido: %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    threads = calloc(nthreads, sizeof(load_thread_t));
+    if (!threads) {
+        perror("malloc threads failed");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        load_thread_t *t = &threads[i];
+        t->index = i;
+        t->port = port;
+        t->scenario = scenario;
+        t->rate = rate / nthreads;
+        t->seconds = seconds;
+        t->calls = calloc(MAX_CALLS, sizeof(call_t));
+        t->free_slots = malloc(sizeof(int) * MAX_CALLS);
+        for (int txn = 0; txn < TXN_TYPES; ++txn) {
+            t->samples[txn] = malloc(sizeof(uint64_t) * MAX_SAMPLES);
+            if (!t->samples[txn]) {
+                fprintf(stderr, "No se pudo reservar muestras para el hilo %d\n", i);
+                return EXIT_FAILURE;
+            }
+        }
+        if (!t->calls || !t->free_slots || open_socket(t) != 0) {
+            fprintf(stderr, "No se pudo preparar el hilo %d\n", i);
+            return EXIT_FAILURE;
+        }
+        for (int slot = 0; slot < MAX_CALLS; ++slot)
+            t->free_slots[t->nfree++] = MAX_CALLS - 1 - slot;
+    }
+    printf("sipload: %s a %.0f llamadas/s durante %.0f s contra 127.0.0.1:%d (%d hilos)\n", argv[1], rate, seconds,
+           port, nthreads);
+    for (int i = 0; i < nthreads; ++i)
+        pthread_create(&threads[i].thread, NULL, load_thread, &threads[i]);
+    for (int i = 0; i < nthreads; ++i)
+        pthread_join(threads[i].thread, NULL);
+    print_results(threads, nthreads, scenario, rate);
+    return 0;
+}
+
+/*
+Compila: gcc -O2 sipload.c -o sipload -lpthread
+Ejecuta: ./sipload <register|message|invite> [llamadas/s] [segundos] [hilos] [puerto]
+Ejemplos:
+    ./miniserver &                       ./sipload message 5000 10
+    ./udp_shard_proto 5060 4 &           ./sipload invite 20000 10 4
+Explicación:
+    -Bucle Abierto:
+        Cada hilo inicia sus llamadas a intervalos fijos (tasa / hilos) sin
+        esperar a que terminen las anteriores. Si el servidor se satura, las
+        llamadas se acumulan y la latencia lo refleja; un generador en bucle
+        cerrado bajaría la tasa y escondería la cola. Si un hilo llega a
+        MAX_CALLS llamadas en curso, las siguientes se cuentan como 'sin hueco'.
+
+    -Transacciones:
+        Se mide desde el primer envío de cada petición hasta su respuesta
+        final (y hasta la primera 18x para el post-dial delay del INVITE).
+        Las retransmisiones siguen el temporizador A de SIP (T1 = 500 ms,
+        doblando hasta T2 = 4 s); la transacción falla a los 8 s. Con la
+        primera provisional el INVITE deja de retransmitirse.
+
+    -Resultados:
+        Llamadas completadas por segundo, fallos (timeouts y respuestas de
+        error) y percentiles p50/p90/p99/p99.9/max por tipo de transacción.
+        Cada hilo guarda hasta MAX_SAMPLES muestras por transacción; las que
+        no caben se cuentan en la columna 'perdidas' y se avisa al final.
+        Todo va por loopback, así que se puede medir la capacidad de un
+        servidor local tras cada cambio.
+*/
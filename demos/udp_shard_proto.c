@@ -0,0 +1,781 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "sip_steering.h"
+
+/*
+Prototipo de reparto por shards sobre UDP crudo: N bucles de eventos
+independientes, uno por núcleo, sobre el mismo puerto UDP. No usa Sofia-SIP:
+cada shard responde con un UAS mínimo sin estado de transacción (200 a todo
+INVITE), sirve para medir el reparto y los buzones, no como agente SIP.
+
+- Cada shard tiene su socket (SO_REUSEPORT), su epoll y su tabla de
+    diálogos; no comparte nada con los demás salvo los buzones.
+- El kernel reparte los datagramas entre los sockets. Con el programa cBPF
+    de SO_ATTACH_REUSEPORT_CBPF el socket es el del núcleo que recibió el
+    paquete, así que el datagrama se atiende donde ya está en caché.
+- Dueño de una llamada: hash(Call-ID) % N. Todas las peticiones de una
+    llamada (INVITE, ACK, BYE) acaban en el mismo shard, así que la tabla
+    de diálogos no necesita locks.
+- Si un datagrama llega a un shard que no es el dueño, se copia al buzón
+    del dueño (anillo MPSC sin locks) y se le avisa por su eventfd, una vez
+    por lote y solo si no estaba ya avisado.
+- Las respuestas salen por el socket del shard que atiende: todos están en
+    el mismo puerto, el origen que ve el cliente es el mismo.
+- Los diálogos sin actividad caducan: sin ACK a los 64*T1, confirmados al
+    cabo del tiempo de sesión. Un BYE perdido no deja la entrada para siempre.
+*/
+
+#define SIP_PORT 5060
+#define MAX_SHARDS 64              // los avisos pendientes van en una máscara de 64 bits
+#define SIP_MAX_DATAGRAM 2048
+#define RECV_BATCH 32              // datagramas por recvmmsg
+#define RECV_ROUNDS 4              // recvmmsg por aviso de epoll antes de mirar el buzón
+#define OUT_BATCH 32               // respuestas por sendmmsg
+#define MAILBOX_SLOTS 1024         // potencia de 2
+#define DIALOG_SLOTS 32768         // potencia de 2, por shard
+#define CALLID_MAX 128
+#define MAX_VIA 8
+#define SIP_T1_MS 500
+#define DIALOG_EARLY_MS (64 * SIP_T1_MS)   // 200 sin ACK: el cliente ya dejó de retransmitir
+#define DIALOG_SESSION_MS (1800 * 1000)    // Session-Expires por defecto (RFC 4028)
+#define SWEEP_INTERVAL_MS 1000
+
+enum {
+    EV_SOCKET = 1,
+    EV_MAILBOX = 2
+};
+
+enum {
+    DLG_FREE = 0,
+    DLG_EARLY = 1,                 // 200 OK enviado, falta el ACK
+    DLG_CONFIRMED = 2
+};
+
+typedef struct {
+    const char *p;
+    int len;
+} sip_str_t;
+
+// Lo que hace falta de una petición para responderla sin estado
+typedef struct {
+    sip_str_t method;
+    sip_str_t uri;
+    sip_str_t call_id;
+    sip_str_t from;
+    sip_str_t to;
+    sip_str_t cseq;
+    sip_str_t via[MAX_VIA];
+    int via_count;
+    int to_has_tag;
+} sip_request_t;
+
+typedef struct {
+    atomic_size_t seq;
+    int len;
+    struct sockaddr_in from;
+    char data[SIP_MAX_DATAGRAM];
+} mail_slot_t;
+
+/*
+Buzón de un shard: anillo acotado de Vyukov con varios productores (los
+otros shards) y un consumidor (el dueño). El datagrama se copia en la
+ranura, así que reenviar no reserva memoria.
+*/
+typedef struct {
+    _Alignas(64) atomic_size_t tail;
+    _Alignas(64) size_t head;
+    _Alignas(64) atomic_int wake_pending;
+    int efd;
+    mail_slot_t *slots;
+} mailbox_t;
+
+typedef struct {
+    uint64_t hash;                 // 0: libre
+    uint64_t last_ms;              // última petición del diálogo (INVITE, ACK)
+    int state;
+    int callid_len;
+    char callid[CALLID_MAX];
+} dialog_t;
+
+typedef struct {
+    long received;                 // datagramas leídos del socket
+    long forwarded;                // enviados al buzón de otro shard
+    long from_mailbox;             // recibidos de otros shards
+    long dropped;                  // buzón lleno o datagrama inválido
+    long calls;                    // INVITE nuevos
+    long hangups;                  // BYE de diálogos existentes
+    long replies;
+    long expired;                  // diálogos caducados sin BYE
+} shard_stats_t;
+
+typedef struct {
+    int index;
+    int cpu;
+    int fd;
+    int epfd;
+    mailbox_t mailbox;
+    dialog_t *dialogs;
+    long dialog_count;
+    uint64_t now_ms;               // reloj de la vuelta actual del bucle
+    uint64_t next_sweep_ms;
+    uint64_t wake_mask;            // shards a los que avisar al acabar el lote
+    pthread_t thread;
+    // Lote de entrada
+    struct mmsghdr in_msgs[RECV_BATCH];
+    struct iovec in_iov[RECV_BATCH];
+    struct sockaddr_in in_addr[RECV_BATCH];
+    char in_buf[RECV_BATCH][SIP_MAX_DATAGRAM];
+    // Lote de salida
+    struct mmsghdr out_msgs[OUT_BATCH];
+    struct iovec out_iov[OUT_BATCH];
+    struct sockaddr_in out_addr[OUT_BATCH];
+    char out_buf[OUT_BATCH][SIP_MAX_DATAGRAM];
+    int out_count;
+    // Contadores: los escribe solo el shard, el hilo principal los lee
+    _Alignas(64) atomic_long stats[sizeof(shard_stats_t) / sizeof(long)];
+} shard_t;
+
+enum {
+    ST_RECEIVED,
+    ST_FORWARDED,
+    ST_FROM_MAILBOX,
+    ST_DROPPED,
+    ST_CALLS,
+    ST_HANGUPS,
+    ST_REPLIES,
+    ST_EXPIRED
+};
+
+static shard_t *shards;
+static int num_shards;
+static int sip_port = SIP_PORT;
+static volatile sig_atomic_t stop_requested;
+
+static void count(shard_t *s, int stat) {
+    // Un solo escritor: carga y almacenamiento relajados, sin instrucción con lock
+    atomic_store_explicit(&s->stats[stat], atomic_load_explicit(&s->stats[stat], memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Parser mínimo de peticiones SIP
+static sip_str_t trim(const char *p, const char *end) {
+    sip_str_t s;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        end--;
+    s.p = p;
+    s.len = (int)(end - p);
+    return s;
+}
+
+static int header_is(const char *name, int len, const char *full, const char *compact) {
+    return ((int)strlen(full) == len && strncasecmp(name, full, len) == 0) ||
+           (compact && len == 1 && (name[0] | 0x20) == compact[0]);
+}
+
+static int parse_request(const char *data, int len, sip_request_t *req) {
+    /*
+    Recorre la línea de petición y las cabeceras hasta la línea en blanco.
+    - Solo guarda punteros al datagrama: Via (todas), From, To, Call-ID y CSeq,
+        con sus formas compactas (v, f, t, i).
+    - Las respuestas (SIP/2.0 ...) y los datagramas sin Call-ID se rechazan.
+    Retorna 0 si la petición se puede atender.
+    */
+    const char *end = data + len;
+    const char *line = data;
+    const char *eol = memchr(line, '\n', len);
+    const char *sp;
+
+    memset(req, 0, sizeof(*req));
+    if (!eol || (len >= 7 && memcmp(data, "SIP/2.0", 7) == 0))
+        return -1;
+    sp = memchr(line, ' ', eol - line);
+    if (!sp || sp == line)
+        return -1;
+    req->method.p = line;
+    req->method.len = (int)(sp - line);
+    req->uri.p = sp + 1;
+    sp = memchr(req->uri.p, ' ', eol - req->uri.p);
+    if (!sp)
+        return -1;
+    req->uri.len = (int)(sp - req->uri.p);
+    for (line = eol + 1; line < end; line = eol + 1) {
+        const char *colon;
+        sip_str_t name;
+
+        eol = memchr(line, '\n', end - line);
+        if (!eol)
+            eol = end;
+        if (eol - line <= 1) // línea en blanco: empieza el cuerpo
+            break;
+        colon = memchr(line, ':', eol - line);
+        if (!colon)
+            continue;
+        name = trim(line, colon);
+        if (header_is(name.p, name.len, "Via", "v")) {
+            if (req->via_count < MAX_VIA)
+                req->via[req->via_count++] = trim(colon + 1, eol);
+        } else if (header_is(name.p, name.len, "From", "f")) {
+            req->from = trim(colon + 1, eol);
+        } else if (header_is(name.p, name.len, "To", "t")) {
+            req->to = trim(colon + 1, eol);
+            req->to_has_tag = memmem(req->to.p, req->to.len, ";tag=", 5) != NULL;
+        } else if (header_is(name.p, name.len, "Call-ID", "i")) {
+            req->call_id = trim(colon + 1, eol);
+        } else if (header_is(name.p, name.len, "CSeq", NULL)) {
+            req->cseq = trim(colon + 1, eol);
+        }
+    }
+    if (req->call_id.len <= 0 || req->call_id.len > CALLID_MAX || req->via_count == 0)
+        return -1;
+    return 0;
+}
+
+static int method_is(const sip_request_t *req, const char *method) {
+    return req->method.len == (int)strlen(method) && memcmp(req->method.p, method, req->method.len) == 0;
+}
+
+// Buzones entre shards
+static int mailbox_init(mailbox_t *mb) {
+    mb->slots = aligned_alloc(64, sizeof(mail_slot_t) * MAILBOX_SLOTS);
+    mb->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!mb->slots || mb->efd < 0)
+        return -1;
+    for (size_t i = 0; i < MAILBOX_SLOTS; ++i)
+        atomic_init(&mb->slots[i].seq, i);
+    atomic_init(&mb->tail, 0);
+    atomic_init(&mb->wake_pending, 0);
+    mb->head = 0;
+    return 0;
+}
+
+static int mailbox_push(mailbox_t *mb, const char *data, int len, const struct sockaddr_in *from) {
+    // Productor (cualquier shard): reserva la ranura con un CAS sobre tail. -1 si está lleno
+    size_t pos = atomic_load_explicit(&mb->tail, memory_order_relaxed);
+    mail_slot_t *slot;
+
+    for (;;) {
+        slot = &mb->slots[pos & (MAILBOX_SLOTS - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&mb->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&mb->tail, memory_order_relaxed);
+        }
+    }
+    memcpy(slot->data, data, len);
+    slot->len = len;
+    slot->from = *from;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return 0;
+}
+
+static void mailbox_wake(mailbox_t *mb) {
+    /*
+    Avisa al dueño si no tiene ya un aviso pendiente: un write al eventfd por
+    ráfaga, no por datagrama. El exchange va después de publicar las ranuras;
+    el dueño hace otro exchange antes de vaciar el buzón, así que o ve las
+    ranuras o recibe un aviso nuevo.
+    */
+    uint64_t one = 1;
+
+    if (atomic_exchange(&mb->wake_pending, 1) == 0 && write(mb->efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("write eventfd failed");
+}
+
+// Tabla de diálogos del shard: direccionamiento abierto con sondeo lineal
+static dialog_t *dialog_find(shard_t *s, uint64_t h, const sip_str_t *call_id) {
+    for (size_t i = h & (DIALOG_SLOTS - 1);; i = (i + 1) & (DIALOG_SLOTS - 1)) {
+        dialog_t *d = &s->dialogs[i];
+        if (d->hash == 0)
+            return NULL;
+        if (d->hash == h && d->callid_len == call_id->len && memcmp(d->callid, call_id->p, call_id->len) == 0)
+            return d;
+    }
+}
+
+static dialog_t *dialog_insert(shard_t *s, uint64_t h, const sip_str_t *call_id) {
+    // Se deja al menos un cuarto libre para que los sondeos sigan siendo cortos
+    size_t i = h & (DIALOG_SLOTS - 1);
+
+    if (s->dialog_count >= DIALOG_SLOTS * 3 / 4)
+        return NULL;
+    while (s->dialogs[i].hash != 0)
+        i = (i + 1) & (DIALOG_SLOTS - 1);
+    s->dialogs[i].hash = h;
+    s->dialogs[i].last_ms = s->now_ms;
+    s->dialogs[i].state = DLG_EARLY;
+    s->dialogs[i].callid_len = call_id->len;
+    memcpy(s->dialogs[i].callid, call_id->p, call_id->len);
+    s->dialog_count++;
+    return &s->dialogs[i];
+}
+
+static void dialog_erase(shard_t *s, dialog_t *d) {
+    // Borrado con desplazamiento hacia atrás: sin lápidas que alarguen los sondeos
+    size_t i = d - s->dialogs;
+    size_t j = i;
+
+    for (;;) {
+        j = (j + 1) & (DIALOG_SLOTS - 1);
+        if (s->dialogs[j].hash == 0)
+            break;
+        size_t home = s->dialogs[j].hash & (DIALOG_SLOTS - 1);
+        // j puede ocupar el hueco i si su posición natural no está entre i y j
+        if (((j - home) & (DIALOG_SLOTS - 1)) >= ((j - i) & (DIALOG_SLOTS - 1))) {
+            s->dialogs[i] = s->dialogs[j];
+            i = j;
+        }
+    }
+    s->dialogs[i].hash = 0;
+    s->dialogs[i].state = DLG_FREE;
+    s->dialog_count--;
+}
+
+static void dialog_sweep(shard_t *s) {
+    /*
+    Borra los diálogos sin actividad: los que no recibieron ACK en 64*T1 y
+    los confirmados que pasan del tiempo de sesión sin BYE. Tras un borrado
+    la ranura puede haber recibido otro diálogo por el desplazamiento, así
+    que se vuelve a mirar la misma.
+    */
+    for (size_t i = 0; i < DIALOG_SLOTS;) {
+        dialog_t *d = &s->dialogs[i];
+        uint64_t limit = d->state == DLG_EARLY ? DIALOG_EARLY_MS : DIALOG_SESSION_MS;
+
+        if (d->hash != 0 && s->now_ms - d->last_ms >= limit) {
+            dialog_erase(s, d);
+            count(s, ST_EXPIRED);
+            continue;
+        }
+        i++;
+    }
+}
+
+// Respuestas
+static void shard_flush(shard_t *s) {
+    int sent = 0;
+
+    while (sent < s->out_count) {
+        int n = sendmmsg(s->fd, s->out_msgs + sent, s->out_count - sent, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                perror("sendmmsg failed");
+            break; // UDP: lo que no sale lo recupera la retransmisión del cliente
+        }
+        sent += n;
+    }
+    s->out_count = 0;
+}
+
+static void shard_reply(shard_t *s, const sip_request_t *req, const struct sockaddr_in *to, int code,
+                        const char *reason, uint64_t h) {
+    /*
+    Respuesta sin estado: copia Via, From, Call-ID y CSeq de la petición.
+    El To lleva una etiqueta derivada del Call-ID (la misma en cada
+    retransmisión del INVITE) y el 200 del INVITE un Contact con la URI de
+    la petición, para que el ACK y el BYE vuelvan a este servidor.
+    */
+    char *out;
+    int n;
+    int cap = SIP_MAX_DATAGRAM;
+
+    if (s->out_count == OUT_BATCH)
+        shard_flush(s);
+    out = s->out_buf[s->out_count];
+    n = snprintf(out, cap, "SIP/2.0 %d %s\r\n", code, reason);
+    for (int i = 0; i < req->via_count && n < cap; ++i)
+        n += snprintf(out + n, cap - n, "Via: %.*s\r\n", req->via[i].len, req->via[i].p);
+    if (n < cap)
+        n += snprintf(out + n, cap - n, "From: %.*s\r\nTo: %.*s", req->from.len, req->from.p, req->to.len,
+                      req->to.p);
+    if (n < cap && !req->to_has_tag && code > 100)
+        n += snprintf(out + n, cap - n, ";tag=%08x", (unsigned)(h >> 32));
+    if (n < cap)
+        n += snprintf(out + n, cap - n, "\r\nCall-ID: %.*s\r\nCSeq: %.*s\r\n", req->call_id.len, req->call_id.p,
+                      req->cseq.len, req->cseq.p);
+    if (n < cap && code == 200 && method_is(req, "INVITE"))
+        n += snprintf(out + n, cap - n, "Contact: <%.*s>\r\n", req->uri.len, req->uri.p);
+    if (n < cap)
+        n += snprintf(out + n, cap - n, "Content-Length: 0\r\n\r\n");
+    if (n >= cap) {
+        count(s, ST_DROPPED);
+        return;
+    }
+    s->out_addr[s->out_count] = *to;
+    s->out_iov[s->out_count].iov_base = out;
+    s->out_iov[s->out_count].iov_len = n;
+    s->out_msgs[s->out_count].msg_hdr.msg_name = &s->out_addr[s->out_count];
+    s->out_msgs[s->out_count].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    s->out_msgs[s->out_count].msg_hdr.msg_iov = &s->out_iov[s->out_count];
+    s->out_msgs[s->out_count].msg_hdr.msg_iovlen = 1;
+    s->out_count++;
+    count(s, ST_REPLIES);
+}
+
+static void shard_handle(shard_t *s, const sip_request_t *req, const struct sockaddr_in *from, uint64_t h) {
+    /*
+    UAS mínimo en el shard dueño de la llamada:
+    - INVITE: crea el diálogo (o reconoce la retransmisión) y responde 200.
+    - ACK: confirma el diálogo; no lleva respuesta.
+    - BYE: cierra el diálogo con 200, o 481 si no existe.
+    - OPTIONS, MESSAGE y REGISTER: 200. CANCEL: 481 (el INVITE ya se
+        respondió). El resto: 501.
+    */
+    dialog_t *d;
+
+    if (method_is(req, "INVITE")) {
+        d = dialog_find(s, h, &req->call_id);
+        if (!d) {
+            if (!dialog_insert(s, h, &req->call_id)) {
+                shard_reply(s, req, from, 503, "Service Unavailable", h);
+                return;
+            }
+            count(s, ST_CALLS);
+        } else {
+            d->last_ms = s->now_ms; // retransmisión o re-INVITE
+        }
+        shard_reply(s, req, from, 200, "OK", h);
+    } else if (method_is(req, "ACK")) {
+        d = dialog_find(s, h, &req->call_id);
+        if (d) {
+            d->state = DLG_CONFIRMED;
+            d->last_ms = s->now_ms;
+        }
+    } else if (method_is(req, "BYE")) {
+        d = dialog_find(s, h, &req->call_id);
+        if (!d) {
+            shard_reply(s, req, from, 481, "Call/Transaction Does Not Exist", h);
+            return;
+        }
+        dialog_erase(s, d);
+        count(s, ST_HANGUPS);
+        shard_reply(s, req, from, 200, "OK", h);
+    } else if (method_is(req, "OPTIONS") || method_is(req, "MESSAGE") || method_is(req, "REGISTER")) {
+        shard_reply(s, req, from, 200, "OK", h);
+    } else if (method_is(req, "CANCEL")) {
+        shard_reply(s, req, from, 481, "Call/Transaction Does Not Exist", h);
+    } else {
+        shard_reply(s, req, from, 501, "Not Implemented", h);
+    }
+}
+
+static void shard_steer(shard_t *s, const char *data, int len, const struct sockaddr_in *from) {
+    // Atiende el datagrama si la llamada es de este shard; si no, al buzón del dueño
+    sip_request_t req;
+    uint64_t h;
+    int owner;
+
+    if (parse_request(data, len, &req) != 0) {
+        count(s, ST_DROPPED);
+        return;
+    }
+    h = sip_callid_hash(req.call_id.p, req.call_id.len);
+    owner = (int)(h % (uint64_t)num_shards);
+    if (owner == s->index) {
+        shard_handle(s, &req, from, h);
+        return;
+    }
+    if (mailbox_push(&shards[owner].mailbox, data, len, from) != 0) {
+        count(s, ST_DROPPED); // el cliente retransmitirá
+        return;
+    }
+    s->wake_mask |= 1ULL << owner;
+    count(s, ST_FORWARDED);
+}
+
+static void shard_receive(shard_t *s) {
+    for (int round = 0; round < RECV_ROUNDS; ++round) {
+        for (int i = 0; i < RECV_BATCH; ++i) {
+            s->in_iov[i].iov_base = s->in_buf[i];
+            s->in_iov[i].iov_len = SIP_MAX_DATAGRAM;
+            s->in_msgs[i].msg_hdr.msg_name = &s->in_addr[i];
+            s->in_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            s->in_msgs[i].msg_hdr.msg_iov = &s->in_iov[i];
+            s->in_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(s->fd, s->in_msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+                perror("recvmmsg failed");
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            count(s, ST_RECEIVED);
+            shard_steer(s, s->in_buf[i], (int)s->in_msgs[i].msg_len, &s->in_addr[i]);
+        }
+        if (n < RECV_BATCH)
+            return;
+    }
+}
+
+static void shard_drain(shard_t *s) {
+    // Consumidor único del buzón: atiende todo lo que otros shards le han pasado
+    mailbox_t *mb = &s->mailbox;
+    uint64_t value;
+    sip_request_t req;
+
+    if (read(mb->efd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        perror("read eventfd failed");
+    atomic_exchange(&mb->wake_pending, 0);
+    for (;;) {
+        mail_slot_t *slot = &mb->slots[mb->head & (MAILBOX_SLOTS - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != mb->head + 1)
+            break;
+        count(s, ST_FROM_MAILBOX);
+        if (parse_request(slot->data, slot->len, &req) == 0)
+            shard_handle(s, &req, &slot->from, sip_callid_hash(req.call_id.p, req.call_id.len));
+        atomic_store_explicit(&slot->seq, mb->head + MAILBOX_SLOTS, memory_order_release);
+        mb->head++;
+    }
+}
+
+static void *shard_loop(void *arg) {
+    /*
+    Bucle de un shard, fijado a su núcleo:
+    - datagramas del socket (recvmmsg por lotes) y del buzón (eventfd);
+    - al final de cada vuelta, las respuestas acumuladas salen con un
+        sendmmsg y cada shard con reenvíos pendientes recibe un aviso;
+    - una vez por SWEEP_INTERVAL_MS se barren los diálogos caducados. El
+        epoll_wait tiene ese plazo para que el barrido no dependa del tráfico.
+    */
+    shard_t *s = (shard_t *)arg;
+    struct epoll_event events[2];
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(s->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        fprintf(stderr, "shard %d: no se pudo fijar al núcleo %d\n", s->index, s->cpu);
+    s->next_sweep_ms = monotonic_ms() + SWEEP_INTERVAL_MS;
+    for (;;) {
+        int n = epoll_wait(s->epfd, events, 2, SWEEP_INTERVAL_MS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
+        }
+        s->now_ms = monotonic_ms();
+        if (s->now_ms >= s->next_sweep_ms) {
+            dialog_sweep(s);
+            s->next_sweep_ms = s->now_ms + SWEEP_INTERVAL_MS;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u32 == EV_MAILBOX)
+                shard_drain(s);
+            else
+                shard_receive(s);
+        }
+        shard_flush(s);
+        while (s->wake_mask) {
+            int owner = __builtin_ctzll(s->wake_mask);
+            s->wake_mask &= s->wake_mask - 1;
+            mailbox_wake(&shards[owner].mailbox);
+        }
+    }
+    return NULL;
+}
+
+static int open_shard_socket(int port) {
+    int one = 1;
+    int fd;
+    struct sockaddr_in address;
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int shard_init(shard_t *s, int index, int cpus) {
+    struct epoll_event ev;
+
+    s->index = index;
+    s->cpu = index % cpus;
+    s->fd = open_shard_socket(sip_port);
+    s->epfd = epoll_create1(0);
+    s->dialogs = calloc(DIALOG_SLOTS, sizeof(dialog_t));
+    if (s->fd < 0 || s->epfd < 0 || !s->dialogs || mailbox_init(&s->mailbox) != 0)
+        return -1;
+    for (int i = 0; i < (int)(sizeof(s->stats) / sizeof(s->stats[0])); ++i)
+        atomic_init(&s->stats[i], 0);
+    ev.events = EPOLLIN;
+    ev.data.u32 = EV_SOCKET;
+    if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0)
+        return -1;
+    ev.data.u32 = EV_MAILBOX;
+    return epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->mailbox.efd, &ev);
+}
+
+static void read_stats(shard_t *s, shard_stats_t *st) {
+    long *out = (long *)st;
+
+    for (int i = 0; i < (int)(sizeof(s->stats) / sizeof(s->stats[0])); ++i)
+        out[i] = atomic_load_explicit(&s->stats[i], memory_order_relaxed);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+int main(int argc, char **argv) {
+    /*
+    Arranca los shards y cada segundo imprime llamadas/s, peticiones/s y
+    qué parte del tráfico ha tenido que cambiar de shard. Con SIGINT o
+    SIGTERM imprime los totales por shard y termina.
+    */
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    shard_stats_t prev = { 0 };
+
+    if (argc > 1)
+        sip_port = atoi(argv[1]);
+    num_shards = argc > 2 ? atoi(argv[2]) : cpus;
+    if (num_shards < 1 || num_shards > MAX_SHARDS) {
+        fprintf(stderr, "Uso: %s [puerto] [shards 1-%d]\n", argv[0], MAX_SHARDS);
+        return EXIT_FAILURE;
+    }
+    shards = aligned_alloc(64, sizeof(shard_t) * num_shards);
+    if (!shards) {
+        perror("malloc shards failed");
+        return EXIT_FAILURE;
+    }
+    memset(shards, 0, sizeof(shard_t) * num_shards);
+    // Los sockets entran al grupo SO_REUSEPORT en orden: el socket i es el shard i
+    for (int i = 0; i < num_shards; ++i) {
+        if (shard_init(&shards[i], i, cpus > 0 ? cpus : 1) != 0) {
+            fprintf(stderr, "No se pudo crear el shard %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    sip_attach_cpu_steering(shards[0].fd, num_shards);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    for (int i = 0; i < num_shards; ++i)
+        pthread_create(&shards[i].thread, NULL, shard_loop, &shards[i]);
+    printf("Prototipo UDP (%d shards, %d núcleos) escuchando en UDP %d...\n", num_shards, cpus, sip_port);
+
+    while (!stop_requested) {
+        shard_stats_t total = { 0 };
+        shard_stats_t st;
+
+        sleep(1);
+        for (int i = 0; i < num_shards; ++i) {
+            read_stats(&shards[i], &st);
+            total.received += st.received;
+            total.forwarded += st.forwarded;
+            total.calls += st.calls;
+            total.replies += st.replies;
+            total.dropped += st.dropped;
+        }
+        if (total.received != prev.received)
+            printf("%ld llamadas/s, %ld peticiones/s, %.1f%% redirigidas, %ld descartadas\n",
+                   total.calls - prev.calls, total.received - prev.received,
+                   100.0 * (total.forwarded - prev.forwarded) / (total.received - prev.received),
+                   total.dropped - prev.dropped);
+        fflush(stdout);
+        prev = total;
+    }
+    printf("\n%-6s %12s %12s %12s %10s %10s %10s %10s\n", "shard", "recibidas", "redirigidas", "del buzón",
+           "llamadas", "colgadas", "caducadas", "descartes");
+    for (int i = 0; i < num_shards; ++i) {
+        shard_stats_t st;
+        read_stats(&shards[i], &st);
+        printf("%-6d %12ld %12ld %12ld %10ld %10ld %10ld %10ld\n", i, st.received, st.forwarded, st.from_mailbox,
+               st.calls, st.hangups, st.expired, st.dropped);
+    }
+    return 0;
+}
+
+/*
+Compila: gcc -O2 udp_shard_proto.c -o udp_shard_proto -lpthread
+Ejecuta: ./udp_shard_proto [puerto] [shards]
+(sip_steering.h está en este mismo directorio)
+Explicación:
+    -Un Bucle por Núcleo:
+        demo2-demo5 y miniserver ejecutan un solo su_root_t con un solo nua_t
+        en un hilo, así que la señalización no pasa de un núcleo. Aquí cada
+        shard es un hilo fijado a su núcleo con su propio socket UDP en el
+        mismo puerto (SO_REUSEPORT), su epoll y su tabla de diálogos.
+        Es un prototipo sobre UDP crudo, no un agente Sofia por núcleo: cada
+        shard atiende las peticiones con un UAS mínimo sin estado de
+        transacción (INVITE/ACK/BYE, MESSAGE, OPTIONS, REGISTER). El agente
+        con un su_root/nua por shard está en sharded_agent.c: cada nua
+        escucha en un puerto propio de loopback y el reparto por Call-ID le
+        pasa los datagramas por ahí en vez de por el buzón.
+
+    -Reparto por Call-ID:
+        El kernel elige el socket (con el programa cBPF, el del núcleo que
+        recibió el paquete) pero el dueño de una llamada es hash(Call-ID) % N.
+        Si el datagrama cae en otro shard, se copia al buzón del dueño y se le
+        avisa por su eventfd. Así el INVITE, el ACK y el BYE de una llamada
+        ven siempre la misma tabla de diálogos, sin locks.
+
+    -Buzones sin Locks:
+        Cada buzón es un anillo acotado MPSC (secuencia por ranura, como la
+        cola de pthreads3): los productores reservan ranura con un CAS, el
+        dueño la vacía sin atómicas de escritura compartidas. El aviso es un
+        write al eventfd solo si el dueño no tenía ya uno pendiente, y se hace
+        una vez por lote de recvmmsg, no por datagrama. Si el buzón se llena
+        el datagrama se descarta: UDP y el cliente SIP retransmite.
+
+    -Lotes:
+        recvmmsg lee hasta 32 datagramas por llamada y las respuestas se
+        acumulan y salen con un sendmmsg al final de cada vuelta del bucle.
+
+    -Caducidad de Diálogos:
+        Un diálogo solo se borra de verdad con el BYE, pero si el BYE se
+        pierde (o el cliente no cuelga) la entrada se quedaría y con la tabla
+        a 3/4 todos los INVITE recibirían 503. Cada diálogo guarda la hora de
+        su última petición y el bucle barre la tabla cada segundo: los que no
+        tienen ACK a los 64*T1 (32 s) y los confirmados con más de 30 minutos
+        sin actividad se borran.
+*/
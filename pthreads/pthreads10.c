@@ -1,274 +1,1195 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <fcntl.h>
-#include <sys/select.h>
-#include <errno.h>
-
-#define PORT 8080
-#define MAX_CLIENTS 10
-#define THREAD_POOL_SIZE 4
-#define MAX_TASKS 20
-#define BUFFER_SIZE 1024
-
-// (Incluir aquí las definiciones de task_t y thread_pool_t del Bloque 9, simplificadas si es necesario)
-typedef struct {
-    void (*function)(void *);
-    void *argument;
-    int priority;
-} task_t;
-
-typedef struct {
-    task_t **tasks[1];
-    int head[1];
-    int tail[1];
-    int count[1];
-    int capacity;
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_not_empty[1];
-    pthread_cond_t queue_not_full[1];
-    pthread_t threads[THREAD_POOL_SIZE];
-    int shutdown;
-} thread_pool_t;
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument); // Simplificado sin prioridad
-void thread_pool_destroy(thread_pool_t *pool);
-void *worker(void *pool);
-
-// Estructura para pasar información del cliente a la tarea del thread pool
-typedef struct {
-    int client_fd;
-} client_info_t;
-
-void handle_client(void *arg);
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
-    pool->capacity = max_tasks;
-    for (int i = 0; i < 1; ++i) {
-        pool->head[i] = pool->tail[i] = pool->count[i] = 0;
-        pool->tasks[i] = malloc(sizeof(task_t) * pool->capacity);
-        if (!pool->tasks[i]) perror("malloc tasks failed");
-        pthread_cond_init(&pool->queue_not_empty[i], NULL);
-        pthread_cond_init(&pool->queue_not_full[i], NULL);
-    }
-    pthread_mutex_init(&pool->queue_mutex, NULL);
-    pool->shutdown = 0;
-    for (int i = 0; i < num_threads; ++i) {
-        pthread_create(&pool->threads[i], NULL, worker, pool);
-    }
-}
-
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
-    pthread_mutex_lock(&pool->queue_mutex);
-    while (pool->count[0] == pool->capacity && !pool->shutdown) {
-        pthread_cond_wait(&pool->queue_not_full[0], &pool->queue_mutex);
-    }
-    if (pool->shutdown) {
-        pthread_mutex_unlock(&pool->queue_mutex);
-        return;
-    }
-    pool->tasks[0][pool->tail[0]].function = function;
-    pool->tasks[0][pool->tail[0]].argument = argument;
-    pool->tail[0] = (pool->tail[0] + 1) % pool->capacity;
-    pool->count[0]++;
-    pthread_cond_signal(&pool->queue_not_empty[0]);
-    pthread_mutex_unlock(&pool->queue_mutex);
-}
-
-void *worker(void *pool) {
-    thread_pool_t *p = (thread_pool_t *)pool;
-    while (1) {
-        pthread_mutex_lock(&p->queue_mutex);
-        while (p->count[0] == 0 && !p->shutdown) {
-            pthread_cond_wait(&p->queue_not_empty[0], &p->queue_mutex);
-        }
-        if (p->shutdown) {
-            pthread_mutex_unlock(&p->queue_mutex);
-            pthread_exit(NULL);
-        }
-        task_t task = p->tasks[0][p->head[0]];
-        p->head[0] = (p->head[0] + 1) % p->capacity;
-        p->count[0]--;
-        pthread_cond_signal(&p->queue_not_full[0]);
-        pthread_mutex_unlock(&p->queue_mutex);
-        task.function(task.argument);
-    }
-    return NULL;
-}
-
-void thread_pool_destroy(thread_pool_t *pool) {
-    pthread_mutex_lock(&pool->queue_mutex);
-    pool->shutdown = 1;
-    pthread_cond_broadcast(&pool->queue_not_empty[0]);
-    pthread_mutex_unlock(&pool->queue_mutex);
-    for (int i = 0; i < THREAD_POOL_SIZE; ++i) {
-        pthread_join(pool->threads[i], NULL);
-    }
-    for (int i = 0; i < 1; ++i) {
-        free(pool->tasks[i]);
-        pthread_cond_destroy(&pool->queue_not_empty[i]);
-        pthread_cond_destroy(&pool->queue_not_full[i]);
-    }
-    pthread_mutex_destroy(&pool->queue_mutex);
-}
-
-void handle_client(void *arg) {
-    /*
-    Función que se ejecuta en un hilo del pool para manejar la comunicación con un cliente.
-
-    - Recibe un puntero a una estructura client_info_t que contiene el descriptor del socket del cliente.
-    - Lee datos del socket del cliente (no bloqueante).
-    - Procesa los datos recibidos.
-    - Envía una respuesta al cliente (no bloqueante).
-    - Cierra la conexión con el cliente.
-    */
-}
-
-int main() {
-    int server_fd, new_socket, max_fd;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    fd_set readfds;
-    thread_pool_t pool;
-
-    // Inicializar el thread pool
-    thread_pool_init(&pool, THREAD_POOL_SIZE, MAX_TASKS);
-
-    // Crear socket del servidor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Configurar socket no bloqueante
-    int flags = fcntl(server_fd, F_GETFL, 0);
-    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
-        perror("fcntl nonblock failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-
-    // Bind del socket
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    // Escuchar por conexiones
-    if (listen(server_fd, MAX_CLIENTS) < 0) {
-        perror("listen failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    printf("Servidor escuchando en el puerto %d...\n", PORT);
-
-    while (1) {
-        FD_ZERO(&readfds);
-        FD_SET(server_fd, &readfds);
-        max_fd = server_fd;
-
-        // No estamos gestionando activamente los sockets de los clientes en el bucle principal
-        // ya que el I/O se delega al thread pool.
-
-        // Usar select para esperar por actividad en el socket del servidor (nuevas conexiones)
-        int activity = select(max_fd + 1, &readfds, NULL, NULL, NULL);
-
-        if ((activity < 0) && (errno != EINTR)) {
-            perror("select error");
-            continue;
-        }
-
-        if (FD_ISSET(server_fd, &readfds)) {
-            if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
-                perror("accept failed");
-                continue;
-            }
-
-            printf("Nueva conexión aceptada, socket fd es %d, IP es: %s, puerto: %d\n", new_socket, inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-
-            // Configurar el socket del cliente como no bloqueante (opcional, depende de la estrategia)
-            flags = fcntl(new_socket, F_GETFL, 0);
-            if (fcntl(new_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
-                perror("fcntl nonblock client failed");
-                close(new_socket);
-                continue;
-            }
-
-            // Crear una tarea para manejar al cliente y enviarla al thread pool
-            client_info_t *client_info = malloc(sizeof(client_info_t));
-            if (!client_info) {
-                perror("malloc client_info failed");
-                close(new_socket);
-                continue;
-            }
-            client_info->client_fd = new_socket;
-            thread_pool_submit(&pool, handle_client, client_info);
-        }
-    }
-
-    // En un servidor real, aquí habría lógica para una terminación más controlada
-    close(server_fd);
-    thread_pool_destroy(&pool);
-    return 0;
-}
-
-/*
-Compila: gcc pthreads10.c -o nonblocking_io_pool -lpthread
-Ejecuta: ./nonblocking_io_pool
-Explicación:
-    -Socket No Bloqueante:
-        El socket del servidor se configura como no bloqueante
-        usando fcntl(server_fd, F_SETFL, flags | O_NONBLOCK).
-        Esto significa que las llamadas a accept() retornarán inmediatamente,
-        incluso si no hay conexiones pendientes
-        (en cuyo caso retornarán con un error EAGAIN o EWOULDBLOCK).
-
-    -select para Multiplexación de I/O:
-        La función select() se utiliza para esperar
-        a que haya actividad en el socket del servidor
-        (es decir, una nueva conexión entrante).
-        select() permite al servidor esperar en múltiples descriptores de archivo a la vez,
-        aunque en este ejemplo solo estamos esperando en el socket del servidor en el bucle principal.
-
-    -Thread Pool para Manejo de Clientes:
-        Cuando se acepta una nueva conexión, no se crea un nuevo hilo directamente para manejarla.
-        En lugar de eso, se crea1 una estructura client_info_t
-        que contiene el descriptor del socket del cliente,
-        y esta estructura se pasa como argumento a la función handle_client.
-        Esta función handle_client se envía como una tarea al thread pool.
-
-    -handle_client en el Thread Pool:
-        La función handle_client se ejecuta en uno de los hilos trabajadores del pool.
-        Esta función es responsable de leer y escribir datos en el socket del cliente.
-        En este ejemplo simplificado, se usa recv() y send(),
-        que en sockets no bloqueantes también deberían manejarse de forma no bloqueante
-        en un entorno real más complejo (posiblemente usando select o poll dentro del hilo trabajador
-        si es necesario manejar múltiples operaciones de I/O para un solo cliente).
-
-    -Beneficios:
-        Este enfoque permite que un número limitado de hilos en el thread pool
-        maneje potencialmente muchas conexiones de clientes.
-        El bucle principal del servidor no se bloquea esperando a que los clientes envíen datos;
-        simplemente acepta nuevas conexiones y las delega al pool de hilos.
-
-Nota Importante:
-Este es un ejemplo simplificado.
-Un servidor real con I/O no bloqueante y un thread pool requeriría
-un manejo mucho más sofisticado de los estados de conexión,
-la lectura y escritura parcial de datos,
-y posiblemente el uso de mecanismos de notificación de eventos más avanzados
-(como epoll en Linux para un mayor rendimiento con un gran número de conexiones).
-Sin embargo, este bloque sienta las bases para entender cómo integrar la I/O no bloqueante
-con un thread pool usando select para la aceptación de conexiones.
- */
\ No newline at end of file
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <errno.h>
+#include "slab.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef IORING_RECV_MULTISHOT
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#define PORT 8080
+#define LISTEN_BACKLOG 65535   // el kernel lo recorta a net.core.somaxconn
+#define BUFFER_SIZE 1024
+#define MAX_EVENTS 256
+#define MSG_SIZE 64            // tamaño de cada petición del generador de carga
+#define CONNECT_BATCH 256      // conexiones en curso a la vez por hilo del generador
+#define SOURCE_SPREAD 25000    // conexiones por IP de origen 127.0.0.x (rango efímero ~28k)
+#define GEN_THREADS 4
+#define MAX_SAMPLES (1 << 20)  // muestras de latencia por hilo del generador
+
+typedef enum {
+    MODE_SELECT,
+    MODE_EPOLL,
+    MODE_URING
+} server_mode_t;
+
+typedef enum {
+    CONN_READING, // esperando datos del cliente
+    CONN_WRITING  // hay respuesta pendiente en el buffer (envío parcial)
+} conn_state_t;
+
+// Estado de una conexión del servidor: un único buffer, se responde en eco lo leído
+typedef struct {
+    int fd;
+    conn_state_t state;
+    int len;
+    int off;
+    char buffer[BUFFER_SIZE];
+} conn_t;
+
+// Un reactor por núcleo: su propio socket de escucha (SO_REUSEPORT) y su propio epoll
+typedef struct {
+    int index;
+    int port;
+    int listen_fd;
+    int epfd;
+    long accepted;
+    pthread_t thread;
+} reactor_t;
+
+int handle_client(conn_t *conn);
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void raise_fd_limit(void) {
+    // C10K/C100K necesitan más descriptores que el límite blando habitual (1024)
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static int open_listener(int port, int reuseport) {
+    int one = 1;
+    int fd;
+    struct sockaddr_in address;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, LISTEN_BACKLOG) < 0) {
+        perror("listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static conn_t *conn_create(int fd) {
+    int one = 1;
+    conn_t *conn = slab_alloc(sizeof(conn_t)); // de la caché del reactor, sin malloc por conexión
+
+    if (!conn) {
+        perror("slab_alloc conn failed");
+        close(fd);
+        return NULL;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn->fd = fd;
+    conn->state = CONN_READING;
+    conn->len = 0;
+    conn->off = 0;
+    return conn;
+}
+
+static void conn_close(conn_t *conn) {
+    close(conn->fd); // también lo quita del epoll
+    slab_free(conn);
+}
+
+int handle_client(conn_t *conn) {
+    /*
+    Máquina de estados no bloqueante de una conexión. Se llama cada vez que
+        el socket está listo para leer o escribir, desde select o desde epoll.
+
+    - CONN_WRITING: envía lo que queda del buffer. Si el socket se llena (EAGAIN),
+        sigue en CONN_WRITING y espera a que vuelva a ser escribible; mientras
+        tanto no lee más (contrapresión hacia el cliente).
+    - CONN_READING: lee hasta EAGAIN. Cada bloque leído se procesa (eco) y
+        pasa a CONN_WRITING.
+    - Con epoll edge-triggered hay que agotar lectura y escritura en cada
+        llamada: el kernel no vuelve a avisar hasta que llegue algo nuevo.
+    - Retorna -1 si hay que cerrar la conexión (el cliente cerró o hubo error),
+        0 si sigue abierta.
+    */
+    ssize_t n;
+
+    while (1) {
+        if (conn->state == CONN_WRITING) {
+            while (conn->off < conn->len) {
+                n = send(conn->fd, conn->buffer + conn->off, conn->len - conn->off, MSG_NOSIGNAL);
+                if (n > 0) {
+                    conn->off += n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return 0;
+                return -1;
+            }
+            conn->state = CONN_READING;
+        }
+        n = recv(conn->fd, conn->buffer, BUFFER_SIZE, 0);
+        if (n > 0) {
+            conn->len = n;
+            conn->off = 0;
+            conn->state = CONN_WRITING;
+            continue;
+        }
+        if (n == 0)
+            return -1;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return -1;
+    }
+}
+
+static void run_select_server(int port) {
+    /*
+    Servidor de referencia con select(): un solo hilo y un fd_set que se
+        reconstruye y recorre entero en cada vuelta, O(conexiones) por evento.
+
+    - Solo admite descriptores menores que FD_SETSIZE (1024); el resto se cierra.
+    - Cada conexión entra en 'readfds' o 'writefds' según su estado.
+    */
+    int listen_fd = open_listener(port, 0);
+    conn_t *conns[FD_SETSIZE] = {0};
+    fd_set readfds, writefds;
+    int max_fd, new_socket;
+
+    if (listen_fd < 0)
+        exit(EXIT_FAILURE);
+    printf("Servidor (select) escuchando en el puerto %d...\n", port);
+
+    while (1) {
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        FD_SET(listen_fd, &readfds);
+        max_fd = listen_fd;
+        for (int fd = 0; fd < FD_SETSIZE; ++fd) {
+            if (!conns[fd])
+                continue;
+            FD_SET(fd, conns[fd]->state == CONN_WRITING ? &writefds : &readfds);
+            if (fd > max_fd)
+                max_fd = fd;
+        }
+
+        int activity = select(max_fd + 1, &readfds, &writefds, NULL, NULL);
+        if (activity < 0) {
+            if (errno != EINTR)
+                perror("select error");
+            continue;
+        }
+
+        if (FD_ISSET(listen_fd, &readfds)) {
+            while ((new_socket = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+                if (new_socket >= FD_SETSIZE) {
+                    close(new_socket);
+                    continue;
+                }
+                conns[new_socket] = conn_create(new_socket);
+            }
+        }
+        for (int fd = 0; fd <= max_fd; ++fd) {
+            if (!conns[fd] || !(FD_ISSET(fd, &readfds) || FD_ISSET(fd, &writefds)))
+                continue;
+            if (handle_client(conns[fd]) < 0) {
+                conn_close(conns[fd]);
+                conns[fd] = NULL;
+            }
+        }
+    }
+}
+
+static void reactor_accept(reactor_t *r) {
+    /*
+    Acepta hasta EAGAIN (el listener es edge-triggered) y registra cada
+        conexión con EPOLLIN | EPOLLOUT | EPOLLET una sola vez: no hace falta
+        epoll_ctl(MOD) al cambiar de estado, handle_client ya sabe qué le toca.
+    */
+    struct epoll_event ev;
+    int fd;
+
+    while (1) {
+        fd = accept4(r->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno == EMFILE || errno == ENFILE)
+                perror("accept: sin descriptores (ulimit -n)");
+            return;
+        }
+        conn_t *conn = conn_create(fd);
+        if (!conn)
+            continue;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl add failed");
+            conn_close(conn);
+            continue;
+        }
+        r->accepted++;
+    }
+}
+
+static void *reactor_loop(void *arg) {
+    /*
+    Bucle de un reactor.
+
+    - Espera eventos en su epoll (hasta MAX_EVENTS por llamada).
+    - data.ptr == NULL identifica al socket de escucha.
+    - Para cada conexión lista, llama a handle_client; EPOLLERR/EPOLLHUP o
+        un -1 de handle_client cierran la conexión.
+    */
+    reactor_t *r = (reactor_t *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(r->epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            conn_t *conn = events[i].data.ptr;
+            if (!conn) {
+                reactor_accept(r);
+                continue;
+            }
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) || handle_client(conn) < 0)
+                conn_close(conn);
+        }
+    }
+    return NULL;
+}
+
+static void run_epoll_server(int port, int num_reactors) {
+    /*
+    Arranca 'num_reactors' reactores (uno por núcleo por defecto).
+
+    - Cada reactor abre su propio listener con SO_REUSEPORT en el mismo puerto:
+        el kernel reparte las conexiones entrantes entre ellos, sin accept
+        compartido ni locks entre hilos.
+    - Cada conexión vive siempre en el reactor que la aceptó.
+    */
+    reactor_t *reactors = calloc(num_reactors, sizeof(reactor_t));
+    struct epoll_event ev;
+
+    if (!reactors) {
+        perror("malloc reactors failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_reactors; ++i) {
+        reactors[i].index = i;
+        reactors[i].port = port;
+        reactors[i].listen_fd = open_listener(port, 1);
+        reactors[i].epfd = epoll_create1(0);
+        if (reactors[i].listen_fd < 0 || reactors[i].epfd < 0)
+            exit(EXIT_FAILURE);
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(reactors[i].epfd, EPOLL_CTL_ADD, reactors[i].listen_fd, &ev) < 0) {
+            perror("epoll_ctl listener failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("Servidor (epoll, %d reactores) escuchando en el puerto %d...\n", num_reactors, port);
+    for (int i = 1; i < num_reactors; ++i)
+        pthread_create(&reactors[i].thread, NULL, reactor_loop, &reactors[i]);
+    reactor_loop(&reactors[0]);
+}
+
+#ifdef HAVE_IO_URING
+/*
+Backend io_uring sobre la ABI del kernel (io_uring_setup / io_uring_enter /
+io_uring_register), sin liburing. Un anillo por reactor, como con epoll:
+
+- accept multishot en el listener (un SQE produce una CQE por conexión).
+- recv multishot por conexión con un anillo de buffers provistos: el kernel
+    elige el buffer y lo indica en la CQE, así que no hay un buffer por
+    conexión esperando datos.
+- Un send en vuelo por conexión; lo recibido se acumula en 'out' mientras tanto.
+- Todas las SQE preparadas al procesar un lote de CQE se envían con una
+    sola llamada a io_uring_enter, que además espera la siguiente CQE.
+*/
+
+#define URING_ENTRIES 1024
+#define URING_BUFS 4096        // buffers provistos por reactor (potencia de 2)
+#define URING_BUF_SIZE 2048
+#define URING_BGID 0
+
+enum {
+    UR_ACCEPT = 1,
+    UR_RECV = 2,
+    UR_SEND = 3
+};
+
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned local_tail;   // SQE preparadas
+    unsigned submitted;    // SQE ya publicadas al kernel
+    struct io_uring_buf_ring *br;
+    size_t br_len;
+    char *bufs;
+} uring_t;
+
+typedef struct {
+    int fd;
+    int inflight;   // operaciones del kernel que aún apuntan a la conexión
+    int sending;
+    int closing;
+    char *out;
+    int out_len;
+    int out_off;
+    int out_cap;
+} uconn_t;
+
+static int uring_enter(uring_t *ring, unsigned to_submit, unsigned wait_nr) {
+    return (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr,
+                        wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static void uring_free(uring_t *ring) {
+    if (ring->br)
+        munmap(ring->br, ring->br_len);
+    free(ring->bufs);
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr)
+        munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->fd >= 0)
+        close(ring->fd);
+}
+
+static int uring_init(uring_t *ring) {
+    /*
+    Crea el anillo y registra el anillo de buffers provistos.
+
+    - Pide una cola de completado 4 veces mayor que la de envío: con
+        operaciones multishot cada SQE produce muchas CQE.
+    - SINGLE_ISSUER | DEFER_TASKRUN (kernel >= 6.1): el trabajo pendiente del
+        anillo solo se ejecuta dentro de io_uring_enter, por lotes, en vez de
+        interrumpir al hilo en cada retorno al espacio de usuario. Con miles de
+        conexiones sin estos flags el hilo se pasa el tiempo en task_work.
+        Si el kernel no los admite se reintenta sin ellos. El anillo debe
+        crearse en el hilo que lo va a usar.
+    - Exige IORING_FEAT_SINGLE_MMAP y FEAT_NODROP (kernel >= 5.5) y el
+        registro de buffers provistos (>= 5.19); si algo falta retorna -1
+        y el servidor usa epoll.
+    */
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    unsigned *sq_array;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    for (int attempt = 0; attempt < 2 && ring->fd < 0; ++attempt) {
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+#ifdef IORING_SETUP_DEFER_TASKRUN
+        if (attempt == 0)
+            p.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+#endif
+        p.cq_entries = URING_ENTRIES * 4;
+        ring->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    }
+    if (ring->fd < 0)
+        return -1;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+        errno = ENOTSUP;
+        uring_free(ring);
+        return -1;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->cq_len > ring->sq_len)
+        ring->sq_len = ring->cq_len;
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        uring_free(ring);
+        return -1;
+    }
+    ring->cq_ptr = ring->sq_ptr;
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_free(ring);
+        return -1;
+    }
+    ring->sq_head = (unsigned *)((char *)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = *(unsigned *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_entries = p.sq_entries;
+    sq_array = (unsigned *)((char *)ring->sq_ptr + p.sq_off.array);
+    for (unsigned i = 0; i < p.sq_entries; ++i)
+        sq_array[i] = i; // índice fijo: la SQE i siempre ocupa el hueco i
+    ring->cq_head = (unsigned *)((char *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = *(unsigned *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p.cq_off.cqes);
+    ring->local_tail = ring->submitted = *ring->sq_tail;
+
+    ring->br_len = URING_BUFS * sizeof(struct io_uring_buf);
+    ring->br = mmap(NULL, ring->br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->bufs = malloc((size_t)URING_BUFS * URING_BUF_SIZE);
+    if (ring->br == MAP_FAILED || !ring->bufs) {
+        if (ring->br == MAP_FAILED)
+            ring->br = NULL;
+        uring_free(ring);
+        return -1;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->br;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = URING_BGID;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        uring_free(ring);
+        return -1;
+    }
+    for (unsigned short bid = 0; bid < URING_BUFS; ++bid) {
+        struct io_uring_buf *buf = &ring->br->bufs[bid];
+        buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * URING_BUF_SIZE);
+        buf->len = URING_BUF_SIZE;
+        buf->bid = bid;
+    }
+    __atomic_store_n(&ring->br->tail, (unsigned short)URING_BUFS, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void uring_recycle(uring_t *ring, unsigned short bid) {
+    // Devuelve un buffer provisto al kernel (el anillo tiene hueco para todos).
+    unsigned short tail = ring->br->tail;
+    struct io_uring_buf *buf = &ring->br->bufs[tail & (URING_BUFS - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&ring->br->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    struct io_uring_sqe *sqe;
+
+    while (ring->local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        // Cola de envío llena: publica lo preparado antes de seguir
+        __atomic_store_n(ring->sq_tail, ring->local_tail, __ATOMIC_RELEASE);
+        uring_enter(ring, ring->local_tail - ring->submitted, 0);
+        ring->submitted = ring->local_tail;
+    }
+    sqe = &ring->sqes[ring->local_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->local_tail++;
+    return sqe;
+}
+
+static void uring_prep_accept(uring_t *ring, int listen_fd) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = UR_ACCEPT;
+}
+
+static void uring_prep_recv(uring_t *ring, uconn_t *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | UR_RECV;
+    conn->inflight++;
+}
+
+static void uring_prep_send(uring_t *ring, uconn_t *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(conn->out + conn->out_off);
+    sqe->len = conn->out_len - conn->out_off;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | UR_SEND;
+    conn->inflight++;
+    conn->sending = 1;
+}
+
+static void uconn_close(uconn_t *conn) {
+    /*
+    shutdown() hace que el recv multishot y el send en vuelo terminen;
+    la conexión se libera cuando llega la última de sus CQE.
+    */
+    if (!conn->closing) {
+        conn->closing = 1;
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+    if (conn->inflight == 0) {
+        close(conn->fd);
+        free(conn->out);
+        slab_free(conn);
+    }
+}
+
+static int uconn_append(uconn_t *conn, const char *data, int len) {
+    if (conn->out_off == conn->out_len)
+        conn->out_off = conn->out_len = 0;
+    if (conn->out_len + len > conn->out_cap) {
+        int cap = conn->out_cap ? conn->out_cap : BUFFER_SIZE;
+        while (cap < conn->out_len + len)
+            cap *= 2;
+        char *out = realloc(conn->out, cap);
+        if (!out)
+            return -1;
+        conn->out = out;
+        conn->out_cap = cap;
+    }
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+    return 0;
+}
+
+static void uring_handle_cqe(uring_t *ring, int listen_fd, struct io_uring_cqe *cqe) {
+    /*
+    Máquina de estados del backend io_uring, dirigida por las CQE:
+
+    - UR_ACCEPT: res es el fd nuevo; arma su recv multishot. Si falta
+        IORING_CQE_F_MORE, el accept multishot terminó y se rearma.
+    - UR_RECV: res bytes en el buffer provisto indicado en 'flags'. Se
+        copian a 'out', el buffer vuelve al kernel y, si no hay un send en
+        vuelo, se envía. res == -ENOBUFS (sin buffers libres) rearma el recv;
+        0 u otro error cierran.
+    - UR_SEND: avanza 'out_off'; un envío parcial se completa con otro send.
+    */
+    int op = (int)(cqe->user_data & 7);
+    uconn_t *conn = (uconn_t *)(uintptr_t)(cqe->user_data & ~(uint64_t)7);
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    int one = 1;
+
+    if (op == UR_ACCEPT) {
+        if (!more)
+            uring_prep_accept(ring, listen_fd);
+        if (cqe->res < 0)
+            return;
+        conn = slab_alloc(sizeof(uconn_t));
+        if (!conn) {
+            close(cqe->res);
+            return;
+        }
+        memset(conn, 0, sizeof(uconn_t));
+        conn->fd = cqe->res;
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        uring_prep_recv(ring, conn);
+        return;
+    }
+    if (op == UR_RECV) {
+        if (!more)
+            conn->inflight--;
+        if (cqe->res > 0) {
+            unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            int failed = conn->closing || uconn_append(conn, ring->bufs + (size_t)bid * URING_BUF_SIZE, cqe->res);
+            uring_recycle(ring, bid);
+            if (failed) {
+                uconn_close(conn);
+                return;
+            }
+            if (!conn->sending)
+                uring_prep_send(ring, conn);
+            if (!more)
+                uring_prep_recv(ring, conn);
+            return;
+        }
+        if (cqe->res == -ENOBUFS && !conn->closing) {
+            uring_prep_recv(ring, conn);
+            return;
+        }
+        if (!more)
+            uconn_close(conn);
+        return;
+    }
+    conn->inflight--;
+    conn->sending = 0;
+    if (cqe->res <= 0 || conn->closing) {
+        uconn_close(conn);
+        return;
+    }
+    conn->out_off += cqe->res;
+    if (conn->out_off < conn->out_len)
+        uring_prep_send(ring, conn);
+}
+
+static void *uring_reactor_loop(void *arg) {
+    /*
+    Bucle de un reactor io_uring: procesa todas las CQE disponibles y publica
+        las SQE resultantes junto con la espera de la siguiente CQE
+        (una sola llamada al sistema por lote).
+    */
+    reactor_t *r = (reactor_t *)arg;
+    uring_t ring;
+
+    if (uring_init(&ring) != 0) {
+        perror("io_uring_setup failed");
+        return NULL;
+    }
+    uring_prep_accept(&ring, r->listen_fd);
+    while (1) {
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+            uring_handle_cqe(&ring, r->listen_fd, &ring.cqes[head & ring.cq_mask]);
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+        __atomic_store_n(ring.sq_tail, ring.local_tail, __ATOMIC_RELEASE);
+        if (uring_enter(&ring, ring.local_tail - ring.submitted, 1) < 0 && errno != EINTR) {
+            perror("io_uring_enter failed");
+            break;
+        }
+        ring.submitted = ring.local_tail;
+    }
+    uring_free(&ring);
+    return NULL;
+}
+
+static int uring_available(void) {
+    // Prueba completa (anillo + buffers provistos) antes de arrancar los reactores.
+    uring_t ring;
+
+    if (uring_init(&ring) != 0)
+        return 0;
+    uring_free(&ring);
+    return 1;
+}
+
+static int run_uring_server(int port, int num_reactors) {
+    /*
+    Igual que run_epoll_server (un listener SO_REUSEPORT por reactor) pero
+        cada reactor usa su propio anillo io_uring. Retorna -1 sin arrancar
+        nada si el kernel no soporta lo necesario.
+    */
+    reactor_t *reactors;
+
+    if (!uring_available())
+        return -1;
+    reactors = calloc(num_reactors, sizeof(reactor_t));
+    if (!reactors) {
+        perror("malloc reactors failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_reactors; ++i) {
+        reactors[i].index = i;
+        reactors[i].port = port;
+        reactors[i].listen_fd = open_listener(port, 1);
+        if (reactors[i].listen_fd < 0)
+            exit(EXIT_FAILURE);
+    }
+    printf("Servidor (io_uring, %d reactores) escuchando en el puerto %d...\n", num_reactors, port);
+    for (int i = 1; i < num_reactors; ++i)
+        pthread_create(&reactors[i].thread, NULL, uring_reactor_loop, &reactors[i]);
+    uring_reactor_loop(&reactors[0]);
+    return 0;
+}
+#endif /* HAVE_IO_URING */
+
+static void run_server(server_mode_t mode, int port, int num_reactors) {
+    /*
+    Arranca el servidor en el modo pedido. MODE_URING recurre a epoll si
+        el binario se compiló sin <linux/io_uring.h> o el kernel no lo soporta
+        (io_uring deshabilitado, seccomp, kernel < 5.19).
+    */
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+    if (mode == MODE_SELECT)
+        run_select_server(port);
+#ifdef HAVE_IO_URING
+    if (mode == MODE_URING && run_uring_server(port, num_reactors) == 0)
+        return;
+#endif
+    if (mode == MODE_URING)
+        fprintf(stderr, "io_uring no disponible, se usa epoll\n");
+    run_epoll_server(port, num_reactors);
+}
+
+/* ---- Generador de carga en bucle cerrado sobre loopback ---- */
+
+typedef enum {
+    GEN_CONNECTING,
+    GEN_SENDING,
+    GEN_WAITING
+} gen_state_t;
+
+typedef struct {
+    int fd;
+    gen_state_t state;
+    int sent;
+    int recvd;
+    uint64_t t0;
+} gen_conn_t;
+
+typedef struct {
+    int port;
+    int first;      // índice global de su primera conexión (elige la IP de origen)
+    int nconns;
+    int total;
+    double seconds;
+    int epfd;
+    int established;
+    int failed;
+    int dropped;
+    long requests;
+    uint64_t ready_ns;   // todas sus conexiones resueltas; desde aquí se mide
+    double rate;
+    uint64_t *samples;
+    size_t nsamples;
+    gen_conn_t *conns;
+    pthread_t thread;
+} gen_thread_t;
+
+typedef struct {
+    int established;
+    int failed;
+    int dropped;
+    long requests;
+    double rate;
+    double p50_us;
+    double p99_us;
+} gen_result_t;
+
+static const char gen_message[MSG_SIZE] = "INVITE sip:bench@127.0.0.1 SIP/2.0 carga de prueba .............";
+
+static int gen_open(gen_thread_t *g, gen_conn_t *c, int global_index) {
+    /*
+    Abre una conexión no bloqueante hacia el servidor.
+
+    - Por encima de SOURCE_SPREAD conexiones reparte la IP de origen entre
+        127.0.0.1, 127.0.0.2, ... para no agotar los puertos efímeros de una
+        sola IP (C100K). IP_BIND_ADDRESS_NO_PORT deja elegir el puerto en connect().
+    - SO_LINGER {1, 0}: al cerrar se envía RST y no queda TIME_WAIT que
+        agote puertos entre ejecuciones del benchmark.
+    */
+    struct sockaddr_in addr;
+    struct linger lin = {1, 0};
+    struct epoll_event ev;
+    int one = 1;
+
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0)
+        return -1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (g->total > SOURCE_SPREAD) {
+#ifdef IP_BIND_ADDRESS_NO_PORT
+        setsockopt(c->fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+#endif
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + global_index / SOURCE_SPREAD);
+        if (bind(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(c->fd);
+            return -1;
+        }
+    }
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(g->port);
+    if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        return -1;
+    }
+    c->state = GEN_CONNECTING;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(g->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        close(c->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void gen_start_request(gen_conn_t *c) {
+    c->state = GEN_SENDING;
+    c->sent = 0;
+    c->recvd = 0;
+    c->t0 = monotonic_ns();
+}
+
+static int gen_service(gen_thread_t *g, gen_conn_t *c) {
+    // Envía la petición, espera el eco completo y encadena la siguiente. -1: cerrar.
+    char scratch[MSG_SIZE];
+    ssize_t n;
+
+    while (1) {
+        if (c->state == GEN_SENDING) {
+            n = send(c->fd, gen_message + c->sent, MSG_SIZE - c->sent, MSG_NOSIGNAL);
+            if (n < 0)
+                return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+            c->sent += n;
+            if (c->sent == MSG_SIZE)
+                c->state = GEN_WAITING;
+            continue;
+        }
+        n = recv(c->fd, scratch, MSG_SIZE - c->recvd, 0);
+        if (n == 0)
+            return -1;
+        if (n < 0)
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        c->recvd += n;
+        if (c->recvd < MSG_SIZE)
+            continue;
+        if (g->ready_ns) {
+            g->requests++;
+            if (g->nsamples < MAX_SAMPLES)
+                g->samples[g->nsamples++] = monotonic_ns() - c->t0;
+        }
+        gen_start_request(c);
+    }
+}
+
+static void *gen_thread(void *arg) {
+    /*
+    Hilo del generador: abre sus conexiones de CONNECT_BATCH en CONNECT_BATCH
+        y cada una repite petición -> eco durante 'seconds' (bucle cerrado).
+    Peticiones y latencias solo se cuentan desde que todas sus conexiones
+        están establecidas (o han fallado), para no mezclar la fase de conexión.
+    */
+    gen_thread_t *g = (gen_thread_t *)arg;
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t deadline = monotonic_ns() + (uint64_t)(g->seconds * 1e9);
+    int opened = 0;
+    int pending = 0;
+    int err;
+    socklen_t len;
+
+    while (monotonic_ns() < deadline) {
+        while (opened < g->nconns && pending < CONNECT_BATCH) {
+            gen_conn_t *c = &g->conns[opened];
+            if (gen_open(g, c, g->first + opened) == 0) {
+                pending++;
+            } else {
+                c->fd = -1;
+                g->failed++;
+            }
+            opened++;
+        }
+        int n = epoll_wait(g->epfd, events, MAX_EVENTS, 10);
+        for (int i = 0; i < n; ++i) {
+            gen_conn_t *c = events[i].data.ptr;
+            if (c->fd < 0)
+                continue;
+            if (c->state == GEN_CONNECTING) {
+                pending--;
+                err = 0;
+                len = sizeof(err);
+                getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+                    close(c->fd);
+                    c->fd = -1;
+                    g->failed++;
+                    continue;
+                }
+                g->established++;
+                gen_start_request(c);
+            }
+            if (gen_service(g, c) < 0) {
+                close(c->fd);
+                c->fd = -1;
+                g->dropped++;
+            }
+        }
+        if (!g->ready_ns && opened == g->nconns && pending == 0)
+            g->ready_ns = monotonic_ns();
+    }
+    if (g->ready_ns)
+        g->rate = g->requests / ((monotonic_ns() - g->ready_ns) / 1e9);
+    for (int i = 0; i < opened; ++i)
+        if (g->conns[i].fd >= 0)
+            close(g->conns[i].fd);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int run_load(int port, int conns, double seconds, gen_result_t *res) {
+    /*
+    Lanza GEN_THREADS hilos con 'conns' conexiones en total contra 127.0.0.1:port
+        y resume conexiones establecidas, peticiones por segundo y latencia p50/p99.
+    */
+    gen_thread_t g[GEN_THREADS];
+    uint64_t *all;
+    size_t total = 0;
+    int base = 0;
+
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+    memset(res, 0, sizeof(*res));
+    for (int t = 0; t < GEN_THREADS; ++t) {
+        memset(&g[t], 0, sizeof(g[t]));
+        g[t].port = port;
+        g[t].total = conns;
+        g[t].first = base;
+        g[t].nconns = conns / GEN_THREADS + (t < conns % GEN_THREADS);
+        g[t].seconds = seconds;
+        g[t].epfd = epoll_create1(0);
+        g[t].conns = calloc(g[t].nconns ? g[t].nconns : 1, sizeof(gen_conn_t));
+        g[t].samples = malloc(sizeof(uint64_t) * MAX_SAMPLES);
+        if (g[t].epfd < 0 || !g[t].conns || !g[t].samples) {
+            perror("generador: sin memoria o sin epoll");
+            return -1;
+        }
+        base += g[t].nconns;
+    }
+    for (int t = 0; t < GEN_THREADS; ++t)
+        pthread_create(&g[t].thread, NULL, gen_thread, &g[t]);
+    for (int t = 0; t < GEN_THREADS; ++t) {
+        pthread_join(g[t].thread, NULL);
+        res->established += g[t].established;
+        res->failed += g[t].failed;
+        res->dropped += g[t].dropped;
+        res->requests += g[t].requests;
+        res->rate += g[t].rate;
+        total += g[t].nsamples;
+    }
+    all = malloc(sizeof(uint64_t) * (total ? total : 1));
+    total = 0;
+    for (int t = 0; t < GEN_THREADS; ++t) {
+        if (all)
+            memcpy(all + total, g[t].samples, sizeof(uint64_t) * g[t].nsamples);
+        total += g[t].nsamples;
+        close(g[t].epfd);
+        free(g[t].conns);
+        free(g[t].samples);
+    }
+    if (all && total) {
+        qsort(all, total, sizeof(uint64_t), cmp_u64);
+        res->p50_us = all[total / 2] / 1e3;
+        res->p99_us = all[total * 99 / 100] / 1e3;
+    }
+    free(all);
+    return 0;
+}
+
+static void print_result(const char *mode, int conns, const gen_result_t *res) {
+    printf("%-7s %8d %8d %6d %6d %12.0f %10.1f %10.1f\n", mode, conns, res->established, res->failed,
+           res->dropped, res->rate, res->p50_us, res->p99_us);
+}
+
+static void print_header(void) {
+    printf("%-7s %8s %8s %6s %6s %12s %10s %10s\n", "modo", "conex", "estab", "fallo", "caídas", "pet/s",
+           "p50 us", "p99 us");
+}
+
+static int connection_benchmark(void) {
+    /*
+    Para cada modo y número de conexiones, arranca el servidor en un proceso
+        hijo (su propio límite de descriptores) y el generador en este proceso.
+    select se limita a lo que cabe en FD_SETSIZE; los casos que no caben en
+        RLIMIT_NOFILE se omiten (C100K necesita ulimit -n > 100000).
+    */
+    static const int sizes[] = {100, 1000, 10000, 100000};
+    static const server_mode_t modes[] = {MODE_SELECT, MODE_EPOLL, MODE_URING};
+    static const char *names[] = {"select", "epoll", "uring"};
+    long reactors = sysconf(_SC_NPROCESSORS_ONLN);
+    struct timespec settle = {0, 300 * 1000000L};
+    struct rlimit rl;
+    gen_result_t res;
+
+    raise_fd_limit();
+    getrlimit(RLIMIT_NOFILE, &rl);
+    printf("Núcleos: %ld, RLIMIT_NOFILE: %llu, %d hilos generadores, mensajes de %d bytes\n", reactors,
+           (unsigned long long)rl.rlim_cur, GEN_THREADS, MSG_SIZE);
+    print_header();
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            const char *name = names[modes[m]];
+            if (modes[m] == MODE_SELECT && sizes[s] > FD_SETSIZE - 16)
+                continue;
+            if ((rlim_t)sizes[s] + 64 > rl.rlim_cur) {
+                printf("%-7s %8d   omitido: RLIMIT_NOFILE insuficiente\n", name, sizes[s]);
+                continue;
+            }
+            fflush(stdout);
+            pid_t child = fork();
+            if (child == 0) {
+                fclose(stdout);
+                run_server(modes[m], PORT, (int)reactors);
+                _exit(0);
+            }
+            nanosleep(&settle, NULL);
+            if (run_load(PORT, sizes[s], sizes[s] >= 10000 ? 5.0 : 3.0, &res) == 0)
+                print_result(name, sizes[s], &res);
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long reactors = sysconf(_SC_NPROCESSORS_ONLN);
+    gen_result_t res;
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return connection_benchmark();
+    if (argc > 1 && strcmp(argv[1], "carga") == 0) {
+        int conns = argc > 2 ? atoi(argv[2]) : 10000;
+        double seconds = argc > 3 ? atof(argv[3]) : 10.0;
+        int port = argc > 4 ? atoi(argv[4]) : PORT;
+        if (run_load(port, conns, seconds, &res) != 0)
+            return EXIT_FAILURE;
+        print_header();
+        print_result("carga", conns, &res);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "select") == 0) {
+        run_server(MODE_SELECT, argc > 2 ? atoi(argv[2]) : PORT, 1);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "uring") == 0) {
+        if (argc > 3)
+            reactors = atoi(argv[3]);
+        run_server(MODE_URING, argc > 2 ? atoi(argv[2]) : PORT, reactors > 0 ? (int)reactors : 1);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "epoll") == 0) {
+        if (argc > 3)
+            reactors = atoi(argv[3]);
+        run_server(MODE_EPOLL, argc > 2 ? atoi(argv[2]) : PORT, reactors > 0 ? (int)reactors : 1);
+        return 0;
+    }
+    run_server(MODE_EPOLL, PORT, reactors > 0 ? (int)reactors : 1);
+    return 0;
+}
+
+/*
+Compila: gcc -O2 pthreads10.c -o nonblocking_io_pool -lpthread
+Ejecuta: ./nonblocking_io_pool [epoll [puerto] [reactores] | uring [puerto] [reactores] | select [puerto]]
+Carga: ./nonblocking_io_pool carga <conexiones> <segundos> [puerto]
+Benchmark: ./nonblocking_io_pool bench
+Explicación:
+    -Socket No Bloqueante:
+        Los sockets de escucha y de cliente se crean no bloqueantes
+        (SOCK_NONBLOCK en socket() y accept4()).
+        Las llamadas a accept(), recv() y send() retornan inmediatamente
+        con EAGAIN o EWOULDBLOCK cuando no pueden avanzar.
+
+    -Un Reactor epoll por Núcleo:
+        En lugar de un hilo con select() que delega cada socket aceptado a un
+        thread pool, cada núcleo tiene un reactor: un hilo con su propio epoll y
+        su propio socket de escucha en el mismo puerto (SO_REUSEPORT). El kernel
+        reparte las conexiones nuevas entre los listeners y cada conexión se queda
+        en su reactor, así que no hay locks ni colas compartidas entre hilos.
+        select() está limitado a FD_SETSIZE (1024) descriptores y recorre todos
+        en cada vuelta; epoll solo devuelve los que están listos.
+
+    -Edge-Triggered:
+        Las conexiones se registran una sola vez con EPOLLIN | EPOLLOUT | EPOLLET.
+        El kernel solo avisa cuando cambia el estado del socket, por lo que cada
+        aviso obliga a leer y escribir hasta EAGAIN.
+
+    -Backend io_uring:
+        El modo uring usa io_uring directamente sobre la ABI del kernel (sin
+        liburing): accept multishot en el listener, recv multishot por conexión
+        con un anillo de buffers provistos (el kernel elige el buffer, no hace
+        falta uno por conexión) y un send en vuelo por conexión. Todas las
+        operaciones preparadas en un lote de completados se envían en la misma
+        llamada a io_uring_enter que espera el siguiente lote, en lugar de un
+        recv()/send()/epoll_wait() por operación. Si el kernel no lo soporta
+        (o io_uring está deshabilitado) el servidor arranca con epoll.
+
+    -handle_client como Máquina de Estados:
+        handle_client ya no lee, responde y cierra de una vez: guarda el estado
+        de cada conexión (CONN_READING / CONN_WRITING, buffer y desplazamiento)
+        y avanza lo que pueda sin bloquear, incluidos los envíos parciales.
+        Mientras hay una respuesta pendiente deja de leer (contrapresión).
+        El modo select usa la misma máquina de estados como referencia.
+        Los estados de conexión salen de la caché slab del reactor (slab.h):
+        aceptar y cerrar miles de conexiones por segundo no pasa por malloc.
+
+    -Generador de Carga y Benchmark:
+        El modo carga abre miles de conexiones contra 127.0.0.1 en bucle cerrado
+        (petición de 64 bytes, espera del eco, siguiente petición) y mide
+        peticiones por segundo y latencia p50/p99. Para C100K reparte la IP de
+        origen entre 127.0.0.x y necesita subir ulimit -n en servidor y generador.
+        El modo bench arranca el servidor en un proceso hijo y compara select,
+        epoll e io_uring con 100, 1000, 10000 y 100000 conexiones
+        (peticiones por segundo y latencia p99).
+ */
@@ -1,237 +1,2490 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <fcntl.h>
-#include <sys/select.h>
-#include <errno.h>
-#include <unistd.h>
-#include <arpa/inet.h> // Para inet_ntoa y ntohs
-
-#define PORT 8080
-#define MAX_CLIENTS 10
-#define THREAD_POOL_SIZE 4
-#define MAX_TASKS 20
-#define BUFFER_SIZE 1024
-#define MAX_KEY_LENGTH 64
-#define MAX_VALUE_LENGTH 256
-
-// (Incluir aquí las definiciones de task_t y thread_pool_t del Bloque 10)
-typedef struct {
-    void (*function)(void *);
-    void *argument;
-} task_t;
-
-typedef struct {
-    task_t **tasks[1];
-    int head[1];
-    int tail[1];
-    int count[1];
-    int capacity;
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_not_empty[1];
-    pthread_cond_t queue_not_full[1];
-    pthread_t threads[THREAD_POOL_SIZE];
-    int shutdown;
-} thread_pool_t;
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument);
-void thread_pool_destroy(thread_pool_t *pool);
-void *worker(void *pool);
-
-// Estructura para el almacén clave-valor
-typedef struct {
-    char key[MAX_KEY_LENGTH];
-    char value[MAX_VALUE_LENGTH];
-} kv_entry_t;
-
-typedef struct {
-    kv_entry_t *store;
-    int capacity;
-    int size;
-    pthread_rwlock_t rwlock;
-} key_value_store_t;
-
-key_value_store_t *kv_store_create(int capacity);
-char *kv_store_get(key_value_store_t *store, const char *key);
-int kv_store_put(key_value_store_t *store, const char *key, const char *value);
-int kv_store_delete(key_value_store_t *store, const char *key);
-void kv_store_destroy(key_value_store_t *store);
-
-// Estructura para pasar información del cliente y el almacén a la tarea del thread pool
-typedef struct {
-    int client_fd;
-    key_value_store_t *store;
-} client_context_t;
-
-void handle_client(void *arg);
-
-// Implementaciones de thread pool (copia del Bloque 10)
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
-/* ... */
-}
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
-  /* ... */
-}
-void *worker(void *pool) {
-  /* ... */
-}
-void thread_pool_destroy(thread_pool_t *pool) {
-  /* ... */
-}
-
-// Implementaciones del almacén clave-valor
-key_value_store_t *kv_store_create(int capacity) {
-    /*
-    Crea e inicializa el almacén clave-valor concurrente.
-
-    - Asigna memoria para la estructura del almacén.
-    - Asigna memoria para el array de entradas clave-valor.
-    - Inicializa el read-write lock para controlar el acceso concurrente.
-    */
-}
-
-char *kv_store_get(key_value_store_t *store, const char *key) {
-    /*
-    Obtiene el valor asociado a una clave del almacén de forma concurrente para lectores.
-
-    - Adquiere el read lock.
-    - Itera a través del almacén para buscar la clave.
-    - Si se encuentra, libera el lock y retorna el valor.
-    - Si no se encuentra, libera el lock y retorna NULL.
-    */
-}
-
-int kv_store_put(key_value_store_t *store, const char *key, const char *value) {
-    /*
-    Inserta o actualiza un par clave-valor en el almacén con escritura exclusiva.
-
-    - Adquiere el write lock.
-    - Busca si la clave ya existe para actualizar el valor.
-    - Si no existe y hay espacio, añade una nueva entrada.
-    - Libera el lock y retorna 0 en éxito, -1 si no hay espacio.
-    */
-}
-
-int kv_store_delete(key_value_store_t *store, const char *key) {
-    /*
-    Elimina un par clave-valor del almacén con escritura exclusiva.
-
-    - Adquiere el write lock.
-    - Busca la clave y, si se encuentra, la elimina moviendo las entradas restantes.
-    - Libera el lock y retorna 0 en éxito, -1 si no se encuentra.
-    */
-}
-
-void handle_client(void *arg) {
-    /*
-    Maneja las peticiones de un cliente en un hilo del thread pool.
-
-    - Recibe el descriptor del socket del cliente y el almacén clave-valor.
-    - Lee comandos del cliente (GET, PUT, DELETE).
-    - Parsea el comando y la clave (y el valor para PUT).
-    - Realiza la operación correspondiente en el almacén clave-valor.
-    - Envía una respuesta al cliente.
-    - Cierra la conexión.
-    */
-}
-
-int main() {
-    int server_fd, new_socket, max_fd;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    fd_set readfds;
-    thread_pool_t pool;
-    key_value_store_t *store;
-
-    // Inicializar el thread pool
-    thread_pool_init(&pool, THREAD_POOL_SIZE, MAX_TASKS);
-
-    // Crear el almacén clave-valor
-    store = kv_store_create(100); // Capacidad para 100 entradas
-    if (!store) {
-        perror("kv_store_create failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Crear socket del servidor (igual que en el Bloque 10)
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) { /* ... */ }
-    int flags = fcntl(server_fd, F_GETFL, 0);
-    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) < 0) { /* ... */ }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) { /* ... */ }
-    if (listen(server_fd, MAX_CLIENTS) < 0) { /* ... */ }
-    printf("Servidor escuchando en el puerto %d...\n", PORT);
-
-    while (1) {
-        FD_ZERO(&readfds);
-        FD_SET(server_fd, &readfds);
-        max_fd = server_fd;
-
-        int activity = select(max_fd + 1, &readfds, NULL, NULL, NULL);
-
-        if ((activity < 0) && (errno != EINTR)) { /* ... */ }
-
-        if (FD_ISSET(server_fd, &readfds)) {
-            if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) { /* ... */ }
-            printf("Nueva conexión aceptada, socket fd es %d, IP es: %s, puerto: %d\n", new_socket, inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-            flags = fcntl(new_socket, F_GETFL, 0);
-            if (fcntl(new_socket, F_SETFL, flags | O_NONBLOCK) < 0) { /* ... */ }
-
-            client_context_t *context = malloc(sizeof(client_context_t));
-            if (!context) { /* ... */ }
-            context->client_fd = new_socket;
-            context->store = store;
-            thread_pool_submit(&pool, handle_client, context);
-        }
-    }
-
-    close(server_fd);
-    thread_pool_destroy(&pool);
-    kv_store_destroy(store);
-    return 0;
-}
-
-Compila: gcc pthreads11.c -o concurrent_kv_store -lpthread
-Ejecuta: ./concurrent_kv_store
-Explicación:
-    -Almacén Clave-Valor Concurrente:
-        Se implementa una estructura key_value_store_t
-        que utiliza un array para almacenar las entradas clave-valor
-        y un pthread_rwlock_t para controlar el acceso concurrente.
-        Esto permite que múltiples lectores accedan al almacén simultáneamente,
-        pero requiere un lock exclusivo para las operaciones de escritura (PUT y DELETE).
-
-    -Operaciones del Almacén:
-        Se proporcionan funciones para crear, obtener, insertar/actualizar
-        y eliminar pares clave-valor de forma thread-safe.
-
-    -Integración con el Servidor No Bloqueante y el Thread Pool:
-        Al igual que en el Bloque 10,
-        se utiliza un servidor no bloqueante con select para aceptar conexiones.
-        Cada conexión aceptada se pasa como una tarea al thread pool.
-
-    -handle_client con Almacén:
-        La función handle_client ahora recibe un client_context_t
-        que contiene tanto el descriptor del socket del cliente como un puntero
-        al almacén clave-valor compartido.
-
-    -Protocolo Simple:
-        El cliente puede enviar comandos simples como GET <key>,
-        PUT <key> <value>, y DELETE <key>.
-        El servidor responde con OK, VALUE <value>, NOT_FOUND, o ERROR.
-
-Para probar este servidor:
-
-        Ejecuta el programa concurrent_kv_store.
-            Puedes usar la herramienta netcat (nc) desde otra terminal
-            para interactuar con el servidor.
-    Por ejemplo:
-        Para insertar un valor: echo "PUT mykey myvalue" | nc localhost 8080
-        Para obtener un valor: echo "GET mykey" | nc localhost 8080
-        Para eliminar una clave: echo "DELETE mykey" | nc localhost 8080
\ No newline at end of file
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define PORT 8080
+#define LISTEN_BACKLOG 1024
+#define MAX_EVENTS 256
+#define IN_INITIAL 4096        // buffer de entrada inicial por conexión
+#define MAX_LINE (1 << 20)     // línea más larga admitida (MPUT grandes)
+#define IOV_BATCH 1024         // iovecs por lote de respuestas (un writev, IOV_MAX en Linux)
+#define SCRATCH_SIZE 2048      // cabeceras con número de un lote ("VALUES n", "OK n", tramas binarias)
+#define BIN_HEADER 8           // trama binaria: u32 longitud | u8 op | u8 estado | u16 n
+#define BIN_ITEM 8             // elemento: u32 longitud de clave | u32 longitud de valor
+#define BIN_GET 1
+#define BIN_PUT 2
+#define BIN_DELETE 3
+#define BIN_OK 0
+#define BIN_NOT_FOUND 1
+#define BIN_ERROR 2
+#define KV_SEGMENTS 256        // segmentos con su propio rwlock (potencia de 2, <= 256)
+#define KV_MIN_BUCKETS 8
+#define KV_REHASH_STEP 16      // buckets migrados por cada escritura durante un rehash
+#define KV_FSYNC_INTERVAL_MS 10               // group commit: un fdatasync cada intervalo
+#define KV_SNAPSHOT_INTERVAL_S 300
+#define KV_SNAPSHOT_LOG_BYTES (256UL << 20)   // snapshot anticipado si el log crece más
+#define KV_LOG_FLUSH_BYTES (4UL << 20)        // vuelca antes del intervalo si hay tanto pendiente
+
+/*
+Valor con contador de referencias. kv_store_get devuelve una referencia
+propia: el valor sigue siendo válido aunque otro hilo lo sustituya o borre
+la clave, hasta que el lector llame a kv_value_release.
+*/
+typedef struct {
+    size_t len;
+    atomic_int refs;
+    unsigned char wire_len[4];   // 'len' en orden de red justo antes de los datos (respuesta binaria sin copia)
+    char data[];                 // 'len' bytes más un '\0' final
+} kv_value_t;
+
+_Static_assert(offsetof(kv_value_t, data) == offsetof(kv_value_t, wire_len) + 4, "wire_len debe preceder a data");
+
+typedef struct kv_entry {
+    struct kv_entry *next;
+    uint64_t hash;
+    kv_value_t *value;
+    size_t key_len;
+    char key[];
+} kv_entry_t;
+
+/*
+Segmento de la tabla: una tabla hash encadenada con su propio rwlock.
+Durante un rehash conviven la tabla anterior ('old_buckets') y la nueva;
+los buckets anteriores a 'migrate_pos' ya se han movido.
+*/
+typedef struct {
+    _Alignas(64) pthread_rwlock_t rwlock;
+    kv_entry_t **buckets;
+    size_t mask;
+    kv_entry_t **old_buckets;
+    size_t old_mask;
+    size_t migrate_pos;
+    size_t count;
+    long rehashes;
+} kv_segment_t;
+
+typedef struct {
+    kv_segment_t *segments;
+    size_t segment_mask;
+    struct kv_persist *persist;   // NULL: almacén solo en memoria
+} key_value_store_t;
+
+typedef struct {
+    size_t size;
+    long rehashes;          // rehashes iniciados en todos los segmentos
+    int rehashing;          // segmentos con un rehash en curso
+} kv_stats_t;
+
+key_value_store_t *kv_store_create(int capacity);
+kv_value_t *kv_store_get(key_value_store_t *store, const char *key, size_t key_len);
+void kv_value_release(kv_value_t *value);
+int kv_store_put(key_value_store_t *store, const char *key, size_t key_len, const char *value, size_t value_len);
+int kv_store_delete(key_value_store_t *store, const char *key, size_t key_len);
+void kv_store_get_stats(key_value_store_t *store, kv_stats_t *stats);
+void kv_store_destroy(key_value_store_t *store);
+
+typedef struct {
+    int fsync_interval_ms;        // group commit: las escrituras de cada intervalo comparten un fdatasync
+    int snapshot_interval_s;      // 0: sin snapshots periódicos
+    size_t snapshot_log_bytes;    // snapshot anticipado cuando el log supera este tamaño (0: nunca)
+} kv_persist_config_t;
+
+typedef struct {
+    size_t snapshot_keys;         // claves cargadas del snapshot al arrancar
+    size_t replayed;              // registros del log reaplicados al arrancar
+    uint64_t load_ns;             // tiempo de cargar el snapshot
+    uint64_t replay_ns;           // tiempo de reaplicar la cola del log
+    long commits;                 // volcados con fdatasync del group commit
+    long snapshots;
+    long errors;                  // volcados o snapshots fallidos, escrituras rechazadas sin memoria para el log
+    uint64_t generation;
+} kv_persist_stats_t;
+
+typedef struct kv_persist kv_persist_t;
+
+kv_persist_t *kv_persist_open(key_value_store_t *store, const char *dir, const kv_persist_config_t *config);
+int kv_persist_sync(kv_persist_t *p);
+int kv_persist_snapshot(kv_persist_t *p);
+void kv_persist_get_stats(kv_persist_t *p, kv_persist_stats_t *stats);
+void kv_persist_close(kv_persist_t *p);
+
+/*
+Estado de una conexión persistente: buffer de entrada con las órdenes
+recibidas (puede haber varias y una a medias) y el lote de respuestas
+pendiente de enviar con un único writev. Los GET apuntan directamente al
+valor guardado; 'held' mantiene esas referencias hasta que el lote sale.
+Cada conexión empieza en modo texto y pasa a tramas binarias con BINARY.
+*/
+typedef struct {
+    int fd;
+    int binary;
+    key_value_store_t *store;
+    char *in;
+    size_t in_len;
+    size_t in_off;
+    size_t in_cap;
+    struct iovec iov[IOV_BATCH];
+    int iov_cnt;
+    int iov_pos;
+    kv_value_t *held[IOV_BATCH];
+    int held_cnt;
+    char scratch[SCRATCH_SIZE];
+    size_t scratch_len;
+} conn_t;
+
+// Un reactor por núcleo: su propio listener (SO_REUSEPORT) y su propio epoll
+typedef struct {
+    int listen_fd;
+    int epfd;
+    key_value_store_t *store;
+    pthread_t thread;
+} reactor_t;
+
+int handle_client(conn_t *conn);
+static uint64_t monotonic_ns(void);
+static int kv_log_append(kv_persist_t *p, int op, const char *key, size_t key_len, const char *value, size_t value_len);
+
+// Implementaciones del almacén clave-valor
+static uint64_t kv_hash(const char *key, size_t len) {
+    // FNV-1a de 64 bits con mezcla final: los bits altos eligen segmento y los bajos bucket
+    uint64_t h = 1469598103934665603ULL;
+
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+static kv_segment_t *kv_segment(key_value_store_t *store, uint64_t h) {
+    return &store->segments[(h >> 56) & store->segment_mask];
+}
+
+static kv_value_t *kv_value_create(const char *data, size_t len) {
+    kv_value_t *value = malloc(sizeof(kv_value_t) + len + 1);
+
+    if (!value)
+        return NULL;
+    uint32_t wire_len = htonl((uint32_t)len);
+
+    atomic_init(&value->refs, 1);
+    value->len = len;
+    memcpy(value->wire_len, &wire_len, 4);
+    memcpy(value->data, data, len);
+    value->data[len] = '\0';
+    return value;
+}
+
+void kv_value_release(kv_value_t *value) {
+    if (value && atomic_fetch_sub_explicit(&value->refs, 1, memory_order_acq_rel) == 1)
+        free(value);
+}
+
+static key_value_store_t *kv_store_create_segments(int capacity, int num_segments) {
+    /*
+    Crea el almacén con 'num_segments' segmentos (potencia de 2, <= 256).
+    'capacity' solo dimensiona las tablas iniciales: cada segmento crece
+    por separado y sin límite.
+    */
+    key_value_store_t *store = malloc(sizeof(key_value_store_t));
+    size_t buckets = KV_MIN_BUCKETS;
+
+    if (!store)
+        return NULL;
+    while (buckets * 3 / 4 * (size_t)num_segments < (size_t)capacity)
+        buckets <<= 1;
+    store->segment_mask = num_segments - 1;
+    store->persist = NULL;
+    store->segments = aligned_alloc(64, sizeof(kv_segment_t) * num_segments);
+    if (!store->segments) {
+        free(store);
+        return NULL;
+    }
+    for (int i = 0; i < num_segments; ++i) {
+        kv_segment_t *seg = &store->segments[i];
+        pthread_rwlock_init(&seg->rwlock, NULL);
+        seg->buckets = calloc(buckets, sizeof(kv_entry_t *));
+        seg->mask = buckets - 1;
+        seg->old_buckets = NULL;
+        seg->old_mask = 0;
+        seg->migrate_pos = 0;
+        seg->count = 0;
+        seg->rehashes = 0;
+        if (!seg->buckets) {
+            store->segment_mask = i ? i - 1 : 0;
+            kv_store_destroy(store);
+            return NULL;
+        }
+    }
+    return store;
+}
+
+key_value_store_t *kv_store_create(int capacity) {
+    /*
+    Crea e inicializa el almacén clave-valor concurrente.
+
+    - Asigna memoria para la estructura del almacén.
+    - Reparte las claves en KV_SEGMENTS segmentos según los bits altos del hash;
+        cada segmento es una tabla hash encadenada con su propio rwlock, así que
+        operaciones sobre segmentos distintos no compiten entre sí.
+    - Dimensiona cada segmento para 'capacity' entradas en total con factor de
+        carga 0.75; no es un límite, las tablas crecen solas.
+    */
+    return kv_store_create_segments(capacity, KV_SEGMENTS);
+}
+
+static kv_entry_t **kv_find(kv_segment_t *seg, uint64_t h, const char *key, size_t key_len) {
+    /*
+    Busca la clave en el segmento (con su lock tomado). Retorna el enlace que
+    apunta a la entrada, para poder borrarla, o NULL.
+
+    - Si hay un rehash en curso y el bucket antiguo de la clave aún no se ha
+        migrado, mira primero ahí; las inserciones nuevas van siempre a la tabla nueva.
+    */
+    kv_entry_t **link;
+
+    if (seg->old_buckets && (h & seg->old_mask) >= seg->migrate_pos) {
+        for (link = &seg->old_buckets[h & seg->old_mask]; *link; link = &(*link)->next)
+            if ((*link)->hash == h && (*link)->key_len == key_len && memcmp((*link)->key, key, key_len) == 0)
+                return link;
+    }
+    for (link = &seg->buckets[h & seg->mask]; *link; link = &(*link)->next)
+        if ((*link)->hash == h && (*link)->key_len == key_len && memcmp((*link)->key, key, key_len) == 0)
+            return link;
+    return NULL;
+}
+
+static void kv_migrate(kv_segment_t *seg) {
+    // Mueve hasta KV_REHASH_STEP buckets de la tabla anterior a la nueva (write lock tomado).
+    for (int step = 0; step < KV_REHASH_STEP && seg->old_buckets; ++step) {
+        kv_entry_t *e = seg->old_buckets[seg->migrate_pos];
+        while (e) {
+            kv_entry_t *next = e->next;
+            e->next = seg->buckets[e->hash & seg->mask];
+            seg->buckets[e->hash & seg->mask] = e;
+            e = next;
+        }
+        seg->old_buckets[seg->migrate_pos] = NULL;
+        if (++seg->migrate_pos > seg->old_mask) {
+            free(seg->old_buckets);
+            seg->old_buckets = NULL;
+        }
+    }
+}
+
+static void kv_maybe_grow(kv_segment_t *seg) {
+    /*
+    Inicia un rehash incremental si el segmento supera el factor de carga 0.75.
+    No mueve nada aquí: solo cambia a una tabla del doble de tamaño y deja la
+    anterior para que cada escritura posterior migre KV_REHASH_STEP buckets.
+    Así ninguna operación paga el coste de mover el segmento entero.
+    */
+    kv_entry_t **buckets;
+
+    if (seg->old_buckets || seg->count <= (seg->mask + 1) / 4 * 3)
+        return;
+    buckets = calloc((seg->mask + 1) * 2, sizeof(kv_entry_t *));
+    if (!buckets)
+        return; // sin memoria: se sigue con cadenas más largas
+    seg->old_buckets = seg->buckets;
+    seg->old_mask = seg->mask;
+    seg->migrate_pos = 0;
+    seg->buckets = buckets;
+    seg->mask = seg->mask * 2 + 1;
+    seg->rehashes++;
+}
+
+kv_value_t *kv_store_get(key_value_store_t *store, const char *key, size_t key_len) {
+    /*
+    Obtiene el valor asociado a una clave del almacén de forma concurrente para lectores.
+
+    - Calcula el hash y elige el segmento.
+    - Adquiere el read lock del segmento (solo bloquea a escritores de ese segmento).
+    - Busca la clave en su bucket, O(1) de media.
+    - Si se encuentra, suma una referencia al valor antes de liberar el lock.
+    - Retorna el valor (liberar con kv_value_release) o NULL si no existe.
+    */
+    uint64_t h = kv_hash(key, key_len);
+    kv_segment_t *seg = kv_segment(store, h);
+    kv_value_t *value = NULL;
+    kv_entry_t **link;
+
+    pthread_rwlock_rdlock(&seg->rwlock);
+    link = kv_find(seg, h, key, key_len);
+    if (link) {
+        value = (*link)->value;
+        atomic_fetch_add_explicit(&value->refs, 1, memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&seg->rwlock);
+    return value;
+}
+
+static kv_entry_t *kv_entry_create(uint64_t h, const char *key, size_t key_len, kv_value_t *value) {
+    kv_entry_t *entry = malloc(sizeof(kv_entry_t) + key_len);
+
+    if (!entry)
+        return NULL;
+    entry->hash = h;
+    entry->value = value;
+    entry->key_len = key_len;
+    memcpy(entry->key, key, key_len);
+    return entry;
+}
+
+static void kv_link(kv_segment_t *seg, kv_entry_t *entry) {
+    // Engancha una entrada nueva en la tabla nueva (write lock tomado). No falla.
+    entry->next = seg->buckets[entry->hash & seg->mask];
+    seg->buckets[entry->hash & seg->mask] = entry;
+    seg->count++;
+    kv_maybe_grow(seg);
+}
+
+static int kv_insert(kv_segment_t *seg, uint64_t h, const char *key, size_t key_len, kv_value_t *value) {
+    // Añade una entrada nueva (la clave no existe; write lock tomado). Retorna -1 si no hay memoria.
+    kv_entry_t *entry = kv_entry_create(h, key, key_len, value);
+
+    if (!entry)
+        return -1;
+    kv_link(seg, entry);
+    return 0;
+}
+
+int kv_store_put(key_value_store_t *store, const char *key, size_t key_len, const char *value, size_t value_len) {
+    /*
+    Inserta o actualiza un par clave-valor en el almacén con escritura exclusiva.
+
+    - Copia el valor fuera del lock.
+    - Adquiere el write lock del segmento de la clave.
+    - Avanza el rehash incremental del segmento si hay uno en curso.
+    - Si la clave ya existe, sustituye el valor; el anterior se libera cuando
+        lo suelte el último lector.
+    - Si no existe, añade una entrada en la tabla nueva y, si hace falta,
+        inicia un rehash incremental.
+    - Con persistencia, añade el registro al log antes de tocar la tabla y
+        con el lock tomado: las escrituras de una misma clave quedan en el log
+        en el orden en que se aplican, y si el registro no cabe la tabla no
+        cambia. Todo lo que puede fallar (memoria de la entrada y del log) va
+        antes del cambio.
+    - Libera el lock y retorna 0 en éxito, -1 si no hay memoria.
+    */
+    uint64_t h = kv_hash(key, key_len);
+    kv_segment_t *seg = kv_segment(store, h);
+    kv_value_t *new_value = kv_value_create(value, value_len);
+    kv_value_t *old_value = NULL;
+    kv_entry_t *entry = NULL;
+    kv_entry_t **link;
+
+    if (!new_value)
+        return -1;
+    pthread_rwlock_wrlock(&seg->rwlock);
+    kv_migrate(seg);
+    link = kv_find(seg, h, key, key_len);
+    if ((!link && !(entry = kv_entry_create(h, key, key_len, new_value))) ||
+        (store->persist && kv_log_append(store->persist, 'P', key, key_len, value, value_len) < 0)) {
+        pthread_rwlock_unlock(&seg->rwlock);
+        free(entry);
+        kv_value_release(new_value);
+        return -1;
+    }
+    if (link) {
+        old_value = (*link)->value;
+        (*link)->value = new_value;
+    } else {
+        kv_link(seg, entry);
+    }
+    pthread_rwlock_unlock(&seg->rwlock);
+    kv_value_release(old_value);
+    return 0;
+}
+
+int kv_store_delete(key_value_store_t *store, const char *key, size_t key_len) {
+    /*
+    Elimina un par clave-valor del almacén con escritura exclusiva.
+
+    - Adquiere el write lock del segmento y avanza su rehash si hay uno en curso.
+    - Busca la clave y, si se encuentra, con persistencia añade el borrado al
+        log y después la desengancha de su cadena en O(1). Si el registro no
+        cabe en el log la clave se queda.
+    - Libera el lock, después la entrada, y retorna 0 en éxito, 1 si no se
+        encuentra, -1 si no se pudo registrar el borrado.
+    */
+    uint64_t h = kv_hash(key, key_len);
+    kv_segment_t *seg = kv_segment(store, h);
+    kv_entry_t *entry = NULL;
+    kv_entry_t **link;
+
+    pthread_rwlock_wrlock(&seg->rwlock);
+    kv_migrate(seg);
+    link = kv_find(seg, h, key, key_len);
+    if (link && store->persist && kv_log_append(store->persist, 'D', key, key_len, NULL, 0) < 0) {
+        pthread_rwlock_unlock(&seg->rwlock);
+        return -1;
+    }
+    if (link) {
+        entry = *link;
+        *link = entry->next;
+        seg->count--;
+    }
+    pthread_rwlock_unlock(&seg->rwlock);
+    if (!entry)
+        return 1;
+    kv_value_release(entry->value);
+    free(entry);
+    return 0;
+}
+
+void kv_store_get_stats(key_value_store_t *store, kv_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i <= store->segment_mask; ++i) {
+        kv_segment_t *seg = &store->segments[i];
+        pthread_rwlock_rdlock(&seg->rwlock);
+        stats->size += seg->count;
+        stats->rehashes += seg->rehashes;
+        stats->rehashing += seg->old_buckets != NULL;
+        pthread_rwlock_unlock(&seg->rwlock);
+    }
+}
+
+static void kv_free_chain(kv_entry_t *e) {
+    while (e) {
+        kv_entry_t *next = e->next;
+        kv_value_release(e->value);
+        free(e);
+        e = next;
+    }
+}
+
+void kv_store_destroy(key_value_store_t *store) {
+    if (!store)
+        return;
+    for (size_t i = 0; i <= store->segment_mask; ++i) {
+        kv_segment_t *seg = &store->segments[i];
+        for (size_t b = 0; seg->buckets && b <= seg->mask; ++b)
+            kv_free_chain(seg->buckets[b]);
+        for (size_t b = seg->migrate_pos; seg->old_buckets && b <= seg->old_mask; ++b)
+            kv_free_chain(seg->old_buckets[b]);
+        free(seg->buckets);
+        free(seg->old_buckets);
+        pthread_rwlock_destroy(&seg->rwlock);
+    }
+    free(store->segments);
+    free(store);
+}
+
+/* ---- Persistencia: log de escrituras con group commit y snapshots compactos ---- */
+
+#define KV_LOG_HEADER 13        // crc32, operación ('P'/'D'), longitud de clave y de valor
+#define KV_SNAP_MAGIC "KVSNAP01"
+#define KV_SNAP_END "KVSNPEND"
+
+/*
+Ficheros en el directorio de persistencia, numerados por generación:
+log.<G> con las escrituras posteriores a la rotación G y snapshot.<G> con el
+estado completo desde esa misma rotación. Para arrancar basta el snapshot de
+generación más alta y los logs de esa generación en adelante.
+*/
+struct kv_persist {
+    key_value_store_t *store;
+    char *dir;
+    kv_persist_config_t config;
+    pthread_mutex_t log_mutex;      // buffer, descriptor y generación del log
+    pthread_cond_t flush_cond;
+    pthread_cond_t snap_cond;
+    char *buf;                      // registros aún no escritos
+    size_t len;
+    size_t cap;
+    char *spare;                    // segundo buffer: sale a disco mientras se llena el otro
+    size_t spare_cap;
+    int log_fd;
+    off_t log_synced;               // bytes de log.<G> ya en disco (io_mutex): tras un fallo se trunca aquí
+    int log_failed;                 // el log no se pudo recomponer: se rechazan las escrituras
+    size_t log_bytes;               // tamaño del log de la generación actual
+    uint64_t generation;
+    int snap_pending;
+    int stop;
+    pthread_mutex_t io_mutex;       // un volcado (o una rotación) a la vez
+    pthread_mutex_t snap_mutex;     // un snapshot a la vez
+    pthread_t flusher;
+    pthread_t snapshotter;
+    kv_persist_stats_t stats;       // datos del arranque
+    atomic_long commits;
+    atomic_long snapshots;
+    atomic_long errors;
+};
+
+static uint32_t crc32_table[256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+            c = (c >> 1) ^ (0xEDB88320U & -(c & 1));
+        crc32_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    crc = ~crc;
+    while (len--)
+        crc = crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static int kv_write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void kv_path(const kv_persist_t *p, char *path, const char *kind, uint64_t gen, const char *suffix) {
+    snprintf(path, PATH_MAX, "%s/%s.%llu%s", p->dir, kind, (unsigned long long)gen, suffix);
+}
+
+static int kv_parse_name(const char *name, const char *kind, uint64_t *gen) {
+    // "log.12" -> 12; cualquier otro nombre (incluidos los .tmp) retorna 0
+    size_t n = strlen(kind);
+    char *end;
+
+    if (strncmp(name, kind, n) != 0 || name[n] != '.' || name[n + 1] < '0' || name[n + 1] > '9')
+        return 0;
+    *gen = strtoull(name + n + 1, &end, 10);
+    return *end == '\0';
+}
+
+static void kv_sync_dir(const char *dir) {
+    // Los rename y los ficheros nuevos solo son permanentes tras el fsync del directorio
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static void kv_remove_older(kv_persist_t *p, uint64_t gen) {
+    // Borra snapshots y logs de generaciones anteriores a 'gen' y snapshots a medias
+    char path[PATH_MAX];
+    struct dirent *de;
+    DIR *d = opendir(p->dir);
+    uint64_t g;
+
+    if (!d)
+        return;
+    while ((de = readdir(d))) {
+        size_t n = strlen(de->d_name);
+        int tmp = strncmp(de->d_name, "snapshot.", 9) == 0 && n > 4 && strcmp(de->d_name + n - 4, ".tmp") == 0;
+        if (tmp || ((kv_parse_name(de->d_name, "snapshot", &g) || kv_parse_name(de->d_name, "log", &g)) && g < gen)) {
+            snprintf(path, sizeof(path), "%s/%s", p->dir, de->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+static int kv_log_append(kv_persist_t *p, int op, const char *key, size_t key_len, const char *value, size_t value_len) {
+    /*
+    Añade un registro al buffer del log (con el write lock del segmento tomado).
+    No toca el disco: el hilo de group commit vuelca el buffer y hace un solo
+    fdatasync para todas las escrituras de cada intervalo.
+    Retorna -1 si el buffer no puede crecer o el log ha fallado sin remedio:
+    el llamador no aplica la escritura.
+    */
+    size_t need = KV_LOG_HEADER + key_len + value_len;
+    unsigned char hdr[KV_LOG_HEADER];
+    uint32_t klen = (uint32_t)key_len;
+    uint32_t vlen = (uint32_t)value_len;
+    uint32_t crc;
+
+    hdr[4] = (unsigned char)op;
+    memcpy(hdr + 5, &klen, 4);
+    memcpy(hdr + 9, &vlen, 4);
+    crc = crc32_update(crc32_update(crc32_update(0, hdr + 4, 9), key, key_len), value, value_len);
+    memcpy(hdr, &crc, 4);
+
+    pthread_mutex_lock(&p->log_mutex);
+    if (p->log_failed) {
+        pthread_mutex_unlock(&p->log_mutex);
+        return -1;
+    }
+    if (p->len + need > p->cap) {
+        size_t cap = p->cap ? p->cap : KV_LOG_FLUSH_BYTES;
+        char *buf;
+        while (cap < p->len + need)
+            cap *= 2;
+        buf = realloc(p->buf, cap);
+        if (!buf) {
+            pthread_mutex_unlock(&p->log_mutex);
+            atomic_fetch_add(&p->errors, 1);
+            return -1;
+        }
+        p->buf = buf;
+        p->cap = cap;
+    }
+    memcpy(p->buf + p->len, hdr, KV_LOG_HEADER);
+    memcpy(p->buf + p->len + KV_LOG_HEADER, key, key_len);
+    if (value_len)
+        memcpy(p->buf + p->len + KV_LOG_HEADER + key_len, value, value_len);
+    p->len += need;
+    p->log_bytes += need;
+    if (p->len >= KV_LOG_FLUSH_BYTES && p->len - need < KV_LOG_FLUSH_BYTES)
+        pthread_cond_signal(&p->flush_cond);
+    if (p->config.snapshot_log_bytes && p->log_bytes >= p->config.snapshot_log_bytes && !p->snap_pending) {
+        p->snap_pending = 1;
+        pthread_cond_signal(&p->snap_cond);
+    }
+    pthread_mutex_unlock(&p->log_mutex);
+    return 0;
+}
+
+static size_t kv_log_take(kv_persist_t *p, char **buf) {
+    // Intercambia los buffers (log_mutex tomado): los escritores siguen con el vacío
+    char *full = p->buf;
+    size_t cap = p->cap;
+    size_t len = p->len;
+
+    p->buf = p->spare;
+    p->cap = p->spare_cap;
+    p->len = 0;
+    p->spare = full;
+    p->spare_cap = cap;
+    *buf = full;
+    return len;
+}
+
+static int kv_log_write(kv_persist_t *p, int fd, off_t *synced, const char *buf, size_t len) {
+    /*
+    Escribe un bloque de registros y hace fdatasync. Si falla, trunca el
+    fichero a 'synced', lo último que llegó entero al disco: con O_APPEND una
+    escritura corta dejaría un registro roto, el replay se pararía en él y se
+    perderían los registros escritos detrás. Retorna 0, -1 si falló (el
+    fichero queda como estaba) o -2 si además no se pudo truncar.
+    */
+    if (len == 0)
+        return 0;
+    if (kv_write_all(fd, buf, len) < 0 || fdatasync(fd) < 0) {
+        perror("kv log write failed");
+        atomic_fetch_add(&p->errors, 1);
+        if (ftruncate(fd, *synced) < 0) {
+            perror("ftruncate log failed");
+            return -2;
+        }
+        return -1;
+    }
+    *synced += (off_t)len;
+    atomic_fetch_add(&p->commits, 1);
+    return 0;
+}
+
+static void kv_log_requeue(kv_persist_t *p, const char *buf, size_t len) {
+    /*
+    Devuelve los registros de un volcado fallido al principio del buffer
+    (log_mutex tomado), delante de los que llegaron mientras tanto: el
+    siguiente volcado los reintenta en el mismo orden. Si no caben, el log
+    se da por perdido y las escrituras nuevas se rechazan en vez de
+    confirmarse.
+    */
+    if (p->len + len > p->cap) {
+        char *grown = realloc(p->buf, p->len + len);
+        if (!grown) {
+            p->log_failed = 1;
+            return;
+        }
+        p->buf = grown;
+        p->cap = p->len + len;
+    }
+    memmove(p->buf + len, p->buf, p->len);
+    memcpy(p->buf, buf, len);
+    p->len += len;
+}
+
+int kv_persist_sync(kv_persist_t *p) {
+    /*
+    Group commit: vuelca todo lo acumulado con un write y un único fdatasync.
+    El hilo de fondo lo llama cada fsync_interval_ms (antes si hay
+    KV_LOG_FLUSH_BYTES pendientes); llamarlo directamente garantiza que las
+    escrituras anteriores están en disco. Retorna 0, o -1 si falla la escritura.
+
+    - Intercambia los buffers con el lock del log, que se suelta enseguida:
+        los escritores nunca esperan al disco.
+    - io_mutex evita que dos volcados o una rotación se intercalen en el fichero.
+    - Si el volcado falla, el fichero vuelve a su último tamaño bueno y los
+        registros al buffer para el siguiente intento. Si no se puede truncar,
+        detrás del registro roto nada sería recuperable: el log se marca como
+        fallido y kv_log_append rechaza las escrituras.
+    */
+    char *buf;
+    size_t len;
+    int fd, rc;
+
+    pthread_mutex_lock(&p->io_mutex);
+    pthread_mutex_lock(&p->log_mutex);
+    len = kv_log_take(p, &buf);
+    fd = p->log_fd;
+    pthread_mutex_unlock(&p->log_mutex);
+    rc = kv_log_write(p, fd, &p->log_synced, buf, len);
+    if (rc < 0) {
+        pthread_mutex_lock(&p->log_mutex);
+        if (rc == -2)
+            p->log_failed = 1;
+        else
+            kv_log_requeue(p, buf, len);
+        pthread_mutex_unlock(&p->log_mutex);
+        rc = -1;
+    }
+    pthread_mutex_unlock(&p->io_mutex);
+    return rc;
+}
+
+static int kv_log_rotate(kv_persist_t *p, uint64_t *generation) {
+    /*
+    Cierra el log actual (volcado y fdatasync) y pasa al de la generación
+    siguiente. Si el último volcado falla, sus registros pasan al principio
+    del log nuevo: siguen en orden y delante de todo lo posterior. Un
+    registro roto al final del log viejo no importa, porque ya no se le
+    añade nada y el replay sigue con la generación siguiente.
+    */
+    char path[PATH_MAX];
+    char *buf;
+    size_t len;
+    off_t old_synced;
+    int fd, old_fd, rc;
+
+    pthread_mutex_lock(&p->io_mutex);
+    kv_path(p, path, "log", p->generation + 1, "");
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open log failed");
+        pthread_mutex_unlock(&p->io_mutex);
+        return -1;
+    }
+    kv_sync_dir(p->dir);
+    pthread_mutex_lock(&p->log_mutex);
+    len = kv_log_take(p, &buf);
+    old_fd = p->log_fd;
+    old_synced = p->log_synced;
+    p->log_fd = fd;
+    p->log_synced = 0;
+    p->log_bytes = 0;
+    *generation = ++p->generation;
+    pthread_mutex_unlock(&p->log_mutex);
+    rc = kv_log_write(p, old_fd, &old_synced, buf, len);
+    if (rc < 0) {
+        pthread_mutex_lock(&p->log_mutex);
+        kv_log_requeue(p, buf, len);
+        p->log_bytes += len;
+        pthread_mutex_unlock(&p->log_mutex);
+        rc = -1;
+    }
+    close(old_fd);
+    pthread_mutex_unlock(&p->io_mutex);
+    return rc;
+}
+
+static int kv_snapshot_chain(kv_entry_t *e, char **buf, size_t *len, size_t *cap, uint64_t *count) {
+    // Serializa una cadena de entradas como [klen][vlen][clave][valor]
+    for (; e; e = e->next) {
+        uint32_t klen = (uint32_t)e->key_len;
+        uint32_t vlen = (uint32_t)e->value->len;
+        size_t need = 8 + klen + vlen;
+        if (*len + need > *cap) {
+            size_t new_cap = *cap ? *cap * 2 : 1 << 20;
+            char *grown;
+            while (new_cap < *len + need)
+                new_cap *= 2;
+            if (!(grown = realloc(*buf, new_cap)))
+                return -1;
+            *buf = grown;
+            *cap = new_cap;
+        }
+        memcpy(*buf + *len, &klen, 4);
+        memcpy(*buf + *len + 4, &vlen, 4);
+        memcpy(*buf + *len + 8, e->key, klen);
+        memcpy(*buf + *len + 8 + klen, e->value->data, vlen);
+        *len += need;
+        (*count)++;
+    }
+    return 0;
+}
+
+int kv_persist_snapshot(kv_persist_t *p) {
+    /*
+    Escribe un snapshot compacto (una entrada por clave viva) y descarta los
+    logs que cubre. Lo llama el hilo de fondo cada snapshot_interval_s o cuando
+    el log supera snapshot_log_bytes.
+
+    - Rota el log: las escrituras siguientes van a log.<G> y el snapshot será
+        snapshot.<G>.
+    - Recorre los segmentos de uno en uno con su read lock: los lectores no se
+        bloquean nunca y un escritor espera como mucho la copia de un segmento.
+        La escritura en disco se hace fuera del lock.
+    - Una escritura que llega durante el recorrido puede quedar en el snapshot
+        y también en log.<G>; reaplicarla al arrancar da el mismo resultado,
+        porque cada registro fija el estado final de su clave.
+    - Escribe snapshot.<G>.tmp, hace fsync y lo renombra: un snapshot a medias
+        nunca sustituye al anterior. Después borra las generaciones anteriores.
+    - Retorna 0 en éxito, -1 si falla (el snapshot anterior y sus logs siguen valiendo).
+    */
+    char tmp[PATH_MAX], path[PATH_MAX];
+    char *buf = NULL;
+    size_t cap = 0;
+    uint64_t gen, count = 0;
+    int fd, failed = 0;
+
+    pthread_mutex_lock(&p->snap_mutex);
+    if (kv_log_rotate(p, &gen) < 0) {
+        pthread_mutex_unlock(&p->snap_mutex);
+        return -1;
+    }
+    kv_path(p, tmp, "snapshot", gen, ".tmp");
+    kv_path(p, path, "snapshot", gen, "");
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open snapshot failed");
+        pthread_mutex_unlock(&p->snap_mutex);
+        return -1;
+    }
+    failed = kv_write_all(fd, KV_SNAP_MAGIC, 8) < 0 || kv_write_all(fd, (char *)&count, 8) < 0;
+    for (size_t i = 0; i <= p->store->segment_mask && !failed; ++i) {
+        kv_segment_t *seg = &p->store->segments[i];
+        size_t len = 0;
+        pthread_rwlock_rdlock(&seg->rwlock);
+        for (size_t b = 0; b <= seg->mask && !failed; ++b)
+            failed = kv_snapshot_chain(seg->buckets[b], &buf, &len, &cap, &count) < 0;
+        for (size_t b = seg->migrate_pos; seg->old_buckets && b <= seg->old_mask && !failed; ++b)
+            failed = kv_snapshot_chain(seg->old_buckets[b], &buf, &len, &cap, &count) < 0;
+        pthread_rwlock_unlock(&seg->rwlock);
+        failed = failed || kv_write_all(fd, buf, len) < 0;
+    }
+    failed = failed || kv_write_all(fd, KV_SNAP_END, 8) < 0 || kv_write_all(fd, (char *)&count, 8) < 0 ||
+             pwrite(fd, &count, 8, 8) != 8 || fsync(fd) < 0;
+    close(fd);
+    free(buf);
+    if (failed || rename(tmp, path) < 0) {
+        perror("snapshot failed");
+        unlink(tmp);
+        atomic_fetch_add(&p->errors, 1);
+        pthread_mutex_unlock(&p->snap_mutex);
+        return -1;
+    }
+    kv_sync_dir(p->dir);
+    kv_remove_older(p, gen);
+    atomic_fetch_add(&p->snapshots, 1);
+    pthread_mutex_unlock(&p->snap_mutex);
+    return 0;
+}
+
+static void kv_store_reserve(key_value_store_t *store, size_t entries) {
+    // Dimensiona los segmentos vacíos para 'entries' claves en total (reparto uniforme más un margen)
+    size_t per_segment = entries / (store->segment_mask + 1);
+
+    per_segment += per_segment / 8 + KV_MIN_BUCKETS;
+    for (size_t i = 0; i <= store->segment_mask; ++i) {
+        kv_segment_t *seg = &store->segments[i];
+        size_t buckets = seg->mask + 1;
+        kv_entry_t **table;
+        if (seg->count || seg->old_buckets)
+            continue;
+        while (buckets / 4 * 3 < per_segment)
+            buckets <<= 1;
+        if (buckets == seg->mask + 1 || !(table = calloc(buckets, sizeof(kv_entry_t *))))
+            continue;
+        free(seg->buckets);
+        seg->buckets = table;
+        seg->mask = buckets - 1;
+    }
+}
+
+static void *kv_map_file(int fd, size_t *size) {
+    struct stat st;
+    void *map;
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        *size = 0;
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+static int kv_snapshot_load(kv_persist_t *p, uint64_t gen) {
+    /*
+    Carga snapshot.<gen> con mmap: claves y valores se copian directamente del
+    mapeo a sus entradas, sin lecturas por bloques ni buffers intermedios.
+
+    - Comprueba las marcas de inicio y fin y que el número de claves coincide.
+    - Dimensiona los segmentos para todas las claves antes de insertar: la
+        carga no provoca ningún rehash.
+    - Las claves de un snapshot son únicas: se insertan sin buscarlas antes
+        (todavía no hay otros hilos, así que tampoco hacen falta los locks).
+    */
+    char path[PATH_MAX];
+    const char *map;
+    size_t size, off = 16;
+    uint64_t count, end_count;
+    int fd;
+
+    kv_path(p, path, "snapshot", gen, "");
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror("open snapshot failed");
+        return -1;
+    }
+    map = kv_map_file(fd, &size);
+    close(fd);
+    if (!map || size < 32 || memcmp(map, KV_SNAP_MAGIC, 8) != 0 || memcmp(map + size - 16, KV_SNAP_END, 8) != 0) {
+        fprintf(stderr, "%s: snapshot no válido\n", path);
+        if (map)
+            munmap((void *)map, size);
+        return -1;
+    }
+    memcpy(&count, map + 8, 8);
+    memcpy(&end_count, map + size - 8, 8);
+    if (count == end_count)
+        kv_store_reserve(p->store, count);
+    for (uint64_t i = 0; i < count && count == end_count; ++i) {
+        uint32_t klen, vlen;
+        if (size - 16 - off < 8)
+            break;
+        memcpy(&klen, map + off, 4);
+        memcpy(&vlen, map + off + 4, 4);
+        if (size - 16 - off - 8 < (size_t)klen + vlen)
+            break;
+        const char *key = map + off + 8;
+        uint64_t h = kv_hash(key, klen);
+        kv_value_t *value = kv_value_create(key + klen, vlen);
+        if (!value || kv_insert(kv_segment(p->store, h), h, key, klen, value) < 0) {
+            kv_value_release(value);
+            munmap((void *)map, size);
+            fprintf(stderr, "%s: sin memoria para cargar el snapshot\n", path);
+            return -1;
+        }
+        off += 8 + (size_t)klen + vlen;
+        p->stats.snapshot_keys++;
+    }
+    munmap((void *)map, size);
+    if (p->stats.snapshot_keys != count || count != end_count || off != size - 16) {
+        fprintf(stderr, "%s: snapshot no válido\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static long kv_log_replay(kv_persist_t *p, uint64_t gen, int last) {
+    /*
+    Reaplica log.<gen> sobre el almacén. Cada registro lleva un CRC32: uno
+    incompleto o corrupto marca el final de lo que llegó al disco antes de
+    una caída. En el último log se trunca ahí, para que los registros nuevos
+    no queden detrás de basura. Retorna los registros aplicados o -1.
+    */
+    char path[PATH_MAX];
+    const char *map;
+    size_t size, off = 0;
+    long applied = 0;
+    int fd;
+
+    kv_path(p, path, "log", gen, "");
+    if ((fd = open(path, (last ? O_RDWR : O_RDONLY) | O_CLOEXEC)) < 0)
+        return errno == ENOENT ? 0 : -1;
+    map = kv_map_file(fd, &size);
+    if (!map) {
+        close(fd);
+        return size == 0 ? 0 : -1;
+    }
+    while (size - off >= KV_LOG_HEADER) {
+        uint32_t crc, klen, vlen;
+        const char *rec = map + off;
+        memcpy(&crc, rec, 4);
+        memcpy(&klen, rec + 5, 4);
+        memcpy(&vlen, rec + 9, 4);
+        if (size - off - KV_LOG_HEADER < (size_t)klen + vlen ||
+            crc32_update(0, rec + 4, 9 + (size_t)klen + vlen) != crc || (rec[4] != 'P' && rec[4] != 'D'))
+            break;
+        const char *key = rec + KV_LOG_HEADER;
+        if (rec[4] == 'D') {
+            kv_store_delete(p->store, key, klen);
+        } else if (kv_store_put(p->store, key, klen, key + klen, vlen) < 0) {
+            munmap((void *)map, size);
+            close(fd);
+            return -1;
+        }
+        off += KV_LOG_HEADER + (size_t)klen + vlen;
+        applied++;
+    }
+    if (off < size) {
+        fprintf(stderr, "%s: %zu bytes finales incompletos descartados\n", path, size - off);
+        if (last && ftruncate(fd, (off_t)off) < 0)
+            perror("ftruncate log failed");
+    }
+    munmap((void *)map, size);
+    close(fd);
+    return applied;
+}
+
+static void kv_deadline(struct timespec *ts, long ms) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *kv_flusher_thread(void *arg) {
+    // Group commit: un volcado cada fsync_interval_ms, o antes si el buffer supera KV_LOG_FLUSH_BYTES
+    kv_persist_t *p = (kv_persist_t *)arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&p->log_mutex);
+    while (!p->stop) {
+        kv_deadline(&deadline, p->config.fsync_interval_ms);
+        while (!p->stop && p->len < KV_LOG_FLUSH_BYTES &&
+               pthread_cond_timedwait(&p->flush_cond, &p->log_mutex, &deadline) != ETIMEDOUT)
+            ;
+        pthread_mutex_unlock(&p->log_mutex);
+        kv_persist_sync(p);
+        pthread_mutex_lock(&p->log_mutex);
+    }
+    pthread_mutex_unlock(&p->log_mutex);
+    return NULL;
+}
+
+static void *kv_snapshot_thread(void *arg) {
+    // Un snapshot cada snapshot_interval_s si ha habido escrituras, o en cuanto el log supera snapshot_log_bytes
+    kv_persist_t *p = (kv_persist_t *)arg;
+    struct timespec deadline;
+    int timed_out;
+
+    pthread_mutex_lock(&p->log_mutex);
+    while (!p->stop) {
+        timed_out = 0;
+        if (p->config.snapshot_interval_s > 0)
+            kv_deadline(&deadline, p->config.snapshot_interval_s * 1000L);
+        while (!p->stop && !p->snap_pending && !timed_out) {
+            if (p->config.snapshot_interval_s > 0)
+                timed_out = pthread_cond_timedwait(&p->snap_cond, &p->log_mutex, &deadline) == ETIMEDOUT;
+            else
+                pthread_cond_wait(&p->snap_cond, &p->log_mutex);
+        }
+        if (p->stop)
+            break;
+        p->snap_pending = 0;
+        if (p->log_bytes == 0)
+            continue;
+        pthread_mutex_unlock(&p->log_mutex);
+        kv_persist_snapshot(p);
+        pthread_mutex_lock(&p->log_mutex);
+    }
+    pthread_mutex_unlock(&p->log_mutex);
+    return NULL;
+}
+
+kv_persist_t *kv_persist_open(key_value_store_t *store, const char *dir, const kv_persist_config_t *config) {
+    /*
+    Recupera el almacén desde 'dir' y activa la persistencia de sus escrituras.
+    El almacén debe estar vacío y nadie debe usarlo hasta que retorne.
+
+    - Busca el snapshot de generación más alta y los logs de esa generación en
+        adelante (si una rotación no llegó a completar su snapshot, hay varios).
+    - Carga el snapshot y reaplica los logs en orden de generación.
+    - Abre el último log para seguir añadiendo registros y arranca los hilos
+        de group commit y de snapshots.
+    - Retorna NULL si no puede recuperar los datos (no arranca con datos a
+        medias); el almacén puede haber quedado cargado en parte.
+    */
+    kv_persist_t *p;
+    kv_stats_t stats;
+    pthread_condattr_t attr;
+    struct dirent *de;
+    struct stat st;
+    char path[PATH_MAX];
+    uint64_t g, snap_gen = 0, first_log = UINT64_MAX, last_gen = 0;
+    uint64_t start;
+    int has_snap = 0;
+    DIR *d;
+
+    pthread_once(&crc32_once, crc32_init);
+    kv_store_get_stats(store, &stats);
+    if (stats.size) {
+        fprintf(stderr, "kv_persist_open: el almacén no está vacío\n");
+        return NULL;
+    }
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir failed");
+        return NULL;
+    }
+    if (!(d = opendir(dir))) {
+        perror("opendir failed");
+        return NULL;
+    }
+    while ((de = readdir(d))) {
+        if (kv_parse_name(de->d_name, "snapshot", &g) && (!has_snap || g > snap_gen)) {
+            snap_gen = g;
+            has_snap = 1;
+        } else if (kv_parse_name(de->d_name, "log", &g)) {
+            first_log = g < first_log ? g : first_log;
+            last_gen = g > last_gen ? g : last_gen;
+        }
+    }
+    closedir(d);
+    if (!(p = calloc(1, sizeof(kv_persist_t))) || !(p->dir = strdup(dir))) {
+        free(p);
+        return NULL;
+    }
+    p->log_fd = -1;
+    p->store = store;
+    p->config = *config;
+    if (p->config.fsync_interval_ms < 1)
+        p->config.fsync_interval_ms = 1;
+    if (has_snap && snap_gen > last_gen)
+        last_gen = snap_gen;
+
+    start = monotonic_ns();
+    if (has_snap && kv_snapshot_load(p, snap_gen) < 0)
+        goto fail;
+    p->stats.load_ns = monotonic_ns() - start;
+    start = monotonic_ns();
+    for (g = has_snap ? snap_gen : (first_log == UINT64_MAX ? 0 : first_log); g <= last_gen; ++g) {
+        long applied = kv_log_replay(p, g, g == last_gen);
+        if (applied < 0) {
+            perror("log replay failed");
+            goto fail;
+        }
+        p->stats.replayed += applied;
+    }
+    p->stats.replay_ns = monotonic_ns() - start;
+
+    p->generation = last_gen;
+    kv_path(p, path, "log", last_gen, "");
+    if ((p->log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0 || fstat(p->log_fd, &st) < 0) {
+        perror("open log failed");
+        goto fail;
+    }
+    p->log_bytes = (size_t)st.st_size;
+    p->log_synced = st.st_size;
+    kv_sync_dir(dir);
+    if (has_snap)
+        kv_remove_older(p, snap_gen);
+
+    pthread_mutex_init(&p->log_mutex, NULL);
+    pthread_mutex_init(&p->io_mutex, NULL);
+    pthread_mutex_init(&p->snap_mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&p->flush_cond, &attr);
+    pthread_cond_init(&p->snap_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    atomic_init(&p->commits, 0);
+    atomic_init(&p->snapshots, 0);
+    atomic_init(&p->errors, 0);
+    store->persist = p;
+    pthread_create(&p->flusher, NULL, kv_flusher_thread, p);
+    pthread_create(&p->snapshotter, NULL, kv_snapshot_thread, p);
+    return p;
+
+fail:
+    if (p->log_fd >= 0)
+        close(p->log_fd);
+    free(p->dir);
+    free(p);
+    return NULL;
+}
+
+void kv_persist_get_stats(kv_persist_t *p, kv_persist_stats_t *stats) {
+    *stats = p->stats;
+    stats->commits = atomic_load(&p->commits);
+    stats->snapshots = atomic_load(&p->snapshots);
+    stats->errors = atomic_load(&p->errors);
+    pthread_mutex_lock(&p->log_mutex);
+    stats->generation = p->generation;
+    pthread_mutex_unlock(&p->log_mutex);
+}
+
+void kv_persist_close(kv_persist_t *p) {
+    /*
+    Para los hilos de fondo (esperando a un snapshot en curso), vuelca lo
+    pendiente con un último fdatasync y desactiva la persistencia del almacén.
+    Se llama sin otros hilos escribiendo y antes de kv_store_destroy.
+    */
+    pthread_mutex_lock(&p->log_mutex);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->flush_cond);
+    pthread_cond_broadcast(&p->snap_cond);
+    pthread_mutex_unlock(&p->log_mutex);
+    pthread_join(p->flusher, NULL);
+    pthread_join(p->snapshotter, NULL);
+    kv_persist_sync(p);
+    p->store->persist = NULL;
+    close(p->log_fd);
+    pthread_mutex_destroy(&p->log_mutex);
+    pthread_mutex_destroy(&p->io_mutex);
+    pthread_mutex_destroy(&p->snap_mutex);
+    pthread_cond_destroy(&p->flush_cond);
+    pthread_cond_destroy(&p->snap_cond);
+    free(p->buf);
+    free(p->spare);
+    free(p->dir);
+    free(p);
+}
+
+static conn_t *conn_create(int fd, key_value_store_t *store) {
+    int one = 1;
+    conn_t *conn = calloc(1, sizeof(conn_t));
+
+    if (!conn || !(conn->in = malloc(IN_INITIAL))) {
+        free(conn);
+        close(fd);
+        return NULL;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn->fd = fd;
+    conn->in_cap = IN_INITIAL;
+    conn->store = store;
+    return conn;
+}
+
+static void conn_release_batch(conn_t *conn) {
+    // Suelta las referencias a valores enviados y vacía el lote de respuestas
+    for (int i = 0; i < conn->held_cnt; ++i)
+        kv_value_release(conn->held[i]);
+    conn->held_cnt = 0;
+    conn->iov_cnt = 0;
+    conn->iov_pos = 0;
+    conn->scratch_len = 0;
+}
+
+static void conn_close(conn_t *conn) {
+    conn_release_batch(conn);
+    close(conn->fd);
+    free(conn->in);
+    free(conn);
+}
+
+static void out_static(conn_t *conn, const char *text, size_t len) {
+    conn->iov[conn->iov_cnt].iov_base = (void *)text;
+    conn->iov[conn->iov_cnt].iov_len = len;
+    conn->iov_cnt++;
+}
+
+#define OUT_LITERAL(conn, text) out_static((conn), (text), sizeof(text) - 1)
+
+static void out_format(conn_t *conn, const char *prefix, int count) {
+    // Cabeceras con número ("VALUES 3\n", "OK 100\n") en el scratch de la conexión
+    char *dst = conn->scratch + conn->scratch_len;
+    int len = snprintf(dst, SCRATCH_SIZE - conn->scratch_len, "%s %d\n", prefix, count);
+
+    conn->scratch_len += len;
+    out_static(conn, dst, len);
+}
+
+static void out_value(conn_t *conn, kv_value_t *value) {
+    // Sin copia: el iovec apunta al valor y la conexión guarda la referencia hasta enviarlo
+    if (!value) {
+        OUT_LITERAL(conn, "NOT_FOUND\n");
+        return;
+    }
+    OUT_LITERAL(conn, "VALUE ");
+    out_static(conn, value->data, value->len);
+    OUT_LITERAL(conn, "\n");
+    conn->held[conn->held_cnt++] = value;
+}
+
+static int count_tokens(const char *s, const char *end) {
+    int n = 0;
+
+    while (s < end) {
+        while (s < end && *s == ' ')
+            s++;
+        if (s == end)
+            break;
+        n++;
+        while (s < end && *s != ' ')
+            s++;
+    }
+    return n;
+}
+
+static const char *next_token(const char **s, const char *end, size_t *len) {
+    const char *start;
+
+    while (*s < end && **s == ' ')
+        (*s)++;
+    start = *s;
+    while (*s < end && **s != ' ')
+        (*s)++;
+    *len = *s - start;
+    return *len ? start : NULL;
+}
+
+static int execute_command(conn_t *conn, const char *line, const char *end) {
+    /*
+    Ejecuta un comando y añade su respuesta al lote de la conexión.
+
+    - GET <k> / PUT <k> <valor hasta fin de línea> / DELETE <k>.
+    - MGET <k1> <k2> ...: responde "VALUES n" y una línea por clave
+        (hasta (IOV_BATCH - 1) / 3 claves por orden).
+    - MPUT <k1> <v1> <k2> <v2> ...: valores sin espacios; responde "OK n".
+    - BINARY: responde "OK" y el resto de la conexión usa tramas binarias
+        (execute_frame); puede ir seguido de tramas sin esperar la respuesta.
+    - Retorna -2 si la respuesta no cabe en lo que queda del lote (hay que
+        enviar lo acumulado y reintentar), 0 en otro caso.
+    */
+    const char *cmd, *key, *value;
+    size_t cmd_len, key_len, value_len;
+    int room = IOV_BATCH - conn->iov_cnt;
+    int n;
+
+    cmd = next_token(&line, end, &cmd_len);
+    if (!cmd) {
+        if (room < 1)
+            return -2;
+        OUT_LITERAL(conn, "ERROR\n");
+        return 0;
+    }
+    if (cmd_len == 6 && memcmp(cmd, "BINARY", 6) == 0) {
+        if (room < 1)
+            return -2;
+        conn->binary = 1;
+        OUT_LITERAL(conn, "OK\n");
+        return 0;
+    }
+    if (cmd_len == 4 && memcmp(cmd, "MGET", 4) == 0) {
+        n = count_tokens(line, end);
+        if (1 + 3 * n > IOV_BATCH || n == 0) {
+            if (room < 1)
+                return -2;
+            OUT_LITERAL(conn, "ERROR\n");
+            return 0;
+        }
+        if (1 + 3 * n > room || conn->scratch_len + 32 > SCRATCH_SIZE)
+            return -2;
+        out_format(conn, "VALUES", n);
+        while ((key = next_token(&line, end, &key_len)))
+            out_value(conn, kv_store_get(conn->store, key, key_len));
+        return 0;
+    }
+    if (room < 3 || conn->scratch_len + 32 > SCRATCH_SIZE)
+        return -2;
+    key = next_token(&line, end, &key_len);
+    if (!key) {
+        OUT_LITERAL(conn, "ERROR\n");
+    } else if (cmd_len == 3 && memcmp(cmd, "GET", 3) == 0) {
+        out_value(conn, kv_store_get(conn->store, key, key_len));
+    } else if (cmd_len == 3 && memcmp(cmd, "PUT", 3) == 0) {
+        value = line < end ? line + 1 : end;
+        if (value >= end)
+            OUT_LITERAL(conn, "ERROR\n");
+        else if (kv_store_put(conn->store, key, key_len, value, end - value) == 0)
+            OUT_LITERAL(conn, "OK\n");
+        else
+            OUT_LITERAL(conn, "ERROR\n");
+    } else if (cmd_len == 6 && memcmp(cmd, "DELETE", 6) == 0) {
+        n = kv_store_delete(conn->store, key, key_len);
+        if (n == 0)
+            OUT_LITERAL(conn, "OK\n");
+        else if (n > 0)
+            OUT_LITERAL(conn, "NOT_FOUND\n");
+        else
+            OUT_LITERAL(conn, "ERROR\n");
+    } else if (cmd_len == 4 && memcmp(cmd, "MPUT", 4) == 0) {
+        n = 0;
+        do {
+            value = next_token(&line, end, &value_len);
+            if (!value)
+                break;
+            if (kv_store_put(conn->store, key, key_len, value, value_len) == 0)
+                n++;
+        } while ((key = next_token(&line, end, &key_len)));
+        if (key && !value)
+            OUT_LITERAL(conn, "ERROR\n"); // clave final sin valor; los pares anteriores ya están guardados
+        else
+            out_format(conn, "OK", n);
+    } else {
+        OUT_LITERAL(conn, "ERROR\n");
+    }
+    return 0;
+}
+
+static int execute_frame(conn_t *conn, const char *frame, size_t len) {
+    /*
+    Ejecuta una trama binaria y añade su respuesta al lote.
+
+    - Trama (tras su u32 de longitud): u8 op | u8 0 | u16 n | n elementos
+        "u32 longitud de clave | u32 longitud de valor | clave | valor",
+        todo en orden de red.
+    - Claves y valores se usan directamente desde el buffer de entrada: sin
+        tokenizar ni copiar (PUT copia el valor al guardarlo, como en texto).
+    - Primero valida las longitudes de todos los elementos: una trama mal
+        formada no se aplica a medias.
+    - GET responde n elementos "u32 longitud | valor" (0xFFFFFFFF si la clave
+        no existe). Cada uno es un iovec sobre la longitud y los datos del
+        kv_value_t guardado: la respuesta tampoco se copia ni se formatea.
+    - PUT y DELETE responden solo la cabecera, con n = claves guardadas o borradas.
+    - Retorna -2 si la respuesta no cabe en lo que queda del lote.
+    */
+    static const uint32_t not_found = 0xFFFFFFFFU;
+    const char *end = frame + len;
+    const char *p = frame + 4;
+    uint32_t klen, vlen, body = 4, body_n;
+    uint16_t n = 0, count = 0;
+    int op = len >= 4 ? (unsigned char)frame[0] : 0;
+    int status = BIN_OK;
+    int hdr;
+    char *out;
+
+    if (len >= 4) {
+        memcpy(&n, frame + 2, 2);
+        n = ntohs(n);
+    }
+    if (len < 4 || (op != BIN_GET && op != BIN_PUT && op != BIN_DELETE) || (op == BIN_GET && n >= IOV_BATCH))
+        status = BIN_ERROR;
+    for (int i = 0; i < n && status == BIN_OK; ++i) {
+        if (end - p < BIN_ITEM) {
+            status = BIN_ERROR;
+            break;
+        }
+        memcpy(&klen, p, 4);
+        memcpy(&vlen, p + 4, 4);
+        p += BIN_ITEM;
+        if ((size_t)(end - p) < (size_t)ntohl(klen) + ntohl(vlen))
+            status = BIN_ERROR;
+        else
+            p += (size_t)ntohl(klen) + ntohl(vlen);
+    }
+    if (status == BIN_OK && p != end)
+        status = BIN_ERROR;
+    if (IOV_BATCH - conn->iov_cnt < 1 + (status == BIN_OK && op == BIN_GET ? n : 0) ||
+        conn->scratch_len + BIN_HEADER > SCRATCH_SIZE)
+        return -2;
+
+    hdr = conn->iov_cnt++; // la cabecera se completa al final, cuando se conoce la longitud
+    for (p = frame + 4; status != BIN_ERROR && p < end;) {
+        memcpy(&klen, p, 4);
+        memcpy(&vlen, p + 4, 4);
+        klen = ntohl(klen);
+        vlen = ntohl(vlen);
+        const char *key = p + BIN_ITEM;
+        p = key + klen + vlen;
+        if (op == BIN_GET) {
+            kv_value_t *value = kv_store_get(conn->store, key, klen);
+            count++;
+            if (!value) {
+                out_static(conn, (const char *)&not_found, 4);
+                body += 4;
+                status = BIN_NOT_FOUND;
+                continue;
+            }
+            out_static(conn, (const char *)value->wire_len, 4 + value->len);
+            conn->held[conn->held_cnt++] = value;
+            body += 4 + value->len;
+        } else if (op == BIN_PUT) {
+            if (kv_store_put(conn->store, key, klen, key + klen, vlen) == 0)
+                count++;
+            else
+                status = BIN_ERROR;
+        } else {
+            int rc = kv_store_delete(conn->store, key, klen);
+            if (rc == 0)
+                count++;
+            else
+                status = rc > 0 ? BIN_NOT_FOUND : BIN_ERROR;
+        }
+    }
+    out = conn->scratch + conn->scratch_len;
+    body_n = htonl(body);
+    count = htons(count);
+    memcpy(out, &body_n, 4);
+    out[4] = (char)op;
+    out[5] = (char)status;
+    memcpy(out + 6, &count, 2);
+    conn->iov[hdr].iov_base = out;
+    conn->iov[hdr].iov_len = BIN_HEADER;
+    conn->scratch_len += BIN_HEADER;
+    return 0;
+}
+
+static int flush_batch(conn_t *conn) {
+    /*
+    Envía el lote de respuestas con writev. Un envío parcial ajusta el iovec
+    en curso y deja el resto para cuando el socket vuelva a ser escribible.
+    Retorna 1 si se envió todo, 0 si queda pendiente (EAGAIN), -1 si hay error.
+    */
+    while (conn->iov_pos < conn->iov_cnt) {
+        ssize_t n = writev(conn->fd, conn->iov + conn->iov_pos, conn->iov_cnt - conn->iov_pos);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        while (n > 0 && conn->iov_pos < conn->iov_cnt) {
+            struct iovec *v = &conn->iov[conn->iov_pos];
+            if ((size_t)n >= v->iov_len) {
+                n -= v->iov_len;
+                conn->iov_pos++;
+            } else {
+                v->iov_base = (char *)v->iov_base + n;
+                v->iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+    conn_release_batch(conn);
+    return 1;
+}
+
+int handle_client(conn_t *conn) {
+    /*
+    Maneja las peticiones de un cliente con conexión persistente. Se llama cada
+        vez que el socket está listo para leer o escribir (epoll edge-triggered).
+
+    - Si hay un lote de respuestas pendiente, lo envía primero; mientras no
+        salga entero no se procesan más comandos (contrapresión).
+    - Procesa todas las líneas (o tramas, en modo binario) completas del
+        buffer de entrada (pipelining): cada respuesta se añade al lote en
+        lugar de enviarse por separado.
+    - Cuando el lote está lleno o no quedan líneas completas, lo envía con
+        un único writev.
+    - Si falta entrada, compacta el buffer (la línea a medias pasa al principio),
+        lo agranda hasta MAX_LINE si hace falta y lee hasta EAGAIN.
+    - Retorna -1 si hay que cerrar la conexión, 0 si sigue abierta.
+    */
+    ssize_t n;
+
+    while (1) {
+        if (conn->iov_cnt > 0) {
+            int flushed = flush_batch(conn);
+            if (flushed <= 0)
+                return flushed;
+        }
+        while (conn->in_off < conn->in_len) {
+            if (conn->binary) {
+                size_t avail = conn->in_len - conn->in_off;
+                uint32_t frame_len;
+                if (avail < 4)
+                    break;
+                memcpy(&frame_len, conn->in + conn->in_off, 4);
+                frame_len = ntohl(frame_len);
+                if (frame_len > MAX_LINE - 4)
+                    return -1; // trama demasiado larga: no se puede resincronizar
+                if (avail - 4 < frame_len || execute_frame(conn, conn->in + conn->in_off + 4, frame_len) == -2)
+                    break;
+                conn->in_off += 4 + frame_len;
+                continue;
+            }
+            char *line = conn->in + conn->in_off;
+            char *nl = memchr(line, '\n', conn->in_len - conn->in_off);
+            if (!nl)
+                break;
+            char *end = (nl > line && nl[-1] == '\r') ? nl - 1 : nl;
+            if (execute_command(conn, line, end) == -2)
+                break;
+            conn->in_off = nl + 1 - conn->in;
+        }
+        if (conn->iov_cnt > 0)
+            continue;
+
+        if (conn->in_off > 0) {
+            memmove(conn->in, conn->in + conn->in_off, conn->in_len - conn->in_off);
+            conn->in_len -= conn->in_off;
+            conn->in_off = 0;
+        }
+        if (conn->in_len == conn->in_cap) {
+            char *in;
+            if (conn->in_cap >= MAX_LINE)
+                return -1; // línea demasiado larga
+            in = realloc(conn->in, conn->in_cap * 2);
+            if (!in)
+                return -1;
+            conn->in = in;
+            conn->in_cap *= 2;
+        }
+        n = recv(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len, 0);
+        if (n > 0) {
+            conn->in_len += n;
+            continue;
+        }
+        if (n == 0)
+            return -1;
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return -1;
+    }
+}
+
+static int open_listener(int port) {
+    int one = 1;
+    int fd;
+    struct sockaddr_in address;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, LISTEN_BACKLOG) < 0) {
+        perror("listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void reactor_accept(reactor_t *r) {
+    struct epoll_event ev;
+    int fd;
+
+    while ((fd = accept4(r->listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0 || errno == EINTR || errno == ECONNABORTED) {
+        if (fd < 0)
+            continue;
+        conn_t *conn = conn_create(fd, r->store);
+        if (!conn)
+            continue;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            conn_close(conn);
+    }
+}
+
+static void *reactor_loop(void *arg) {
+    // Igual que en el Bloque 10: data.ptr == NULL es el listener
+    reactor_t *r = (reactor_t *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(r->epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait failed");
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            conn_t *conn = events[i].data.ptr;
+            if (!conn) {
+                reactor_accept(r);
+                continue;
+            }
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) || handle_client(conn) < 0)
+                conn_close(conn);
+        }
+    }
+    return NULL;
+}
+
+static void run_server(key_value_store_t *store, int port, int num_reactors) {
+    /*
+    Un reactor epoll por núcleo, cada uno con su listener SO_REUSEPORT
+        (ver Bloque 10). Todos comparten el mismo almacén.
+    */
+    reactor_t *reactors = calloc(num_reactors, sizeof(reactor_t));
+    struct epoll_event ev;
+
+    signal(SIGPIPE, SIG_IGN);
+    if (!reactors) {
+        perror("malloc reactors failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_reactors; ++i) {
+        reactors[i].store = store;
+        reactors[i].listen_fd = open_listener(port);
+        reactors[i].epfd = epoll_create1(0);
+        if (reactors[i].listen_fd < 0 || reactors[i].epfd < 0)
+            exit(EXIT_FAILURE);
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(reactors[i].epfd, EPOLL_CTL_ADD, reactors[i].listen_fd, &ev) < 0) {
+            perror("epoll_ctl listener failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("Servidor escuchando en el puerto %d (%d reactores)...\n", port, num_reactors);
+    fflush(stdout);
+    for (int i = 1; i < num_reactors; ++i)
+        pthread_create(&reactors[i].thread, NULL, reactor_loop, &reactors[i]);
+    reactor_loop(&reactors[0]);
+}
+
+/* ---- Benchmark estilo YCSB: claves con distribución zipfiana ---- */
+
+#define YCSB_RECORDS 100000
+#define YCSB_KEYSPACE (2 * YCSB_RECORDS)  // las escrituras también insertan claves nuevas
+#define YCSB_VALUE_SIZE 100
+#define YCSB_THETA 0.99
+#define YCSB_RUN_MS 500
+
+typedef struct {
+    int read_pct;
+    int put_pct;       // el resto son DELETE
+    const char *name;
+} ycsb_workload_t;
+
+typedef struct {
+    double zetan;
+    double alpha;
+    double eta;
+    double half_pow_theta;
+    uint64_t n;
+} zipf_t;
+
+typedef struct {
+    key_value_store_t *store;
+    const ycsb_workload_t *workload;
+    const zipf_t *zipf;
+    atomic_int *stop;
+    uint64_t rng;
+    long ops;
+    long hits;
+    pthread_t thread;
+} ycsb_thread_t;
+
+static char (*ycsb_keys)[16];
+static size_t *ycsb_key_len;
+static char ycsb_value[YCSB_VALUE_SIZE];
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static void zipf_init(zipf_t *z, uint64_t n, double theta) {
+    // Generador zipfiano de Gray et al., el mismo que usa YCSB
+    double zeta2 = 1.0 + pow(0.5, theta);
+
+    z->n = n;
+    z->zetan = 0;
+    for (uint64_t i = 1; i <= n; ++i)
+        z->zetan += 1.0 / pow((double)i, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+    z->half_pow_theta = pow(0.5, theta);
+}
+
+static uint64_t zipf_next(const zipf_t *z, uint64_t *rng) {
+    /*
+    Rango zipfiano y después mezclado (ScrambledZipfian de YCSB): las claves
+    calientes quedan repartidas por todo el espacio y no todas en el mismo segmento.
+    */
+    double u = (xorshift64(rng) >> 11) * (1.0 / 9007199254740992.0);
+    double uz = u * z->zetan;
+    uint64_t rank;
+
+    if (uz < 1.0)
+        rank = 0;
+    else if (uz < 1.0 + z->half_pow_theta)
+        rank = 1;
+    else
+        rank = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    rank ^= rank >> 31;
+    rank *= 0x9e3779b97f4a7c15ULL;
+    return (rank ^ (rank >> 29)) % z->n;
+}
+
+static void *ycsb_thread(void *arg) {
+    ycsb_thread_t *t = (ycsb_thread_t *)arg;
+
+    while (!atomic_load_explicit(t->stop, memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i) {
+            uint64_t k = zipf_next(t->zipf, &t->rng);
+            int op = (int)(xorshift64(&t->rng) % 100);
+            if (op < t->workload->read_pct) {
+                kv_value_t *v = kv_store_get(t->store, ycsb_keys[k], ycsb_key_len[k]);
+                if (v) {
+                    t->hits++;
+                    kv_value_release(v);
+                }
+            } else if (op < t->workload->read_pct + t->workload->put_pct) {
+                kv_store_put(t->store, ycsb_keys[k], ycsb_key_len[k], ycsb_value, YCSB_VALUE_SIZE);
+            } else {
+                kv_store_delete(t->store, ycsb_keys[k], ycsb_key_len[k]);
+            }
+        }
+        t->ops += 64;
+    }
+    return NULL;
+}
+
+static double ycsb_run(key_value_store_t *store, const ycsb_workload_t *w, const zipf_t *zipf, int nthreads) {
+    ycsb_thread_t threads[16];
+    struct timespec run = {YCSB_RUN_MS / 1000, (YCSB_RUN_MS % 1000) * 1000000L};
+    atomic_int stop;
+    uint64_t start;
+    long ops = 0;
+
+    atomic_init(&stop, 0);
+    start = monotonic_ns();
+    for (int i = 0; i < nthreads; ++i) {
+        threads[i] = (ycsb_thread_t){store, w, zipf, &stop, 0x9e3779b97f4a7c15ULL * (i + 1), 0, 0, 0};
+        pthread_create(&threads[i].thread, NULL, ycsb_thread, &threads[i]);
+    }
+    nanosleep(&run, NULL);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < nthreads; ++i) {
+        pthread_join(threads[i].thread, NULL);
+        ops += threads[i].ops;
+    }
+    return ops / ((monotonic_ns() - start) / 1e9);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static key_value_store_t *ycsb_preload(int num_segments) {
+    /*
+    Carga YCSB_RECORDS registros partiendo de una capacidad mínima, de modo que
+    la tabla crece decenas de veces durante la carga, y mide la latencia de cada
+    PUT: sin pausas de rehash completo, la máxima debe quedar en microsegundos.
+    */
+    key_value_store_t *store = kv_store_create_segments(1, num_segments);
+    uint64_t *lat = malloc(sizeof(uint64_t) * YCSB_RECORDS);
+    kv_stats_t stats;
+    uint64_t start;
+
+    if (!store || !lat) {
+        free(lat);
+        kv_store_destroy(store);
+        return NULL;
+    }
+    start = monotonic_ns();
+    for (int i = 0; i < YCSB_RECORDS; ++i) {
+        uint64_t t0 = monotonic_ns();
+        kv_store_put(store, ycsb_keys[i], ycsb_key_len[i], ycsb_value, YCSB_VALUE_SIZE);
+        lat[i] = monotonic_ns() - t0;
+    }
+    double ms = (monotonic_ns() - start) / 1e6;
+    qsort(lat, YCSB_RECORDS, sizeof(uint64_t), cmp_u64);
+    kv_store_get_stats(store, &stats);
+    printf("precarga %d segmentos: %d claves en %.1f ms, %ld rehashes, PUT p50 %.2f us p99.9 %.2f us máx %.2f us\n",
+           num_segments, YCSB_RECORDS, ms, stats.rehashes, lat[YCSB_RECORDS / 2] / 1e3,
+           lat[YCSB_RECORDS * 999 / 1000] / 1e3, lat[YCSB_RECORDS - 1] / 1e3);
+    free(lat);
+    return store;
+}
+
+static int kv_benchmark(void) {
+    static const ycsb_workload_t workloads[] = {
+        {95, 5, "lectura 95/5"},
+        {50, 40, "mixta 50/40/10"},
+        {5, 95, "escritura 5/95"},
+    };
+    static const int thread_counts[] = {1, 2, 4, 8};
+    static const int segment_counts[] = {1, KV_SEGMENTS};
+    zipf_t zipf;
+
+    ycsb_keys = malloc(sizeof(*ycsb_keys) * YCSB_KEYSPACE);
+    ycsb_key_len = malloc(sizeof(size_t) * YCSB_KEYSPACE);
+    if (!ycsb_keys || !ycsb_key_len)
+        return 1;
+    for (int i = 0; i < YCSB_KEYSPACE; ++i)
+        ycsb_key_len[i] = (size_t)snprintf(ycsb_keys[i], sizeof(ycsb_keys[i]), "user%010d", i);
+    memset(ycsb_value, 'v', sizeof(ycsb_value));
+    zipf_init(&zipf, YCSB_KEYSPACE, YCSB_THETA);
+
+    printf("YCSB: %d registros, espacio de %d claves, zipf %.2f, valores de %d bytes, CPUs en línea: %ld\n",
+           YCSB_RECORDS, YCSB_KEYSPACE, YCSB_THETA, YCSB_VALUE_SIZE, sysconf(_SC_NPROCESSORS_ONLN));
+    for (size_t s = 0; s < sizeof(segment_counts) / sizeof(segment_counts[0]); ++s) {
+        key_value_store_t *store = ycsb_preload(segment_counts[s]);
+        if (!store)
+            return 1;
+        printf("%-16s", "Mops/s");
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t)
+            printf(" %7d h", thread_counts[t]);
+        printf("\n");
+        for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w) {
+            printf("%-16s", workloads[w].name);
+            for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); ++t)
+                printf(" %9.2f", ycsb_run(store, &workloads[w], &zipf, thread_counts[t]) / 1e6);
+            printf("\n");
+        }
+        kv_store_destroy(store);
+        printf("\n");
+    }
+    free(ycsb_keys);
+    free(ycsb_key_len);
+    return 0;
+}
+
+/* ---- Benchmark de red: una orden por conexión frente a conexión persistente y pipelining ---- */
+
+#define NET_VALUE "sip:abonado@ims.example.com;expira=3600"
+
+static int net_connect(int port) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int net_send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int net_read_lines(int fd, int lines) {
+    // Lee hasta recibir 'lines' finales de línea (respuestas de una ráfaga)
+    char buf[65536];
+
+    while (lines > 0) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        for (ssize_t i = 0; i < n; ++i)
+            lines -= buf[i] == '\n';
+    }
+    return 0;
+}
+
+static int net_read_frames(int fd, int frames) {
+    // Lee hasta recibir 'frames' tramas binarias completas (respuestas de una ráfaga)
+    char buf[65536];
+    unsigned char hdr[4];
+    size_t hdr_len = 0, skip = 0;
+
+    while (frames > 0) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        for (ssize_t i = 0; i < n;) {
+            if (skip > 0) {
+                size_t k = (size_t)(n - i) < skip ? (size_t)(n - i) : skip;
+                skip -= k;
+                i += k;
+                frames -= skip == 0;
+                continue;
+            }
+            hdr[hdr_len++] = buf[i++];
+            if (hdr_len == 4) {
+                uint32_t len;
+                memcpy(&len, hdr, 4);
+                skip = ntohl(len);
+                hdr_len = 0;
+            }
+        }
+    }
+    return 0;
+}
+
+static size_t net_frame(char *dst, int op, long first, int n) {
+    // Trama binaria con las claves first .. first + n - 1 (y NET_VALUE si es PUT)
+    uint32_t vlen = op == BIN_PUT ? (uint32_t)strlen(NET_VALUE) : 0;
+    uint32_t word;
+    uint16_t count = htons((uint16_t)n);
+    char *p = dst + BIN_HEADER;
+
+    for (int i = 0; i < n; ++i) {
+        char key[24];
+        uint32_t klen = (uint32_t)snprintf(key, sizeof(key), "sub:%08ld", first + i);
+        word = htonl(klen);
+        memcpy(p, &word, 4);
+        word = htonl(vlen);
+        memcpy(p + 4, &word, 4);
+        memcpy(p + BIN_ITEM, key, klen);
+        memcpy(p + BIN_ITEM + klen, NET_VALUE, vlen);
+        p += BIN_ITEM + klen + vlen;
+    }
+    word = htonl((uint32_t)(p - dst - 4));
+    memcpy(dst, &word, 4);
+    dst[4] = (char)op;
+    dst[5] = 0;
+    memcpy(dst + 6, &count, 2);
+    return p - dst;
+}
+
+typedef struct {
+    const char *name;
+    int mode;        // 0: una conexión por orden, 1: persistente en texto, 2: persistente binaria
+    int get;         // lecturas de las claves cargadas por los casos anteriores
+    long records;
+    int depth;
+    int per_cmd;
+} net_case_t;
+
+static double net_run(int port, const net_case_t *c) {
+    /*
+    Carga (o lee) c->records registros con un solo cliente y retorna registros/s.
+
+    - mode 0: una conexión por orden PUT (el protocolo anterior).
+    - mode 1: conexión persistente; ráfagas de 'depth' órdenes seguidas
+        (depth 1: petición-respuesta) y una lectura de todas las respuestas.
+    - mode 2: igual, pero negocia BINARY y envía tramas.
+    - per_cmd > 1: MPUT/MGET (o tramas) con 'per_cmd' claves.
+    */
+    size_t cap = (size_t)c->depth * (c->per_cmd * 64 + 16) + 64;
+    char *req = malloc(cap);
+    uint64_t start = monotonic_ns();
+    long done = 0;
+    int fd = -1;
+
+    if (!req)
+        return 0;
+    if (c->mode > 0 && (fd = net_connect(port)) < 0) {
+        free(req);
+        return 0;
+    }
+    if (c->mode == 2 && (net_send_all(fd, "BINARY\n", 7) || net_read_lines(fd, 1))) {
+        close(fd);
+        free(req);
+        return 0;
+    }
+    while (done < c->records) {
+        size_t len = 0;
+        int cmds = 0, replies = 0;
+        for (; cmds < c->depth && done < c->records; ++cmds) {
+            int n = c->records - done < c->per_cmd ? (int)(c->records - done) : c->per_cmd;
+            if (c->mode == 2) {
+                len += net_frame(req + len, c->get ? BIN_GET : BIN_PUT, done, n);
+                done += n;
+            } else if (n == 1) {
+                if (c->get)
+                    len += snprintf(req + len, cap - len, "GET sub:%08ld\n", done++);
+                else
+                    len += snprintf(req + len, cap - len, "PUT sub:%08ld " NET_VALUE "\n", done++);
+            } else {
+                len += snprintf(req + len, cap - len, c->get ? "MGET" : "MPUT");
+                for (int k = 0; k < n; ++k) {
+                    if (c->get)
+                        len += snprintf(req + len, cap - len, " sub:%08ld", done++);
+                    else
+                        len += snprintf(req + len, cap - len, " sub:%08ld " NET_VALUE, done++);
+                }
+                req[len++] = '\n';
+            }
+            replies += c->mode < 2 && c->get && n > 1 ? n + 1 : 1;
+        }
+        if (c->mode == 0) {
+            if ((fd = net_connect(port)) < 0)
+                break;
+            int failed = net_send_all(fd, req, len) || net_read_lines(fd, replies);
+            close(fd);
+            if (failed)
+                break;
+        } else if (net_send_all(fd, req, len) ||
+                   (c->mode == 2 ? net_read_frames(fd, replies) : net_read_lines(fd, replies))) {
+            break;
+        }
+    }
+    if (c->mode > 0)
+        close(fd);
+    free(req);
+    return done / ((monotonic_ns() - start) / 1e9);
+}
+
+static uint64_t process_cpu_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int pipeline_benchmark(void) {
+    /*
+    Arranca el servidor en un proceso hijo y mide cuántos registros por segundo
+    carga (y después lee) un único cliente, como un script de aprovisionamiento,
+    con cada forma de usar el protocolo. La CPU por registro es la del proceso
+    servidor (clock_getcpuclockid), sin contar la del cliente.
+    */
+    static const net_case_t cases[] = {
+        {"PUT, una conexión por orden", 0, 0, 5000, 1, 1},
+        {"PUT, conexión persistente", 1, 0, 50000, 1, 1},
+        {"PUT, pipeline de 64", 1, 0, 500000, 64, 1},
+        {"PUT, pipeline de 512", 1, 0, 1000000, 512, 1},
+        {"PUT binario, pipeline de 512", 2, 0, 1000000, 512, 1},
+        {"MPUT x100, pipeline de 16", 1, 0, 2000000, 16, 100},
+        {"PUT binario x100, pipeline 16", 2, 0, 2000000, 16, 100},
+        {"GET, pipeline de 512", 1, 1, 1000000, 512, 1},
+        {"GET binario, pipeline de 512", 2, 1, 1000000, 512, 1},
+        {"MGET x100, pipeline de 16", 1, 1, 2000000, 16, 100},
+        {"GET binario x100, pipeline 16", 2, 1, 2000000, 16, 100},
+    };
+    struct timespec settle = {0, 300 * 1000000L};
+    int port = PORT + 1;
+    double base = 0;
+    clockid_t server_clock;
+    pid_t child;
+
+    fflush(stdout);
+    child = fork();
+    if (child == 0) {
+        fclose(stdout);
+        run_server(kv_store_create(1 << 20), port, 1);
+        _exit(0);
+    }
+    nanosleep(&settle, NULL);
+    if (clock_getcpuclockid(child, &server_clock) != 0) {
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+        return 1;
+    }
+    printf("Un cliente, valores de %zu bytes, servidor con 1 reactor, CPUs en línea: %ld\n", strlen(NET_VALUE),
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-30s %12s %8s %16s\n", "modo", "registros/s", "x", "CPU servidor/reg");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        uint64_t cpu = process_cpu_ns(server_clock);
+        double rate = net_run(port, &cases[i]);
+        cpu = process_cpu_ns(server_clock) - cpu;
+        if (i == 0)
+            base = rate;
+        printf("%-30s %12.0f %8.1f %13.0f ns\n", cases[i].name, rate, base > 0 ? rate / base : 0,
+               (double)cpu / cases[i].records);
+    }
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    return 0;
+}
+
+/* ---- Benchmark de arranque: snapshot más cola del log frente a reaplicar el log entero ---- */
+
+static size_t restart_dir_bytes(const char *dir, const char *kind) {
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct stat st;
+    size_t total = 0;
+    DIR *d = opendir(dir);
+    uint64_t g;
+
+    while (d && (de = readdir(d))) {
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (kv_parse_name(de->d_name, kind, &g) && stat(path, &st) == 0)
+            total += (size_t)st.st_size;
+    }
+    if (d)
+        closedir(d);
+    return total;
+}
+
+static void restart_cleanup(const char *dir) {
+    char path[PATH_MAX];
+    struct dirent *de;
+    DIR *d = opendir(dir);
+
+    while (d && (de = readdir(d))) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        unlink(path);
+    }
+    if (d)
+        closedir(d);
+    rmdir(dir);
+}
+
+static double restart_open(const char *dir, size_t expected, key_value_store_t **store, kv_persist_t **p) {
+    // Arranca un almacén vacío desde 'dir' y retorna los ms hasta que queda disponible
+    kv_persist_config_t config = {KV_FSYNC_INTERVAL_MS, 0, 0};
+    kv_stats_t stats;
+    uint64_t start;
+
+    *store = kv_store_create(1);
+    start = monotonic_ns();
+    *p = kv_persist_open(*store, dir, &config);
+    double ms = (monotonic_ns() - start) / 1e6;
+    if (!*p)
+        return -1;
+    kv_store_get_stats(*store, &stats);
+    if (stats.size != expected)
+        fprintf(stderr, "arranque: %zu claves, se esperaban %zu\n", stats.size, expected);
+    return ms;
+}
+
+static int restart_benchmark(int argc, char **argv) {
+    /*
+    Mide el tiempo de arranque con 1M y 10M claves (o las cantidades dadas).
+
+    - Carga N registros con la persistencia activa (un PUT por abonado) y
+        arranca de nuevo reaplicando solo el log.
+    - Escribe un snapshot, aplica N/10 actualizaciones y N/100 borrados (la
+        cola del log) y arranca desde el snapshot más la cola.
+    */
+    static const long default_sizes[] = {1000000, 10000000};
+    kv_persist_config_t config = {KV_FSYNC_INTERVAL_MS, 0, 0};
+    int count = argc > 0 ? argc : (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    char key[32];
+
+    printf("Valores de %zu bytes, group commit cada %d ms, CPUs en línea: %ld\n", strlen(NET_VALUE),
+           KV_FSYNC_INTERVAL_MS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%10s %10s %8s %8s %9s %10s %10s %9s %9s\n", "claves", "PUT/s", "log MB", "snap MB", "snap ms",
+           "solo log", "snap+cola", "carga", "cola");
+    for (int c = 0; c < count; ++c) {
+        long n = argc > 0 ? atol(argv[c]) : default_sizes[c];
+        char dir[] = "/tmp/kvpersist.XXXXXX";
+        key_value_store_t *store;
+        kv_persist_stats_t stats;
+        kv_persist_t *p;
+        uint64_t start;
+        double put_rate, snap_ms, log_ms, snap_restart_ms;
+        size_t log_bytes, snap_bytes, expected = (size_t)(n - n / 100);
+
+        if (n <= 0 || !mkdtemp(dir))
+            return 1;
+        store = kv_store_create((int)n);
+        if (!store || !(p = kv_persist_open(store, dir, &config)))
+            return 1;
+        start = monotonic_ns();
+        for (long i = 0; i < n; ++i) {
+            int len = snprintf(key, sizeof(key), "sub:%010ld", i);
+            kv_store_put(store, key, len, NET_VALUE, strlen(NET_VALUE));
+        }
+        kv_persist_sync(p);
+        put_rate = n / ((monotonic_ns() - start) / 1e9);
+        log_bytes = restart_dir_bytes(dir, "log");
+        kv_persist_close(p);
+        kv_store_destroy(store);
+
+        log_ms = restart_open(dir, (size_t)n, &store, &p);
+        if (log_ms < 0)
+            return 1;
+        start = monotonic_ns();
+        kv_persist_snapshot(p);
+        snap_ms = (monotonic_ns() - start) / 1e6;
+        for (long i = 0; i < n / 10; ++i) {
+            int len = snprintf(key, sizeof(key), "sub:%010ld", i * 10);
+            kv_store_put(store, key, len, NET_VALUE ";q=0.5", strlen(NET_VALUE ";q=0.5"));
+        }
+        for (long i = 0; i < n / 100; ++i) {
+            int len = snprintf(key, sizeof(key), "sub:%010ld", i * 100 + 1);
+            kv_store_delete(store, key, len);
+        }
+        kv_persist_close(p);
+        kv_store_destroy(store);
+        snap_bytes = restart_dir_bytes(dir, "snapshot");
+
+        snap_restart_ms = restart_open(dir, expected, &store, &p);
+        if (snap_restart_ms < 0)
+            return 1;
+        kv_persist_get_stats(p, &stats);
+        printf("%10ld %10.0f %8.1f %8.1f %9.0f %7.0f ms %7.0f ms %6.0f ms %6.0f ms\n", n, put_rate, log_bytes / 1e6,
+               snap_bytes / 1e6, snap_ms, log_ms, snap_restart_ms, stats.load_ns / 1e6, stats.replay_ns / 1e6);
+        fflush(stdout);
+        kv_persist_close(p);
+        kv_store_destroy(store);
+        restart_cleanup(dir);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long reactors = sysconf(_SC_NPROCESSORS_ONLN);
+    kv_persist_config_t config = {KV_FSYNC_INTERVAL_MS, KV_SNAPSHOT_INTERVAL_S, KV_SNAPSHOT_LOG_BYTES};
+    key_value_store_t *store;
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return kv_benchmark();
+    if (argc > 1 && strcmp(argv[1], "pipeline") == 0)
+        return pipeline_benchmark();
+    if (argc > 1 && strcmp(argv[1], "restart") == 0)
+        return restart_benchmark(argc - 2, argv + 2);
+
+    // Crear el almacén clave-valor
+    store = kv_store_create(100); // Tamaño inicial para 100 entradas; crece según haga falta
+    if (!store) {
+        perror("kv_store_create failed");
+        exit(EXIT_FAILURE);
+    }
+    // Con directorio de datos: recupera lo guardado y registra cada escritura
+    if (argc > 2) {
+        if (argc > 3)
+            config.fsync_interval_ms = atoi(argv[3]);
+        if (!kv_persist_open(store, argv[2], &config))
+            exit(EXIT_FAILURE);
+    }
+    run_server(store, argc > 1 ? atoi(argv[1]) : PORT, reactors > 0 ? (int)reactors : 1);
+    kv_store_destroy(store);
+    return 0;
+}
+
+/*
+Compila: gcc -O2 pthreads11.c -o concurrent_kv_store -lpthread -lm
+Ejecuta: ./concurrent_kv_store [puerto] [directorio de datos] [fsync ms]
+Benchmark: ./concurrent_kv_store bench
+Benchmark de red: ./concurrent_kv_store pipeline
+Benchmark de arranque: ./concurrent_kv_store restart [claves ...]
+Explicación:
+    -Almacén Clave-Valor Concurrente:
+        key_value_store_t es una tabla hash dividida en KV_SEGMENTS segmentos.
+        Los bits altos del hash eligen el segmento y los bajos el bucket, así que
+        GET, PUT y DELETE son O(1) de media. Cada segmento tiene su propio
+        pthread_rwlock_t: múltiples lectores acceden a la vez y una escritura solo
+        bloquea su segmento, no todo el almacén.
+
+    -Crecimiento sin Pausas:
+        Cuando un segmento supera un factor de carga de 0.75 pasa a una tabla del
+        doble de tamaño, pero no mueve las entradas de golpe: cada escritura
+        posterior migra KV_REHASH_STEP buckets. Mientras tanto las búsquedas miran
+        en la tabla anterior o en la nueva según el bucket ya se haya migrado.
+        Ninguna operación paga el coste de rehacer la tabla entera.
+
+    -Claves y Valores de Longitud Variable:
+        Las claves y los valores se guardan con su longitud (pueden contener
+        cualquier byte) en lugar de arrays fijos de 64 y 256 bytes.
+        kv_store_get devuelve un kv_value_t con contador de referencias: el valor
+        sigue siendo válido aunque otro hilo lo sustituya o borre la clave, hasta
+        que el lector llame a kv_value_release.
+
+    -Integración con el Servidor No Bloqueante:
+        Al igual que en el Bloque 10, un reactor epoll edge-triggered por núcleo
+        (listeners SO_REUSEPORT) atiende las conexiones; todos comparten el almacén.
+
+    -Conexiones Persistentes y Pipelining:
+        La conexión ya no se cierra tras una orden: el cliente puede enviar
+        muchas órdenes seguidas sin esperar respuesta. handle_client procesa
+        todas las líneas completas que haya en el buffer de entrada y guarda
+        la línea a medias para la siguiente lectura.
+
+    -Respuestas por Lotes:
+        Las respuestas de todas las órdenes procesadas se acumulan como iovecs
+        y se envían con un único writev. Los valores de GET/MGET no se copian:
+        el iovec apunta al kv_value_t y la conexión mantiene la referencia hasta
+        que el lote se ha enviado. Mientras un lote no sale entero no se leen
+        más órdenes (contrapresión).
+
+    -Persistencia:
+        Con un directorio de datos, cada PUT y DELETE añade un registro (con
+        CRC32) a un buffer en memoria antes de soltar el lock de su segmento.
+        Un hilo de fondo hace group commit: cada fsync_interval_ms vuelca el
+        buffer con un write y un único fdatasync para todas las escrituras del
+        intervalo, así que ningún cliente espera al disco y una caída pierde
+        como mucho ese intervalo. El log (log.<G>) es solo de añadidos.
+
+    -Snapshots:
+        Otro hilo escribe periódicamente (o cuando el log supera
+        KV_SNAPSHOT_LOG_BYTES) un snapshot compacto con una entrada por clave
+        viva. Antes rota el log, y después recorre los segmentos de uno en uno con su
+        read lock: los lectores no se bloquean y cada escritor espera como mucho
+        la copia de un segmento. El snapshot se escribe en un .tmp y se renombra
+        al terminar; después se borran las generaciones anteriores.
+
+    -Arranque Rápido:
+        Al arrancar se mapea (mmap) el último snapshot y se carga en tablas ya
+        dimensionadas para todas sus claves (sin rehashes ni búsquedas), y se
+        reaplica solo la cola del log escrita después. Un registro final
+        incompleto (caída a mitad de un volcado) se descarta y se trunca.
+
+    -Protocolo:
+        GET <key>, PUT <key> <value>, DELETE <key>: el servidor responde con
+        OK, VALUE <value>, NOT_FOUND, o ERROR.
+        MGET <k1> <k2> ...: responde "VALUES n" y una línea VALUE/NOT_FOUND por clave
+        (hasta 341 claves por orden).
+        MPUT <k1> <v1> <k2> <v2> ...: valores sin espacios; responde "OK n".
+
+    -Protocolo Binario:
+        Para clientes máquina a máquina, la orden BINARY (respuesta "OK") pasa
+        la conexión a tramas con longitud, todo en orden de red:
+            petición:  u32 longitud | u8 op (1 GET, 2 PUT, 3 DELETE) | u8 0 | u16 n
+                       y n elementos u32 long. clave | u32 long. valor | clave | valor
+            respuesta: u32 longitud | u8 op | u8 estado (0 OK, 1 NOT_FOUND, 2 ERROR) | u16 n
+                       y, para GET, n elementos u32 long. valor | valor (0xFFFFFFFF: no existe)
+        Las claves se leen directamente del buffer de recepción, sin tokenizar,
+        y la respuesta de GET es un iovec por valor que apunta a su longitud
+        (guardada en orden de red en el propio kv_value_t) y a sus datos: no
+        se formatea ni se copia nada. El modo texto sigue disponible para
+        depurar con nc; cada conexión elige el suyo.
+
+    -Benchmark:
+        El modo bench precarga 100000 registros partiendo de una tabla mínima
+        (mide la latencia máxima de PUT durante el crecimiento) y ejecuta cargas
+        estilo YCSB con claves zipfianas (lectura 95/5, mixta 50/40/10 con
+        borrados, escritura 5/95) con 1, 2, 4 y 8 hilos, con un solo segmento
+        (equivalente a un rwlock global) y con KV_SEGMENTS segmentos.
+        El modo pipeline mide cuántos registros por segundo carga un cliente:
+        una conexión por orden, conexión persistente, pipelining, MPUT/MGET y
+        tramas binarias, junto con la CPU que gasta el servidor por registro.
+        El modo restart carga 1M y 10M claves con persistencia y compara el
+        arranque reaplicando todo el log con el arranque desde snapshot más cola.
+
+Para probar este servidor:
+
+        Ejecuta el programa concurrent_kv_store.
+            Puedes usar la herramienta netcat (nc) desde otra terminal
+            para interactuar con el servidor.
+    Por ejemplo:
+        Varias órdenes en una conexión: printf "PUT a 1\nPUT b 2\nMGET a b c\n" | nc localhost 8080
+        Para insertar un valor: echo "PUT mykey myvalue" | nc localhost 8080
+        Para obtener un valor: echo "GET mykey" | nc localhost 8080
+        Para eliminar una clave: echo "DELETE mykey" | nc localhost 8080
+ */
@@ -1,190 +1,793 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-
-#define QUEUE_CAPACITY 5
-
-
-typedef struct
-{
-	int *queue;
-	int head;
-	int tail;
-	int size;
-	int capacity;
-	pthread_mutex_t mutex;
-	pthread_cond_t not_empty;
-	pthread_cond_t not_full;
-} blocking_queue_t;
-
-blocking_queue_t	*bqueue_create(int capacity);
-void	bqueue_enqueue(blocking_queue_t *bq, int item);
-int	bqueue_dequeue(blocking_queue_t *bq);
-void	bqueue_destroy(blocking_queue_t *bq);
-
-blocking_queue_t	*bqueue_create(int capacity)
-{
-	/*
-  Crea e inicializa una cola bloqueante con la capacidad especificada.
-
-  - Asigna memoria para la estructura de la cola.
-  - Asigna memoria para el array que contendrá los elementos de la cola.
-  - Inicializa el mutex para proteger el acceso a la cola.
- 
-	- Inicializa las variables de condición 'not_empty' (para señalar cuando hay elementos en la cola)
-	y 'not_full' (para señalar cuando hay espacio disponible en la cola).
-  - Establece el tamaño,
-	la cabeza y la cola de la cola a sus valores iniciales.
-  - Retorna un puntero a la cola bloqueante creada.
-  */
-	blocking_queue_t *bq = malloc(sizeof(blocking_queue_t));
-	if (!bq)
-		return (NULL);
-
-	bq->queue = malloc(sizeof(int) * capacity);
-	if (!bq->queue)
-	{
-		free(bq);
-		return (NULL);
-	}
-
-	bq->head = 0;
-	bq->tail = 0;
-	bq->size = 0;
-	bq->capacity = capacity;
-
-	pthread_mutex_init(&bq->mutex, NULL);
-	pthread_cond_init(&bq->not_empty, NULL);
-	pthread_cond_init(&bq->not_full, NULL);
-
-	return (bq);
-}
-
-void	bqueue_enqueue(blocking_queue_t *bq, int item)
-{
-	pthread_mutex_lock(&bq->mutex);
-	while (bq->size == bq->capacity)
-	{
-		pthread_cond_wait(&bq->not_full, &bq->mutex);
-	}
-	bq->queue[bq->tail] = item;
-	bq->tail = (bq->tail + 1) % bq->capacity;
-	bq->size++;
-	pthread_cond_signal(&bq->not_empty);
-	pthread_mutex_unlock(&bq->mutex);
-}
-
-int	bqueue_dequeue(blocking_queue_t *bq)
-{
-	/*
-	Desenfila un elemento de la cola bloqueante. Si la cola está vacía,
-		espera hasta que haya un elemento disponible.
-
-	- Bloquea el mutex para proteger el acceso a la cola.
-	- Mientras el tamaño de la cola sea cero:
-		- Espera en la variable de condición 'not_empty'. Este hilo se desbloqueará cuando otro hilo
-			(el productor) encole un elemento y señale 'not_empty'. El mutex se libera mientras espera.
-	- Obtiene el elemento de la cabeza de la cola (en el índice 'head').
-	- Decrementa el tamaño de la cola.
-	- Actualiza el índice 'head' de forma circular.
-	- Señala a un hilo (el productor) que la cola ya no está llena,
-		usando la variable de condición 'not_full'.
-	- Desbloquea el mutex.
-	- Retorna el elemento desencolado.
-	*/
-	pthread_mutex_lock(&bq->mutex);
-	while (bq->size == 0)
-	{
-		pthread_cond_wait(&bq->not_empty, &bq->mutex);
-	}
-	int item = bq->queue[bq->head];
-	bq->head = (bq->head + 1) % bq->capacity;
-	bq->size--;
-	pthread_cond_signal(&bq->not_full);
-	pthread_mutex_unlock(&bq->mutex);
-	return (item);
-}
-
-void	bqueue_destroy(blocking_queue_t *bq)
-{
-	if (!bq)
-		return ;
-	pthread_mutex_destroy(&bq->mutex);
-	pthread_cond_destroy(&bq->not_empty);
-	pthread_cond_destroy(&bq->not_full);
-	free(bq->queue);
-	free(bq);
-}
-
-void	*producer_thread(void *arg)
-{
-	blocking_queue_t *bq = (blocking_queue_t *)arg;
-	for (int i = 1; i <= 10; ++i)
-	{
-		printf("Productor encolando: %d\n", i);
-		bqueue_enqueue(bq, i);
-		sleep(rand() % 2);
-	}
-	pthread_exit(NULL);
-}
-
-void	*consumer_thread(void *arg)
-{
-	blocking_queue_t *bq = (blocking_queue_t *)arg;
-	for (int i = 0; i < 10; ++i)
-	{
-		int item = bqueue_dequeue(bq);
-		printf("Consumidor desencolando: %d\n", item);
-		sleep(rand() % 3);
-	}
-	pthread_exit(NULL);
-}
-
-int	main(void)
-{
-	blocking_queue_t *bq = bqueue_create(QUEUE_CAPACITY);
-	if (!bq)
-	{
-		perror("Error al crear la cola bloqueante");
-		return (1);
-	}
-	srand(time(NULL));
-
-	pthread_t producer, consumer;
-
-	if (pthread_create(&producer, NULL, producer_thread, bq) != 0)
-	{
-		perror("Error al crear el hilo productor");
-		bqueue_destroy(bq);
-		return (1);
-	}
-
-	if (pthread_create(&consumer, NULL, consumer_thread, bq) != 0)
-	{
-		perror("Error al crear el hilo consumidor");
-		pthread_join(producer, NULL);
-		bqueue_destroy(bq);
-		return (1);
-	}
-
-	pthread_join(producer, NULL);
-	pthread_join(consumer, NULL);
-
-	bqueue_destroy(bq);
-	printf("Programa principal terminado.\n");
-	return (0);
-}
-
-/*
-Compila: gcc pthreads3.c -o thread_safe_queue -lpthread
-Ejecuta: ./thread_safe_queue
-Explicación:
-Este bloque implementa una cola thread-safe utilizando un mutex
-para proteger el acceso a la estructura de la cola
-y dos variables de condición (not_empty y not_full)
-para coordinar la actividad de los hilos productores y consumidores.
-El productor encola números y el consumidor los desencola,
-demostrando cómo los hilos pueden comunicarse de forma segura a través de la cola,
-incluso cuando la cola está llena o vacía.
- */
\ No newline at end of file
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define QUEUE_CAPACITY 5
+#define CACHELINE_SIZE 64
+#define BQ_SPIN_MAX 1024  // techo de la espera activa adaptativa
+#define BQ_SPIN_MIN 16
+#define BQ_YIELD_LIMIT 8  // sched_yield() antes de dormir en la condición
+
+#if defined(__x86_64__) || defined(__i386__)
+# define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+# define cpu_relax() __asm__ __volatile__("yield")
+#else
+# define cpu_relax() ((void)0)
+#endif
+
+/*
+Cola acotada sin locks para múltiples productores y consumidores (Vyukov).
+Los elementos son registros de tamaño fijo 'elem_size' (un int, un puntero o
+una estructura) copiados por valor en 'data'. Cada slot lleva un número de
+secuencia en 'sequences' que indica si está libre para la vuelta actual del
+productor o lleno para la del consumidor. 'tail' y 'head' van en líneas de
+caché distintas para que productores y consumidores no se disputen la misma
+línea. El mutex y las condiciones solo se usan para dormir cuando la espera
+activa no basta.
+*/
+typedef struct
+{
+	_Alignas(CACHELINE_SIZE) atomic_size_t tail;
+	_Alignas(CACHELINE_SIZE) atomic_size_t head;
+	_Alignas(CACHELINE_SIZE) atomic_size_t *sequences;
+	unsigned char	*data;
+	size_t			elem_size;
+	size_t			mask;
+	int				capacity;
+	atomic_int		spin_limit;
+	atomic_int		waiting_consumers;
+	atomic_int		waiting_producers;
+	pthread_mutex_t	mutex;
+	pthread_cond_t	not_empty;
+	pthread_cond_t	not_full;
+}	blocking_queue_t;
+
+blocking_queue_t	*bqueue_create(int capacity, size_t elem_size);
+void	bqueue_enqueue(blocking_queue_t *bq, const void *item);
+void	bqueue_dequeue(blocking_queue_t *bq, void *item);
+int	bqueue_try_enqueue(blocking_queue_t *bq, const void *item);
+int	bqueue_try_dequeue(blocking_queue_t *bq, void *item);
+void	bqueue_enqueue_batch(blocking_queue_t *bq, const void *items, size_t n);
+size_t	bqueue_dequeue_batch(blocking_queue_t *bq, void *items, size_t max);
+size_t	bqueue_try_enqueue_batch(blocking_queue_t *bq, const void *items,
+			size_t n);
+size_t	bqueue_try_dequeue_batch(blocking_queue_t *bq, void *items, size_t max);
+void	bqueue_destroy(blocking_queue_t *bq);
+
+blocking_queue_t	*bqueue_create(int capacity, size_t elem_size)
+{
+	/*
+	Crea e inicializa una cola sin locks con al menos la capacidad especificada
+		para elementos de 'elem_size' bytes.
+
+	- Redondea la capacidad a la siguiente potencia de 2 (el índice es pos & mask).
+	- Asigna la estructura alineada a línea de caché, el array de secuencias
+		y el buffer de elementos.
+	- Inicializa la secuencia de cada slot con su índice (todos libres).
+	- Inicializa el mutex y las condiciones usados solo para dormir.
+	- Retorna un puntero a la cola creada, o NULL si falla.
+	*/
+	size_t	size;
+
+	if (capacity <= 0 || elem_size == 0)
+		return (NULL);
+	size = 2;
+	while (size < (size_t)capacity)
+		size <<= 1;
+
+	blocking_queue_t *bq = aligned_alloc(CACHELINE_SIZE,
+			(sizeof(blocking_queue_t) + CACHELINE_SIZE - 1)
+			& ~(size_t)(CACHELINE_SIZE - 1));
+	if (!bq)
+		return (NULL);
+
+	bq->sequences = aligned_alloc(CACHELINE_SIZE,
+			(sizeof(atomic_size_t) * size + CACHELINE_SIZE - 1)
+			& ~(size_t)(CACHELINE_SIZE - 1));
+	bq->data = malloc(elem_size * size);
+	if (!bq->sequences || !bq->data)
+	{
+		free(bq->sequences);
+		free(bq->data);
+		free(bq);
+		return (NULL);
+	}
+	for (size_t i = 0; i < size; ++i)
+		atomic_init(&bq->sequences[i], i);
+
+	atomic_init(&bq->tail, 0);
+	atomic_init(&bq->head, 0);
+	bq->elem_size = elem_size;
+	bq->mask = size - 1;
+	bq->capacity = (int)size;
+	atomic_init(&bq->spin_limit, BQ_SPIN_MAX);
+	atomic_init(&bq->waiting_consumers, 0);
+	atomic_init(&bq->waiting_producers, 0);
+
+	pthread_mutex_init(&bq->mutex, NULL);
+	pthread_cond_init(&bq->not_empty, NULL);
+	pthread_cond_init(&bq->not_full, NULL);
+
+	return (bq);
+}
+
+static void	bqueue_wake(blocking_queue_t *bq, atomic_int *waiting,
+		pthread_cond_t *cond)
+{
+	/*
+	Despierta a un hilo dormido solo si lo hay.
+	La barrera ordena la publicación de los slots antes de leer el contador de
+	dormidos; el hilo que se duerme incrementa el contador y reintenta bajo
+	el mutex, así que nunca se pierde una señal.
+	*/
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(waiting, memory_order_relaxed) > 0)
+	{
+		pthread_mutex_lock(&bq->mutex);
+		pthread_cond_signal(cond);
+		pthread_mutex_unlock(&bq->mutex);
+	}
+}
+
+static void	bq_copy_in(blocking_queue_t *bq, size_t pos, const void *src,
+		size_t n)
+{
+	/*
+	Copia 'n' elementos del llamador al buffer a partir de la posición 'pos',
+	en como mucho dos tramos si el anillo da la vuelta.
+	*/
+	size_t	idx = pos & bq->mask;
+	size_t	first = bq->mask + 1 - idx;
+	size_t	es = bq->elem_size;
+
+	if (first > n)
+		first = n;
+	memcpy(bq->data + idx * es, src, first * es);
+	memcpy(bq->data, (const unsigned char *)src + first * es, (n - first) * es);
+}
+
+static void	bq_copy_out(blocking_queue_t *bq, size_t pos, void *dst, size_t n)
+{
+	/* Copia 'n' elementos del buffer, desde la posición 'pos', al llamador. */
+	size_t	idx = pos & bq->mask;
+	size_t	first = bq->mask + 1 - idx;
+	size_t	es = bq->elem_size;
+
+	if (first > n)
+		first = n;
+	memcpy(dst, bq->data + idx * es, first * es);
+	memcpy((unsigned char *)dst + first * es, bq->data, (n - first) * es);
+}
+
+static size_t	bq_push(blocking_queue_t *bq, const void *items, size_t n)
+{
+	/*
+	Intenta encolar hasta 'n' elementos sin bloquear y sin despertar a nadie.
+
+	- Lee la posición 'tail' y cuenta cuántos slots consecutivos están libres
+		(secuencia igual a su posición), hasta 'n'.
+	- Si hay alguno, los reserva todos con un único CAS sobre 'tail', copia
+		los elementos y publica secuencia + 1 en cada slot.
+	- Si el primero tiene secuencia menor, la cola está llena: retorna 0.
+	- Si es mayor, otro productor se adelantó: relee 'tail' y reintenta.
+	- Retorna el número de elementos encolados.
+	*/
+	size_t		pos;
+	size_t		k;
+	intptr_t	diff;
+
+	pos = atomic_load_explicit(&bq->tail, memory_order_relaxed);
+	while (1)
+	{
+		diff = 0;
+		for (k = 0; k < n; ++k)
+		{
+			diff = (intptr_t)atomic_load_explicit(
+					&bq->sequences[(pos + k) & bq->mask], memory_order_acquire)
+				- (intptr_t)(pos + k);
+			if (diff != 0)
+				break ;
+		}
+		if (k > 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(&bq->tail, &pos, pos + k,
+					memory_order_relaxed, memory_order_relaxed))
+				break ;
+		}
+		else if (diff < 0)
+			return (0);
+		else
+			pos = atomic_load_explicit(&bq->tail, memory_order_relaxed);
+	}
+	bq_copy_in(bq, pos, items, k);
+	for (size_t i = 0; i < k; ++i)
+		atomic_store_explicit(&bq->sequences[(pos + i) & bq->mask],
+			pos + i + 1, memory_order_release);
+	return (k);
+}
+
+static size_t	bq_pop(blocking_queue_t *bq, void *items, size_t max)
+{
+	/*
+	Intenta desencolar hasta 'max' elementos sin bloquear y sin despertar a nadie.
+
+	- Lee la posición 'head' y cuenta cuántos slots consecutivos están llenos
+		(secuencia igual a su posición + 1), hasta 'max'.
+	- Si hay alguno, los reserva todos con un único CAS sobre 'head', copia
+		los elementos y marca cada slot libre para la siguiente vuelta
+		(secuencia = posición + capacidad).
+	- Si el primero tiene secuencia menor, la cola está vacía: retorna 0.
+	- Retorna el número de elementos desencolados en 'items'.
+	*/
+	size_t		pos;
+	size_t		k;
+	intptr_t	diff;
+
+	pos = atomic_load_explicit(&bq->head, memory_order_relaxed);
+	while (1)
+	{
+		diff = 0;
+		for (k = 0; k < max; ++k)
+		{
+			diff = (intptr_t)atomic_load_explicit(
+					&bq->sequences[(pos + k) & bq->mask], memory_order_acquire)
+				- (intptr_t)(pos + k + 1);
+			if (diff != 0)
+				break ;
+		}
+		if (k > 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(&bq->head, &pos, pos + k,
+					memory_order_relaxed, memory_order_relaxed))
+				break ;
+		}
+		else if (diff < 0)
+			return (0);
+		else
+			pos = atomic_load_explicit(&bq->head, memory_order_relaxed);
+	}
+	bq_copy_out(bq, pos, items, k);
+	for (size_t i = 0; i < k; ++i)
+		atomic_store_explicit(&bq->sequences[(pos + i) & bq->mask],
+			pos + i + bq->mask + 1, memory_order_release);
+	return (k);
+}
+
+static int	bq_has_items(blocking_queue_t *bq)
+{
+	size_t	pos = atomic_load_explicit(&bq->head, memory_order_relaxed);
+
+	return (atomic_load_explicit(&bq->sequences[pos & bq->mask],
+			memory_order_acquire) == pos + 1);
+}
+
+static int	bq_has_room(blocking_queue_t *bq)
+{
+	size_t	pos = atomic_load_explicit(&bq->tail, memory_order_relaxed);
+
+	return (atomic_load_explicit(&bq->sequences[pos & bq->mask],
+			memory_order_acquire) == pos);
+}
+
+static void	bqueue_after_push(blocking_queue_t *bq)
+{
+	/*
+	Una sola señal por reserva: despierta a un consumidor y, si aún queda
+	hueco, a otro productor dormido para que no espere a un consumidor.
+	*/
+	bqueue_wake(bq, &bq->waiting_consumers, &bq->not_empty);
+	if (atomic_load_explicit(&bq->waiting_producers, memory_order_relaxed) > 0
+		&& bq_has_room(bq))
+		bqueue_wake(bq, &bq->waiting_producers, &bq->not_full);
+}
+
+static void	bqueue_after_pop(blocking_queue_t *bq)
+{
+	/*
+	Despierta a un productor y, si quedan elementos (un lote grande puede
+	superar lo que pidió este consumidor), encadena la señal a otro consumidor.
+	*/
+	bqueue_wake(bq, &bq->waiting_producers, &bq->not_full);
+	if (atomic_load_explicit(&bq->waiting_consumers, memory_order_relaxed) > 0
+		&& bq_has_items(bq))
+		bqueue_wake(bq, &bq->waiting_consumers, &bq->not_empty);
+}
+
+size_t	bqueue_try_enqueue_batch(blocking_queue_t *bq, const void *items,
+		size_t n)
+{
+	/* Encola sin bloquear los que quepan de 'n' elementos; retorna cuántos. */
+	size_t	k;
+
+	k = bq_push(bq, items, n);
+	if (k > 0)
+		bqueue_after_push(bq);
+	return (k);
+}
+
+size_t	bqueue_try_dequeue_batch(blocking_queue_t *bq, void *items, size_t max)
+{
+	/* Desencola sin bloquear hasta 'max' elementos; retorna cuántos. */
+	size_t	k;
+
+	k = bq_pop(bq, items, max);
+	if (k > 0)
+		bqueue_after_pop(bq);
+	return (k);
+}
+
+int	bqueue_try_enqueue(blocking_queue_t *bq, const void *item)
+{
+	/* Encola sin bloquear. Retorna 0 si encoló, -1 si la cola está llena. */
+	return (bqueue_try_enqueue_batch(bq, item, 1) == 1 ? 0 : -1);
+}
+
+int	bqueue_try_dequeue(blocking_queue_t *bq, void *item)
+{
+	/* Desencola sin bloquear. Retorna 0 si desencoló, -1 si la cola está vacía. */
+	return (bqueue_try_dequeue_batch(bq, item, 1) == 1 ? 0 : -1);
+}
+
+/* Operación pendiente que reintentan la espera activa y la espera dormida. */
+typedef struct
+{
+	const void	*src;
+	void		*dst;
+	size_t		n;
+	size_t		done;
+}	bq_op_t;
+
+static int	bqueue_spin(blocking_queue_t *bq, int (*attempt)(blocking_queue_t *,
+		bq_op_t *), bq_op_t *op)
+{
+	/*
+	Espera activa adaptativa: reintenta 'spin_limit' veces con pausa de CPU y
+	luego cede el procesador unas pocas veces. Si la espera activa acierta,
+	amplía el presupuesto; si no, lo reduce para la próxima vez.
+	Retorna 0 si la operación avanzó, -1 si hay que dormir.
+	*/
+	int	limit;
+
+	limit = atomic_load_explicit(&bq->spin_limit, memory_order_relaxed);
+	for (int i = 0; i < limit; ++i)
+	{
+		if (attempt(bq, op) == 0)
+		{
+			if (limit < BQ_SPIN_MAX)
+				atomic_store_explicit(&bq->spin_limit, limit * 2,
+					memory_order_relaxed);
+			return (0);
+		}
+		cpu_relax();
+	}
+	for (int i = 0; i < BQ_YIELD_LIMIT; ++i)
+	{
+		if (attempt(bq, op) == 0)
+			return (0);
+		sched_yield();
+	}
+	if (limit > BQ_SPIN_MIN)
+		atomic_store_explicit(&bq->spin_limit, limit / 2, memory_order_relaxed);
+	return (-1);
+}
+
+static int	attempt_enqueue(blocking_queue_t *bq, bq_op_t *op)
+{
+	size_t	k;
+
+	k = bq_push(bq, (const unsigned char *)op->src + op->done * bq->elem_size,
+			op->n - op->done);
+	op->done += k;
+	return (k > 0 ? 0 : -1);
+}
+
+static int	attempt_dequeue(blocking_queue_t *bq, bq_op_t *op)
+{
+	op->done = bq_pop(bq, op->dst, op->n);
+	return (op->done > 0 ? 0 : -1);
+}
+
+static void	bqueue_park(blocking_queue_t *bq, atomic_int *waiting,
+		pthread_cond_t *cond, int (*attempt)(blocking_queue_t *, bq_op_t *),
+		bq_op_t *op)
+{
+	/*
+	Duerme en 'cond' hasta que la operación avance.
+	Se anuncia como dormido antes de reintentar, bajo el mutex, para que el
+	otro extremo vea el contador o este hilo vea sus slots. El llamador
+	despierta al otro extremo después, ya sin el mutex.
+	*/
+	pthread_mutex_lock(&bq->mutex);
+	atomic_fetch_add(waiting, 1);
+	while (attempt(bq, op) != 0)
+		pthread_cond_wait(cond, &bq->mutex);
+	atomic_fetch_sub(waiting, 1);
+	pthread_mutex_unlock(&bq->mutex);
+}
+
+void	bqueue_enqueue_batch(blocking_queue_t *bq, const void *items, size_t n)
+{
+	/*
+	Encola los 'n' elementos de 'items', esperando si la cola se llena.
+
+	- Reserva de una vez todos los slots libres consecutivos que puede (un
+		único CAS sobre 'tail' por tramo) y copia el tramo entero.
+	- Si la cola está llena, espera activamente y después duerme en 'not_full'.
+	- Emite una sola señal a los consumidores por tramo, no por elemento:
+		si el lote cabe, una sola señal para todo el lote.
+	*/
+	bq_op_t	op = {items, NULL, n, 0};
+
+	while (op.done < n)
+	{
+		if (attempt_enqueue(bq, &op) != 0
+			&& bqueue_spin(bq, attempt_enqueue, &op) != 0)
+			bqueue_park(bq, &bq->waiting_producers, &bq->not_full,
+				attempt_enqueue, &op);
+		bqueue_after_push(bq);
+	}
+}
+
+size_t	bqueue_dequeue_batch(blocking_queue_t *bq, void *items, size_t max)
+{
+	/*
+	Desencola entre 1 y 'max' elementos en 'items'. Si la cola está vacía,
+		espera hasta que haya al menos uno disponible.
+
+	- Intenta desencolar sin bloquear todos los disponibles hasta 'max'.
+	- Si está vacía, espera activamente un número adaptativo de intentos.
+	- Si sigue vacía, se anuncia como consumidor dormido y espera en 'not_empty';
+		los productores solo toman el mutex para señalar si hay alguien dormido.
+	- Emite una sola señal a los productores por lote.
+	- Retorna el número de elementos desencolados.
+	*/
+	bq_op_t	op = {NULL, items, max, 0};
+
+	if (max == 0)
+		return (0);
+	if (attempt_dequeue(bq, &op) != 0 && bqueue_spin(bq, attempt_dequeue, &op) != 0)
+		bqueue_park(bq, &bq->waiting_consumers, &bq->not_empty,
+			attempt_dequeue, &op);
+	bqueue_after_pop(bq);
+	return (op.done);
+}
+
+void	bqueue_enqueue(blocking_queue_t *bq, const void *item)
+{
+	/* Encola un elemento; si la cola está llena, espera activamente y después duerme. */
+	bqueue_enqueue_batch(bq, item, 1);
+}
+
+void	bqueue_dequeue(blocking_queue_t *bq, void *item)
+{
+	/* Desencola un elemento en '*item'; si la cola está vacía, espera. */
+	bqueue_dequeue_batch(bq, item, 1);
+}
+
+void	bqueue_destroy(blocking_queue_t *bq)
+{
+	if (!bq)
+		return ;
+	pthread_mutex_destroy(&bq->mutex);
+	pthread_cond_destroy(&bq->not_empty);
+	pthread_cond_destroy(&bq->not_full);
+	free(bq->sequences);
+	free(bq->data);
+	free(bq);
+}
+
+/*
+Cola bloqueante con mutex y dos condiciones (implementación anterior).
+Se conserva como referencia para el benchmark.
+*/
+typedef struct
+{
+	int *queue;
+	int head;
+	int tail;
+	int size;
+	int capacity;
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+} locked_queue_t;
+
+locked_queue_t	*lqueue_create(int capacity)
+{
+	locked_queue_t *lq = malloc(sizeof(locked_queue_t));
+	if (!lq)
+		return (NULL);
+	lq->queue = malloc(sizeof(int) * capacity);
+	if (!lq->queue)
+	{
+		free(lq);
+		return (NULL);
+	}
+	lq->head = 0;
+	lq->tail = 0;
+	lq->size = 0;
+	lq->capacity = capacity;
+	pthread_mutex_init(&lq->mutex, NULL);
+	pthread_cond_init(&lq->not_empty, NULL);
+	pthread_cond_init(&lq->not_full, NULL);
+	return (lq);
+}
+
+void	lqueue_enqueue(locked_queue_t *lq, int item)
+{
+	pthread_mutex_lock(&lq->mutex);
+	while (lq->size == lq->capacity)
+		pthread_cond_wait(&lq->not_full, &lq->mutex);
+	lq->queue[lq->tail] = item;
+	lq->tail = (lq->tail + 1) % lq->capacity;
+	lq->size++;
+	pthread_cond_signal(&lq->not_empty);
+	pthread_mutex_unlock(&lq->mutex);
+}
+
+int	lqueue_dequeue(locked_queue_t *lq)
+{
+	pthread_mutex_lock(&lq->mutex);
+	while (lq->size == 0)
+		pthread_cond_wait(&lq->not_empty, &lq->mutex);
+	int item = lq->queue[lq->head];
+	lq->head = (lq->head + 1) % lq->capacity;
+	lq->size--;
+	pthread_cond_signal(&lq->not_full);
+	pthread_mutex_unlock(&lq->mutex);
+	return (item);
+}
+
+void	lqueue_destroy(locked_queue_t *lq)
+{
+	pthread_mutex_destroy(&lq->mutex);
+	pthread_cond_destroy(&lq->not_empty);
+	pthread_cond_destroy(&lq->not_full);
+	free(lq->queue);
+	free(lq);
+}
+
+void	*producer_thread(void *arg)
+{
+	blocking_queue_t *bq = (blocking_queue_t *)arg;
+	for (int i = 1; i <= 10; ++i)
+	{
+		printf("Productor encolando: %d\n", i);
+		bqueue_enqueue(bq, &i);
+		sleep(rand() % 2);
+	}
+	pthread_exit(NULL);
+}
+
+void	*consumer_thread(void *arg)
+{
+	blocking_queue_t *bq = (blocking_queue_t *)arg;
+	for (int i = 0; i < 10; ++i)
+	{
+		int item;
+		bqueue_dequeue(bq, &item);
+		printf("Consumidor desencolando: %d\n", item);
+		sleep(rand() % 3);
+	}
+	pthread_exit(NULL);
+}
+
+/* ---- Benchmark productor/consumidor: cola sin locks frente a mutex ---- */
+
+#define BENCH_ITEMS 2000000
+#define BENCH_CAPACITY 1024
+#define BENCH_MAX_PAIRS 8
+#define BENCH_MAX_BURST 256
+#define BENCH_BURST_PAIRS 4
+
+enum { BENCH_MUTEX, BENCH_LOCKFREE, BENCH_BATCH };
+
+typedef struct
+{
+	void	*queue;
+	int		mode;
+	long	count;
+	int		burst;
+	long	sum;
+}	bench_arg_t;
+
+static void	*bench_producer(void *arg)
+{
+	bench_arg_t *b = (bench_arg_t *)arg;
+	int burst[BENCH_MAX_BURST];
+	long i = 1;
+
+	while (i <= b->count)
+	{
+		int n = 0;
+		while (n < b->burst && i <= b->count)
+			burst[n++] = (int)i++;
+		if (b->mode == BENCH_BATCH)
+			bqueue_enqueue_batch(b->queue, burst, n);
+		else
+			for (int j = 0; j < n; ++j)
+			{
+				if (b->mode == BENCH_LOCKFREE)
+					bqueue_enqueue(b->queue, &burst[j]);
+				else
+					lqueue_enqueue(b->queue, burst[j]);
+			}
+	}
+	return (NULL);
+}
+
+static void	*bench_consumer(void *arg)
+{
+	bench_arg_t *b = (bench_arg_t *)arg;
+	int burst[BENCH_MAX_BURST];
+	long sum = 0;
+	long got = 0;
+
+	while (got < b->count)
+	{
+		size_t n = 1;
+		long want = b->count - got;
+		if (b->mode == BENCH_BATCH)
+			n = bqueue_dequeue_batch(b->queue, burst,
+					want < b->burst ? (size_t)want : (size_t)b->burst);
+		else if (b->mode == BENCH_LOCKFREE)
+			bqueue_dequeue(b->queue, &burst[0]);
+		else
+			burst[0] = lqueue_dequeue(b->queue);
+		for (size_t j = 0; j < n; ++j)
+			sum += burst[j];
+		got += n;
+	}
+	b->sum = sum;
+	return (NULL);
+}
+
+static double	bench_run(int mode, int pairs, int burst)
+{
+	/*
+	Mueve BENCH_ITEMS elementos con 'pairs' productores y 'pairs' consumidores
+	que producen en ráfagas de 'burst' elementos.
+	Comprueba que la suma desencolada coincide con la encolada y retorna
+	las operaciones (encolar + desencolar) por segundo.
+	*/
+	pthread_t		threads[2 * BENCH_MAX_PAIRS];
+	bench_arg_t		args[2 * BENCH_MAX_PAIRS];
+	struct timespec	t0;
+	struct timespec	t1;
+	long			per_thread = BENCH_ITEMS / pairs;
+	long			sum = 0;
+	void			*queue;
+
+	if (mode == BENCH_MUTEX)
+		queue = lqueue_create(BENCH_CAPACITY);
+	else
+		queue = bqueue_create(BENCH_CAPACITY, sizeof(int));
+	if (!queue)
+		return (0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < pairs; ++i)
+	{
+		args[i] = (bench_arg_t){queue, mode, per_thread, burst, 0};
+		args[pairs + i] = (bench_arg_t){queue, mode, per_thread, burst, 0};
+		pthread_create(&threads[i], NULL, bench_producer, &args[i]);
+		pthread_create(&threads[pairs + i], NULL, bench_consumer,
+			&args[pairs + i]);
+	}
+	for (int i = 0; i < 2 * pairs; ++i)
+	{
+		pthread_join(threads[i], NULL);
+		sum += args[i].sum;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (sum != pairs * per_thread * (per_thread + 1) / 2)
+		fprintf(stderr, "bench: suma incorrecta (%ld)\n", sum);
+	if (mode == BENCH_MUTEX)
+		lqueue_destroy(queue);
+	else
+		bqueue_destroy(queue);
+	return (2.0 * pairs * per_thread / ((t1.tv_sec - t0.tv_sec)
+			+ (t1.tv_nsec - t0.tv_nsec) / 1e9));
+}
+
+static int	queue_benchmark(void)
+{
+	static const int	bursts[] = {1, 8, 32, 64, 128, 256};
+
+	printf("Elementos: %d, capacidad: %d, CPUs en línea: %ld\n", BENCH_ITEMS,
+		BENCH_CAPACITY, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%6s %16s %16s %8s\n", "P/C", "mutex ops/s", "sin locks ops/s",
+		"mejora");
+	for (int pairs = 1; pairs <= BENCH_MAX_PAIRS; pairs *= 2)
+	{
+		double locked = bench_run(BENCH_MUTEX, pairs, 1);
+		double lockfree = bench_run(BENCH_LOCKFREE, pairs, 1);
+		printf("%3d/%-2d %16.0f %16.0f %7.2fx\n", pairs, pairs, locked,
+			lockfree, lockfree / locked);
+	}
+
+	printf("\nRáfagas con %d/%d productores/consumidores (ns por operación)\n",
+		BENCH_BURST_PAIRS, BENCH_BURST_PAIRS);
+	printf("%6s %12s %12s %12s %8s\n", "ráfaga", "mutex", "uno a uno",
+		"por lotes", "mejora");
+	for (size_t i = 0; i < sizeof(bursts) / sizeof(bursts[0]); ++i)
+	{
+		double locked = bench_run(BENCH_MUTEX, BENCH_BURST_PAIRS, bursts[i]);
+		double single = bench_run(BENCH_LOCKFREE, BENCH_BURST_PAIRS, bursts[i]);
+		double batch = bench_run(BENCH_BATCH, BENCH_BURST_PAIRS, bursts[i]);
+		printf("%6d %12.1f %12.1f %12.1f %7.2fx\n", bursts[i], 1e9 / locked,
+			1e9 / single, 1e9 / batch, batch / locked);
+	}
+	return (0);
+}
+
+int	main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return (queue_benchmark());
+
+	blocking_queue_t *bq = bqueue_create(QUEUE_CAPACITY, sizeof(int));
+	if (!bq)
+	{
+		perror("Error al crear la cola bloqueante");
+		return (1);
+	}
+	srand(time(NULL));
+
+	pthread_t producer, consumer;
+
+	if (pthread_create(&producer, NULL, producer_thread, bq) != 0)
+	{
+		perror("Error al crear el hilo productor");
+		bqueue_destroy(bq);
+		return (1);
+	}
+
+	if (pthread_create(&consumer, NULL, consumer_thread, bq) != 0)
+	{
+		perror("Error al crear el hilo consumidor");
+		pthread_join(producer, NULL);
+		bqueue_destroy(bq);
+		return (1);
+	}
+
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+
+	bqueue_destroy(bq);
+	printf("Programa principal terminado.\n");
+	return (0);
+}
+
+/*
+Compila: gcc -O2 pthreads3.c -o thread_safe_queue -lpthread
+Ejecuta: ./thread_safe_queue
+Benchmark: ./thread_safe_queue bench
+Explicación:
+Este bloque implementa una cola thread-safe acotada sin locks para múltiples
+productores y consumidores (anillo de Vyukov con números de secuencia por slot).
+Productores y consumidores reservan posiciones avanzando 'tail' y 'head' con CAS;
+la secuencia de cada slot indica si está libre o lleno para la vuelta actual,
+así que no hace falta un mutex para mover elementos.
+Los elementos son registros de tamaño fijo elegido en bqueue_create (un int,
+un puntero o una estructura pequeña) y se copian por valor.
+bqueue_try_enqueue y bqueue_try_dequeue nunca bloquean. bqueue_enqueue y
+bqueue_dequeue esperan primero de forma activa (un número de intentos que se
+adapta según haya funcionado antes), luego ceden la CPU y, si la cola sigue
+llena o vacía, duermen en las condiciones not_full / not_empty.
+El otro extremo solo toma el mutex para despertar cuando hay alguien dormido,
+evitando las tormentas de futex de la versión con mutex.
+bqueue_enqueue_batch y bqueue_dequeue_batch mueven ráfagas: reservan de una vez
+todos los slots consecutivos disponibles con un único CAS, copian el tramo
+entero y emiten una sola señal por lote en lugar de una por elemento.
+El modo bench compara esta cola con la implementación anterior con mutex
+(locked_queue_t) moviendo 2 millones de enteros con 1 a 8 pares productor/consumidor,
+y después mide el coste por elemento con ráfagas de 1 a 256 elementos
+(mutex, sin locks uno a uno y sin locks por lotes).
+ */
@@ -1,144 +1,1012 @@
-#include <pthread.h>
-#include <semaphore.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-
-
-typedef struct
-{
-	sem_t semaphore;
-} rate_limiter_t;
-
-rate_limiter_t	*rate_limiter_create(int max_requests);
-void	rate_limiter_acquire(rate_limiter_t *rl);
-void	rate_limiter_release(rate_limiter_t *rl);
-void	rate_limiter_destroy(rate_limiter_t *rl);
-
-rate_limiter_t	*rate_limiter_create(int max_requests)
-{
-	/*
-	Crea e inicializa un limitador de tasa que permite un máximo de 'max_requests' peticiones simultáneas.
-
-	- Asigna memoria para la estructura del limitador de tasa.
-	- Inicializa un semáforo binario (o contador) con un valor inicial de 'max_requests'.
-		Este valor representa el número de "permisos" disponibles.
-	- Retorna un puntero al limitador de tasa creado.
-	*/
-	rate_limiter_t *rl = malloc(sizeof(rate_limiter_t));
-	if (!rl)
-		return (NULL);
-
-	if (sem_init(&rl->semaphore, 0, max_requests) != 0)
-	{
-		perror("sem_init failed");
-		free(rl);
-		return (NULL);
-	}
-
-	return (rl);
-}
-
-void	rate_limiter_acquire(rate_limiter_t *rl)
-{
-	/*
-	Intenta adquirir un permiso del limitador de tasa. Si no hay permisos disponibles,
-		el hilo se bloquea hasta que se libere uno.
-
-	- Llama a la función sem_wait(). Esta función decrementa el valor del semáforo.
-	- Si el valor del semáforo es mayor que cero, el hilo continúa.
-	- Si el valor del semáforo es cero,
-		el hilo se bloquea hasta que otro hilo llame a sem_post().
-	*/
-	sem_wait(&rl->semaphore);
-}
-
-void	rate_limiter_release(rate_limiter_t *rl)
-{
-	/*
-	Libera un permiso al limitador de tasa,
-		incrementando el contador del semáforo.
-
-	- Llama a la función sem_post(). Esta función incrementa el valor del semáforo,
-		lo que podría desbloquear a un hilo que estaba esperando en sem_wait().
-	*/
-	sem_post(&rl->semaphore);
-}
-
-void	rate_limiter_destroy(rate_limiter_t *rl)
-{
-	/*
-	Destruye el limitador de tasa, liberando los recursos.
-
-	- Llama a sem_destroy() para liberar los recursos asociados con el semáforo.
-	- Libera la memoria asignada para la estructura del limitador de tasa.
-	*/
-	if (rl)
-	{
-		sem_destroy(&rl->semaphore);
-		free(rl);
-	}
-}
-
-void	*task_function(void *arg)
-{
-	rate_limiter_t *limiter = (rate_limiter_t *)arg;
-	printf("Hilo %lu intentando adquirir permiso...\n", pthread_self());
-	rate_limiter_acquire(limiter);
-	printf("Hilo %lu ha adquirido permiso y está ejecutando la tarea...\n",
-		pthread_self());
-	sleep(2); // Simular trabajo
-	printf("Hilo %lu ha terminado la tarea y libera el permiso.\n",
-		pthread_self());
-	rate_limiter_release(limiter);
-	pthread_exit(NULL);
-}
-
-int	main(void)
-{
-	int max_requests = 3;
-	int num_threads = 5;
-	rate_limiter_t *limiter = rate_limiter_create(max_requests);
-	if (!limiter)
-	{
-		return (1);
-	}
-
-	pthread_t threads[num_threads];
-
-	printf("Creando %d hilos...\n", num_threads);
-	for (int i = 0; i < num_threads; ++i)
-	{
-		if (pthread_create(&threads[i], NULL, task_function, limiter) != 0)
-		{
-			perror("Error al crear el hilo");
-			rate_limiter_destroy(limiter);
-			return (1);
-		}
-	}
-
-	printf("Esperando que los hilos terminen...\n");
-	for (int i = 0; i < num_threads; ++i)
-	{
-		pthread_join(threads[i], NULL);
-	}
-
-	rate_limiter_destroy(limiter);
-	printf("Programa principal terminado.\n");
-	return (0);
-}
-
-/*
-Compila: gcc pthreads4.c -o thread_pool_basic -lpthread
-Ejecuta: ./thread_pool_basic
-Explicación:
-Este bloque presenta una implementación básica de un thread pool.
-Se inicializa un número fijo de hilos trabajadores que esperan tareas en una cola.
-La función main envía algunas tareas simples (execute_task) al pool para ser ejecutadas.
-Se utilizan mutexes y variables de condición para la sincronización
-entre el hilo principal (que encola las tareas)
-y los hilos trabajadores (que las desencolan y ejecutan).
-Se ha añadido un mecanismo de cierre para que los hilos trabajadores terminen 1
-de forma controlada cuando se destruye el pool.
-
- */
\ No newline at end of file
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/*
+Limitador de tasa GCRA (Generic Cell Rate Algorithm), equivalente a un token
+bucket de capacidad 'burst' que se rellena a 'rate' tokens por segundo.
+En lugar de un contador de tokens y un hilo que lo rellena, guarda un único
+instante teórico de llegada ('tat', en ns del reloj monotónico): cada petición
+aceptada lo adelanta un intervalo de emisión. Una petición se acepta si 'tat'
+no está más de 'burst' intervalos por delante de ahora. El relleno es
+implícito en el paso del tiempo y la actualización es un CAS sobre 'tat',
+así que no hace falta mutex ni syscall (clock_gettime va por vDSO).
+*/
+typedef struct
+{
+	_Alignas(64) _Atomic uint64_t	tat;
+	uint64_t	interval_ns;
+	uint64_t	tolerance_ns;
+}	rate_limiter_t;
+
+rate_limiter_t	*rate_limiter_create(double rate, unsigned burst);
+int	rate_limiter_try_acquire(rate_limiter_t *rl);
+int	rate_limiter_try_acquire_n(rate_limiter_t *rl, unsigned n);
+void	rate_limiter_acquire(rate_limiter_t *rl);
+void	rate_limiter_destroy(rate_limiter_t *rl);
+
+static inline uint64_t	monotonic_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * NSEC_PER_SEC + (uint64_t)ts.tv_nsec);
+}
+
+rate_limiter_t	*rate_limiter_create(double rate, unsigned burst)
+{
+	/*
+	Crea un limitador que permite 'rate' peticiones por segundo de media
+		con ráfagas de hasta 'burst' peticiones seguidas.
+
+	- Calcula el intervalo de emisión (1 / rate) en nanosegundos.
+	- La tolerancia es 'burst' intervalos: cuánto puede adelantarse 'tat'
+		respecto a ahora antes de rechazar.
+	- Inicializa 'tat' a 0: el cubo empieza lleno.
+	- Retorna el limitador, o NULL si los parámetros no son válidos.
+	*/
+	rate_limiter_t	*rl;
+
+	if (rate <= 0 || burst == 0)
+		return (NULL);
+	rl = aligned_alloc(64, (sizeof(rate_limiter_t) + 63) & ~(size_t)63);
+	if (!rl)
+		return (NULL);
+	rl->interval_ns = (uint64_t)(NSEC_PER_SEC / rate);
+	if (rl->interval_ns == 0)
+		rl->interval_ns = 1;
+	rl->tolerance_ns = rl->interval_ns * burst;
+	atomic_init(&rl->tat, 0);
+	return (rl);
+}
+
+static int	rate_limiter_take(rate_limiter_t *rl, unsigned n, uint64_t now,
+		uint64_t *wait_ns)
+{
+	/*
+	Núcleo GCRA sin bloqueo para 'n' peticiones en el instante 'now'.
+
+	- El nuevo 'tat' es max(tat, now) + n intervalos.
+	- Si queda más de 'tolerance' por delante de 'now', rechaza y deja en
+		'*wait_ns' (si no es NULL) lo que falta para poder aceptar.
+	- Si no, intenta publicarlo con CAS; si otro hilo se adelantó, reintenta
+		con el valor que leyó el CAS.
+	- Retorna 0 si acepta, -1 si rechaza.
+	*/
+	uint64_t	tat;
+	uint64_t	new_tat;
+	uint64_t	cost = rl->interval_ns * n;
+
+	tat = atomic_load_explicit(&rl->tat, memory_order_relaxed);
+	do
+	{
+		new_tat = (tat > now ? tat : now) + cost;
+		if (new_tat - now > rl->tolerance_ns)
+		{
+			if (wait_ns)
+				*wait_ns = new_tat - now - rl->tolerance_ns;
+			return (-1);
+		}
+	} while (!atomic_compare_exchange_weak_explicit(&rl->tat, &tat, new_tat,
+			memory_order_relaxed, memory_order_relaxed));
+	return (0);
+}
+
+int	rate_limiter_try_acquire(rate_limiter_t *rl)
+{
+	/* Acepta una petición si hay tasa disponible. Retorna 0 o -1; nunca bloquea. */
+	return (rate_limiter_take(rl, 1, monotonic_ns(), NULL));
+}
+
+int	rate_limiter_try_acquire_n(rate_limiter_t *rl, unsigned n)
+{
+	/* Igual que rate_limiter_try_acquire pero consume 'n' tokens de una vez. */
+	return (rate_limiter_take(rl, n, monotonic_ns(), NULL));
+}
+
+void	rate_limiter_acquire(rate_limiter_t *rl)
+{
+	/*
+	Adquiere un token, durmiendo lo justo si no hay disponible.
+	El tiempo de espera se calcula con el propio 'tat', sin sondear.
+	*/
+	uint64_t		wait_ns;
+	struct timespec	ts;
+
+	while (rate_limiter_take(rl, 1, monotonic_ns(), &wait_ns) != 0)
+	{
+		ts.tv_sec = wait_ns / NSEC_PER_SEC;
+		ts.tv_nsec = wait_ns % NSEC_PER_SEC;
+		nanosleep(&ts, NULL);
+	}
+}
+
+void	rate_limiter_destroy(rate_limiter_t *rl)
+{
+	free(rl);
+}
+
+/*
+Tabla de limitadores por clave (IP de origen, AOR SIP...).
+Cada clave tiene su propio estado GCRA ('tat') con la misma tasa y ráfaga,
+así que un UA que inunda solo se frena a sí mismo.
+La tabla se divide en KL_SHARDS shards con su propio mutex (una sección
+crítica de unas decenas de ns por petición). Cada shard guarda sus entradas en
+un array denso de tamaño fijo y un índice hash de enteros de 32 bits con sondeo
+lineal, así que la memoria queda acotada a 'max_keys' entradas desde la creación.
+Las claves se comparan siempre enteras: las cortas van dentro de la entrada y
+las largas (AOR y Call-ID suelen pasar de 47 bytes) en una copia aparte, para
+que dos claves distintas con el mismo hash nunca compartan cubo.
+Una entrada cuyo 'tat' ya pasó tiene el cubo lleno y equivale a no tenerla:
+se puede descartar sin cambiar el comportamiento del limitador.
+*/
+#define KL_SHARD_BITS 8
+#define KL_SHARDS (1 << KL_SHARD_BITS)
+#define KL_KEY_INLINE 47  // claves de hasta 47 bytes dentro de la entrada
+
+typedef struct
+{
+	uint64_t	hash;
+	uint64_t	tat;
+	uint32_t	rejected;
+	uint16_t	key_len;
+	uint8_t		ref;
+	union
+	{
+		char	inl[KL_KEY_INLINE + 1];
+		char	*ext;       // key_len > KL_KEY_INLINE: copia completa en el heap
+	}	key;
+}	kl_entry_t;
+
+typedef struct
+{
+	_Alignas(64) pthread_mutex_t mutex;
+	kl_entry_t	*entries;
+	uint32_t	*index;     // posición en 'entries' + 1; 0 = vacío
+	size_t		mask;
+	size_t		count;
+	size_t		max;
+	size_t		hand;       // manecilla CLOCK sobre 'entries'
+	uint64_t	evictions;
+	size_t		key_bytes;  // memoria de las claves largas
+}	kl_shard_t;
+
+typedef struct
+{
+	kl_shard_t	shards[KL_SHARDS];
+	uint64_t	interval_ns;
+	uint64_t	tolerance_ns;
+	uint64_t	idle_ns;
+}	keyed_limiter_t;
+
+// 'key' es una copia de la clave completa; se libera con keyed_limiter_top_free
+typedef struct
+{
+	char		*key;
+	size_t		key_len;
+	uint32_t	rejected;
+}	kl_offender_t;
+
+typedef struct
+{
+	size_t		keys;
+	size_t		max_keys;
+	uint64_t	evictions;
+	size_t		memory_bytes;
+}	kl_stats_t;
+
+keyed_limiter_t	*keyed_limiter_create(size_t max_keys, double rate,
+					unsigned burst, unsigned idle_seconds);
+int	keyed_limiter_try_acquire(keyed_limiter_t *kl, const char *key,
+		size_t key_len);
+size_t	keyed_limiter_sweep(keyed_limiter_t *kl);
+size_t	keyed_limiter_top(keyed_limiter_t *kl, kl_offender_t *out, size_t k);
+void	keyed_limiter_top_free(kl_offender_t *out, size_t n);
+void	keyed_limiter_get_stats(keyed_limiter_t *kl, kl_stats_t *stats);
+void	keyed_limiter_destroy(keyed_limiter_t *kl);
+
+keyed_limiter_t	*keyed_limiter_create(size_t max_keys, double rate,
+		unsigned burst, unsigned idle_seconds)
+{
+	/*
+	Crea una tabla de hasta 'max_keys' limitadores de 'rate' peticiones por
+		segundo con ráfaga 'burst'. 'idle_seconds' es cuánto tiempo debe llevar
+		lleno el cubo de una clave para que keyed_limiter_sweep la borre.
+
+	- Reparte 'max_keys' entre los shards y asigna de una vez el array de
+		entradas de cada uno.
+	- El índice de cada shard tiene al menos el doble de posiciones que
+		entradas (factor de carga <= 0.5) para que el sondeo sea corto.
+	- Retorna la tabla, o NULL si falla.
+	*/
+	keyed_limiter_t	*kl;
+	rate_limiter_t	*proto;
+	size_t			per_shard;
+	size_t			slots;
+
+	if (max_keys == 0)
+		return (NULL);
+	proto = rate_limiter_create(rate, burst);
+	if (!proto)
+		return (NULL);
+	kl = aligned_alloc(64, (sizeof(keyed_limiter_t) + 63) & ~(size_t)63);
+	if (!kl)
+	{
+		rate_limiter_destroy(proto);
+		return (NULL);
+	}
+	kl->interval_ns = proto->interval_ns;
+	kl->tolerance_ns = proto->tolerance_ns;
+	kl->idle_ns = (uint64_t)idle_seconds * NSEC_PER_SEC;
+	rate_limiter_destroy(proto);
+
+	per_shard = (max_keys + KL_SHARDS - 1) / KL_SHARDS;
+	slots = 8;
+	while (slots < per_shard * 2)
+		slots <<= 1;
+	for (int i = 0; i < KL_SHARDS; ++i)
+	{
+		kl_shard_t *s = &kl->shards[i];
+		pthread_mutex_init(&s->mutex, NULL);
+		s->entries = malloc(per_shard * sizeof(kl_entry_t));
+		s->index = calloc(slots, sizeof(uint32_t));
+		s->mask = slots - 1;
+		s->count = 0;
+		s->max = per_shard;
+		s->hand = 0;
+		s->evictions = 0;
+		s->key_bytes = 0;
+		if (!s->entries || !s->index)
+		{
+			free(s->entries);
+			free(s->index);
+			s->entries = NULL;
+			s->index = NULL;
+			while (--i >= 0)
+			{
+				free(kl->shards[i].entries);
+				free(kl->shards[i].index);
+			}
+			free(kl);
+			return (NULL);
+		}
+	}
+	return (kl);
+}
+
+static uint64_t	kl_hash(const char *key, size_t len)
+{
+	// FNV-1a de 64 bits con mezcla final para repartir bien los bits altos (shard)
+	uint64_t	h = 1469598103934665603ULL;
+
+	for (size_t i = 0; i < len; ++i)
+	{
+		h ^= (unsigned char)key[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return (h ? h : 1);
+}
+
+static inline const char	*kl_key(const kl_entry_t *e)
+{
+	return (e->key_len > KL_KEY_INLINE ? e->key.ext : e->key.inl);
+}
+
+static size_t	kl_find(kl_shard_t *s, uint64_t h, const char *key, size_t len)
+{
+	/*
+	Retorna la posición del índice que apunta a la clave, o la posición vacía
+	donde terminó el sondeo si no está. El hash y la longitud descartan casi
+	todas las entradas; la clave se compara entera.
+	*/
+	for (size_t i = h & s->mask;; i = (i + 1) & s->mask)
+	{
+		if (s->index[i] == 0)
+			return (i);
+		kl_entry_t *e = &s->entries[s->index[i] - 1];
+		if (e->hash == h && e->key_len == len
+			&& memcmp(kl_key(e), key, len) == 0)
+			return (i);
+	}
+}
+
+static int	kl_key_store(kl_shard_t *s, kl_entry_t *e, const char *key,
+		size_t len)
+{
+	// Copia la clave en la entrada, o en el heap si no cabe. -1 si no hay memoria
+	char	*dst = e->key.inl;
+
+	if (len > KL_KEY_INLINE)
+	{
+		dst = malloc(len + 1);
+		if (!dst)
+			return (-1);
+		e->key.ext = dst;
+		s->key_bytes += len + 1;
+	}
+	memcpy(dst, key, len);
+	dst[len] = '\0';
+	e->key_len = (uint16_t)len;
+	return (0);
+}
+
+static void	kl_key_release(kl_shard_t *s, kl_entry_t *e)
+{
+	if (e->key_len > KL_KEY_INLINE)
+	{
+		s->key_bytes -= e->key_len + 1;
+		free(e->key.ext);
+	}
+}
+
+static size_t	kl_slot_of(kl_shard_t *s, size_t entry)
+{
+	// Posición del índice que apunta a la entrada densa 'entry'.
+	size_t	i = s->entries[entry].hash & s->mask;
+
+	while (s->index[i] != entry + 1)
+		i = (i + 1) & s->mask;
+	return (i);
+}
+
+static void	kl_remove(kl_shard_t *s, size_t entry)
+{
+	/*
+	Borra la entrada densa 'entry' sin dejar lápidas.
+
+	- Borra su posición del índice desplazando hacia atrás las entradas
+		siguientes del mismo grupo de sondeo que ya no serían alcanzables.
+	- Mueve la última entrada del array denso al hueco y corrige su posición
+		en el índice, para que el array siga compacto.
+	*/
+	size_t	i = kl_slot_of(s, entry);
+	size_t	j = i;
+
+	kl_key_release(s, &s->entries[entry]);
+	while (1)
+	{
+		j = (j + 1) & s->mask;
+		if (s->index[j] == 0)
+			break ;
+		size_t k = s->entries[s->index[j] - 1].hash & s->mask;
+		if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+		{
+			s->index[i] = s->index[j];
+			i = j;
+		}
+	}
+	s->index[i] = 0;
+	if (entry != s->count - 1)
+	{
+		size_t last = kl_slot_of(s, s->count - 1);
+		s->entries[entry] = s->entries[s->count - 1];
+		s->index[last] = entry + 1;
+	}
+	s->count--;
+}
+
+static void	kl_evict_one(kl_shard_t *s, uint64_t now)
+{
+	/*
+	Libera una entrada cuando el shard está lleno (algoritmo CLOCK).
+	Prefiere una clave con el cubo ya lleno ('tat' <= now), que se puede
+	borrar sin perder estado; si no, la primera sin bit de referencia.
+	Tras dos vueltas sin candidata, borra la que señala la manecilla.
+	*/
+	for (size_t n = 0; n < 2 * s->count; ++n)
+	{
+		if (s->hand >= s->count)
+			s->hand = 0;
+		kl_entry_t *e = &s->entries[s->hand];
+		if (e->tat <= now || !e->ref)
+			break ;
+		e->ref = 0;
+		s->hand++;
+	}
+	if (s->hand >= s->count)
+		s->hand = 0;
+	kl_remove(s, s->hand);
+	s->evictions++;
+}
+
+int	keyed_limiter_try_acquire(keyed_limiter_t *kl, const char *key,
+		size_t key_len)
+{
+	/*
+	Aplica el limitador de la clave 'key' a una petición. Nunca bloquea salvo
+		por el mutex del shard.
+
+	- Selecciona el shard con los bits altos del hash y busca la clave.
+	- Si no existe, la crea con el cubo lleno; si el shard está lleno, antes
+		desaloja una entrada (ver kl_evict_one). Si no hay memoria para
+		copiar una clave larga, la petición se acepta sin estado, igual que
+		una clave recién desalojada.
+	- Aplica el paso GCRA sobre el 'tat' de la entrada y, si rechaza, suma
+		uno al contador de rechazos de la clave.
+	- Retorna 0 si acepta, -1 si rechaza.
+	*/
+	uint64_t	h = kl_hash(key, key_len);
+	kl_shard_t	*s = &kl->shards[h >> (64 - KL_SHARD_BITS)];
+	uint64_t	now = monotonic_ns();
+	uint64_t	new_tat;
+	kl_entry_t	*e;
+	size_t		i;
+	int			ret = 0;
+
+	if (key_len > UINT16_MAX)
+		key_len = UINT16_MAX;
+	pthread_mutex_lock(&s->mutex);
+	i = kl_find(s, h, key, key_len);
+	if (s->index[i] == 0)
+	{
+		if (s->count == s->max)
+		{
+			kl_evict_one(s, now);
+			i = kl_find(s, h, key, key_len);
+		}
+		e = &s->entries[s->count];
+		if (kl_key_store(s, e, key, key_len) != 0)
+		{
+			pthread_mutex_unlock(&s->mutex);
+			return (0);
+		}
+		e->hash = h;
+		e->tat = 0;
+		e->rejected = 0;
+		s->index[i] = ++s->count;
+	}
+	else
+		e = &s->entries[s->index[i] - 1];
+	e->ref = 1;
+	new_tat = (e->tat > now ? e->tat : now) + kl->interval_ns;
+	if (new_tat - now > kl->tolerance_ns)
+	{
+		e->rejected++;
+		ret = -1;
+	}
+	else
+		e->tat = new_tat;
+	pthread_mutex_unlock(&s->mutex);
+	return (ret);
+}
+
+size_t	keyed_limiter_sweep(keyed_limiter_t *kl)
+{
+	/*
+	Borra las claves inactivas: las que llevan al menos 'idle_ns' con el cubo
+	lleno. Pensada para llamarse periódicamente desde un hilo de mantenimiento.
+	Retorna cuántas claves borró.
+	*/
+	uint64_t	now = monotonic_ns();
+	size_t		removed = 0;
+
+	for (int i = 0; i < KL_SHARDS; ++i)
+	{
+		kl_shard_t *s = &kl->shards[i];
+		pthread_mutex_lock(&s->mutex);
+		for (size_t j = 0; j < s->count;)
+		{
+			if (s->entries[j].tat + kl->idle_ns <= now)
+			{
+				kl_remove(s, j);
+				removed++;
+			}
+			else
+				j++;
+		}
+		pthread_mutex_unlock(&s->mutex);
+	}
+	return (removed);
+}
+
+static void	kl_heap_sift(kl_offender_t *heap, size_t n, size_t i)
+{
+	// Hunde 'i' en un montículo de mínimos por número de rechazos.
+	while (1)
+	{
+		size_t min = i;
+		size_t l = 2 * i + 1;
+		size_t r = l + 1;
+		if (l < n && heap[l].rejected < heap[min].rejected)
+			min = l;
+		if (r < n && heap[r].rejected < heap[min].rejected)
+			min = r;
+		if (min == i)
+			return ;
+		kl_offender_t tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
+	}
+}
+
+size_t	keyed_limiter_top(keyed_limiter_t *kl, kl_offender_t *out, size_t k)
+{
+	/*
+	Rellena 'out' con las 'k' claves con más rechazos, de mayor a menor.
+
+	- Recorre los shards de uno en uno (bloqueando solo el que lee) y mantiene
+		en 'out' un montículo de mínimos de tamaño 'k'.
+	- Al final ordena el montículo de forma descendente.
+	- Cada clave de 'out' es una copia completa; el llamador la libera con
+		keyed_limiter_top_free. Una clave que no se puede copiar se omite.
+	- Retorna cuántas claves escribió (solo claves con algún rechazo).
+	*/
+	size_t	n = 0;
+
+	if (k == 0)
+		return (0);
+	for (int i = 0; i < KL_SHARDS; ++i)
+	{
+		kl_shard_t *s = &kl->shards[i];
+		pthread_mutex_lock(&s->mutex);
+		for (size_t j = 0; j < s->count; ++j)
+		{
+			kl_entry_t *e = &s->entries[j];
+			if (e->rejected == 0 || (n == k && e->rejected <= out[0].rejected))
+				continue ;
+			kl_offender_t o;
+			o.key = malloc(e->key_len + 1);
+			if (!o.key)
+				continue ;
+			memcpy(o.key, kl_key(e), e->key_len + 1);
+			o.key_len = e->key_len;
+			o.rejected = e->rejected;
+			if (n < k)
+			{
+				size_t c = n++;
+				out[c] = o;
+				while (c > 0 && out[(c - 1) / 2].rejected > out[c].rejected)
+				{
+					out[c] = out[(c - 1) / 2];
+					out[(c - 1) / 2] = o;
+					c = (c - 1) / 2;
+				}
+			}
+			else
+			{
+				free(out[0].key);
+				out[0] = o;
+				kl_heap_sift(out, n, 0);
+			}
+		}
+		pthread_mutex_unlock(&s->mutex);
+	}
+	for (size_t m = n; m > 1; --m)
+	{
+		kl_offender_t tmp = out[0];
+		out[0] = out[m - 1];
+		out[m - 1] = tmp;
+		kl_heap_sift(out, m - 1, 0);
+	}
+	return (n);
+}
+
+void	keyed_limiter_top_free(kl_offender_t *out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		free(out[i].key);
+		out[i].key = NULL;
+	}
+}
+
+void	keyed_limiter_get_stats(keyed_limiter_t *kl, kl_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->memory_bytes = sizeof(keyed_limiter_t);
+	for (int i = 0; i < KL_SHARDS; ++i)
+	{
+		kl_shard_t *s = &kl->shards[i];
+		pthread_mutex_lock(&s->mutex);
+		stats->keys += s->count;
+		stats->max_keys += s->max;
+		stats->evictions += s->evictions;
+		stats->memory_bytes += s->max * sizeof(kl_entry_t)
+			+ (s->mask + 1) * sizeof(uint32_t) + s->key_bytes;
+		pthread_mutex_unlock(&s->mutex);
+	}
+}
+
+void	keyed_limiter_destroy(keyed_limiter_t *kl)
+{
+	if (!kl)
+		return ;
+	for (int i = 0; i < KL_SHARDS; ++i)
+	{
+		for (size_t j = 0; j < kl->shards[i].count; ++j)
+			kl_key_release(&kl->shards[i], &kl->shards[i].entries[j]);
+		pthread_mutex_destroy(&kl->shards[i].mutex);
+		free(kl->shards[i].entries);
+		free(kl->shards[i].index);
+	}
+	free(kl);
+}
+
+/*
+Limitador de concurrencia con semáforo (implementación anterior de
+rate_limiter_t): acota cuántas tareas se ejecutan a la vez, no cuántas por
+segundo.
+*/
+typedef struct
+{
+	sem_t semaphore;
+} concurrency_limiter_t;
+
+concurrency_limiter_t	*concurrency_limiter_create(int max_requests);
+void	concurrency_limiter_acquire(concurrency_limiter_t *cl);
+void	concurrency_limiter_release(concurrency_limiter_t *cl);
+void	concurrency_limiter_destroy(concurrency_limiter_t *cl);
+
+concurrency_limiter_t	*concurrency_limiter_create(int max_requests)
+{
+	/*
+	Crea e inicializa un limitador que permite un máximo de 'max_requests' peticiones simultáneas.
+
+	- Asigna memoria para la estructura del limitador.
+	- Inicializa un semáforo binario (o contador) con un valor inicial de 'max_requests'.
+		Este valor representa el número de "permisos" disponibles.
+	- Retorna un puntero al limitador creado.
+	*/
+	concurrency_limiter_t *cl = malloc(sizeof(concurrency_limiter_t));
+	if (!cl)
+		return (NULL);
+
+	if (sem_init(&cl->semaphore, 0, max_requests) != 0)
+	{
+		perror("sem_init failed");
+		free(cl);
+		return (NULL);
+	}
+
+	return (cl);
+}
+
+void	concurrency_limiter_acquire(concurrency_limiter_t *cl)
+{
+	/*
+	Intenta adquirir un permiso del limitador. Si no hay permisos disponibles,
+		el hilo se bloquea hasta que se libere uno.
+
+	- Llama a la función sem_wait(). Esta función decrementa el valor del semáforo.
+	- Si el valor del semáforo es mayor que cero, el hilo continúa.
+	- Si el valor del semáforo es cero,
+		el hilo se bloquea hasta que otro hilo llame a sem_post().
+	*/
+	sem_wait(&cl->semaphore);
+}
+
+void	concurrency_limiter_release(concurrency_limiter_t *cl)
+{
+	/*
+	Libera un permiso al limitador,
+		incrementando el contador del semáforo.
+
+	- Llama a la función sem_post(). Esta función incrementa el valor del semáforo,
+		lo que podría desbloquear a un hilo que estaba esperando en sem_wait().
+	*/
+	sem_post(&cl->semaphore);
+}
+
+void	concurrency_limiter_destroy(concurrency_limiter_t *cl)
+{
+	/*
+	Destruye el limitador, liberando los recursos.
+
+	- Llama a sem_destroy() para liberar los recursos asociados con el semáforo.
+	- Libera la memoria asignada para la estructura del limitador.
+	*/
+	if (cl)
+	{
+		sem_destroy(&cl->semaphore);
+		free(cl);
+	}
+}
+
+void	*task_function(void *arg)
+{
+	concurrency_limiter_t *limiter = (concurrency_limiter_t *)arg;
+	printf("Hilo %lu intentando adquirir permiso...\n", pthread_self());
+	concurrency_limiter_acquire(limiter);
+	printf("Hilo %lu ha adquirido permiso y está ejecutando la tarea...\n",
+		pthread_self());
+	sleep(2); // Simular trabajo
+	printf("Hilo %lu ha terminado la tarea y libera el permiso.\n",
+		pthread_self());
+	concurrency_limiter_release(limiter);
+	pthread_exit(NULL);
+}
+
+/* ---- Demo de tasa: varios hilos inundan un limitador de 'INVITE's ---- */
+
+#define FLOOD_THREADS 4
+#define FLOOD_SECONDS 2
+#define FLOOD_RATE 100.0
+#define FLOOD_BURST 20
+
+typedef struct
+{
+	rate_limiter_t	*limiter;
+	long			accepted;
+	long			rejected;
+}	flood_arg_t;
+
+static void	*flood_thread(void *arg)
+{
+	flood_arg_t *f = (flood_arg_t *)arg;
+	uint64_t end = monotonic_ns() + FLOOD_SECONDS * NSEC_PER_SEC;
+
+	while (monotonic_ns() < end)
+	{
+		if (rate_limiter_try_acquire(f->limiter) == 0)
+			f->accepted++;
+		else
+			f->rejected++;
+	}
+	return (NULL);
+}
+
+static int	rate_demo(void)
+{
+	pthread_t		threads[FLOOD_THREADS];
+	flood_arg_t		args[FLOOD_THREADS];
+	long			accepted = 0;
+	long			rejected = 0;
+	rate_limiter_t	*rl = rate_limiter_create(FLOOD_RATE, FLOOD_BURST);
+
+	if (!rl)
+		return (1);
+	printf("\n%d hilos inundan durante %d s un limitador de %.0f/s (ráfaga %d)\n",
+		FLOOD_THREADS, FLOOD_SECONDS, FLOOD_RATE, FLOOD_BURST);
+	for (int i = 0; i < FLOOD_THREADS; ++i)
+	{
+		args[i] = (flood_arg_t){rl, 0, 0};
+		pthread_create(&threads[i], NULL, flood_thread, &args[i]);
+	}
+	for (int i = 0; i < FLOOD_THREADS; ++i)
+	{
+		pthread_join(threads[i], NULL);
+		accepted += args[i].accepted;
+		rejected += args[i].rejected;
+	}
+	printf("Aceptadas: %ld (esperadas ~%.0f), rechazadas: %ld\n", accepted,
+		FLOOD_RATE * FLOOD_SECONDS + FLOOD_BURST, rejected);
+	rate_limiter_destroy(rl);
+	return (0);
+}
+
+/* ---- Demo por clave: un millón de orígenes legítimos y unos pocos abusivos ---- */
+
+#define KEYS_DEMO_SOURCES 1000000
+#define KEYS_DEMO_OFFENDERS 3
+#define KEYS_DEMO_TOP 5
+
+static int	keyed_demo(void)
+{
+	/*
+	Cada origen legítimo envía una petición; cada abusivo envía 1000 mezcladas
+	con las demás. Los abusivos se frenan tras su ráfaga sin afectar a nadie más.
+	*/
+	keyed_limiter_t	*kl = keyed_limiter_create(KEYS_DEMO_SOURCES, 5.0, 10, 0);
+	kl_offender_t	top[KEYS_DEMO_TOP];
+	kl_stats_t		st;
+	char			key[32];
+	long			rejected_legit = 0;
+	uint64_t		t0;
+	uint64_t		t1;
+
+	if (!kl)
+		return (1);
+	printf("\nLimitador por clave: %d orígenes legítimos y %d abusivos (5/s, ráfaga 10)\n",
+		KEYS_DEMO_SOURCES, KEYS_DEMO_OFFENDERS);
+	t0 = monotonic_ns();
+	for (int i = 0; i < KEYS_DEMO_SOURCES; ++i)
+	{
+		int len = snprintf(key, sizeof(key), "10.%d.%d.%d", (i >> 16) & 255,
+				(i >> 8) & 255, i & 255);
+		rejected_legit += keyed_limiter_try_acquire(kl, key, len) != 0;
+		if (i % 1000 < KEYS_DEMO_OFFENDERS)
+		{
+			len = snprintf(key, sizeof(key), "sip:flood%d@evil.example",
+					i % 1000);
+			keyed_limiter_try_acquire(kl, key, len);
+		}
+	}
+	t1 = monotonic_ns();
+	keyed_limiter_get_stats(kl, &st);
+	printf("%.1f ns por petición, legítimas rechazadas: %ld\n",
+		(double)(t1 - t0) / (KEYS_DEMO_SOURCES + KEYS_DEMO_OFFENDERS * 1000),
+		rejected_legit);
+	printf("Claves: %zu de %zu, desalojos: %llu, memoria: %.1f MiB\n", st.keys,
+		st.max_keys, (unsigned long long)st.evictions,
+		st.memory_bytes / (1024.0 * 1024.0));
+	size_t n = keyed_limiter_top(kl, top, KEYS_DEMO_TOP);
+	printf("Principales infractores:\n");
+	for (size_t i = 0; i < n; ++i)
+		printf("  %-32s %u rechazos\n", top[i].key, top[i].rejected);
+	keyed_limiter_top_free(top, n);
+	printf("Barrido de inactivas: %zu claves borradas\n", keyed_limiter_sweep(kl));
+	keyed_limiter_destroy(kl);
+	return (0);
+}
+
+/* ---- Microbenchmark: coste por llamada de rate_limiter_try_acquire ---- */
+
+#define BENCH_CALLS 20000000L
+#define BENCH_MAX_THREADS 4
+
+typedef struct
+{
+	rate_limiter_t	*limiter;
+	long			calls;
+	long			accepted;
+}	bench_arg_t;
+
+static void	*bench_thread(void *arg)
+{
+	bench_arg_t *b = (bench_arg_t *)arg;
+	long accepted = 0;
+
+	for (long i = 0; i < b->calls; ++i)
+		accepted += rate_limiter_try_acquire(b->limiter) == 0;
+	b->accepted = accepted;
+	return (NULL);
+}
+
+static double	bench_run(double rate, unsigned burst, int nthreads)
+{
+	/* Retorna los ns por llamada (tiempo de pared / llamadas por hilo). */
+	pthread_t		threads[BENCH_MAX_THREADS];
+	bench_arg_t		args[BENCH_MAX_THREADS];
+	rate_limiter_t	*rl = rate_limiter_create(rate, burst);
+	uint64_t		t0;
+	uint64_t		t1;
+	long			calls = BENCH_CALLS / nthreads;
+
+	if (!rl)
+		return (0);
+	t0 = monotonic_ns();
+	for (int i = 0; i < nthreads; ++i)
+	{
+		args[i] = (bench_arg_t){rl, calls, 0};
+		pthread_create(&threads[i], NULL, bench_thread, &args[i]);
+	}
+	for (int i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+	t1 = monotonic_ns();
+	rate_limiter_destroy(rl);
+	return ((double)(t1 - t0) / calls);
+}
+
+static double	keyed_bench_run(int nkeys)
+{
+	/* ns por llamada de keyed_limiter_try_acquire recorriendo 'nkeys' claves. */
+	keyed_limiter_t	*kl = keyed_limiter_create(nkeys, 1e9, 1000, 60);
+	char			(*keys)[16] = malloc(sizeof(*keys) * nkeys);
+	int				*lens = malloc(sizeof(int) * nkeys);
+	uint64_t		t0;
+	uint64_t		t1;
+	double			ns = 0;
+
+	if (kl && keys && lens)
+	{
+		for (int i = 0; i < nkeys; ++i)
+			lens[i] = snprintf(keys[i], sizeof(keys[i]), "10.%d.%d.%d",
+					(i >> 16) & 255, (i >> 8) & 255, i & 255);
+		t0 = monotonic_ns();
+		for (long i = 0; i < BENCH_CALLS / 4; ++i)
+		{
+			int k = (int)((i * 2654435761u) % (unsigned)nkeys);
+			keyed_limiter_try_acquire(kl, keys[k], lens[k]);
+		}
+		t1 = monotonic_ns();
+		ns = (double)(t1 - t0) / (BENCH_CALLS / 4);
+	}
+	keyed_limiter_destroy(kl);
+	free(keys);
+	free(lens);
+	return (ns);
+}
+
+static int	rate_benchmark(void)
+{
+	printf("Llamadas: %ld, CPUs en línea: %ld\n", BENCH_CALLS,
+		sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%-36s %10.1f ns\n", "1 hilo, todas aceptadas",
+		bench_run(1e12, 1000, 1));
+	printf("%-36s %10.1f ns\n", "1 hilo, todas rechazadas (inundación)",
+		bench_run(1.0, 1, 1));
+	for (int n = 2; n <= BENCH_MAX_THREADS; n *= 2)
+	{
+		char label[64];
+		snprintf(label, sizeof(label), "%d hilos, todas aceptadas", n);
+		printf("%-36s %10.1f ns\n", label, bench_run(1e12, 1000, n));
+	}
+	printf("%-36s %10.1f ns\n", "por clave, una clave", keyed_bench_run(1));
+	printf("%-36s %10.1f ns\n", "por clave, 1M claves", keyed_bench_run(1 << 20));
+	return (0);
+}
+
+int	main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return (rate_benchmark());
+
+	int max_requests = 3;
+	int num_threads = 5;
+	concurrency_limiter_t *limiter = concurrency_limiter_create(max_requests);
+	if (!limiter)
+	{
+		return (1);
+	}
+
+	pthread_t threads[num_threads];
+
+	printf("Creando %d hilos...\n", num_threads);
+	for (int i = 0; i < num_threads; ++i)
+	{
+		if (pthread_create(&threads[i], NULL, task_function, limiter) != 0)
+		{
+			perror("Error al crear el hilo");
+			concurrency_limiter_destroy(limiter);
+			return (1);
+		}
+	}
+
+	printf("Esperando que los hilos terminen...\n");
+	for (int i = 0; i < num_threads; ++i)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	concurrency_limiter_destroy(limiter);
+	if (rate_demo() != 0 || keyed_demo() != 0)
+		return (1);
+	printf("Programa principal terminado.\n");
+	return (0);
+}
+
+/*
+Compila: gcc -O2 pthreads4.c -o rate_limiter -lpthread
+Ejecuta: ./rate_limiter
+Benchmark: ./rate_limiter bench
+Explicación:
+Este bloque implementa dos limitadores distintos.
+rate_limiter_t es un limitador de tasa real (GCRA, equivalente a un token
+bucket): permite 'rate' peticiones por segundo con ráfagas de hasta 'burst',
+por ejemplo N INVITEs por segundo de un origen. Guarda un solo instante
+teórico de llegada en un entero atómico; rate_limiter_try_acquire lee el
+reloj monotónico, calcula el nuevo instante y lo publica con un CAS, sin
+mutex, sin hilo de relleno y sin bloquear, así que puede descartar una
+inundación SIP al ritmo de llegada. rate_limiter_acquire duerme justo el
+tiempo que falta en lugar de sondear.
+concurrency_limiter_t es la implementación anterior con semáforo: acota
+cuántas tareas se ejecutan a la vez (3 de 5 hilos en la demo).
+keyed_limiter_t mantiene un limitador GCRA por clave (IP de origen o AOR)
+para que un UA que inunda no frene a los demás: una tabla hash repartida en
+256 shards con mutex, con entradas compactas (72 bytes) en arrays de tamaño
+fijo, de modo que la memoria queda acotada desde la creación (~80 MiB para
+un millón de claves, más la copia de las claves de más de 47 bytes). Las
+claves se comparan enteras: con claves elegidas por el atacante, una
+colisión de hash no puede poner a dos UA en el mismo cubo. Cuando un shard se llena desaloja con CLOCK, prefiriendo
+claves con el cubo lleno, que se pueden olvidar sin cambiar nada;
+keyed_limiter_sweep borra periódicamente las inactivas y keyed_limiter_top
+lista las claves con más rechazos.
+La demo ejecuta primero el limitador de concurrencia, después 4 hilos que
+inundan un limitador de 100/s durante 2 segundos y por último un millón de
+orígenes distintos mezclados con tres abusivos en el limitador por clave.
+El modo bench mide el coste por llamada de rate_limiter_try_acquire sin
+contención (aceptando y rechazando) y con varios hilos, y el de
+keyed_limiter_try_acquire con una clave y con un millón.
+ */
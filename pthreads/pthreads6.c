@@ -1,283 +1,1362 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-
-#define INITIAL_THREADS 2
-#define MAX_THREADS 5
-#define MAX_TASKS 20
-
-
-typedef struct
-{
-	void (*function)(void *);
-	void *argument;
-} task_t;
-
-typedef struct
-{
-	task_t *tasks;
-	int head;
-	int tail;
-	int count;
-	int capacity;
-	pthread_mutex_t queue_mutex;
-	pthread_cond_t queue_not_empty;
-	pthread_cond_t queue_not_full;
-
-	pthread_t *threads;
-	int num_threads;
-	int max_threads;
-	int shutdown;               // bandera para terminar los hilos
-	pthread_mutex_t pool_mutex; // mutex para controlar num de hilos
-} thread_pool_t;
-
-void	thread_pool_init(thread_pool_t *pool, int initial_threads,
-		int max_threads, int max_tasks);
-void	thread_pool_submit(thread_pool_t *pool, void (*function)(void *),
-		void *argument);
-void	thread_pool_destroy(thread_pool_t *pool);
-void	*worker(void *pool);
-int	add_worker(thread_pool_t *pool);
-
-void	execute_task(void *arg)
-{
-	int task_id = *(int *)arg;
-	printf("Hilo %lu ejecutando tarea %d\n", pthread_self(), task_id);
-	sleep(rand() % 5); // Simular trabajo más largo
-	free(arg);
-}
-
-void	thread_pool_init(thread_pool_t *pool, int initial_threads,
-		int max_threads, int max_tasks)
-{
-	/*
-	Inicializa la estructura del thread pool con soporte para redimensionamiento dinámico.
-
-	- Asigna memoria para la cola de tareas y los hilos.
-	- Inicializa los mutexes para la cola y el pool de hilos.
-	- Inicializa las variables de condición para la cola.
-	- Establece la capacidad máxima de la cola y el número máximo de hilos.
-	- Crea el número inicial de hilos trabajadores y los inicia.
-	*/
-	pool->capacity = max_tasks;
-	pool->tasks = malloc(sizeof(task_t) * pool->capacity);
-	if (!pool->tasks)
-		perror("malloc tasks failed");
-	pool->head = pool->tail = pool->count = 0;
-	pthread_mutex_init(&pool->queue_mutex, NULL);
-	pthread_cond_init(&pool->queue_not_empty, NULL);
-	pthread_cond_init(&pool->queue_not_full, NULL);
-
-	pool->max_threads = max_threads;
-	pool->num_threads = 0;
-	pool->threads = malloc(sizeof(pthread_t) * pool->max_threads);
-	if (!pool->threads)
-		perror("malloc threads failed");
-	pthread_mutex_init(&pool->pool_mutex, NULL);
-
-	for (int i = 0; i < initial_threads; ++i)
-	{
-		if (add_worker(pool) != 0)
-		{
-			fprintf(stderr, "Error al inicializar los hilos iniciales\n");
-			// Aquí se debería implementar una limpieza más robusta
-		}
-	}
-}
-
-void	thread_pool_submit(thread_pool_t *pool, void (*function)(void *),
-		void *argument)
-{
-	/*
-	Añade una tarea a la cola del thread pool y gestiona el redimensionamiento dinámico.
-
-	- Bloquea el mutex de la cola.
-	- Espera si la cola está llena.
-	- Añade la tarea a la cola.
-	- Incrementa el contador de tareas.
-	- Señala que la cola ya no está vacía.
-	- Comprueba si la cola está llena y si el número actual de hilos es menor que el máximo.
-		Si ambas condiciones son verdaderas,
-			intenta añadir un nuevo hilo trabajador.
-	- Desbloquea el mutex de la cola.
-	*/
-	pthread_mutex_lock(&pool->queue_mutex);
-	while (pool->count == pool->capacity)
-	{
-		pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
-	}
-	pool->tasks[pool->tail].function = function;
-	pool->tasks[pool->tail].argument = argument;
-	pool->tail = (pool->tail + 1) % pool->capacity;
-	pool->count++;
-	pthread_cond_signal(&pool->queue_not_empty);
-
-	if (pool->count == pool->capacity && pool->num_threads < pool->max_threads)
-	{
-		pthread_mutex_lock(&pool->pool_mutex);
-		if (pool->num_threads < pool->max_threads)
-		{
-			printf("Redimensionando pool: %d +1 hilo)\n", pool->num_threads);
-			add_worker(pool);
-		}
-		pthread_mutex_unlock(&pool->pool_mutex);
-	}
-	pthread_mutex_unlock(&pool->queue_mutex);
-}
-
-int	add_worker(thread_pool_t *pool)
-{
-	/*
-	Añade un nuevo hilo trabajador al pool.
-
-	- Bloquea el mutex del pool para modificar el número de hilos.
-	- Crea un nuevo hilo que ejecuta la función 'worker'.
-	- Incrementa el contador de hilos.
-	- Desbloquea el mutex del pool.
-	- Retorna 0 en éxito, -1 en error.
-	*/
-	pthread_mutex_lock(&pool->pool_mutex);
-	if (pool->num_threads < pool->max_threads)
-	{
-		if (pthread_create(&pool->threads[pool->num_threads], NULL, worker,
-				pool) == 0)
-		{
-			pool->num_threads++;
-			pthread_mutex_unlock(&pool->pool_mutex);
-			return (0);
-		}
-		else
-		{
-			perror("Error al crear un nuevo hilo trabajador");
-			pthread_mutex_unlock(&pool->pool_mutex);
-			return (-1);
-		}
-	}
-	pthread_mutex_unlock(&pool->pool_mutex);
-	return (-1); // No se pueden añadir más hilos
-}
-
-void	*worker(void *pool)
-{
-	/*
-	Función que ejecuta cada hilo trabajador del pool.
-
-	- Entra en un bucle infinito para procesar tareas.
-	- Bloquea el mutex de la cola.
-	- Espera hasta que haya una tarea disponible o se indique el cierre.
-	- Obtiene una tarea de la cola.
-	- Desbloquea el mutex de la cola.
-	- Ejecuta la tarea.
-	*/
-
-	thread_pool_t *p = (thread_pool_t *)pool;
-
-	while (1)
-	{
-		pthread_mutex_lock(&p->queue_mutex);
-		while (p->count == 0 && !p->shutdown)
-		{
-			pthread_cond_wait(&p->queue_not_empty, &p->queue_mutex);
-		}
-		// Si shutdown y no hay tareas pendientes, salir
-        if (p->shutdown && p->count == 0)
-        {
-            pthread_mutex_unlock(&p->queue_mutex);
-            break;
-        }
-		task_t task = p->tasks[p->head];
-		p->head = (p->head + 1) % p->capacity;
-		p->count--;
-		pthread_cond_signal(&p->queue_not_full);
-		pthread_mutex_unlock(&p->queue_mutex);
-
-		task.function(task.argument);
-	}
-	return (NULL);
-}
-
-void	thread_pool_destroy(thread_pool_t *pool)
-{
-	/*
-	Destruye el thread pool.
-
-	- Bloquea el mutex de la cola.
-	- Señala a todos los hilos que deben terminar (esto requeriría un mecanismo más sofisticado
-		para una terminación limpia,
-			como una bandera 'shutdown' y una condición).
-	- Desbloquea el mutex de la cola.
-	- Espera a que todos los hilos terminen.
-	- Libera la memoria asignada.
-	- Destruye los mutexes y las condiciones.
-	*/
-	pthread_mutex_lock(&pool->queue_mutex);
-	// Indicar a los hilos que terminen
-	// Estableciendo pool->shutdown = 1 y señalando la condición.
-	pthread_cond_broadcast(&pool->queue_not_empty);
-		// Despertar a todos los hilos
-	pthread_cond_broadcast(&pool->queue_not_full); 
-		// Despertar por si alguno está esperando espacio
-	pthread_mutex_unlock(&pool->queue_mutex);
-
-	for (int i = 0; i < pool->num_threads; ++i)
-	{
-		pthread_join(pool->threads[i], NULL);
-	}
-
-	free(pool->tasks);
-	free(pool->threads);
-	pthread_mutex_destroy(&pool->queue_mutex);
-	pthread_cond_destroy(&pool->queue_not_empty);
-	pthread_cond_destroy(&pool->queue_not_full);
-	pthread_mutex_destroy(&pool->pool_mutex);
-}
-
-int	main(void)
-{
-	thread_pool_t pool;
-	thread_pool_init(&pool, INITIAL_THREADS, MAX_THREADS, MAX_TASKS);
-	srand(time(NULL));
-
-	printf("Enviando tareas...\n");
-	for (int i = 1; i <= 15; ++i)
-	{
-		int *arg = malloc(sizeof(int));
-		*arg = i;
-		thread_pool_submit(&pool, execute_task, arg);
-		usleep(2000); // Simular llegadas de tareas con un pequeño retraso
-	}
-
-	sleep(10);
-	// Dar tiempo para que las tareas se ejecuten y el pool se redimensione
-
-	thread_pool_destroy(&pool);
-	printf("Programa principal terminado.\n");
-	return (0);
-}
-
-/*
-Compila: gcc pthreads6.c -o thread_pool_dynamic -lpthread
-Ejecuta: ./thread_pool_dynamic
-Explicación:
-Este bloque implementa un thread pool que puede redimensionarse dinámicamente.
-
-	-Inicialización: El pool comienza con un número inicial de hilos (INITIAL_THREADS).
-
-	-Envío de Tareas: Cuando se envía una tarea y la cola está llena,
-	el pool intenta crear un nuevo hilo trabajador
-	(siempre que no se haya alcanzado el número máximo de hilos, MAX_THREADS).
-
-	-Hilos Trabajadores: Los hilos trabajadores toman tareas de la cola y las ejecutan.
-
-	-Redimensionamiento: El redimensionamiento se activa en la función thread_pool_submit
-	cuando la cola está llena y todavía hay capacidad para crear más hilos.
-
-Observarás en la salida que el número de hilos trabajadores puede aumentar
-a medida que se envían más tareas y la cola se llena,
-hasta alcanzar el 1  límite máximo de hilos definido.
-Este es un ejemplo básico de cómo un thread pool puede adaptarse a la carga de trabajo.
-En una implementación más completa,
-	también se podría incluir la reducción del número de hilos
-cuando la carga disminuye.
- */
\ No newline at end of file
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "slab.h"
+
+#define INITIAL_THREADS 2
+#define MAX_THREADS 5
+#define MAX_TASKS 20
+#define CACHELINE_SIZE 64
+#define DEQUE_CAPACITY 256 // tareas por deque de trabajador (potencia de 2)
+#define INJECT_BATCH 16    // tareas que un trabajador saca de la cola global de una vez
+#define STEAL_ROUNDS 2     // vueltas de robo antes de dormir
+#define NSEC_PER_MSEC 1000000ULL
+
+/*
+Parámetros del controlador de tamaño. Cada CONTROL_TICK_MS mide la latencia
+de cola y cuántos trabajadores están dormidos; crece si la latencia supera
+GROW_LATENCY_MS durante GROW_TICKS ticks seguidos y encoge si más de la mitad
+de los trabajadores llevan SHRINK_TICKS ticks dormidos. Tras cada cambio espera
+COOLDOWN_TICKS ticks (histéresis) antes de volver a decidir.
+*/
+#define CONTROL_TICK_MS 50
+#define GROW_LATENCY_MS 5
+#define GROW_TICKS 2
+#define SHRINK_TICKS 20
+#define COOLDOWN_TICKS 10
+#define LATENCY_SAMPLE 16  // una de cada 16 tareas de la cola global lleva marca de tiempo
+
+
+typedef struct
+{
+	void (*function)(void *);
+	void *argument;
+	uint64_t enqueue_ns;        // momento en que entró en la cola global (0 = sin muestrear)
+} task_t;
+
+/*
+Deque de Chase-Lev de capacidad fija.
+Solo su trabajador empuja y saca por 'bottom' (LIFO, caché caliente); los
+demás roban por 'top' (FIFO) con un CAS. Cada campo del slot es atómico
+porque un ladrón puede leerlo mientras el dueño escribe otro índice.
+*/
+typedef struct
+{
+	_Atomic(void (*)(void *)) function;
+	_Atomic(void *) argument;
+} ws_slot_t;
+
+typedef struct
+{
+	_Alignas(CACHELINE_SIZE) atomic_long top;
+	_Alignas(CACHELINE_SIZE) atomic_long bottom;
+	_Alignas(CACHELINE_SIZE) ws_slot_t slots[DEQUE_CAPACITY];
+} ws_deque_t;
+
+enum { WORKER_FREE, WORKER_RUNNING, WORKER_EXITED };
+enum { SHUTDOWN_NONE, SHUTDOWN_DRAIN, SHUTDOWN_CANCEL };
+
+/* Recibe cada tarea pendiente que el cierre descarta sin ejecutar. */
+typedef void (*task_cancel_t)(void (*function)(void *), void *argument);
+
+typedef struct
+{
+	ws_deque_t deque;
+	struct s_thread_pool *pool;
+	pthread_t thread;
+	int index;
+	atomic_int state;           // WORKER_FREE, WORKER_RUNNING o WORKER_EXITED (sin join)
+	uint64_t rng;               // estado xorshift para elegir víctima
+} ws_worker_t;
+
+typedef struct s_thread_pool
+{
+	task_t *tasks;              // cola global de inyección (envíos externos)
+	int head;
+	int tail;
+	int count;
+	int capacity;
+	pthread_mutex_t queue_mutex;
+	pthread_cond_t queue_not_empty; // trabajadores dormidos
+	pthread_cond_t queue_not_full;
+	atomic_int sleeping;        // trabajadores dormidos en queue_not_empty
+	int retire_requests;        // trabajadores que deben retirarse (bajo queue_mutex)
+	_Atomic uint64_t max_wait_ns; // mayor latencia de cola vista desde el último tick
+
+	ws_worker_t *workers;
+	atomic_int num_threads;     // trabajadores vivos
+	atomic_int slots_used;      // slots de 'workers' usados alguna vez
+	int min_threads;
+	int max_threads;
+	atomic_int shutdown;        // SHUTDOWN_NONE, SHUTDOWN_DRAIN o SHUTDOWN_CANCEL
+	pthread_cond_t drained;     // un trabajador terminó durante el cierre
+	task_cancel_t on_cancel;
+	atomic_long cancelled;
+	pthread_mutex_t pool_mutex; // mutex para controlar num de hilos
+
+	pthread_t controller;
+	pthread_mutex_t control_mutex;
+	pthread_cond_t control_cond; // despierta al controlador antes del tick
+	int control_nudge;
+	int verbose;                // imprime cada redimensionamiento
+} thread_pool_t;
+
+void	thread_pool_init(thread_pool_t *pool, int initial_threads,
+		int max_threads, int max_tasks);
+int	thread_pool_submit(thread_pool_t *pool, void (*function)(void *),
+		void *argument);
+long	thread_pool_shutdown(thread_pool_t *pool, long timeout_ms,
+		task_cancel_t on_cancel);
+void	thread_pool_destroy(thread_pool_t *pool);
+void	*worker(void *arg);
+int	add_worker(thread_pool_t *pool);
+static void	*controller(void *arg);
+
+/* Trabajador del pool que ejecuta el hilo actual, o NULL si es un hilo externo. */
+static _Thread_local ws_worker_t *ws_current;
+
+void	execute_task(void *arg)
+{
+	int task_id = *(int *)arg;
+	printf("Hilo %lu ejecutando tarea %d\n", pthread_self(), task_id);
+	sleep(rand() % 5); // Simular trabajo más largo
+	slab_free(arg);
+}
+
+void	cancel_task(void (*function)(void *), void *arg)
+{
+	(void)function;
+	printf("Tarea %d cancelada por el cierre\n", *(int *)arg);
+	slab_free(arg);
+}
+
+static uint64_t	monotonic_ns(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+static int	ws_push(ws_deque_t *dq, task_t task)
+{
+	/*
+	Empuja una tarea por 'bottom' (solo el dueño).
+	Retorna 0, o -1 si el deque está lleno.
+	*/
+	long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+	long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+
+	if (b - t >= DEQUE_CAPACITY)
+		return (-1);
+	atomic_store_explicit(&dq->slots[b & (DEQUE_CAPACITY - 1)].function,
+		task.function, memory_order_relaxed);
+	atomic_store_explicit(&dq->slots[b & (DEQUE_CAPACITY - 1)].argument,
+		task.argument, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+	return (0);
+}
+
+static int	ws_take(ws_deque_t *dq, task_t *task)
+{
+	/*
+	Saca la tarea más reciente por 'bottom' (solo el dueño).
+
+	- Reserva la posición bajando 'bottom' y, tras una barrera completa,
+		lee 'top'.
+	- Si quedaba más de una tarea, la posición es suya sin más.
+	- Si era la última, compite con los ladrones con un CAS sobre 'top'.
+	- Retorna 0 si obtuvo una tarea, -1 si el deque estaba vacío.
+	*/
+	long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+	long t;
+	int ret = 0;
+
+	atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+	if (t > b)
+	{
+		atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+		return (-1);
+	}
+	task->function = atomic_load_explicit(
+			&dq->slots[b & (DEQUE_CAPACITY - 1)].function, memory_order_relaxed);
+	task->argument = atomic_load_explicit(
+			&dq->slots[b & (DEQUE_CAPACITY - 1)].argument, memory_order_relaxed);
+	if (t == b)
+	{
+		if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+				memory_order_seq_cst, memory_order_relaxed))
+			ret = -1;
+		atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+	}
+	return (ret);
+}
+
+static int	ws_steal(ws_deque_t *dq, task_t *task)
+{
+	/*
+	Roba la tarea más antigua por 'top' (cualquier hilo).
+	Retorna 0 si robó, -1 si el deque estaba vacío y 1 si perdió la
+	carrera con otro ladrón o con el dueño (merece la pena reintentar).
+	*/
+	long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+	long b;
+
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+	if (t >= b)
+		return (-1);
+	task->function = atomic_load_explicit(
+			&dq->slots[t & (DEQUE_CAPACITY - 1)].function, memory_order_relaxed);
+	task->argument = atomic_load_explicit(
+			&dq->slots[t & (DEQUE_CAPACITY - 1)].argument, memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+			memory_order_seq_cst, memory_order_relaxed))
+		return (1);
+	return (0);
+}
+
+static int	ws_has_work(ws_deque_t *dq)
+{
+	return (atomic_load(&dq->top) < atomic_load(&dq->bottom));
+}
+
+static void	wake_sleeper(thread_pool_t *pool)
+{
+	/*
+	Despierta a un trabajador dormido solo si lo hay.
+	La barrera ordena la publicación de la tarea antes de leer 'sleeping';
+	el trabajador que se duerme incrementa 'sleeping' y revisa las colas
+	bajo queue_mutex, así que nunca se pierde una tarea.
+	*/
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&pool->sleeping, memory_order_relaxed) > 0)
+	{
+		pthread_mutex_lock(&pool->queue_mutex);
+		pthread_cond_signal(&pool->queue_not_empty);
+		pthread_mutex_unlock(&pool->queue_mutex);
+	}
+}
+
+void	thread_pool_init(thread_pool_t *pool, int initial_threads,
+		int max_threads, int max_tasks)
+{
+	/*
+	Inicializa la estructura del thread pool con soporte para redimensionamiento dinámico.
+
+	- Asigna memoria para la cola global de inyección y para los trabajadores
+		(cada uno con su deque alineado a línea de caché).
+	- Inicializa los mutexes, las variables de condición y los contadores.
+	- Establece la capacidad máxima de la cola y el número máximo de hilos;
+		'initial_threads' es también el mínimo al que puede encoger.
+	- Crea el número inicial de hilos trabajadores y los inicia.
+	- Arranca el hilo controlador, que crea y retira trabajadores fuera del
+		camino de thread_pool_submit.
+	*/
+	pool->capacity = max_tasks;
+	pool->tasks = malloc(sizeof(task_t) * pool->capacity);
+	if (!pool->tasks)
+		perror("malloc tasks failed");
+	pool->head = pool->tail = pool->count = 0;
+	pthread_mutex_init(&pool->queue_mutex, NULL);
+	pthread_cond_init(&pool->queue_not_empty, NULL);
+	pthread_cond_init(&pool->queue_not_full, NULL);
+	atomic_init(&pool->sleeping, 0);
+	atomic_init(&pool->shutdown, SHUTDOWN_NONE);
+	atomic_init(&pool->cancelled, 0);
+	pool->on_cancel = NULL;
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pool->drained, &attr);
+	pthread_condattr_destroy(&attr);
+	atomic_init(&pool->max_wait_ns, 0);
+	pool->retire_requests = 0;
+
+	pool->min_threads = initial_threads;
+	pool->max_threads = max_threads;
+	atomic_init(&pool->num_threads, 0);
+	atomic_init(&pool->slots_used, 0);
+	pool->workers = aligned_alloc(CACHELINE_SIZE,
+			sizeof(ws_worker_t) * pool->max_threads);
+	if (!pool->workers)
+		perror("malloc threads failed");
+	for (int i = 0; pool->workers && i < pool->max_threads; ++i)
+	{
+		atomic_init(&pool->workers[i].deque.top, 0);
+		atomic_init(&pool->workers[i].deque.bottom, 0);
+		atomic_init(&pool->workers[i].state, WORKER_FREE);
+	}
+	pthread_mutex_init(&pool->pool_mutex, NULL);
+	pthread_mutex_init(&pool->control_mutex, NULL);
+	pthread_cond_init(&pool->control_cond, NULL);
+	pool->control_nudge = 0;
+	pool->verbose = 1;
+
+	for (int i = 0; i < initial_threads; ++i)
+	{
+		if (add_worker(pool) != 0)
+		{
+			fprintf(stderr, "Error al inicializar los hilos iniciales\n");
+			// Aquí se debería implementar una limpieza más robusta
+		}
+	}
+	if (pthread_create(&pool->controller, NULL, controller, pool) != 0)
+		perror("Error al crear el hilo controlador");
+}
+
+int	thread_pool_submit(thread_pool_t *pool, void (*function)(void *),
+		void *argument)
+{
+	/*
+	Añade una tarea al thread pool y gestiona el redimensionamiento dinámico.
+
+	- Durante el cierre rechaza los envíos externos; los de los trabajadores
+		(subtareas de tareas en curso) se aceptan mientras se drena y se
+		rechazan una vez vencido el plazo.
+	- Si la envía un trabajador del propio pool (una tarea que genera
+		subtareas), la empuja en su deque sin tomar ningún mutex y despierta
+		a un trabajador dormido para que pueda robarla.
+	- Si la envía un hilo externo (o el deque está lleno), bloquea el mutex
+		de la cola global, espera si está llena y la añade.
+		Un trabajador nunca espera: si la cola global también está llena,
+		ejecuta la tarea él mismo para no bloquear el pool.
+	- Señala a un trabajador dormido, si lo hay.
+	- Si la cola global se llena, avisa al controlador para que decida si
+		crece; el envío nunca crea hilos ni espera a pthread_create.
+	- Retorna 0 si aceptó la tarea, -1 si el pool se está cerrando (la tarea
+		sigue siendo del llamador).
+	*/
+	task_t task = {function, argument, 0};
+	ws_worker_t *self = ws_current;
+	int internal = self && self->pool == pool;
+
+	if (internal)
+	{
+		if (atomic_load(&pool->shutdown) == SHUTDOWN_CANCEL)
+			return (-1);
+		if (ws_push(&self->deque, task) == 0)
+		{
+			wake_sleeper(pool);
+			return (0);
+		}
+	}
+	pthread_mutex_lock(&pool->queue_mutex);
+	while (1)
+	{
+		int state = atomic_load(&pool->shutdown);
+		if (state == SHUTDOWN_CANCEL || (state != SHUTDOWN_NONE && !internal))
+		{
+			pthread_mutex_unlock(&pool->queue_mutex);
+			return (-1);
+		}
+		if (pool->count < pool->capacity)
+			break ;
+		if (internal)
+		{
+			pthread_mutex_unlock(&pool->queue_mutex);
+			function(argument);
+			return (0);
+		}
+		pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
+	}
+	if (pool->tail % LATENCY_SAMPLE == 0)
+		task.enqueue_ns = monotonic_ns();
+	pool->tasks[pool->tail] = task;
+	pool->tail = (pool->tail + 1) % pool->capacity;
+	pool->count++;
+	if (atomic_load(&pool->sleeping) > 0)
+		pthread_cond_signal(&pool->queue_not_empty);
+	int full = pool->count == pool->capacity;
+	pthread_mutex_unlock(&pool->queue_mutex);
+
+	if (full && atomic_load(&pool->num_threads) < pool->max_threads)
+	{
+		pthread_mutex_lock(&pool->control_mutex);
+		pool->control_nudge = 1;
+		pthread_cond_signal(&pool->control_cond);
+		pthread_mutex_unlock(&pool->control_mutex);
+	}
+	return (0);
+}
+
+int	add_worker(thread_pool_t *pool)
+{
+	/*
+	Añade un nuevo hilo trabajador al pool.
+
+	- Bloquea el mutex del pool para modificar el número de hilos.
+	- Elige un slot libre (uno ya unido con pthread_join o uno nuevo). El
+		deque de un slot reutilizado se conserva vacío, con 'top' y 'bottom'
+		monótonos, para que un ladrón rezagado no vea índices reciclados.
+	- Crea un nuevo hilo que ejecuta la función 'worker'.
+	- Incrementa el contador de hilos.
+	- Desbloquea el mutex del pool.
+	- Retorna 0 en éxito, -1 en error.
+	*/
+	pthread_mutex_lock(&pool->pool_mutex);
+	int n = atomic_load(&pool->num_threads);
+	if (n < pool->max_threads && atomic_load(&pool->shutdown) == SHUTDOWN_NONE)
+	{
+		int used = atomic_load(&pool->slots_used);
+		int i = 0;
+		while (i < used && atomic_load(&pool->workers[i].state) != WORKER_FREE)
+			i++;
+		ws_worker_t *w = &pool->workers[i];
+		w->pool = pool;
+		w->index = i;
+		w->rng = 0x9e3779b97f4a7c15ULL * (uint64_t)(i + 1);
+		atomic_store(&w->state, WORKER_RUNNING);
+		if (i == used)
+			atomic_store(&pool->slots_used, used + 1);
+		if (pthread_create(&w->thread, NULL, worker, w) == 0)
+		{
+			atomic_store(&pool->num_threads, n + 1);
+			pthread_mutex_unlock(&pool->pool_mutex);
+			return (0);
+		}
+		else
+		{
+			perror("Error al crear un nuevo hilo trabajador");
+			atomic_store(&w->state, WORKER_FREE);
+			pthread_mutex_unlock(&pool->pool_mutex);
+			return (-1);
+		}
+	}
+	pthread_mutex_unlock(&pool->pool_mutex);
+	return (-1); // No se pueden añadir más hilos (o el pool se está cerrando)
+}
+
+static int	take_from_global(ws_worker_t *w, task_t *task)
+{
+	/*
+	Saca de la cola global una tarea para ejecutar y hasta INJECT_BATCH - 1
+	más que deja en el deque propio, donde otros trabajadores pueden
+	robarlas. Así el mutex global se toma una vez por lote, no por tarea.
+	*/
+	thread_pool_t *p = w->pool;
+	int moved = 0;
+
+	pthread_mutex_lock(&p->queue_mutex);
+	if (p->count == 0)
+	{
+		pthread_mutex_unlock(&p->queue_mutex);
+		return (-1);
+	}
+	*task = p->tasks[p->head];
+	p->head = (p->head + 1) % p->capacity;
+	p->count--;
+	if (task->enqueue_ns)
+	{
+		uint64_t wait = monotonic_ns() - task->enqueue_ns;
+		uint64_t cur = atomic_load_explicit(&p->max_wait_ns, memory_order_relaxed);
+
+		while (wait > cur && !atomic_compare_exchange_weak_explicit(&p->max_wait_ns,
+				&cur, wait, memory_order_relaxed, memory_order_relaxed))
+			;
+	}
+	while (p->count > 0 && moved < INJECT_BATCH - 1
+		&& ws_push(&w->deque, p->tasks[p->head]) == 0)
+	{
+		p->head = (p->head + 1) % p->capacity;
+		p->count--;
+		moved++;
+	}
+	if (moved > 0)
+		pthread_cond_broadcast(&p->queue_not_full);
+	else
+		pthread_cond_signal(&p->queue_not_full);
+	pthread_mutex_unlock(&p->queue_mutex);
+	if (moved > 0)
+		wake_sleeper(p);
+	return (0);
+}
+
+static int	steal_task(ws_worker_t *w, task_t *task)
+{
+	/*
+	Roba de otros trabajadores empezando por una víctima aleatoria.
+	Reintenta las víctimas con carreras perdidas hasta STEAL_ROUNDS vueltas.
+	*/
+	thread_pool_t *p = w->pool;
+	int n = atomic_load(&p->slots_used);
+
+	for (int round = 0; round < STEAL_ROUNDS && n > 1; ++round)
+	{
+		int contended = 0;
+		w->rng ^= w->rng << 13;
+		w->rng ^= w->rng >> 7;
+		w->rng ^= w->rng << 17;
+		int start = (int)(w->rng % (uint64_t)n);
+		for (int i = 0; i < n; ++i)
+		{
+			int v = (start + i) % n;
+			if (v == w->index
+				|| atomic_load_explicit(&p->workers[v].state,
+					memory_order_relaxed) != WORKER_RUNNING)
+				continue ;
+			int r = ws_steal(&p->workers[v].deque, task);
+			if (r == 0)
+				return (0);
+			contended |= r > 0;
+		}
+		if (!contended)
+			break ;
+	}
+	return (-1);
+}
+
+static int	pool_has_work(thread_pool_t *p)
+{
+	// Llamada con queue_mutex bloqueado.
+	int n = atomic_load(&p->slots_used);
+
+	if (p->count > 0)
+		return (1);
+	for (int i = 0; i < n; ++i)
+		if (ws_has_work(&p->workers[i].deque))
+			return (1);
+	return (0);
+}
+
+void	*worker(void *arg)
+{
+	/*
+	Función que ejecuta cada hilo trabajador del pool.
+
+	- Busca tarea en este orden: su propio deque (la más reciente), la cola
+		global de inyección (por lotes) y los deques de otros trabajadores
+		(robando la más antigua de una víctima aleatoria).
+	- Si no encuentra ninguna, se anuncia como dormido en 'sleeping' y
+		revisa todas las colas bajo queue_mutex antes de esperar en
+		queue_not_empty, para no perder tareas publicadas sin mutex.
+	- Si el controlador pidió retirar trabajadores y este no tiene nada que
+		hacer, atiende la petición y sale (su deque está vacío: solo él empuja
+		en él). El controlador hace el pthread_join.
+	- Durante el cierre sale cuando no quedan tareas pendientes; si vence el
+		plazo (SHUTDOWN_CANCEL) deja de tomar tareas nuevas, entrega las de su
+		deque al callback de cancelación y sale.
+	- Ejecuta la tarea fuera de cualquier mutex.
+	*/
+	ws_worker_t *w = (ws_worker_t *)arg;
+	thread_pool_t *p = w->pool;
+	task_t task;
+
+	ws_current = w;
+	while (1)
+	{
+		if (atomic_load_explicit(&p->shutdown, memory_order_acquire)
+			== SHUTDOWN_CANCEL)
+			break ;
+		if (ws_take(&w->deque, &task) == 0 || take_from_global(w, &task) == 0
+			|| steal_task(w, &task) == 0)
+		{
+			task.function(task.argument);
+			continue ;
+		}
+		pthread_mutex_lock(&p->queue_mutex);
+		atomic_fetch_add(&p->sleeping, 1);
+		while (!atomic_load(&p->shutdown) && !pool_has_work(p)
+			&& p->retire_requests == 0)
+			pthread_cond_wait(&p->queue_not_empty, &p->queue_mutex);
+		atomic_fetch_sub(&p->sleeping, 1);
+		if (!atomic_load(&p->shutdown) && p->retire_requests > 0
+			&& !pool_has_work(p))
+		{
+			p->retire_requests--;
+			atomic_fetch_sub(&p->num_threads, 1);
+			atomic_store(&w->state, WORKER_EXITED);
+			pthread_mutex_unlock(&p->queue_mutex);
+			return (NULL);
+		}
+		// Si shutdown y no hay tareas pendientes, salir
+		if (atomic_load(&p->shutdown) && !pool_has_work(p))
+		{
+			pthread_mutex_unlock(&p->queue_mutex);
+			break ;
+		}
+		pthread_mutex_unlock(&p->queue_mutex);
+	}
+	while (ws_take(&w->deque, &task) == 0)
+	{
+		if (p->on_cancel)
+			p->on_cancel(task.function, task.argument);
+		atomic_fetch_add(&p->cancelled, 1);
+	}
+	pthread_mutex_lock(&p->queue_mutex);
+	atomic_fetch_sub(&p->num_threads, 1);
+	pthread_cond_broadcast(&p->drained);
+	pthread_mutex_unlock(&p->queue_mutex);
+	return (NULL);
+}
+
+static void	join_exited(thread_pool_t *pool)
+{
+	// Une los trabajadores retirados y deja sus slots libres para reutilizarlos.
+	pthread_mutex_lock(&pool->pool_mutex);
+	for (int i = 0; i < atomic_load(&pool->slots_used); ++i)
+	{
+		if (atomic_load(&pool->workers[i].state) == WORKER_EXITED)
+		{
+			pthread_join(pool->workers[i].thread, NULL);
+			atomic_store(&pool->workers[i].state, WORKER_FREE);
+		}
+	}
+	pthread_mutex_unlock(&pool->pool_mutex);
+}
+
+static void	*controller(void *arg)
+{
+	/*
+	Hilo controlador: ajusta el número de trabajadores a la carga medida.
+
+	- Cada CONTROL_TICK_MS (o antes, si un envío encontró la cola llena) mide
+		la latencia de cola: la mayor espera vista por los trabajadores desde
+		el último tick y la edad de la tarea muestreada más antigua aún en cola.
+		Solo una de cada LATENCY_SAMPLE tareas lleva marca de tiempo, para no
+		pagar clock_gettime en cada envío.
+	- Cuenta los ticks seguidos con latencia alta ('hot') y con más de la
+		mitad de los trabajadores dormidos ('cold').
+	- Tras GROW_TICKS ticks calientes (o un aviso de cola llena) añade la
+		mitad de los trabajadores actuales, sin pasar del máximo, y cancela
+		retiradas pendientes.
+	- Tras SHRINK_TICKS ticks fríos pide retirarse a la mitad de los
+		dormidos, sin bajar del mínimo.
+	- Después de cada cambio ignora COOLDOWN_TICKS ticks para no oscilar.
+	- Une los trabajadores retirados; nunca toma queue_mutex mientras crea hilos.
+	*/
+	thread_pool_t *pool = (thread_pool_t *)arg;
+	int hot = 0;
+	int cold = 0;
+	int cooldown = 0;
+
+	while (!atomic_load(&pool->shutdown))
+	{
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += CONTROL_TICK_MS * NSEC_PER_MSEC;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&pool->control_mutex);
+		while (!pool->control_nudge && !atomic_load(&pool->shutdown))
+			if (pthread_cond_timedwait(&pool->control_cond,
+					&pool->control_mutex, &deadline) != 0)
+				break ;
+		int nudged = pool->control_nudge;
+		pool->control_nudge = 0;
+		pthread_mutex_unlock(&pool->control_mutex);
+		if (atomic_load(&pool->shutdown))
+			break ;
+
+		join_exited(pool);
+		uint64_t wait = atomic_exchange(&pool->max_wait_ns, 0);
+		pthread_mutex_lock(&pool->queue_mutex);
+		for (int i = 0; i < pool->count && i < LATENCY_SAMPLE; ++i)
+		{
+			uint64_t stamp = pool->tasks[(pool->head + i) % pool->capacity].enqueue_ns;
+			if (stamp)
+			{
+				if (monotonic_ns() - stamp > wait)
+					wait = monotonic_ns() - stamp;
+				break ;
+			}
+		}
+		int sleeping = atomic_load(&pool->sleeping);
+		pthread_mutex_unlock(&pool->queue_mutex);
+		int n = atomic_load(&pool->num_threads);
+
+		hot = wait > GROW_LATENCY_MS * NSEC_PER_MSEC ? hot + 1 : 0;
+		cold = sleeping * 2 > n ? cold + 1 : 0;
+		if (cooldown > 0 && !nudged)
+		{
+			cooldown--;
+			continue ;
+		}
+		if ((hot >= GROW_TICKS || nudged) && n < pool->max_threads)
+		{
+			int add = n / 2 > 0 ? n / 2 : 1;
+			if (add > pool->max_threads - n)
+				add = pool->max_threads - n;
+			pthread_mutex_lock(&pool->queue_mutex);
+			pool->retire_requests = 0;
+			pthread_mutex_unlock(&pool->queue_mutex);
+			if (pool->verbose)
+				printf("Redimensionando pool: %d +%d hilos (latencia %.1f ms)\n",
+					n, add, wait / 1e6);
+			for (int i = 0; i < add; ++i)
+				add_worker(pool);
+			hot = 0;
+			cooldown = COOLDOWN_TICKS;
+		}
+		else if (cold >= SHRINK_TICKS && n > pool->min_threads)
+		{
+			int retire = (sleeping + 1) / 2;
+			if (retire > n - pool->min_threads)
+				retire = n - pool->min_threads;
+			if (pool->verbose)
+				printf("Redimensionando pool: %d -%d hilos (%d dormidos)\n", n,
+					retire, sleeping);
+			pthread_mutex_lock(&pool->queue_mutex);
+			pool->retire_requests = retire;
+			pthread_cond_broadcast(&pool->queue_not_empty);
+			pthread_mutex_unlock(&pool->queue_mutex);
+			cold = 0;
+			cooldown = COOLDOWN_TICKS;
+		}
+	}
+	return (NULL);
+}
+
+long	thread_pool_shutdown(thread_pool_t *pool, long timeout_ms,
+		task_cancel_t on_cancel)
+{
+	/*
+	Cierra el pool de forma ordenada.
+
+	- Deja de aceptar envíos externos (thread_pool_submit retorna -1) y
+		despierta a los hilos que esperaban hueco en la cola.
+	- Detiene el controlador para que no cree ni retire trabajadores.
+	- Espera hasta 'timeout_ms' (sin límite si es negativo) a que los
+		trabajadores ejecuten todas las tareas pendientes y salgan.
+	- Si vence el plazo, pasa a SHUTDOWN_CANCEL: los trabajadores terminan la
+		tarea en curso (no se interrumpe), entregan las de su deque a
+		'on_cancel' y salen; las que quedan en la cola global se entregan a
+		'on_cancel' al final. 'on_cancel' puede ser NULL.
+	- Une todos los hilos.
+	- Retorna el número de tareas canceladas. Una segunda llamada no hace nada
+		y retorna 0.
+	*/
+	struct timespec deadline;
+
+	pthread_mutex_lock(&pool->queue_mutex);
+	if (atomic_load(&pool->shutdown) != SHUTDOWN_NONE)
+	{
+		pthread_mutex_unlock(&pool->queue_mutex);
+		return (0);
+	}
+	pool->on_cancel = on_cancel;
+	pool->retire_requests = 0;
+	atomic_store(&pool->shutdown, SHUTDOWN_DRAIN);
+	pthread_cond_broadcast(&pool->queue_not_empty);
+		// Despertar a todos los hilos
+	pthread_cond_broadcast(&pool->queue_not_full);
+		// Despertar por si alguno está esperando espacio
+	pthread_mutex_unlock(&pool->queue_mutex);
+
+	pthread_mutex_lock(&pool->control_mutex);
+	pthread_cond_signal(&pool->control_cond);
+	pthread_mutex_unlock(&pool->control_mutex);
+	pthread_join(pool->controller, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	if (timeout_ms > 0)
+	{
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * NSEC_PER_MSEC;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+	pthread_mutex_lock(&pool->queue_mutex);
+	while (atomic_load(&pool->num_threads) > 0)
+	{
+		if (timeout_ms < 0)
+			pthread_cond_wait(&pool->drained, &pool->queue_mutex);
+		else if (pthread_cond_timedwait(&pool->drained, &pool->queue_mutex,
+				&deadline) != 0)
+			break ;
+	}
+	atomic_store(&pool->shutdown, SHUTDOWN_CANCEL);
+	pthread_cond_broadcast(&pool->queue_not_empty);
+	pthread_mutex_unlock(&pool->queue_mutex);
+
+	int n = atomic_load(&pool->slots_used);
+	for (int i = 0; i < n; ++i)
+	{
+		if (atomic_load(&pool->workers[i].state) != WORKER_FREE)
+		{
+			pthread_join(pool->workers[i].thread, NULL);
+			atomic_store(&pool->workers[i].state, WORKER_FREE);
+		}
+	}
+
+	// Sin trabajadores vivos: lo que quede en la cola global se cancela aquí.
+	while (pool->count > 0)
+	{
+		task_t task = pool->tasks[pool->head];
+		pool->head = (pool->head + 1) % pool->capacity;
+		pool->count--;
+		if (on_cancel)
+			on_cancel(task.function, task.argument);
+		atomic_fetch_add(&pool->cancelled, 1);
+	}
+	return (atomic_load(&pool->cancelled));
+}
+
+void	thread_pool_destroy(thread_pool_t *pool)
+{
+	/*
+	Destruye el thread pool.
+
+	- Si no se cerró antes con thread_pool_shutdown, lo cierra esperando sin
+		límite a que se ejecuten todas las tareas pendientes.
+	- Libera la memoria asignada.
+	- Destruye los mutexes y las condiciones.
+	*/
+	thread_pool_shutdown(pool, -1, NULL);
+
+	free(pool->tasks);
+	free(pool->workers);
+	pthread_mutex_destroy(&pool->queue_mutex);
+	pthread_cond_destroy(&pool->queue_not_empty);
+	pthread_cond_destroy(&pool->queue_not_full);
+	pthread_cond_destroy(&pool->drained);
+	pthread_mutex_destroy(&pool->pool_mutex);
+	pthread_mutex_destroy(&pool->control_mutex);
+	pthread_cond_destroy(&pool->control_cond);
+}
+
+/*
+Pool con una sola cola protegida por mutex (implementación anterior).
+Se conserva como referencia para el benchmark.
+*/
+typedef struct
+{
+	task_t *tasks;
+	int head;
+	int tail;
+	int count;
+	int capacity;
+	pthread_mutex_t queue_mutex;
+	pthread_cond_t queue_not_empty;
+	pthread_cond_t queue_not_full;
+	pthread_t *threads;
+	int num_threads;
+	int shutdown;
+} locked_pool_t;
+
+static void	*locked_worker(void *arg)
+{
+	locked_pool_t *p = (locked_pool_t *)arg;
+
+	while (1)
+	{
+		pthread_mutex_lock(&p->queue_mutex);
+		while (p->count == 0 && !p->shutdown)
+			pthread_cond_wait(&p->queue_not_empty, &p->queue_mutex);
+		if (p->shutdown && p->count == 0)
+		{
+			pthread_mutex_unlock(&p->queue_mutex);
+			break ;
+		}
+		task_t task = p->tasks[p->head];
+		p->head = (p->head + 1) % p->capacity;
+		p->count--;
+		pthread_cond_signal(&p->queue_not_full);
+		pthread_mutex_unlock(&p->queue_mutex);
+		task.function(task.argument);
+	}
+	return (NULL);
+}
+
+static void	locked_pool_init(locked_pool_t *pool, int threads, int max_tasks)
+{
+	pool->capacity = max_tasks;
+	pool->tasks = malloc(sizeof(task_t) * max_tasks);
+	pool->head = pool->tail = pool->count = 0;
+	pool->shutdown = 0;
+	pthread_mutex_init(&pool->queue_mutex, NULL);
+	pthread_cond_init(&pool->queue_not_empty, NULL);
+	pthread_cond_init(&pool->queue_not_full, NULL);
+	pool->threads = malloc(sizeof(pthread_t) * threads);
+	pool->num_threads = 0;
+	for (int i = 0; i < threads; ++i)
+		if (pthread_create(&pool->threads[i], NULL, locked_worker, pool) == 0)
+			pool->num_threads++;
+}
+
+static void	locked_pool_submit(locked_pool_t *pool, void (*function)(void *),
+		void *argument)
+{
+	pthread_mutex_lock(&pool->queue_mutex);
+	while (pool->count == pool->capacity)
+		pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
+	pool->tasks[pool->tail].function = function;
+	pool->tasks[pool->tail].argument = argument;
+	pool->tail = (pool->tail + 1) % pool->capacity;
+	pool->count++;
+	pthread_cond_signal(&pool->queue_not_empty);
+	pthread_mutex_unlock(&pool->queue_mutex);
+}
+
+static void	locked_pool_destroy(locked_pool_t *pool)
+{
+	pthread_mutex_lock(&pool->queue_mutex);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->queue_not_empty);
+	pthread_mutex_unlock(&pool->queue_mutex);
+	for (int i = 0; i < pool->num_threads; ++i)
+		pthread_join(pool->threads[i], NULL);
+	free(pool->tasks);
+	free(pool->threads);
+	pthread_mutex_destroy(&pool->queue_mutex);
+	pthread_cond_destroy(&pool->queue_not_empty);
+	pthread_cond_destroy(&pool->queue_not_full);
+}
+
+/* ---- Benchmark de rendimiento de tareas: work-stealing frente a cola única ---- */
+
+#define BENCH_TASKS 1000000
+#define BENCH_FANOUT 1000   // subtareas por tarea raíz en el modo fork-join
+#define BENCH_MAX_WORKERS 64
+
+typedef struct
+{
+	int stealing;
+	thread_pool_t *ws;
+	locked_pool_t *locked;
+	atomic_long done;
+} bench_ctx_t;
+
+static bench_ctx_t bench_ctx;
+
+static void	bench_leaf(void *arg)
+{
+	(void)arg;
+	atomic_fetch_add_explicit(&bench_ctx.done, 1, memory_order_relaxed);
+}
+
+static void	bench_submit(void (*function)(void *), void *argument)
+{
+	if (bench_ctx.stealing)
+		thread_pool_submit(bench_ctx.ws, function, argument);
+	else
+		locked_pool_submit(bench_ctx.locked, function, argument);
+}
+
+static void	bench_root(void *arg)
+{
+	// Tarea raíz de fork-join: genera BENCH_FANOUT hojas desde el trabajador.
+	(void)arg;
+	for (int i = 0; i < BENCH_FANOUT; ++i)
+		bench_submit(bench_leaf, NULL);
+	atomic_fetch_add_explicit(&bench_ctx.done, 1, memory_order_relaxed);
+}
+
+static double	bench_run(int stealing, int workers, int fork_join)
+{
+	/*
+	Ejecuta BENCH_TASKS tareas triviales y retorna tareas por segundo.
+	Sin fork-join las envía todas el hilo principal; con fork-join envía
+	BENCH_TASKS / BENCH_FANOUT raíces y cada una genera sus hojas.
+	*/
+	thread_pool_t ws;
+	locked_pool_t locked;
+	struct timespec t0;
+	struct timespec t1;
+	long roots = BENCH_TASKS / BENCH_FANOUT;
+	long total = fork_join ? roots * (BENCH_FANOUT + 1) : BENCH_TASKS;
+	struct timespec nap = {0, 100000};
+
+	bench_ctx.stealing = stealing;
+	bench_ctx.ws = &ws;
+	bench_ctx.locked = &locked;
+	atomic_store(&bench_ctx.done, 0);
+	if (stealing)
+		thread_pool_init(&ws, workers, workers, total + 1);
+	else
+		locked_pool_init(&locked, workers, total + 1);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (fork_join)
+		for (long i = 0; i < roots; ++i)
+			bench_submit(bench_root, NULL);
+	else
+		for (long i = 0; i < total; ++i)
+			bench_submit(bench_leaf, NULL);
+	while (atomic_load(&bench_ctx.done) < total)
+		nanosleep(&nap, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (stealing)
+		thread_pool_destroy(&ws);
+	else
+		locked_pool_destroy(&locked);
+	return (total / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9));
+}
+
+static int	pool_benchmark(void)
+{
+	printf("Tareas: %d, CPUs en línea: %ld\n", BENCH_TASKS,
+		sysconf(_SC_NPROCESSORS_ONLN));
+	for (int fork_join = 0; fork_join <= 1; ++fork_join)
+	{
+		printf("\n%s\n", fork_join ? "Fork-join (las tareas generan subtareas)"
+			: "Envíos externos desde el hilo principal");
+		printf("%8s %16s %16s %8s\n", "hilos", "cola única t/s",
+			"work-stealing t/s", "mejora");
+		for (int n = 1; n <= BENCH_MAX_WORKERS; n *= 2)
+		{
+			double locked = bench_run(0, n, fork_join);
+			double stealing = bench_run(1, n, fork_join);
+			printf("%8d %16.0f %16.0f %7.2fx\n", n, locked, stealing,
+				stealing / locked);
+		}
+	}
+	return (0);
+}
+
+/* ---- Demo de carga variable: valle, pico 20x y vuelta al valle ---- */
+
+#define LOAD_TASK_US 2000   // cada tarea simula 2 ms de trabajo (p. ej. E/S)
+#define LOAD_MAX_THREADS 32
+
+static void	load_task(void *arg)
+{
+	(void)arg;
+	usleep(LOAD_TASK_US);
+}
+
+static int	load_demo(void)
+{
+	/*
+	Envía tareas a ritmo constante por fases y muestra cada medio segundo
+	cuántos trabajadores hay y cuántos duermen: el pool debe crecer en el
+	pico y volver al mínimo en el valle.
+	*/
+	static const struct { int rate; int seconds; } phases[] = {
+		{100, 2}, {2000, 3}, {100, 5}};
+	thread_pool_t pool;
+	struct timespec tick = {0, 1000000};
+
+	thread_pool_init(&pool, INITIAL_THREADS, LOAD_MAX_THREADS, 4096);
+	for (size_t ph = 0; ph < sizeof(phases) / sizeof(phases[0]); ++ph)
+	{
+		printf("Fase %zu: %d tareas/s durante %d s\n", ph + 1, phases[ph].rate,
+			phases[ph].seconds);
+		double credit = 0;
+		for (int ms = 0; ms < phases[ph].seconds * 1000; ++ms)
+		{
+			for (credit += phases[ph].rate / 1000.0; credit >= 1; credit -= 1)
+				thread_pool_submit(&pool, load_task, NULL);
+			if (ms % 500 == 0)
+				printf("  t=%d.%ds hilos=%d dormidos=%d\n", ms / 1000,
+					ms % 1000 / 100, atomic_load(&pool.num_threads),
+					atomic_load(&pool.sleeping));
+			nanosleep(&tick, NULL);
+		}
+	}
+	thread_pool_destroy(&pool);
+	return (0);
+}
+
+/* ---- Estrés: envíos concurrentes desde muchos hilos mientras se cierra el pool ---- */
+
+#define STRESS_ROUNDS 50
+#define STRESS_SUBMITTERS 8
+#define STRESS_DEPTH 2      // niveles de subtareas que genera cada tarea
+
+static thread_pool_t *stress_pool;
+static atomic_long stress_accepted;
+static atomic_long stress_executed;
+static atomic_long stress_cancelled;
+
+static void	stress_task(void *arg)
+{
+	// Trabajo corto; las tareas con profundidad generan dos subtareas.
+	uintptr_t depth = (uintptr_t)arg;
+
+	for (volatile int i = 0; i < 20000; ++i)
+		;
+	for (int i = 0; depth > 0 && i < 2; ++i)
+		if (thread_pool_submit(stress_pool, stress_task,
+				(void *)(depth - 1)) == 0)
+			atomic_fetch_add(&stress_accepted, 1);
+	atomic_fetch_add(&stress_executed, 1);
+}
+
+static void	stress_cancel(void (*function)(void *), void *arg)
+{
+	(void)function;
+	(void)arg;
+	atomic_fetch_add(&stress_cancelled, 1);
+}
+
+static void	*stress_submitter(void *arg)
+{
+	// Envía sin parar hasta que el pool rechaza el envío por el cierre.
+	unsigned seed = (unsigned)(uintptr_t)arg;
+
+	while (thread_pool_submit(stress_pool, stress_task,
+			(void *)(uintptr_t)(rand_r(&seed) % (STRESS_DEPTH + 1))) == 0)
+	{
+		atomic_fetch_add(&stress_accepted, 1);
+		if (rand_r(&seed) % 64 == 0)
+			sched_yield();
+	}
+	return (NULL);
+}
+
+static int	stress_test(void)
+{
+	/*
+	En cada ronda STRESS_SUBMITTERS hilos envían tareas (que a su vez generan
+	subtareas) a un pool de 2 a 8 hilos, y el hilo principal lo
+	cierra al cabo de unos milisegundos con distintos plazos: 0 (cancelar todo
+	lo pendiente), 1 ms, 10 ms y sin límite (drenar todo).
+	Comprueba que ninguna tarea aceptada se pierde ni se ejecuta dos veces
+	(aceptadas == ejecutadas + canceladas), que sin límite no se cancela
+	nada y que el cierre no se cuelga.
+	*/
+	static const long timeouts[] = {0, 1, 10, -1};
+	int failures = 0;
+
+	printf("%10s %8s %12s %12s %12s %12s\n", "plazo", "rondas", "aceptadas",
+		"ejecutadas", "canceladas", "cierre máx");
+	for (size_t t = 0; t < sizeof(timeouts) / sizeof(timeouts[0]); ++t)
+	{
+		long accepted = 0, executed = 0, cancelled = 0;
+		double worst_ms = 0;
+		for (int round = 0; round < STRESS_ROUNDS; ++round)
+		{
+			thread_pool_t pool;
+			pthread_t submitters[STRESS_SUBMITTERS];
+			struct timespec pause = {0, (round % 4) * 1000000L};
+
+			stress_pool = &pool;
+			atomic_store(&stress_accepted, 0);
+			atomic_store(&stress_executed, 0);
+			atomic_store(&stress_cancelled, 0);
+			thread_pool_init(&pool, 2, 8, 1024);
+			pool.verbose = 0;
+			for (int i = 0; i < STRESS_SUBMITTERS; ++i)
+				pthread_create(&submitters[i], NULL, stress_submitter,
+					(void *)(uintptr_t)(round * STRESS_SUBMITTERS + i + 1));
+			nanosleep(&pause, NULL);
+			uint64_t t0 = monotonic_ns();
+			long reported = thread_pool_shutdown(&pool, timeouts[t],
+					stress_cancel);
+			double ms = (monotonic_ns() - t0) / 1e6;
+			for (int i = 0; i < STRESS_SUBMITTERS; ++i)
+				pthread_join(submitters[i], NULL);
+			thread_pool_destroy(&pool);
+
+			long a = atomic_load(&stress_accepted);
+			long e = atomic_load(&stress_executed);
+			long c = atomic_load(&stress_cancelled);
+			if (a != e + c || reported != c || (timeouts[t] < 0 && c != 0))
+			{
+				fprintf(stderr, "ronda %d plazo %ld: aceptadas %ld, ejecutadas "
+					"%ld, canceladas %ld (informadas %ld)\n", round,
+					timeouts[t], a, e, c, reported);
+				failures++;
+			}
+			accepted += a;
+			executed += e;
+			cancelled += c;
+			if (ms > worst_ms)
+				worst_ms = ms;
+		}
+		char label[32];
+		if (timeouts[t] < 0)
+			snprintf(label, sizeof(label), "sin límite");
+		else
+			snprintf(label, sizeof(label), "%ld ms", timeouts[t]);
+		printf("%10s %8d %12ld %12ld %12ld %9.1f ms\n", label, STRESS_ROUNDS,
+			accepted, executed, cancelled, worst_ms);
+	}
+	printf(failures ? "FALLO: %d rondas inconsistentes\n" : "OK\n", failures);
+	return (failures != 0);
+}
+
+/* ---- Argumentos de tareas: malloc/free frente al slab por hilo ---- */
+
+#define ALLOC_TASKS 1000000
+#define ALLOC_MAX_WORKERS 8
+
+typedef struct
+{
+	long id;
+	char payload[40];   // p. ej. Call-ID y CSeq de la petición que procesa la tarea
+} alloc_msg_t;
+
+static atomic_long alloc_done;
+
+static void	alloc_task_malloc(void *arg)
+{
+	alloc_msg_t *msg = (alloc_msg_t *)arg;
+
+	atomic_fetch_add_explicit(&alloc_done, msg->payload[msg->id % 40] != 0,
+		memory_order_relaxed);
+	free(msg);
+}
+
+static void	alloc_task_slab(void *arg)
+{
+	alloc_msg_t *msg = (alloc_msg_t *)arg;
+
+	atomic_fetch_add_explicit(&alloc_done, msg->payload[msg->id % 40] != 0,
+		memory_order_relaxed);
+	slab_free(msg);
+}
+
+static double	alloc_run(int use_slab, int workers)
+{
+	/*
+	El hilo principal reserva el argumento de cada tarea y el trabajador que
+	la ejecuta lo libera: con malloc cada liberación vuelve a la arena del
+	productor desde otro hilo; con el slab vuelve a la caché del productor por
+	su pila de devueltos. Retorna tareas por segundo.
+	*/
+	thread_pool_t pool;
+	struct timespec t0;
+	struct timespec t1;
+	struct timespec nap = {0, 100000};
+
+	atomic_store(&alloc_done, 0);
+	thread_pool_init(&pool, workers, workers, ALLOC_TASKS + 1);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (long i = 0; i < ALLOC_TASKS; ++i)
+	{
+		alloc_msg_t *msg = use_slab ? slab_alloc(sizeof(alloc_msg_t))
+			: malloc(sizeof(alloc_msg_t));
+		msg->id = i;
+		memset(msg->payload, 'x', sizeof(msg->payload));
+		thread_pool_submit(&pool, use_slab ? alloc_task_slab : alloc_task_malloc,
+			msg);
+	}
+	while (atomic_load(&alloc_done) < ALLOC_TASKS)
+		nanosleep(&nap, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	thread_pool_destroy(&pool);
+	return (ALLOC_TASKS / ((t1.tv_sec - t0.tv_sec)
+			+ (t1.tv_nsec - t0.tv_nsec) / 1e9));
+}
+
+static int	alloc_benchmark(void)
+{
+	slab_stats_t stats;
+
+	printf("Tareas: %d con un argumento de %zu bytes, CPUs en línea: %ld\n",
+		ALLOC_TASKS, sizeof(alloc_msg_t), sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%8s %14s %14s %8s\n", "hilos", "malloc t/s", "slab t/s", "mejora");
+	for (int n = 1; n <= ALLOC_MAX_WORKERS; n *= 2)
+	{
+		double with_malloc = alloc_run(0, n);
+		double with_slab = alloc_run(1, n);
+		printf("%8d %14.0f %14.0f %7.2fx\n", n, with_malloc, with_slab,
+			with_slab / with_malloc);
+	}
+	slab_get_stats(&stats);
+	printf("\nslab: %ld objetos servidos con %ld bloques del sistema (%ld KB), "
+		"%ld devueltos desde otros hilos, %d cachés de hilo\n", stats.allocs,
+		stats.slabs, stats.slabs * (SLAB_SIZE / 1024), stats.remote_frees,
+		stats.caches);
+	return (0);
+}
+
+int	main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return (pool_benchmark());
+	if (argc > 1 && strcmp(argv[1], "carga") == 0)
+		return (load_demo());
+	if (argc > 1 && strcmp(argv[1], "estres") == 0)
+		return (stress_test());
+	if (argc > 1 && strcmp(argv[1], "alloc") == 0)
+		return (alloc_benchmark());
+
+	thread_pool_t pool;
+	thread_pool_init(&pool, INITIAL_THREADS, MAX_THREADS, MAX_TASKS);
+	srand(time(NULL));
+
+	printf("Enviando tareas...\n");
+	for (int i = 1; i <= 15; ++i)
+	{
+		int *arg = slab_alloc(sizeof(int)); // lo libera el trabajador que ejecuta la tarea
+		*arg = i;
+		if (thread_pool_submit(&pool, execute_task, arg) != 0)
+			slab_free(arg);
+		usleep(2000); // Simular llegadas de tareas con un pequeño retraso
+	}
+
+	// Cierre ordenado: hasta 6 s para drenar; el resto se cancela
+	long cancelled = thread_pool_shutdown(&pool, 6000, cancel_task);
+	printf("Tareas canceladas en el cierre: %ld\n", cancelled);
+
+	thread_pool_destroy(&pool);
+	printf("Programa principal terminado.\n");
+	return (0);
+}
+
+/*
+Compila: gcc -O2 pthreads6.c -o thread_pool_dynamic -lpthread
+Ejecuta: ./thread_pool_dynamic
+Benchmark: ./thread_pool_dynamic bench
+Carga variable: ./thread_pool_dynamic carga
+Estrés de cierre: ./thread_pool_dynamic estres
+Asignación de argumentos: ./thread_pool_dynamic alloc
+Explicación:
+Este bloque implementa un thread pool con robo de trabajo (work-stealing)
+que puede redimensionarse dinámicamente.
+
+	-Inicialización: El pool comienza con un número inicial de hilos (INITIAL_THREADS).
+	Cada trabajador tiene su propio deque de Chase-Lev.
+
+	-Envío de Tareas: Los hilos externos envían a una cola global de inyección
+	protegida por mutex. Las tareas que envía un trabajador (subtareas) van a su
+	propio deque sin tomar ningún mutex.
+
+	-Hilos Trabajadores: Cada trabajador ejecuta primero las tareas de su deque
+	(la más reciente, con la caché caliente), después saca un lote de la cola
+	global y, si no hay nada, roba la tarea más antigua del deque de otro
+	trabajador elegido al azar. Solo duerme cuando no encuentra trabajo en
+	ninguna parte, y los demás solo toman el mutex para despertarlo si hay
+	alguien dormido.
+
+	-Redimensionamiento: Un hilo controlador mide cada 50 ms la latencia de cola
+	(la mayor espera observada y la edad de la tarea más antigua) y cuántos
+	trabajadores duermen. Si la latencia pasa de 5 ms dos ticks seguidos añade la
+	mitad de los hilos actuales (hasta MAX_THREADS); si más de la mitad duermen
+	durante un segundo retira la mitad de los dormidos (hasta INITIAL_THREADS).
+	Tras cada cambio espera medio segundo (histéresis) para no oscilar.
+	Los hilos se crean y se unen en el controlador, nunca en thread_pool_submit:
+	un envío que encuentra la cola llena solo lo avisa para que reaccione antes.
+
+	-Cierre: thread_pool_shutdown deja de aceptar envíos externos
+	(thread_pool_submit retorna -1), drena las tareas pendientes durante un
+	plazo y, si vence, entrega las que queden a un callback de cancelación en
+	lugar de perderlas; la tarea en curso de cada hilo siempre termina.
+	Después une todos los hilos. thread_pool_destroy cierra sin plazo (drena
+	todo) si no se llamó antes a thread_pool_shutdown, y libera el pool.
+	La demo cierra con un plazo de 6 segundos y muestra las tareas canceladas.
+
+	-Argumentos sin malloc: los argumentos de las tareas se reservan con el
+	asignador slab por hilo de slab.h. El productor reserva de su caché y el
+	trabajador que ejecuta la tarea lo libera: el objeto vuelve a la caché del
+	productor por una pila atómica que este recoge entera cuando se le acaban
+	los libres, así que malloc solo aparece cuando hace falta un slab nuevo.
+
+El modo estres lanza 8 hilos que envían tareas (con subtareas) mientras el
+hilo principal cierra el pool con plazos de 0, 1 y 10 ms y sin límite, y
+comprueba que aceptadas == ejecutadas + canceladas en cada ronda.
+El modo carga simula un valle de 100 tareas/s, un pico de 2000 tareas/s (20x)
+y la vuelta al valle, mostrando cómo el pool crece y después encoge.
+El modo bench compara el rendimiento de tareas triviales con 1 a 64 hilos
+frente a la implementación anterior de cola única (locked_pool_t), con envíos
+externos y con tareas que generan subtareas (fork-join).
+El modo alloc compara tareas cuyo argumento se reserva con malloc/free y con
+el slab (reservado en el hilo principal, liberado en el trabajador).
+ */
@@ -1,158 +1,883 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-
-#define MAX_PRIORITY 3
-#define MAX_TASKS 30
-#define NUM_THREADS 4
-
-typedef struct {
-    void (*function)(void *);
-    void *argument;
-    int priority; // 0: Mayor prioridad, MAX_PRIORITY - 1: Menor prioridad
-} task_t;
-
-typedef struct {
-    task_t **tasks[1];
-    int head[1];
-    int tail[1];
-    int count[1];
-    int capacity;
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_not_empty[1];
-    pthread_cond_t queue_not_full[1];
-    pthread_t threads[THREAD_POOL_SIZE];
-    int shutdown;
-} thread_pool_t;
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority);
-void thread_pool_destroy(thread_pool_t *pool);
-void *worker(void *pool);
-
-void execute_task(void *arg) {
-    int task_id = *(int *)arg;
-    printf("Hilo %lu ejecutando tarea %d con prioridad %d\n", pthread_self(), task_id, *(int *)(arg + sizeof(int)));
-    sleep(rand() % 5);
-    free(arg);
-}
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
-    /*
-    Inicializa la estructura del thread pool con soporte para priorización de tareas.
-
-    - Inicializa las cabezas, colas y contadores para cada nivel de prioridad.
-    - Inicializa el mutex para proteger el acceso a las colas de tareas.
-    - Inicializa las variables de condición 'queue_not_empty' y 'queue_not_full' para cada nivel de prioridad.
-    - Establece la capacidad máxima de cada cola de prioridad.
-    - Crea y lanza los hilos trabajadores.
-    - Inicializa la bandera de 'shutdown' a 0.
-    */
-}
-
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority) {
-    /*
-    Añade una tarea a la cola del thread pool con la prioridad especificada.
-
-    - Bloquea el mutex de la cola.
-    - Espera si la cola de la prioridad especificada está llena.
-    - Añade la tarea a la cola correspondiente a su prioridad.
-    - Incrementa el contador de tareas para esa prioridad.
-    - Señala a un hilo trabajador que hay una nueva tarea disponible en esa prioridad.
-    - Desbloquea el mutex de la cola.
-    */
-}
-
-void *worker(void *pool) {
-    /*
-    Función que ejecuta cada hilo trabajador del pool. Los hilos buscan tareas comenzando por la prioridad más alta.
-
-    - Entra en un bucle infinito para procesar tareas.
-    - Bloquea el mutex de la cola.
-    - Itera a través de los niveles de prioridad (de mayor a menor).
-    - Para cada prioridad, espera si no hay tareas disponibles.
-    - Si se encuentra una tarea, la obtiene de la cola correspondiente.
-    - Señala que la cola de esa prioridad ya no está llena.
-    - Desbloquea el mutex de la cola.
-    - Ejecuta la tarea.
-    */
-}
-
-void thread_pool_destroy(thread_pool_t *pool) {
-    /*
-    Destruye el thread pool.
-
-    - Bloquea el mutex de la cola.
-    - Establece la bandera de 'shutdown' a 1.
-    - Envía una señal a todos los hilos trabajadores para que despierten.
-    - Desbloquea el mutex de la cola.
-    - Espera a que todos los hilos terminen.
-    - Libera la memoria asignada.
-    - Destruye los mutexes y las condiciones.
-    */
-}
-
-int main() {
-    thread_pool_t pool;
-    thread_pool_init(&pool, NUM_THREADS, MAX_TASKS);
-    srand(time(NULL));
-
-    printf("Enviando tareas con diferentes prioridades...\n");
-    for (int i = 1; i <= 10; ++i) {
-        int *arg_low = malloc(sizeof(int) * 2);
-        arg_low[0] = i;
-        arg_low[1] = 2; // Prioridad baja
-        thread_pool_submit(&pool, execute_task, arg_low, 2);
-
-        int *arg_high = malloc(sizeof(int) * 2);
-        arg_high[0] = i + 100;
-        arg_high[1] = 0; // Prioridad alta
-        thread_pool_submit(&pool, execute_task, arg_high, 0);
-
-        int *arg_medium = malloc(sizeof(int) * 2);
-        arg_medium[0] = i + 200;
-        arg_medium[1] = 1; // Prioridad media
-        thread_pool_submit(&pool, execute_task, arg_medium, 1);
-    }
-
-    sleep(15);
-
-    thread_pool_destroy(&pool);
-    printf("Programa principal terminado.\n");
-    return 0;
-}
-
-/*
-Compila: gcc pthreads9.c -o thread_pool_priority -lpthread
-Ejecuta: ./thread_pool_priority
-Explicación:
-    -Priorización de Tareas:
-        Este thread pool avanzado introduce la priorización de tareas.
-        Se definen MAX_PRIORITY niveles de prioridad (en este caso, 3: alta, media, baja).
-
-    -Múltiples Colas:
-        Internamente, el thread pool gestiona múltiples colas de tareas,
-        una para cada nivel de prioridad.
-
-    -thread_pool_submit con Prioridad:
-        La función thread_pool_submit ahora toma un argumento adicional de priority
-        para indicar la prioridad de la tarea.
-        La tarea se encola en la cola correspondiente a su prioridad.
-
-    -worker con Prioridad:
-        Los hilos trabajadores, en su función worker,
-        buscan tareas comenzando por la prioridad más alta (0)
-        y luego pasando a prioridades más bajas.
-        Esto asegura que las tareas de mayor prioridad se ejecuten antes que las de menor prioridad.
-
-    -Variables de Condición por Prioridad:
-        Se utiliza un array de variables de condición (queue_not_empty y queue_not_full)
-        para cada nivel de prioridad, permitiendo que los hilos esperen específicamente por tareas
-        en su nivel de prioridad.
-
-Al ejecutar este código, deberías observar que las tareas con prioridad 0 (alta)
-tienden a ejecutarse antes que las tareas con prioridad 1 (media) y 2 (baja).
-Este es un ejemplo de cómo se puede implementar la priorización en un thread pool
-para gestionar diferentes tipos de cargas de trabajo.
- */
\ No newline at end of file
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "slab.h"
+
+#define MAX_PRIORITY 3
+#define MAX_TASKS 30
+#define NUM_THREADS 4
+#define CACHELINE_SIZE 64
+#define AGING_BASE_MS 10        // una tarea de prioridad p pasa al frente tras esperar p * AGING_BASE_MS
+#define AGING_CHECK_INTERVAL 16 // cada cuántas tareas mira un trabajador si alguna ha envejecido
+#define SUBMIT_YIELDS 8         // sched_yield() antes de dormir con la cola llena
+#define EDF_SLACK_MS 50         // en modo EDF, thread_pool_submit usa plazo = ahora + (p + 1) * EDF_SLACK_MS
+
+_Static_assert(MAX_PRIORITY <= 64, "el bitmap de niveles es de 64 bits");
+
+typedef struct {
+    void (*function)(void *);
+    void *argument;
+    int priority; // 0: Mayor prioridad, MAX_PRIORITY - 1: Menor prioridad
+    uint64_t deadline_ns; // plazo absoluto (CLOCK_MONOTONIC) en modo EDF, 0 si no tiene
+} task_t;
+
+typedef enum {
+    SCHED_PRIORITY, // colas por nivel + envejecimiento
+    SCHED_EDF       // primero la tarea con el plazo más cercano
+} sched_mode_t;
+
+/*
+Cola sin locks de un nivel de prioridad (anillo acotado de Vyukov, como la de
+pthreads3.c). La secuencia de cada slot indica si está libre o lleno para la
+vuelta actual; 'enqueue_ns' es atómico porque los trabajadores lo miran en la
+cabeza de la cola para decidir el envejecimiento sin desencolar.
+*/
+typedef struct {
+    atomic_size_t sequence;
+    _Atomic uint64_t enqueue_ns;
+    void (*function)(void *);
+    void *argument;
+} prio_slot_t;
+
+typedef struct {
+    _Alignas(CACHELINE_SIZE) atomic_size_t tail;
+    _Alignas(CACHELINE_SIZE) atomic_size_t head;
+    _Alignas(CACHELINE_SIZE) prio_slot_t *slots;
+    size_t mask;
+} prio_queue_t;
+
+/*
+Montículo mínimo por plazo para el modo EDF. 'seq' desempata plazos iguales
+en orden de llegada. Se protege con su propio mutex: las operaciones son
+O(log n) y cortas, y el bitmap de niveles (bit 0) sigue indicando a los
+trabajadores si hay algo sin tener que tomarlo.
+*/
+typedef struct {
+    uint64_t deadline_ns;
+    uint64_t seq;
+    void (*function)(void *);
+    void *argument;
+} edf_entry_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    edf_entry_t *entries;
+    int size;
+    int capacity;
+    uint64_t next_seq;
+} edf_heap_t;
+
+typedef struct {
+    long completed;         // tareas con plazo ejecutadas
+    long late_start;        // empezaron con el plazo ya vencido
+    long missed;            // terminaron después del plazo
+    uint64_t max_lateness_ns;
+} deadline_stats_t;
+
+typedef struct {
+    sched_mode_t mode;
+    prio_queue_t queues[MAX_PRIORITY];
+    edf_heap_t edf;
+    _Alignas(CACHELINE_SIZE) _Atomic uint64_t nonempty; // bit p: la cola p tiene tareas
+    uint64_t aging_ns[MAX_PRIORITY];
+    int capacity;
+    pthread_mutex_t queue_mutex;   // solo para dormir y despertar
+    pthread_cond_t queue_not_empty;
+    pthread_cond_t queue_not_full;
+    atomic_int idle_workers;
+    atomic_int waiting_producers;
+    pthread_t *threads;
+    int num_threads;
+    atomic_int shutdown;
+    atomic_long executed[MAX_PRIORITY];
+    atomic_long aged[MAX_PRIORITY]; // tareas servidas antes de tiempo por envejecimiento
+    atomic_long dl_completed;
+    atomic_long dl_late_start;
+    atomic_long dl_missed;
+    _Atomic uint64_t dl_max_lateness;
+} thread_pool_t;
+
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
+void thread_pool_init_sched(thread_pool_t *pool, int num_threads, int max_tasks, sched_mode_t mode);
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority);
+int thread_pool_submit_deadline(thread_pool_t *pool, void (*function)(void *), void *argument,
+                                uint64_t deadline_ns);
+void thread_pool_get_deadline_stats(thread_pool_t *pool, deadline_stats_t *stats);
+void thread_pool_destroy(thread_pool_t *pool);
+void *worker(void *pool);
+
+void execute_task(void *arg) {
+    int task_id = ((int *)arg)[0];
+    printf("Hilo %lu ejecutando tarea %d con prioridad %d\n", pthread_self(), task_id, ((int *)arg)[1]);
+    sleep(rand() % 5);
+    slab_free(arg);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int prio_queue_init(prio_queue_t *q, int capacity) {
+    size_t size = 2;
+
+    while (size < (size_t)capacity)
+        size <<= 1;
+    q->slots = aligned_alloc(CACHELINE_SIZE, ((sizeof(prio_slot_t) * size) + CACHELINE_SIZE - 1)
+                                                 & ~(size_t)(CACHELINE_SIZE - 1));
+    if (!q->slots)
+        return -1;
+    for (size_t i = 0; i < size; ++i) {
+        atomic_init(&q->slots[i].sequence, i);
+        atomic_init(&q->slots[i].enqueue_ns, 0);
+    }
+    q->mask = size - 1;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    return 0;
+}
+
+static int prio_push(prio_queue_t *q, void (*function)(void *), void *argument, uint64_t now) {
+    /*
+    Encola sin bloquear (protocolo de Vyukov). Retorna 0, o -1 si la cola está llena.
+    */
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    prio_slot_t *slot;
+
+    while (1) {
+        slot = &q->slots[pos & q->mask];
+        intptr_t diff = (intptr_t)atomic_load_explicit(&slot->sequence, memory_order_acquire) - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+    slot->function = function;
+    slot->argument = argument;
+    atomic_store_explicit(&slot->enqueue_ns, now, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return 0;
+}
+
+static int prio_pop(prio_queue_t *q, task_t *task) {
+    /*
+    Desencola sin bloquear. Retorna 0, o -1 si la cola está vacía.
+    */
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    prio_slot_t *slot;
+
+    while (1) {
+        slot = &q->slots[pos & q->mask];
+        intptr_t diff = (intptr_t)atomic_load_explicit(&slot->sequence, memory_order_acquire) - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+    task->function = slot->function;
+    task->argument = slot->argument;
+    atomic_store_explicit(&slot->sequence, pos + q->mask + 1, memory_order_release);
+    return 0;
+}
+
+static uint64_t prio_head_stamp(prio_queue_t *q) {
+    // Momento de encolado de la tarea en cabeza, o 0 si la cola parece vacía.
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    prio_slot_t *slot = &q->slots[pos & q->mask];
+
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != pos + 1)
+        return 0;
+    return atomic_load_explicit(&slot->enqueue_ns, memory_order_relaxed);
+}
+
+static int edf_before(const edf_entry_t *a, const edf_entry_t *b) {
+    return a->deadline_ns < b->deadline_ns || (a->deadline_ns == b->deadline_ns && a->seq < b->seq);
+}
+
+static int edf_push(thread_pool_t *pool, void (*function)(void *), void *argument, uint64_t deadline_ns) {
+    /*
+    Inserta en el montículo (sift-up). Retorna 0, o -1 si está lleno.
+    Marca el bit 0 del bitmap bajo el mutex del montículo.
+    */
+    edf_heap_t *h = &pool->edf;
+    edf_entry_t entry = {deadline_ns, 0, function, argument};
+    int i;
+
+    pthread_mutex_lock(&h->mutex);
+    if (h->size == h->capacity) {
+        pthread_mutex_unlock(&h->mutex);
+        return -1;
+    }
+    entry.seq = h->next_seq++;
+    i = h->size++;
+    while (i > 0 && edf_before(&entry, &h->entries[(i - 1) / 2])) {
+        h->entries[i] = h->entries[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->entries[i] = entry;
+    atomic_fetch_or(&pool->nonempty, 1ULL);
+    pthread_mutex_unlock(&h->mutex);
+    return 0;
+}
+
+static int edf_pop(thread_pool_t *pool, task_t *task) {
+    /*
+    Extrae la tarea con el plazo más cercano (sift-down). Retorna 0, o -1 si
+    el montículo está vacío. Al vaciarlo borra el bit 0 del bitmap; un bit
+    puesto tarde por thread_pool_submit se limpia en la siguiente llamada.
+    */
+    edf_heap_t *h = &pool->edf;
+    edf_entry_t last;
+    int i = 0;
+
+    pthread_mutex_lock(&h->mutex);
+    if (h->size == 0) {
+        atomic_fetch_and(&pool->nonempty, ~1ULL);
+        pthread_mutex_unlock(&h->mutex);
+        return -1;
+    }
+    task->function = h->entries[0].function;
+    task->argument = h->entries[0].argument;
+    task->deadline_ns = h->entries[0].deadline_ns;
+    task->priority = 0;
+    last = h->entries[--h->size];
+    while (2 * i + 1 < h->size) {
+        int child = 2 * i + 1;
+        if (child + 1 < h->size && edf_before(&h->entries[child + 1], &h->entries[child]))
+            child++;
+        if (!edf_before(&h->entries[child], &last))
+            break;
+        h->entries[i] = h->entries[child];
+        i = child;
+    }
+    h->entries[i] = last;
+    if (h->size == 0)
+        atomic_fetch_and(&pool->nonempty, ~1ULL);
+    pthread_mutex_unlock(&h->mutex);
+    return 0;
+}
+
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
+    thread_pool_init_sched(pool, num_threads, max_tasks, SCHED_PRIORITY);
+}
+
+void thread_pool_init_sched(thread_pool_t *pool, int num_threads, int max_tasks, sched_mode_t mode) {
+    /*
+    Inicializa la estructura del thread pool con soporte para priorización de tareas.
+
+    - Guarda el modo de planificación: SCHED_PRIORITY o SCHED_EDF.
+    - En modo EDF crea un montículo por plazo de 'max_tasks' entradas.
+    - Crea una cola sin locks de al menos 'max_tasks' tareas para cada nivel de prioridad.
+    - Inicializa a cero el bitmap de niveles con tareas.
+    - Calcula el umbral de envejecimiento de cada nivel (p * AGING_BASE_MS).
+    - Inicializa el mutex y las variables de condición, que solo se usan para
+        dormir cuando no hay tareas (trabajadores) o no hay hueco (productores).
+    - Crea y lanza los hilos trabajadores.
+    - Inicializa la bandera de 'shutdown' a 0.
+    */
+    pool->mode = mode;
+    pool->capacity = max_tasks;
+    pthread_mutex_init(&pool->edf.mutex, NULL);
+    pool->edf.size = 0;
+    pool->edf.next_seq = 0;
+    pool->edf.capacity = mode == SCHED_EDF ? max_tasks : 0;
+    pool->edf.entries = NULL;
+    if (mode == SCHED_EDF && !(pool->edf.entries = malloc(sizeof(edf_entry_t) * max_tasks)))
+        perror("malloc heap failed");
+    atomic_init(&pool->dl_completed, 0);
+    atomic_init(&pool->dl_late_start, 0);
+    atomic_init(&pool->dl_missed, 0);
+    atomic_init(&pool->dl_max_lateness, 0);
+    for (int p = 0; p < MAX_PRIORITY; ++p) {
+        if (prio_queue_init(&pool->queues[p], max_tasks) != 0)
+            perror("malloc queue failed");
+        pool->aging_ns[p] = (uint64_t)p * AGING_BASE_MS * 1000000ULL;
+        atomic_init(&pool->executed[p], 0);
+        atomic_init(&pool->aged[p], 0);
+    }
+    atomic_init(&pool->nonempty, 0);
+    atomic_init(&pool->idle_workers, 0);
+    atomic_init(&pool->waiting_producers, 0);
+    atomic_init(&pool->shutdown, 0);
+    pthread_mutex_init(&pool->queue_mutex, NULL);
+    pthread_cond_init(&pool->queue_not_empty, NULL);
+    pthread_cond_init(&pool->queue_not_full, NULL);
+
+    pool->threads = malloc(sizeof(pthread_t) * num_threads);
+    pool->num_threads = 0;
+    for (int i = 0; pool->threads && i < num_threads; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0) {
+            perror("Error al crear el hilo trabajador");
+            break;
+        }
+        pool->num_threads++;
+    }
+}
+
+static int pool_push(thread_pool_t *pool, int level, void (*function)(void *), void *argument, uint64_t stamp) {
+    // En modo EDF 'stamp' es el plazo; en modo prioridad, el momento de encolado.
+    if (pool->mode == SCHED_EDF)
+        return edf_push(pool, function, argument, stamp);
+    return prio_push(&pool->queues[level], function, argument, stamp);
+}
+
+static void submit_blocking(thread_pool_t *pool, int level, void (*function)(void *), void *argument,
+                            uint64_t stamp) {
+    /*
+    Encola en el nivel 'level' (o en el montículo EDF).
+
+    - Si no hay hueco, cede la CPU unas veces y después duerme en
+        'queue_not_full' hasta que un trabajador libere hueco.
+    - Marca el nivel en el bitmap de niveles con tareas.
+    - Si hay trabajadores dormidos, despierta a uno; si no, no toca el mutex.
+    */
+    if (pool_push(pool, level, function, argument, stamp) != 0) {
+        int done = 0;
+        for (int i = 0; i < SUBMIT_YIELDS && !done; ++i) {
+            sched_yield();
+            done = pool_push(pool, level, function, argument, stamp) == 0;
+        }
+        if (!done) {
+            pthread_mutex_lock(&pool->queue_mutex);
+            atomic_fetch_add(&pool->waiting_producers, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            while (pool_push(pool, level, function, argument, stamp) != 0)
+                pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
+            atomic_fetch_sub(&pool->waiting_producers, 1);
+            pthread_mutex_unlock(&pool->queue_mutex);
+        }
+    }
+    // El RMW seq_cst del bitmap ordena la publicación antes de leer 'idle_workers'
+    atomic_fetch_or(&pool->nonempty, 1ULL << level);
+    if (atomic_load(&pool->idle_workers) > 0) {
+        pthread_mutex_lock(&pool->queue_mutex);
+        pthread_cond_signal(&pool->queue_not_empty);
+        pthread_mutex_unlock(&pool->queue_mutex);
+    }
+}
+
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority) {
+    /*
+    Añade una tarea a la cola del thread pool con la prioridad especificada.
+
+    - Encola la tarea sin locks en la cola de su prioridad, con su marca de tiempo.
+    - En modo EDF la prioridad se traduce en un plazo implícito:
+        ahora + (priority + 1) * EDF_SLACK_MS.
+    - Bloquea si no hay hueco (ver submit_blocking).
+    */
+    uint64_t now = monotonic_ns();
+
+    if (priority < 0)
+        priority = 0;
+    if (priority >= MAX_PRIORITY)
+        priority = MAX_PRIORITY - 1;
+    if (pool->mode == SCHED_EDF)
+        submit_blocking(pool, 0, function, argument, now + (uint64_t)(priority + 1) * EDF_SLACK_MS * 1000000ULL);
+    else
+        submit_blocking(pool, priority, function, argument, now);
+}
+
+int thread_pool_submit_deadline(thread_pool_t *pool, void (*function)(void *), void *argument,
+                                uint64_t deadline_ns) {
+    /*
+    Añade una tarea con plazo absoluto 'deadline_ns' (CLOCK_MONOTONIC, ver
+        monotonic_ns). Los trabajadores ejecutan primero la de plazo más cercano.
+
+    - Solo en modo SCHED_EDF; en modo prioridad retorna -1 sin encolar.
+    - Las tareas con el plazo vencido se ejecutan igualmente y cuentan
+        como retrasadas en las métricas (thread_pool_get_deadline_stats).
+    - Bloquea si el montículo está lleno. Retorna 0.
+    */
+    if (pool->mode != SCHED_EDF)
+        return -1;
+    submit_blocking(pool, 0, function, argument, deadline_ns);
+    return 0;
+}
+
+static void record_deadline(thread_pool_t *pool, uint64_t deadline_ns, uint64_t started, uint64_t finished) {
+    uint64_t lateness;
+    uint64_t max;
+
+    atomic_fetch_add_explicit(&pool->dl_completed, 1, memory_order_relaxed);
+    if (started > deadline_ns)
+        atomic_fetch_add_explicit(&pool->dl_late_start, 1, memory_order_relaxed);
+    if (finished <= deadline_ns)
+        return;
+    atomic_fetch_add_explicit(&pool->dl_missed, 1, memory_order_relaxed);
+    lateness = finished - deadline_ns;
+    max = atomic_load_explicit(&pool->dl_max_lateness, memory_order_relaxed);
+    while (lateness > max && !atomic_compare_exchange_weak_explicit(&pool->dl_max_lateness, &max, lateness,
+                                                                     memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+void thread_pool_get_deadline_stats(thread_pool_t *pool, deadline_stats_t *stats) {
+    stats->completed = atomic_load(&pool->dl_completed);
+    stats->late_start = atomic_load(&pool->dl_late_start);
+    stats->missed = atomic_load(&pool->dl_missed);
+    stats->max_lateness_ns = atomic_load(&pool->dl_max_lateness);
+}
+
+static int pop_level(thread_pool_t *pool, int p, task_t *task) {
+    /*
+    Desencola del nivel 'p'. Si está vacío, borra su bit del bitmap y
+    vuelve a mirar la cola: si un productor encoló entre medias, restaura
+    el bit para no dejar una tarea invisible.
+    */
+    if (prio_pop(&pool->queues[p], task) == 0) {
+        task->priority = p;
+        return 0;
+    }
+    atomic_fetch_and(&pool->nonempty, ~(1ULL << p));
+    if (prio_head_stamp(&pool->queues[p]) != 0)
+        atomic_fetch_or(&pool->nonempty, 1ULL << p);
+    return -1;
+}
+
+static int pick_task(thread_pool_t *pool, task_t *task, unsigned *dispatches) {
+    /*
+    Elige la siguiente tarea.
+
+    - Cada AGING_CHECK_INTERVAL tareas, mira la cabeza de los niveles de
+        menor prioridad con tareas: si alguna espera más que el umbral de su
+        nivel, la sirve primero (envejecimiento contra la inanición).
+    - Si no, toma el nivel más prioritario con tareas en O(1): el bit más
+        bajo del bitmap (__builtin_ctzll).
+    - En modo EDF, extrae la raíz del montículo por plazo.
+    - Retorna 0 si obtuvo una tarea, -1 si todas las colas están vacías.
+    */
+    uint64_t bits;
+
+    task->deadline_ns = 0;
+    if (pool->mode == SCHED_EDF)
+        return edf_pop(pool, task);
+
+    if (++*dispatches % AGING_CHECK_INTERVAL == 0) {
+        bits = atomic_load(&pool->nonempty);
+        if (bits & (bits - 1)) {
+            uint64_t now = monotonic_ns();
+            for (int p = MAX_PRIORITY - 1; p > 0; --p) {
+                if (!(bits & (1ULL << p)))
+                    continue;
+                uint64_t stamp = prio_head_stamp(&pool->queues[p]);
+                if (stamp && now - stamp > pool->aging_ns[p] && pop_level(pool, p, task) == 0) {
+                    atomic_fetch_add_explicit(&pool->aged[p], 1, memory_order_relaxed);
+                    return 0;
+                }
+            }
+        }
+    }
+    while ((bits = atomic_load(&pool->nonempty)) != 0) {
+        if (pop_level(pool, __builtin_ctzll(bits), task) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+void *worker(void *pool) {
+    /*
+    Función que ejecuta cada hilo trabajador del pool. Los hilos toman la tarea más prioritaria
+        disponible, salvo que una de menor prioridad haya envejecido.
+
+    - Entra en un bucle infinito para procesar tareas.
+    - Elige una tarea con pick_task (bitmap + envejecimiento), sin locks.
+    - Si un productor espera hueco, lo despierta.
+    - Si no hay tareas, se anuncia como dormido y vuelve a mirar el bitmap
+        bajo el mutex antes de esperar en 'queue_not_empty'.
+    - Sale cuando se indica el cierre y todas las colas están vacías.
+    - Ejecuta la tarea; si tenía plazo, registra si empezó o terminó tarde.
+    */
+    thread_pool_t *p = (thread_pool_t *)pool;
+    unsigned dispatches = 0;
+    task_t task;
+
+    while (1) {
+        if (pick_task(p, &task, &dispatches) == 0) {
+            atomic_thread_fence(memory_order_seq_cst);
+            if (atomic_load_explicit(&p->waiting_producers, memory_order_relaxed) > 0) {
+                pthread_mutex_lock(&p->queue_mutex);
+                pthread_cond_broadcast(&p->queue_not_full);
+                pthread_mutex_unlock(&p->queue_mutex);
+            }
+            if (task.deadline_ns) {
+                uint64_t started = monotonic_ns();
+                task.function(task.argument);
+                record_deadline(p, task.deadline_ns, started, monotonic_ns());
+            } else {
+                task.function(task.argument);
+            }
+            atomic_fetch_add_explicit(&p->executed[task.priority], 1, memory_order_relaxed);
+            continue;
+        }
+        pthread_mutex_lock(&p->queue_mutex);
+        atomic_fetch_add(&p->idle_workers, 1);
+        while (!atomic_load(&p->shutdown) && atomic_load(&p->nonempty) == 0)
+            pthread_cond_wait(&p->queue_not_empty, &p->queue_mutex);
+        atomic_fetch_sub(&p->idle_workers, 1);
+        if (atomic_load(&p->shutdown) && atomic_load(&p->nonempty) == 0) {
+            pthread_mutex_unlock(&p->queue_mutex);
+            break;
+        }
+        pthread_mutex_unlock(&p->queue_mutex);
+    }
+    return NULL;
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+    /*
+    Destruye el thread pool.
+
+    - Bloquea el mutex de la cola.
+    - Establece la bandera de 'shutdown' a 1.
+    - Envía una señal a todos los hilos trabajadores para que despierten;
+        terminan las tareas pendientes de todas las prioridades y salen.
+    - Desbloquea el mutex de la cola.
+    - Espera a que todos los hilos terminen.
+    - Libera la memoria asignada.
+    - Destruye los mutexes y las condiciones.
+    */
+    pthread_mutex_lock(&pool->queue_mutex);
+    atomic_store(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->queue_not_empty);
+    pthread_mutex_unlock(&pool->queue_mutex);
+
+    for (int i = 0; i < pool->num_threads; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    for (int p = 0; p < MAX_PRIORITY; ++p)
+        free(pool->queues[p].slots);
+    free(pool->edf.entries);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->edf.mutex);
+    pthread_mutex_destroy(&pool->queue_mutex);
+    pthread_cond_destroy(&pool->queue_not_empty);
+    pthread_cond_destroy(&pool->queue_not_full);
+}
+
+/* ---- Benchmark: latencia de tareas prioritarias con carga de baja prioridad saturada ---- */
+
+#define BENCH_QUEUE 1024
+#define BENCH_PROBES 2000
+#define BENCH_PROBE_GAP_US 1000
+#define BENCH_SPIN_US 50        // duración de cada tarea de carga
+
+typedef struct {
+    uint64_t submit_ns;
+    uint64_t latency_ns;
+} probe_t;
+
+typedef struct {
+    thread_pool_t *pool;
+    int priority;
+    atomic_int stop;
+} flood_t;
+
+static void spin_task(void *arg) {
+    uint64_t end = monotonic_ns() + BENCH_SPIN_US * 1000ULL;
+
+    (void)arg;
+    while (monotonic_ns() < end)
+        ;
+}
+
+static void probe_task(void *arg) {
+    probe_t *probe = (probe_t *)arg;
+
+    probe->latency_ns = monotonic_ns() - probe->submit_ns;
+}
+
+static void *flood_thread(void *arg) {
+    // Mantiene llena la cola de su prioridad (submit bloquea cuando no hay hueco).
+    flood_t *f = (flood_t *)arg;
+
+    while (!atomic_load(&f->stop))
+        thread_pool_submit(f->pool, spin_task, NULL, f->priority);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(const char *label, uint64_t *samples, int n) {
+    qsort(samples, n, sizeof(uint64_t), cmp_u64);
+    printf("%-34s %9.1f %9.1f %9.1f %9.1f %9.1f\n", label, samples[n / 2] / 1e3, samples[n * 90 / 100] / 1e3,
+           samples[n * 99 / 100] / 1e3, samples[n * 999 / 1000] / 1e3, samples[n - 1] / 1e3);
+}
+
+static void bench_run(const char *label, int flood_priority, int probe_priority, int probes, int gap_us) {
+    /*
+    Satura el pool con tareas de 'flood_priority' desde otro hilo y envía
+    'probes' tareas sonda de 'probe_priority' cada 'gap_us' microsegundos.
+    Cada sonda mide cuánto esperó en cola hasta empezar a ejecutarse.
+    */
+    thread_pool_t pool;
+    probe_t *samples = calloc(probes, sizeof(probe_t));
+    uint64_t *latencies = malloc(sizeof(uint64_t) * probes);
+    struct timespec gap = {0, gap_us * 1000L};
+    pthread_t flooder;
+    flood_t flood;
+
+    if (!samples || !latencies) {
+        free(samples);
+        free(latencies);
+        return;
+    }
+    thread_pool_init(&pool, NUM_THREADS, BENCH_QUEUE);
+    flood.pool = &pool;
+    flood.priority = flood_priority;
+    atomic_init(&flood.stop, 0);
+    pthread_create(&flooder, NULL, flood_thread, &flood);
+    nanosleep(&gap, NULL);
+    for (int i = 0; i < probes; ++i) {
+        samples[i].submit_ns = monotonic_ns();
+        thread_pool_submit(&pool, probe_task, &samples[i], probe_priority);
+        nanosleep(&gap, NULL);
+    }
+    atomic_store(&flood.stop, 1);
+    pthread_join(flooder, NULL);
+    thread_pool_destroy(&pool);
+    for (int i = 0; i < probes; ++i)
+        latencies[i] = samples[i].latency_ns;
+    print_percentiles(label, latencies, probes);
+    free(samples);
+    free(latencies);
+}
+
+static int priority_benchmark(void) {
+    printf("Trabajadores: %d, tareas de carga de %d us, CPUs en línea: %ld\n", NUM_THREADS, BENCH_SPIN_US,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("Latencia de cola de las sondas (us)\n");
+    printf("%-34s %9s %9s %9s %9s %9s\n", "escenario", "p50", "p90", "p99", "p99.9", "máx");
+    bench_run("FIFO: sondas en el nivel de carga", MAX_PRIORITY - 1, MAX_PRIORITY - 1, BENCH_PROBES,
+              BENCH_PROBE_GAP_US);
+    bench_run("prioridad 0 sobre carga nivel 2", MAX_PRIORITY - 1, 0, BENCH_PROBES, BENCH_PROBE_GAP_US);
+    printf("\nInanición: carga saturada en el nivel 0, sondas en el nivel %d\n", MAX_PRIORITY - 1);
+    printf("(umbral de envejecimiento del nivel %d: %d ms)\n", MAX_PRIORITY - 1,
+           (MAX_PRIORITY - 1) * AGING_BASE_MS);
+    bench_run("nivel 2 bajo carga de nivel 0", 0, MAX_PRIORITY - 1, BENCH_PROBES / 10, BENCH_PROBE_GAP_US * 5);
+    return 0;
+}
+
+/* ---- Benchmark EDF: retransmisiones con plazo corto frente a trabajo nuevo con plazo largo ---- */
+
+#define EDF_RETX_DEADLINE_MS 10  // ~Timer A/E: la retransmisión debe salir pronto
+#define EDF_FRESH_DEADLINE_MS 500
+#define EDF_RETX 1000
+
+typedef struct {
+    uint64_t deadline_ns;
+    atomic_long *missed;
+    int owned; // lo libera la propia tarea
+} dl_job_t;
+
+typedef struct {
+    thread_pool_t *pool;
+    atomic_long missed;
+    atomic_int stop;
+} edf_flood_t;
+
+static void dl_job_finish(dl_job_t *job) {
+    if (monotonic_ns() > job->deadline_ns)
+        atomic_fetch_add_explicit(job->missed, 1, memory_order_relaxed);
+    if (job->owned)
+        slab_free(job);
+}
+
+static void fresh_task(void *arg) {
+    spin_task(NULL);
+    dl_job_finish((dl_job_t *)arg);
+}
+
+static void retx_task(void *arg) {
+    dl_job_finish((dl_job_t *)arg);
+}
+
+static void submit_job(thread_pool_t *pool, void (*function)(void *), dl_job_t *job, int priority) {
+    // En modo prioridad todo va al mismo nivel (FIFO); en EDF, por plazo.
+    if (pool->mode == SCHED_EDF)
+        thread_pool_submit_deadline(pool, function, job, job->deadline_ns);
+    else
+        thread_pool_submit(pool, function, job, priority);
+}
+
+static void *edf_flood_thread(void *arg) {
+    edf_flood_t *f = (edf_flood_t *)arg;
+
+    while (!atomic_load(&f->stop)) {
+        dl_job_t *job = slab_alloc(sizeof(dl_job_t)); // lo libera el trabajador al terminar
+        if (!job)
+            break;
+        job->deadline_ns = monotonic_ns() + EDF_FRESH_DEADLINE_MS * 1000000ULL;
+        job->missed = &f->missed;
+        job->owned = 1;
+        submit_job(f->pool, fresh_task, job, MAX_PRIORITY - 1);
+    }
+    return NULL;
+}
+
+static void edf_run(const char *label, sched_mode_t mode) {
+    /*
+    Satura el pool con trabajo nuevo (plazo EDF_FRESH_DEADLINE_MS) y envía
+    una retransmisión por milisegundo con plazo EDF_RETX_DEADLINE_MS.
+    Cuenta cuántas de cada clase terminan después de su plazo.
+    */
+    thread_pool_t pool;
+    dl_job_t *retx = calloc(EDF_RETX, sizeof(dl_job_t));
+    atomic_long retx_missed;
+    struct timespec gap = {0, BENCH_PROBE_GAP_US * 1000L};
+    deadline_stats_t stats;
+    pthread_t flooder;
+    edf_flood_t flood;
+
+    if (!retx)
+        return;
+    atomic_init(&retx_missed, 0);
+    thread_pool_init_sched(&pool, NUM_THREADS, BENCH_QUEUE, mode);
+    flood.pool = &pool;
+    atomic_init(&flood.missed, 0);
+    atomic_init(&flood.stop, 0);
+    pthread_create(&flooder, NULL, edf_flood_thread, &flood);
+    nanosleep(&gap, NULL);
+    for (int i = 0; i < EDF_RETX; ++i) {
+        retx[i].deadline_ns = monotonic_ns() + EDF_RETX_DEADLINE_MS * 1000000ULL;
+        retx[i].missed = &retx_missed;
+        submit_job(&pool, retx_task, &retx[i], MAX_PRIORITY - 1);
+        nanosleep(&gap, NULL);
+    }
+    atomic_store(&flood.stop, 1);
+    pthread_join(flooder, NULL);
+    thread_pool_destroy(&pool);
+    printf("%-10s retransmisiones fuera de plazo: %4ld/%d   trabajo nuevo fuera de plazo: %ld\n", label,
+           atomic_load(&retx_missed), EDF_RETX, atomic_load(&flood.missed));
+    if (mode == SCHED_EDF) {
+        thread_pool_get_deadline_stats(&pool, &stats);
+        printf("%-10s métricas del pool: %ld con plazo, %ld empezaron tarde, %ld terminaron tarde, "
+               "retraso máx %.1f ms\n",
+               "", stats.completed, stats.late_start, stats.missed, stats.max_lateness_ns / 1e6);
+    }
+    free(retx);
+}
+
+static int edf_benchmark(void) {
+    printf("Trabajadores: %d, trabajo nuevo de %d us con plazo %d ms, retransmisiones con plazo %d ms\n",
+           NUM_THREADS, BENCH_SPIN_US, EDF_FRESH_DEADLINE_MS, EDF_RETX_DEADLINE_MS);
+    edf_run("FIFO", SCHED_PRIORITY);
+    edf_run("EDF", SCHED_EDF);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+        return priority_benchmark();
+    if (argc > 1 && strcmp(argv[1], "edf") == 0)
+        return edf_benchmark();
+
+    thread_pool_t pool;
+    thread_pool_init(&pool, NUM_THREADS, MAX_TASKS);
+    srand(time(NULL));
+
+    printf("Enviando tareas con diferentes prioridades...\n");
+    for (int i = 1; i <= 10; ++i) {
+        int *arg_low = slab_alloc(sizeof(int) * 2); // los libera el trabajador (slab.h)
+        arg_low[0] = i;
+        arg_low[1] = 2; // Prioridad baja
+        thread_pool_submit(&pool, execute_task, arg_low, 2);
+
+        int *arg_high = slab_alloc(sizeof(int) * 2);
+        arg_high[0] = i + 100;
+        arg_high[1] = 0; // Prioridad alta
+        thread_pool_submit(&pool, execute_task, arg_high, 0);
+
+        int *arg_medium = slab_alloc(sizeof(int) * 2);
+        arg_medium[0] = i + 200;
+        arg_medium[1] = 1; // Prioridad media
+        thread_pool_submit(&pool, execute_task, arg_medium, 1);
+    }
+
+    sleep(15);
+
+    thread_pool_destroy(&pool);
+    printf("Programa principal terminado.\n");
+    return 0;
+}
+
+/*
+Compila: gcc -O2 pthreads9.c -o thread_pool_priority -lpthread
+Ejecuta: ./thread_pool_priority
+Benchmark: ./thread_pool_priority bench
+Benchmark EDF: ./thread_pool_priority edf
+Explicación:
+    -Priorización de Tareas:
+        Este thread pool avanzado introduce la priorización de tareas.
+        Se definen MAX_PRIORITY niveles de prioridad (en este caso, 3: alta, media, baja).
+
+    -Múltiples Colas sin Locks:
+        Internamente, el thread pool gestiona una cola acotada sin locks
+        (anillo de Vyukov) para cada nivel de prioridad, así que encolar y
+        desencolar no pasa por un mutex común.
+
+    -thread_pool_submit con Prioridad:
+        La función thread_pool_submit ahora toma un argumento adicional de priority
+        para indicar la prioridad de la tarea.
+        La tarea se encola en la cola correspondiente a su prioridad y se marca
+        su nivel en un bitmap de niveles con tareas.
+
+    -worker con Prioridad:
+        Los hilos trabajadores eligen el nivel más prioritario con tareas en O(1)
+        (el bit más bajo del bitmap), así que una tarea de control de turno MCPTT
+        no espera detrás del tráfico MESSAGE masivo.
+
+    -Envejecimiento:
+        Para que las prioridades bajas no se queden sin servicio, cada 16 tareas
+        un trabajador mira la cabeza de los niveles inferiores: si alguna tarea
+        de prioridad p lleva esperando más de p * AGING_BASE_MS, se sirve antes.
+
+    -Modo EDF (earliest deadline first):
+        Con thread_pool_init_sched(..., SCHED_EDF) las tareas se guardan en un
+        montículo mínimo por plazo absoluto y se ejecuta primero la que vence antes.
+        thread_pool_submit_deadline recibe el plazo (p. ej. el vencimiento del
+        Timer A/E de una transacción SIP), y thread_pool_submit asigna un plazo
+        implícito según la prioridad. Así una retransmisión a punto de vencer
+        pasa delante de trabajo nuevo de poco valor. thread_pool_get_deadline_stats
+        cuenta las tareas que empezaron o terminaron fuera de plazo y el retraso máximo.
+
+    -Dormir y Despertar:
+        El mutex y las condiciones solo se usan para dormir: los trabajadores
+        cuando no hay tareas y los productores cuando su cola está llena.
+        Cada lado solo toma el mutex para despertar si hay alguien dormido.
+
+    -Argumentos sin malloc:
+        Los argumentos de las tareas (y los trabajos con plazo del modo edf) se
+        reservan con el asignador slab por hilo de slab.h y los libera el
+        trabajador que ejecuta la tarea; vuelven a la caché del productor sin
+        pasar por malloc.
+
+Al ejecutar este código, deberías observar que las tareas con prioridad 0 (alta)
+tienden a ejecutarse antes que las tareas con prioridad 1 (media) y 2 (baja).
+El modo bench mide los percentiles de latencia de cola de tareas sonda con
+la carga de baja prioridad saturada (FIFO frente a prioridad alta) y la de
+tareas de prioridad baja con el nivel 0 saturado (envejecimiento). El modo edf
+compara cuántas retransmisiones con plazo corto se pierden en FIFO y en EDF.
+ */
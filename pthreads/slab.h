@@ -0,0 +1,271 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Asignador slab por hilo para objetos pequeños de tamaño fijo: argumentos de
+tareas, contextos de conexión, descriptores de mensaje. Sustituye a
+malloc/free en los caminos calientes de los pools (Bloques 6 y 9) y del
+servidor (Bloque 10).
+
+- Cada hilo tiene su caché con una lista libre por clase de tamaño: reservar
+    y liberar en el mismo hilo es sacar o meter en una lista, sin locks ni
+    atómicas.
+- Un slab es un bloque de SLAB_SIZE bytes alineado a su tamaño, con una
+    cabecera (caché dueña y clase) y objetos de una sola clase detrás. El slab
+    de un objeto se obtiene enmascarando su dirección, así que slab_free no
+    necesita el tamaño.
+- Liberación entre hilos: el patrón típico de un pool es que el productor
+    reserva el argumento y el trabajador lo libera. El objeto vuelve a la
+    caché dueña por una pila atómica (solo inserciones); el dueño la vacía
+    entera con un exchange cuando se le acaba su lista libre, así que no
+    hay ABA ni contención con el dueño.
+- Los slabs no se devuelven al sistema: son cachés de objetos de vida corta
+    que se reutilizan. Las cachés de hilos terminados quedan huérfanas y las
+    adopta el siguiente hilo nuevo (los objetos que aún circulan siguen
+    teniendo a dónde volver).
+- Objetos mayores que SLAB_MAX_OBJECT van a un bloque propio (malloc alineado).
+*/
+
+#define SLAB_SIZE (64 * 1024)
+#define SLAB_HEADER 64            // cabecera al principio de cada slab (una línea de caché)
+#define SLAB_CLASSES 16
+#define SLAB_MAX_OBJECT 4096
+#define SLAB_LARGE (-1)
+
+typedef struct slab_object {
+    struct slab_object *next;
+} slab_object_t;
+
+typedef struct slab_cache slab_cache_t;
+
+typedef struct {
+    slab_cache_t *owner;
+    int size_class;               // SLAB_LARGE: bloque con un único objeto grande
+} slab_header_t;
+
+/*
+Contadores de cada caché: solo los escribe su hilo (carga y almacenamiento
+relajados, sin instrucciones con lock); slab_get_stats los suma.
+*/
+struct slab_cache {
+    slab_object_t *free_list[SLAB_CLASSES];
+    char *bump[SLAB_CLASSES];     // parte sin estrenar del último slab de cada clase
+    char *bump_end[SLAB_CLASSES];
+    slab_cache_t *next;           // todas las cachés, para las estadísticas
+    slab_cache_t *next_orphan;
+    atomic_long allocs;
+    atomic_long frees;
+    atomic_long remote_frees;     // objetos de otras cachés devueltos desde este hilo
+    atomic_long slabs;            // bloques pedidos al sistema
+    atomic_long large;
+    _Alignas(64) _Atomic(slab_object_t *) remote[SLAB_CLASSES]; // devueltos por otros hilos
+};
+
+typedef struct {
+    long allocs;
+    long frees;
+    long remote_frees;
+    long slabs;
+    long large;
+    int caches;
+} slab_stats_t;
+
+static const size_t slab_class_size[SLAB_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+};
+
+static _Thread_local slab_cache_t *slab_tls;
+static pthread_key_t slab_key;
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static slab_cache_t *slab_caches;
+static slab_cache_t *slab_orphans;
+
+static inline void slab_count(atomic_long *counter) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static inline int slab_class(size_t size) {
+    // Clases con paso de 1.5x: como mucho un tercio del objeto se desperdicia
+    for (int c = 0; c < SLAB_CLASSES; ++c)
+        if (size <= slab_class_size[c])
+            return c;
+    return SLAB_LARGE;
+}
+
+static inline void slab_thread_exit(void *arg) {
+    /*
+    La caché no se libera: otros hilos pueden seguir devolviéndole objetos.
+    slab_tls se borra antes de dejarla huérfana: desde ese momento otro hilo
+    puede adoptarla, y un destructor TLS posterior de este hilo que reserve
+    o libere tiene que pasar por slab_cache_attach (que vuelve a registrar
+    la clave) en vez de tocar una caché ajena.
+    */
+    slab_cache_t *cache = (slab_cache_t *)arg;
+
+    slab_tls = NULL;
+    pthread_mutex_lock(&slab_mutex);
+    cache->next_orphan = slab_orphans;
+    slab_orphans = cache;
+    pthread_mutex_unlock(&slab_mutex);
+}
+
+static inline void slab_init_key(void) {
+    pthread_key_create(&slab_key, slab_thread_exit);
+}
+
+static inline slab_cache_t *slab_cache_attach(void) {
+    /*
+    Primera reserva (o liberación) de un hilo: adopta una caché huérfana si
+    la hay, o crea una nueva. El destructor de la clave la deja huérfana
+    cuando el hilo termina.
+    */
+    slab_cache_t *cache;
+
+    pthread_once(&slab_once, slab_init_key);
+    pthread_mutex_lock(&slab_mutex);
+    cache = slab_orphans;
+    if (cache)
+        slab_orphans = cache->next_orphan;
+    pthread_mutex_unlock(&slab_mutex);
+    if (!cache) {
+        cache = aligned_alloc(64, sizeof(slab_cache_t));
+        if (!cache)
+            return NULL;
+        memset(cache, 0, sizeof(slab_cache_t));
+        for (int c = 0; c < SLAB_CLASSES; ++c)
+            atomic_init(&cache->remote[c], NULL);
+        pthread_mutex_lock(&slab_mutex);
+        cache->next = slab_caches;
+        slab_caches = cache;
+        pthread_mutex_unlock(&slab_mutex);
+    }
+    pthread_setspecific(slab_key, cache);
+    slab_tls = cache;
+    return cache;
+}
+
+static inline slab_cache_t *slab_cache_get(void) {
+    return slab_tls ? slab_tls : slab_cache_attach();
+}
+
+static inline void *slab_alloc_large(slab_cache_t *cache, size_t size) {
+    void *block;
+    slab_header_t *header;
+
+    if (posix_memalign(&block, SLAB_SIZE, SLAB_HEADER + size) != 0)
+        return NULL;
+    header = (slab_header_t *)block;
+    header->owner = NULL;
+    header->size_class = SLAB_LARGE;
+    if (cache)
+        slab_count(&cache->large);
+    return (char *)block + SLAB_HEADER;
+}
+
+static inline slab_object_t *slab_refill(slab_cache_t *cache, int c) {
+    /*
+    La lista libre de la clase está vacía:
+    - primero recoge de una vez todos los objetos que otros hilos han devuelto;
+    - si no hay, corta el siguiente objeto del último slab de la clase;
+    - si el slab está agotado, pide uno nuevo al sistema.
+    */
+    slab_object_t *obj = atomic_exchange_explicit(&cache->remote[c], NULL, memory_order_acquire);
+    size_t size = slab_class_size[c];
+
+    if (obj) {
+        cache->free_list[c] = obj->next;
+        return obj;
+    }
+    if (!cache->bump[c] || cache->bump[c] + size > cache->bump_end[c]) {
+        char *block = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+        slab_header_t *header = (slab_header_t *)block;
+        if (!block)
+            return NULL;
+        header->owner = cache;
+        header->size_class = c;
+        cache->bump[c] = block + SLAB_HEADER;
+        cache->bump_end[c] = block + SLAB_SIZE;
+        slab_count(&cache->slabs);
+    }
+    obj = (slab_object_t *)cache->bump[c];
+    cache->bump[c] += size;
+    return obj;
+}
+
+static inline void *slab_alloc(size_t size) {
+    /*
+    Reserva un objeto de 'size' bytes (alineado a 16) de la caché del hilo.
+    Retorna NULL si no hay memoria. Se libera con slab_free desde cualquier hilo.
+    */
+    slab_cache_t *cache = slab_cache_get();
+    int c = slab_class(size);
+    slab_object_t *obj;
+
+    if (c == SLAB_LARGE || !cache)
+        return slab_alloc_large(cache, size);
+    obj = cache->free_list[c];
+    if (obj)
+        cache->free_list[c] = obj->next;
+    else if (!(obj = slab_refill(cache, c)))
+        return NULL;
+    slab_count(&cache->allocs);
+    return obj;
+}
+
+static inline void slab_free(void *ptr) {
+    /*
+    Devuelve un objeto de slab_alloc.
+    - Si lo reservó este hilo, vuelve a su lista libre.
+    - Si no, se apila en la lista de devueltos de la caché dueña con un CAS;
+        la dueña la recoge entera en su siguiente slab_refill.
+    */
+    slab_header_t *header;
+    slab_cache_t *cache;
+    slab_object_t *obj = (slab_object_t *)ptr;
+    slab_object_t *head;
+
+    if (!ptr)
+        return;
+    header = (slab_header_t *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+    if (header->size_class == SLAB_LARGE) {
+        free(header);
+        return;
+    }
+    cache = slab_cache_get();
+    if (header->owner == cache) {
+        obj->next = cache->free_list[header->size_class];
+        cache->free_list[header->size_class] = obj;
+        slab_count(&cache->frees);
+        return;
+    }
+    head = atomic_load_explicit(&header->owner->remote[header->size_class], memory_order_relaxed);
+    do {
+        obj->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&header->owner->remote[header->size_class], &head, obj,
+                                                    memory_order_release, memory_order_relaxed));
+    if (cache)
+        slab_count(&cache->remote_frees);
+}
+
+static inline void slab_get_stats(slab_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&slab_mutex);
+    for (slab_cache_t *cache = slab_caches; cache; cache = cache->next) {
+        stats->allocs += atomic_load_explicit(&cache->allocs, memory_order_relaxed);
+        stats->frees += atomic_load_explicit(&cache->frees, memory_order_relaxed);
+        stats->remote_frees += atomic_load_explicit(&cache->remote_frees, memory_order_relaxed);
+        stats->slabs += atomic_load_explicit(&cache->slabs, memory_order_relaxed);
+        stats->large += atomic_load_explicit(&cache->large, memory_order_relaxed);
+        stats->caches++;
+    }
+    pthread_mutex_unlock(&slab_mutex);
+}
+
+#endif